@@ -0,0 +1,307 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+/* gpio_request_array takes an array of the internal struct gpio */
+#include <ugpio-internal.h>
+
+/* the number of lines in the fake tree */
+#define BENCH_LINES	32
+/* the number of lines requested by one gpio_request_array call */
+#define BENCH_ARRAY	16
+
+static char root[] = "/tmp/ugpio-bench.XXXXXX";
+static unsigned long iterations = 100000;
+static int json;
+static int results;
+
+static ugpio_t *ctx;
+static struct gpio array[BENCH_ARRAY];
+
+void print_usage(void)
+{
+	printf("ugpio-bench [-n iterations] [-j]\n"
+	       "  -n  number of iterations of the fast operations (default 100000)\n"
+	       "  -j  print JSON instead of CSV\n");
+	exit(EXIT_SUCCESS);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int write_file(int dfd, const char *name, const char *content)
+{
+	int fd, rv = 0;
+
+	if ((fd = openat(dfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+		return -1;
+
+	if (write(fd, content, strlen(content)) != strlen(content))
+		rv = -1;
+
+	close(fd);
+	return rv;
+}
+
+/* build a tree of plain files looking like /sys/class/gpio with all lines exported */
+static int make_tree(void)
+{
+	char name[32];
+	int rfd, dfd, i, rv = -1;
+
+	if (mkdtemp(root) == NULL)
+		return -1;
+
+	if ((rfd = open(root, O_RDONLY | O_DIRECTORY)) == -1)
+		return -1;
+
+	if (write_file(rfd, "export", "") || write_file(rfd, "unexport", ""))
+		goto out;
+
+	for (i = 0; i < BENCH_LINES; i++) {
+		snprintf(name, sizeof(name), "gpio%d", i);
+		if (mkdirat(rfd, name, 0755) == -1)
+			goto out;
+		if ((dfd = openat(rfd, name, O_RDONLY | O_DIRECTORY)) == -1)
+			goto out;
+		if (write_file(dfd, "value", "0\n") ||
+		    write_file(dfd, "direction", "out\n") ||
+		    write_file(dfd, "active_low", "0\n") ||
+		    write_file(dfd, "edge", "none\n")) {
+			close(dfd);
+			goto out;
+		}
+		close(dfd);
+	}
+
+	rv = 0;
+
+out:
+	close(rfd);
+	return rv;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static void remove_tree(void)
+{
+	nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static int bench_ugpio_get_value(unsigned long i)
+{
+	return ugpio_get_value(ctx);
+}
+
+static int bench_ugpio_set_value(unsigned long i)
+{
+	return ugpio_set_value(ctx, i & 1);
+}
+
+static int bench_gpio_is_requested(unsigned long i)
+{
+	return gpio_is_requested(1);
+}
+
+static int bench_gpio_get_value(unsigned long i)
+{
+	return gpio_get_value(1);
+}
+
+static int bench_gpio_set_value(unsigned long i)
+{
+	return gpio_set_value(1, i & 1);
+}
+
+static int bench_gpio_get_direction(unsigned long i)
+{
+	return gpio_get_direction(1);
+}
+
+static int bench_gpio_direction_output(unsigned long i)
+{
+	return gpio_direction_output(1, i & 1);
+}
+
+static int bench_gpio_get_activelow(unsigned long i)
+{
+	return gpio_get_activelow(1);
+}
+
+static int bench_gpio_get_edge(unsigned long i)
+{
+	return gpio_get_edge(1);
+}
+
+static int bench_gpio_set_edge(unsigned long i)
+{
+	return gpio_set_edge(1, (i & 1) ? GPIOF_TRIG_RISE : 0);
+}
+
+static int bench_ugpio_request_free(unsigned long i)
+{
+	ugpio_t *c;
+
+	if ((c = ugpio_request(2, NULL)) == NULL)
+		return -1;
+
+	ugpio_free(c);
+	return 0;
+}
+
+static int bench_gpio_request_array(unsigned long i)
+{
+	return gpio_request_array(array, BENCH_ARRAY);
+}
+
+static int bench_ugpio_snapshot(unsigned long i)
+{
+	struct ugpio_line_state *states;
+	ssize_t n;
+
+	if ((n = ugpio_snapshot(&states)) == -1)
+		return -1;
+
+	free(states);
+	return (n == BENCH_LINES) ? 0 : -1;
+}
+
+static void report(const char *name, unsigned long n, uint64_t ns, unsigned long errors)
+{
+	double per_op = (double)ns / n;
+
+	if (json)
+		printf("%s\n  {\"name\": \"%s\", \"iterations\": %lu, \"errors\": %lu, "
+		       "\"total_ns\": %llu, \"ns_per_op\": %.1f, \"ops_per_s\": %.0f}",
+		       results ? "," : "", name, n, errors, (unsigned long long)ns,
+		       per_op, 1e9 / per_op);
+	else
+		printf("%s,%lu,%lu,%llu,%.1f,%.0f\n", name, n, errors, (unsigned long long)ns,
+		       per_op, 1e9 / per_op);
+
+	results++;
+}
+
+static void run(const char *name, int (*fn)(unsigned long), unsigned long n)
+{
+	unsigned long i, errors = 0;
+	uint64_t start;
+
+	/* warm up caches and lazily opened file descriptors */
+	for (i = 0; i < n / 100 + 1; i++)
+		fn(i);
+
+	start = now_ns();
+	for (i = 0; i < n; i++)
+		if (fn(i) < 0)
+			errors++;
+
+	report(name, n, now_ns() - start, errors);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, i, rv = EXIT_FAILURE;
+
+	while ((opt = getopt(argc, argv, "n:jh")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			json = 1;
+			break;
+		default:
+			print_usage();
+		}
+	}
+
+	if (iterations == 0)
+		print_usage();
+
+	if (make_tree() == -1) {
+		perror("make_tree");
+		return EXIT_FAILURE;
+	}
+
+	if (ugpio_set_sysfs_root(root) == -1) {
+		perror("ugpio_set_sysfs_root");
+		goto out;
+	}
+
+	if ((ctx = ugpio_request_one(0, GPIOF_OUT_INIT_LOW, NULL)) == NULL) {
+		perror("ugpio_request_one");
+		goto out;
+	}
+
+	if (ugpio_open(ctx) == -1) {
+		perror("ugpio_open");
+		goto out;
+	}
+
+	for (i = 0; i < BENCH_ARRAY; i++) {
+		array[i].gpio = BENCH_LINES - BENCH_ARRAY + i;
+		array[i].flags = GPIOF_OUT_INIT_LOW;
+	}
+
+	if (json)
+		printf("{\"library\": \"%s\", \"backend\": \"%s\", \"results\": [",
+		       LIBUGPIO_VERSION_STRING, ugpio_get_backend());
+	else
+		printf("name,iterations,errors,total_ns,ns_per_op,ops_per_s\n");
+
+	run("ugpio_get_value", bench_ugpio_get_value, iterations);
+	run("ugpio_set_value", bench_ugpio_set_value, iterations);
+	run("gpio_is_requested", bench_gpio_is_requested, iterations);
+	run("gpio_get_value", bench_gpio_get_value, iterations);
+	run("gpio_set_value", bench_gpio_set_value, iterations);
+	run("gpio_get_direction", bench_gpio_get_direction, iterations);
+	run("gpio_direction_output", bench_gpio_direction_output, iterations);
+	run("gpio_get_activelow", bench_gpio_get_activelow, iterations);
+	run("gpio_get_edge", bench_gpio_get_edge, iterations);
+	run("gpio_set_edge", bench_gpio_set_edge, iterations);
+	run("ugpio_request+ugpio_free", bench_ugpio_request_free, iterations / 10 + 1);
+	run("gpio_request_array", bench_gpio_request_array, iterations / 100 + 1);
+	run("ugpio_snapshot", bench_ugpio_snapshot, iterations / 100 + 1);
+
+	/* the same low level calls without the file descriptor cache */
+	gpio_set_fd_cache_size(0);
+	run("gpio_get_value(nocache)", bench_gpio_get_value, iterations);
+	run("gpio_set_value(nocache)", bench_gpio_set_value, iterations);
+
+	if (json)
+		printf("\n]}\n");
+
+	rv = EXIT_SUCCESS;
+
+out:
+	ugpio_close(ctx);
+	ugpio_free(ctx);
+	remove_tree();
+	return rv;
+}
@@ -0,0 +1,721 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpiod-proto.h>
+
+#define DEFAULT_LINES	1024
+#define MAX_EVENTS	32
+
+struct client;
+
+/* edges of a line signalled to an eventfd of a client */
+struct subscription {
+	struct client *client;
+	int id;
+	int evfd;
+	unsigned int gpio;
+	/* next subscription of the same line */
+	struct subscription *next;
+};
+
+struct client {
+	int fd;
+	/* whether the client holds a line, indexed by GPIO number */
+	unsigned char *held;
+	struct client *prev;
+	struct client *next;
+};
+
+struct line {
+	/* the library context, NULL while no client holds the line */
+	ugpio_t *ctx;
+	unsigned int holders;
+	/* the edge setting as seen by the clients */
+	unsigned int edge;
+	/* whether the line is registered with the loop for both edges */
+	int watched;
+	struct subscription *subs;
+};
+
+static const char *socket_path = UGPIOD_SOCKET;
+static unsigned int nlines = DEFAULT_LINES;
+static int shm_fd = -1;
+/* the read-only view of the shared memory handed to the clients */
+static int shm_client_fd = -1;
+static struct ugpiod_shm *shm;
+static size_t shm_size;
+static struct line *lines;
+static struct client *clients;
+static ugpio_loop_t *loop;
+static int epfd;
+
+void print_usage(void)
+{
+	printf("ugpiod [-s socket] [-n lines] [-b backend] [-r sysfs-root]\n"
+	       "  -s  path of the socket (default " UGPIOD_SOCKET ")\n"
+	       "  -n  number of GPIOs served, 0 to n-1 (default %d)\n"
+	       "  -b  backend used to access the GPIOs (default sysfs)\n"
+	       "  -r  sysfs root directory of the sysfs backend\n", DEFAULT_LINES);
+	exit(EXIT_SUCCESS);
+}
+
+static void shm_store(unsigned int gpio, int live, int value)
+{
+	uint32_t word = 0;
+
+	if (live && value >= 0)
+		word = UGPIOD_LINE_LIVE | (value ? UGPIOD_LINE_VALUE : 0);
+
+	atomic_store_explicit(&shm->lines[gpio], word, memory_order_release);
+}
+
+static void line_edge(ugpio_loop_t *l, ugpio_t *ctx, int value, void *userdata)
+{
+	struct line *line = userdata;
+	unsigned int gpio = line - lines;
+	struct subscription *sub;
+	uint64_t one = 1;
+
+	if (value == -1)
+		return;
+
+	shm_store(gpio, 1, value);
+
+	/* the hardware reports both edges, the clients only want theirs */
+	if (!(line->edge & (value ? GPIOF_TRIG_RISE : GPIOF_TRIG_FALL)))
+		return;
+
+	for (sub = line->subs; sub; sub = sub->next)
+		(void)!write(sub->evfd, &one, sizeof(one));
+}
+
+/* watch inputs with edge support and publish the value where it is known */
+static void line_refresh(struct line *line)
+{
+	unsigned int gpio = line - lines;
+	int dir, edges;
+
+	dir = ugpio_get_direction(line->ctx);
+	edges = ugpio_alterable_edge(line->ctx) > 0;
+
+	if (dir == GPIOF_DIR_IN && edges) {
+		if (!line->watched &&
+		    ugpio_set_edge(line->ctx, GPIOF_TRIG_RISE | GPIOF_TRIG_FALL) == 0 &&
+		    ugpio_loop_add(loop, line->ctx, line_edge, line) == 0)
+			line->watched = 1;
+	} else if (line->watched) {
+		ugpio_loop_remove(loop, line->ctx);
+		line->watched = 0;
+	}
+
+	if (dir == GPIOF_DIR_OUT || line->watched)
+		shm_store(gpio, 1, ugpio_get_value(line->ctx));
+	else
+		shm_store(gpio, 0, 0);
+}
+
+static int line_open(struct line *line)
+{
+	unsigned int gpio = line - lines;
+	int edge;
+
+	if ((line->ctx = ugpio_request(gpio, "ugpiod")) == NULL)
+		return -1;
+
+	if (ugpio_full_open(line->ctx) == -1) {
+		ugpio_close(line->ctx);
+		ugpio_free(line->ctx);
+		line->ctx = NULL;
+		return -1;
+	}
+
+	edge = ugpio_alterable_edge(line->ctx) > 0 ? ugpio_get_edge(line->ctx) : 0;
+	line->edge = (edge > 0) ? edge : 0;
+	line_refresh(line);
+
+	return 0;
+}
+
+static void line_close(struct line *line)
+{
+	unsigned int gpio = line - lines;
+
+	shm_store(gpio, 0, 0);
+
+	if (line->watched) {
+		ugpio_loop_remove(loop, line->ctx);
+		/* leave the edge as the clients configured it */
+		ugpio_set_edge(line->ctx, line->edge);
+		line->watched = 0;
+	}
+
+	ugpio_close(line->ctx);
+	ugpio_free(line->ctx);
+	line->ctx = NULL;
+}
+
+static void unsubscribe(struct line *line, struct client *client, int id, int all)
+{
+	struct subscription **p = &line->subs, *sub;
+
+	while ((sub = *p) != NULL) {
+		if (sub->client == client && (all || sub->id == id)) {
+			*p = sub->next;
+			close(sub->evfd);
+			free(sub);
+		} else {
+			p = &sub->next;
+		}
+	}
+}
+
+static int op_acquire(struct client *client, unsigned int gpio)
+{
+	struct line *line = &lines[gpio];
+
+	if (client->held[gpio])
+		return -EBUSY;
+
+	if (line->holders == 0 && line_open(line) == -1)
+		return -errno;
+
+	line->holders++;
+	client->held[gpio] = 1;
+
+	return 0;
+}
+
+static int op_release(struct client *client, unsigned int gpio)
+{
+	struct line *line = &lines[gpio];
+
+	if (!client->held[gpio])
+		return -EINVAL;
+
+	unsubscribe(line, client, 0, 1);
+	client->held[gpio] = 0;
+
+	if (--line->holders == 0)
+		line_close(line);
+
+	return 0;
+}
+
+static int op_check(struct line *line, unsigned int attr)
+{
+	int rv;
+
+	switch (attr) {
+	case UGPIOD_ATTR_DIRECTION:
+		rv = ugpio_alterable_direction(line->ctx);
+		break;
+	case UGPIOD_ATTR_EDGE:
+		rv = ugpio_alterable_edge(line->ctx);
+		break;
+	case UGPIOD_ATTR_ACTIVELOW:
+	case UGPIOD_ATTR_VALUE:
+		return 1;
+	default:
+		return 0;
+	}
+
+	return (rv < 0) ? -errno : rv;
+}
+
+static int op_read(struct line *line, unsigned int attr)
+{
+	uint32_t word;
+	int rv;
+
+	switch (attr) {
+	case UGPIOD_ATTR_DIRECTION:
+		if ((rv = ugpio_get_direction(line->ctx)) >= 0)
+			rv = (rv == GPIOF_DIR_IN) ? UGPIOD_DIR_IN : UGPIOD_DIR_OUT_LOW;
+		break;
+	case UGPIOD_ATTR_ACTIVELOW:
+		rv = ugpio_get_activelow(line->ctx);
+		break;
+	case UGPIOD_ATTR_EDGE:
+		if (ugpio_alterable_edge(line->ctx) <= 0)
+			return -ENOENT;
+		return line->edge;
+	case UGPIOD_ATTR_VALUE:
+		word = atomic_load_explicit(&shm->lines[line - lines], memory_order_relaxed);
+		if (word & UGPIOD_LINE_LIVE)
+			return !!(word & UGPIOD_LINE_VALUE);
+		rv = ugpio_get_value(line->ctx);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return (rv < 0) ? -errno : rv;
+}
+
+static int op_write(struct line *line, unsigned int attr, int arg)
+{
+	int rv;
+
+	switch (attr) {
+	case UGPIOD_ATTR_DIRECTION:
+		if (arg == UGPIOD_DIR_IN) {
+			rv = ugpio_direction_input(line->ctx);
+		} else {
+			/* outputs have no edges */
+			if (line->watched) {
+				ugpio_loop_remove(loop, line->ctx);
+				ugpio_set_edge(line->ctx, 0);
+				line->watched = 0;
+			}
+			line->edge = 0;
+			rv = ugpio_direction_output(line->ctx, arg == UGPIOD_DIR_OUT_HIGH);
+		}
+		break;
+	case UGPIOD_ATTR_ACTIVELOW:
+		rv = ugpio_set_activelow(line->ctx, arg);
+		break;
+	case UGPIOD_ATTR_EDGE:
+		if (ugpio_alterable_edge(line->ctx) <= 0)
+			return -ENOENT;
+		if (arg && ugpio_get_direction(line->ctx) != GPIOF_DIR_IN)
+			return -EIO;
+		/* the line itself stays configured for both edges while watched */
+		rv = line->watched ? 0 : ugpio_set_edge(line->ctx, arg);
+		if (rv == 0)
+			line->edge = arg & (GPIOF_TRIG_RISE | GPIOF_TRIG_FALL);
+		break;
+	case UGPIOD_ATTR_VALUE:
+		if ((rv = ugpio_set_value(line->ctx, arg)) == 0)
+			shm_store(line - lines, 1, !!arg);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (rv < 0)
+		return -errno;
+
+	/* the value changes with the direction and the polarity */
+	if (attr == UGPIOD_ATTR_DIRECTION || attr == UGPIOD_ATTR_ACTIVELOW)
+		line_refresh(line);
+
+	return 0;
+}
+
+/*
+ * Edges are signalled with a write from the only thread of the daemon, so
+ * only an eventfd is accepted: a pipe or socket of a client could block it.
+ */
+static int is_eventfd(int fd)
+{
+	char path[32], target[32];
+	ssize_t len;
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	if ((len = readlink(path, target, sizeof(target) - 1)) == -1)
+		return 0;
+	target[len] = '\0';
+
+	return strcmp(target, "anon_inode:[eventfd]") == 0;
+}
+
+/* the caller closes the eventfd when the subscription fails */
+static int op_subscribe(struct client *client, const struct ugpiod_op *op, int evfd)
+{
+	struct subscription *sub;
+	struct line *line;
+
+	if (op->gpio >= nlines)
+		return -EINVAL;
+
+	/* the attributes of a line vanish with the release */
+	if (!client->held[op->gpio])
+		return -ENODEV;
+
+	if (!is_eventfd(evfd))
+		return -EINVAL;
+
+	if ((sub = malloc(sizeof(*sub))) == NULL)
+		return -errno;
+
+	line = &lines[op->gpio];
+	sub->client = client;
+	sub->id = op->arg;
+	sub->evfd = evfd;
+	sub->gpio = op->gpio;
+	sub->next = line->subs;
+	line->subs = sub;
+
+	return 0;
+}
+
+static int32_t handle_op(struct client *client, const struct ugpiod_op *op,
+			 const int *fds, unsigned int nfds, unsigned int *fdi)
+{
+	struct line *line;
+	int32_t rv;
+	int evfd;
+
+	/*
+	 * Take the eventfd of a subscription before anything else can fail,
+	 * so that the descriptors stay in step with the later subscriptions.
+	 */
+	if (op->op == UGPIOD_OP_SUBSCRIBE) {
+		if (*fdi >= nfds)
+			return -EBADF;
+		evfd = fds[(*fdi)++];
+		if ((rv = op_subscribe(client, op, evfd)) < 0)
+			close(evfd);
+		return rv;
+	}
+
+	if (op->op == UGPIOD_OP_HELLO)
+		return nlines;
+
+	if (op->gpio >= nlines)
+		return -EINVAL;
+
+	line = &lines[op->gpio];
+
+	switch (op->op) {
+	case UGPIOD_OP_ACQUIRE:
+		return op_acquire(client, op->gpio);
+	case UGPIOD_OP_RELEASE:
+		return op_release(client, op->gpio);
+	case UGPIOD_OP_CHECK:
+		return client->held[op->gpio] ? op_check(line, op->attr) : 0;
+	}
+
+	/* the attributes of a line vanish with the release */
+	if (!client->held[op->gpio])
+		return -ENODEV;
+
+	switch (op->op) {
+	case UGPIOD_OP_READ:
+		return op_read(line, op->attr);
+	case UGPIOD_OP_WRITE:
+		return op_write(line, op->attr, op->arg);
+	case UGPIOD_OP_UNSUBSCRIBE:
+		unsubscribe(line, client, op->arg, 0);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static void client_drop(struct client *client)
+{
+	unsigned int gpio;
+
+	for (gpio = 0; gpio < nlines; gpio++)
+		if (client->held[gpio])
+			op_release(client, gpio);
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+
+	if (client->prev)
+		client->prev->next = client->next;
+	else
+		clients = client->next;
+	if (client->next)
+		client->next->prev = client->prev;
+
+	free(client->held);
+	free(client);
+}
+
+static void client_handle(struct client *client)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * UGPIOD_MAX_OPS)];
+	} control;
+	struct ugpiod_op ops[UGPIOD_MAX_OPS];
+	int32_t results[UGPIOD_MAX_OPS];
+	int fds[UGPIOD_MAX_OPS];
+	unsigned int i, num, nfds = 0, fdi = 0, hello = 0;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t c;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = ops;
+	iov.iov_len = sizeof(ops);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	c = recvmsg(client->fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+	if (c == -1 && (errno == EAGAIN || errno == EINTR))
+		return;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+		}
+	}
+
+	if (c <= 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || c % sizeof(ops[0])) {
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		client_drop(client);
+		return;
+	}
+
+	num = c / sizeof(ops[0]);
+	for (i = 0; i < num; i++) {
+		results[i] = handle_op(client, &ops[i], fds, nfds, &fdi);
+		hello |= (ops[i].op == UGPIOD_OP_HELLO);
+	}
+
+	/* descriptors without a matching subscription */
+	for (i = fdi; i < nfds; i++)
+		close(fds[i]);
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = results;
+	iov.iov_len = num * sizeof(results[0]);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (hello) {
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int));
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &shm_client_fd, sizeof(int));
+	}
+
+	/* a client not reading its replies must not stall the daemon */
+	if (sendmsg(client->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == -1)
+		client_drop(client);
+}
+
+static void client_accept(int lfd)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct client *client;
+	int fd;
+
+	if ((fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) == -1)
+		return;
+
+	if ((client = calloc(1, sizeof(*client))) == NULL ||
+	    (client->held = calloc(nlines, 1)) == NULL) {
+		free(client);
+		close(fd);
+		return;
+	}
+
+	client->fd = fd;
+	ev.data.ptr = client;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		free(client->held);
+		free(client);
+		close(fd);
+		return;
+	}
+
+	client->next = clients;
+	if (clients)
+		clients->prev = client;
+	clients = client;
+}
+
+static int setup_shm(void)
+{
+	char path[32];
+
+	shm_size = sizeof(*shm) + nlines * sizeof(shm->lines[0]);
+
+	if ((shm_fd = memfd_create("ugpiod", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1)
+		return -1;
+
+	if (ftruncate(shm_fd, shm_size) == -1)
+		return -1;
+
+	shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+	if (shm == MAP_FAILED)
+		return -1;
+
+	shm->magic = UGPIOD_SHM_MAGIC;
+	shm->version = UGPIOD_SHM_VERSION;
+	shm->nlines = nlines;
+
+	/*
+	 * The clients must neither resize nor write the segment. Sealing
+	 * future writes keeps the mapping of the daemon writable, kernels
+	 * before 5.1 lack it and fall back to a read-only reopen, which a
+	 * client of the same user could still reopen for writing.
+	 */
+	if (fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1)
+		return -1;
+
+#ifdef F_SEAL_FUTURE_WRITE
+	if (fcntl(shm_fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) == 0) {
+		shm_client_fd = shm_fd;
+		return 0;
+	}
+#endif
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", shm_fd);
+	if ((shm_client_fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+		return -1;
+
+	return fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SEAL);
+}
+
+static int setup_socket(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1)
+		return -1;
+
+	unlink(socket_path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 16) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int main(int argc, char *argv[])
+{
+	struct epoll_event ev = { .events = EPOLLIN }, events[MAX_EVENTS];
+	int lfd, sfd, lpfd, i, n, opt;
+	int stop = 0;
+	sigset_t mask;
+
+	while ((opt = getopt(argc, argv, "s:n:b:r:h")) != -1) {
+		switch (opt) {
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'n':
+			nlines = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			if (ugpio_set_backend(optarg) == -1) {
+				perror("ugpio_set_backend");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'r':
+			if (ugpio_set_sysfs_root(optarg) == -1) {
+				perror("ugpio_set_sysfs_root");
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			print_usage();
+		}
+	}
+
+	if (nlines == 0 || (lines = calloc(nlines, sizeof(*lines))) == NULL) {
+		fprintf(stderr, "invalid number of lines\n");
+		return EXIT_FAILURE;
+	}
+
+	if (setup_shm() == -1) {
+		perror("shared memory");
+		return EXIT_FAILURE;
+	}
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	if ((loop = ugpio_loop_new()) == NULL) {
+		perror("ugpio_loop_new");
+		return EXIT_FAILURE;
+	}
+
+	if ((lfd = setup_socket()) == -1) {
+		perror(socket_path);
+		return EXIT_FAILURE;
+	}
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+	    (sfd = signalfd(-1, &mask, SFD_CLOEXEC)) == -1) {
+		perror("epoll");
+		return EXIT_FAILURE;
+	}
+
+	/* the library's loop is embedded, data.ptr tells the sources apart */
+	lpfd = ugpio_loop_fd(loop);
+	ev.data.ptr = &lfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+	ev.data.ptr = &sfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev);
+	ev.data.ptr = &lpfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, lpfd, &ev);
+
+	while (!stop) {
+		if ((n = epoll_wait(epfd, events, MAX_EVENTS, -1)) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (events[i].data.ptr == &lfd)
+				client_accept(lfd);
+			else if (events[i].data.ptr == &sfd)
+				stop = 1;
+			else if (events[i].data.ptr == &lpfd)
+				ugpio_loop_run_once(loop, 0);
+			else
+				client_handle(events[i].data.ptr);
+		}
+	}
+
+	/* release all lines */
+	while (clients)
+		client_drop(clients);
+
+	close(lfd);
+	unlink(socket_path);
+	ugpio_loop_free(loop);
+
+	return stop ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
@@ -25,19 +26,38 @@ int gpio_is_requested(unsigned int gpio)
 int gpio_request(unsigned int gpio, const char *label)
 {
     char buffer[16];
+    int rv;
+
+    GPIO_PROBE1(gpio_request, gpio);
 
     snprintf(buffer, sizeof(buffer), "%d\n", gpio);
 
-    return gpio_write(-1, GPIO_EXPORT, buffer, strlen(buffer));
+    if ((rv = gpio_write(-1, GPIO_EXPORT, buffer, strlen(buffer))) == -1)
+        GPIO_TRACE_ERROR(UGPIO_TRACE_REQUEST, gpio);
+    else
+        GPIO_TRACE(UGPIO_TRACE_REQUEST, gpio, 0);
+
+    return rv;
 }
 
 int gpio_free(unsigned int gpio)
 {
     char buffer[16];
+    int rv;
+
+    GPIO_PROBE1(gpio_free, gpio);
+
+    /* the attribute files vanish, so close cached ones first */
+    gpio_fdcache_invalidate(gpio);
 
     snprintf(buffer, sizeof(buffer), "%d\n", gpio);
 
-    return gpio_write(-1, GPIO_UNEXPORT, buffer, strlen(buffer));
+    if ((rv = gpio_write(-1, GPIO_UNEXPORT, buffer, strlen(buffer))) == -1)
+        GPIO_TRACE_ERROR(UGPIO_TRACE_FREE, gpio);
+    else
+        GPIO_TRACE(UGPIO_TRACE_FREE, gpio, 0);
+
+    return rv;
 }
 
 int gpio_alterable_direction(unsigned int gpio)
@@ -86,29 +106,30 @@ int gpio_get_value(unsigned int gpio)
 {
     char buffer;
 
-    if (gpio_read(gpio, GPIO_VALUE, &buffer, sizeof(buffer)) != sizeof(buffer))
+    if (gpio_read(gpio, GPIO_VALUE, &buffer, sizeof(buffer)) != sizeof(buffer)) {
+        GPIO_TRACE_ERROR(UGPIO_TRACE_GET, gpio);
         return -1;
+    }
 
+    GPIO_TRACE(UGPIO_TRACE_GET, gpio, !!(buffer - '0'));
     return !!(buffer - '0');
 }
 
 int gpio_set_value(unsigned int gpio, int value)
 {
-    return gpio_write(gpio, GPIO_VALUE, value ? "1" : "0", 2);
+    int rv;
+
+    if ((rv = gpio_write(gpio, GPIO_VALUE, value ? "1" : "0", 2)) == -1)
+        GPIO_TRACE_ERROR(UGPIO_TRACE_SET, gpio);
+    else
+        GPIO_TRACE(UGPIO_TRACE_SET, gpio, !!value);
+
+    return rv;
 }
 
-int gpio_request_one(unsigned int gpio, unsigned int flags, const char *label)
+static int gpio_configure(unsigned int gpio, unsigned int flags)
 {
     int rv;
-    int is_requested;
-
-    if ((is_requested = gpio_is_requested(gpio)) < 0)
-        return -1;
-
-    if (!is_requested) {
-        if (gpio_request(gpio, label) < 0)
-            return -1;
-    }
 
     if (flags & GPIOF_DIR_IN)
         rv = gpio_direction_input(gpio);
@@ -116,15 +137,32 @@ int gpio_request_one(unsigned int gpio, unsigned int flags, const char *label)
         rv = gpio_direction_output(gpio, (flags & GPIOF_INIT_HIGH) ? 1 : 0);
 
     if (rv)
-        goto err_free;
+        return -1;
 
     if ((rv = gpio_alterable_edge(gpio)) < 0)
-        goto err_free;
+        return -1;
 
     if (rv)
         rv = gpio_set_edge(gpio, flags);
 
-  err_free:
+    return rv;
+}
+
+int gpio_request_one(unsigned int gpio, unsigned int flags, const char *label)
+{
+    int rv;
+    int is_requested;
+
+    if ((is_requested = gpio_is_requested(gpio)) < 0)
+        return -1;
+
+    if (!is_requested) {
+        if (gpio_request(gpio, label) < 0)
+            return -1;
+    }
+
+    rv = gpio_configure(gpio, flags);
+
     if (rv < 0) {
         if (!is_requested)
             gpio_free(gpio);
@@ -153,6 +191,51 @@ int gpio_request_array(const struct gpio *array, size_t num)
     return err;
 }
 
+int gpio_request_array_wait(const struct gpio *array, size_t num, int timeout_ms)
+{
+    unsigned int *exported;
+    size_t i, n = 0;
+    int rv;
+
+    if (num == 0)
+        return 0;
+
+    if ((exported = malloc(num * sizeof(*exported))) == NULL)
+        return -1;
+
+    /* issue all exports up front ... */
+    for (i = 0; i < num; i++) {
+        if ((rv = gpio_is_requested(array[i].gpio)) < 0)
+            goto err_free;
+        if (rv)
+            continue;
+        if (gpio_request(array[i].gpio, array[i].label) < 0)
+            goto err_free;
+        exported[n++] = array[i].gpio;
+    }
+
+    /* ... then wait for all of them at once ... */
+    if (n && gpio_backend->wait_ready &&
+        gpio_backend->wait_ready(exported, n, timeout_ms) < 0)
+        goto err_free;
+
+    /* ... and configure them when they are accessible */
+    for (i = 0; i < num; i++)
+        if (gpio_configure(array[i].gpio, array[i].flags) < 0)
+            goto err_free;
+
+    free(exported);
+    return 0;
+
+  err_free:
+    rv = errno;
+    while (n--)
+        gpio_free(exported[n]);
+    free(exported);
+    errno = rv;
+    return -1;
+}
+
 void gpio_free_array(const struct gpio *array, size_t num)
 {
     while (num--)
@@ -166,28 +249,21 @@ int gpio_alterable_edge(unsigned int gpio)
 
 int gpio_set_edge(unsigned int gpio, unsigned int flags)
 {
-    int fd, rv;
+    const char *name;
 
-    if ((fd = gpio_fd_open(gpio, GPIO_EDGE, O_WRONLY | O_CLOEXEC)) == -1)
+    if ((name = gpio_edge_name(flags)) == NULL)
         return -1;
 
-    rv = gpio_fd_set_edge(fd, flags);
-
-    close(fd);
-
-    return rv;
+    return gpio_write(gpio, GPIO_EDGE, name, strlen(name) + 1);
 }
 
 int gpio_get_edge(unsigned int gpio)
 {
-    int fd, rv;
+    char buffer[16];
+    ssize_t c;
 
-    if ((fd = gpio_fd_open(gpio, GPIO_EDGE, O_RDONLY | O_CLOEXEC)) == -1)
+    if ((c = gpio_read(gpio, GPIO_EDGE, buffer, sizeof(buffer))) == -1)
         return -1;
 
-    rv = gpio_fd_get_edge(fd);
-
-    close(fd);
-
-    return rv;
+    return gpio_edge_parse(buffer, c);
 }
@@ -0,0 +1,395 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-async.h>
+#include <ugpio-internal.h>
+
+#if HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+/**
+ * A queued or in flight operation.
+ */
+struct async_op {
+    ugpio_t *ctx;
+    ugpio_async_cb cb;
+    void *userdata;
+    /* whether the value is written */
+    int set;
+    int value;
+    char buffer[2];
+    struct iovec iov;
+    /* free list resp. queue of the synchronous fallback */
+    struct async_op *next;
+};
+
+struct ugpio_async {
+    /* the maximum number of operations in flight */
+    unsigned int entries;
+    /* the number of operations queued or in flight */
+    unsigned int pending;
+    struct async_op *ops;
+    struct async_op *free_ops;
+    /* operations carried out synchronously by ugpio_async_run */
+    struct async_op *queue_head;
+    struct async_op *queue_tail;
+#if HAVE_LINUX_IO_URING_H
+    /* the io_uring instance, -1 if not available */
+    int ring_fd;
+    /* submission entries not yet handed to the kernel */
+    unsigned int to_submit;
+    /* operations queued on or in flight in the io_uring */
+    unsigned int in_ring;
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+#endif
+};
+
+#if HAVE_LINUX_IO_URING_H
+static int async_uring_setup(ugpio_async_t *as)
+{
+    struct io_uring_params p;
+    void *sq, *cq;
+
+    memset(&p, 0, sizeof(p));
+
+    as->ring_fd = syscall(__NR_io_uring_setup, as->entries, &p);
+    if (as->ring_fd == -1)
+        return -1;
+
+    as->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    as->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (as->cq_size > as->sq_size)
+            as->sq_size = as->cq_size;
+        as->cq_size = 0;
+    }
+
+    sq = mmap(NULL, as->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              as->ring_fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+        goto err_close;
+
+    if (as->cq_size) {
+        cq = mmap(NULL, as->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  as->ring_fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED)
+            goto err_unmap_sq;
+    } else {
+        cq = sq;
+    }
+
+    as->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    as->sqes = mmap(NULL, as->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    as->ring_fd, IORING_OFF_SQES);
+    if (as->sqes == MAP_FAILED)
+        goto err_unmap_cq;
+
+    as->sq_ptr = sq;
+    as->cq_ptr = cq;
+    as->sq_tail = (unsigned int *)((char *)sq + p.sq_off.tail);
+    as->sq_mask = (unsigned int *)((char *)sq + p.sq_off.ring_mask);
+    as->sq_array = (unsigned int *)((char *)sq + p.sq_off.array);
+    as->cq_head = (unsigned int *)((char *)cq + p.cq_off.head);
+    as->cq_tail = (unsigned int *)((char *)cq + p.cq_off.tail);
+    as->cq_mask = (unsigned int *)((char *)cq + p.cq_off.ring_mask);
+    as->cqes = (struct io_uring_cqe *)((char *)cq + p.cq_off.cqes);
+
+    return 0;
+
+err_unmap_cq:
+    if (as->cq_size)
+        munmap(cq, as->cq_size);
+err_unmap_sq:
+    munmap(sq, as->sq_size);
+err_close:
+    close(as->ring_fd);
+    as->ring_fd = -1;
+    return -1;
+}
+
+static int async_uring_enter(ugpio_async_t *as, unsigned int min_complete)
+{
+    unsigned int flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    int rv;
+
+    do {
+        rv = syscall(__NR_io_uring_enter, as->ring_fd, as->to_submit, min_complete, flags,
+                     NULL, 0);
+    } while (rv == -1 && errno == EINTR);
+
+    if (rv == -1)
+        return -1;
+
+    as->to_submit -= rv;
+    return 0;
+}
+
+static void async_uring_queue(ugpio_async_t *as, struct async_op *op)
+{
+    unsigned int tail = *as->sq_tail;
+    unsigned int index = tail & *as->sq_mask;
+    struct io_uring_sqe *sqe = &as->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    /* vectored I/O is available since the first io_uring kernels */
+    sqe->opcode = op->set ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = op->ctx->fd_value;
+    sqe->off = 0;
+    sqe->addr = (unsigned long)&op->iov;
+    sqe->len = 1;
+    sqe->user_data = (unsigned long)op;
+
+    as->sq_array[index] = index;
+    __atomic_store_n(as->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    as->to_submit++;
+    as->in_ring++;
+}
+#endif
+
+ugpio_async_t *ugpio_async_new(unsigned int entries)
+{
+    ugpio_async_t *as;
+    unsigned int i;
+
+    if (entries == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((as = calloc(1, sizeof(*as))) == NULL)
+        return NULL;
+
+    as->entries = entries;
+
+    if ((as->ops = calloc(entries, sizeof(*as->ops))) == NULL) {
+        free(as);
+        return NULL;
+    }
+
+    for (i = 0; i < entries; i++) {
+        as->ops[i].next = as->free_ops;
+        as->free_ops = &as->ops[i];
+    }
+
+#if HAVE_LINUX_IO_URING_H
+    /* the value files of the other backends are no plain files */
+    if (gpio_backend == &gpio_backend_sysfs)
+        async_uring_setup(as);
+    else
+        as->ring_fd = -1;
+#endif
+
+    return as;
+}
+
+void ugpio_async_free(ugpio_async_t *as)
+{
+    unsigned int i;
+
+    if (as == NULL)
+        return;
+
+    for (i = 0; i < as->entries; i++)
+        as->ops[i].cb = NULL;
+
+#if HAVE_LINUX_IO_URING_H
+    if (as->ring_fd != -1) {
+        /* the kernel must be done with our buffers before they are freed */
+        while (as->in_ring)
+            if (ugpio_async_run(as, as->in_ring) == -1)
+                break;
+        munmap(as->sqes, as->sqes_size);
+        if (as->cq_size)
+            munmap(as->cq_ptr, as->cq_size);
+        munmap(as->sq_ptr, as->sq_size);
+        close(as->ring_fd);
+    }
+#endif
+
+    free(as->ops);
+    free(as);
+}
+
+int ugpio_async_is_uring(ugpio_async_t *as)
+{
+#if HAVE_LINUX_IO_URING_H
+    return as->ring_fd != -1;
+#else
+    return 0;
+#endif
+}
+
+unsigned int ugpio_async_pending(ugpio_async_t *as)
+{
+    return as->pending;
+}
+
+static int async_submit(ugpio_async_t *as, ugpio_t *ctx, int set, int value,
+                        ugpio_async_cb cb, void *userdata)
+{
+    struct async_op *op;
+
+    if ((op = as->free_ops) == NULL) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (ugpio_open(ctx) == -1)
+        return -1;
+
+    as->free_ops = op->next;
+    as->pending++;
+
+    op->ctx = ctx;
+    op->cb = cb;
+    op->userdata = userdata;
+    op->set = set;
+    op->value = !!value;
+    op->buffer[0] = op->value ? '1' : '0';
+    op->buffer[1] = '\n';
+    op->iov.iov_base = op->buffer;
+    op->iov.iov_len = set ? 2 : 1;
+    op->next = NULL;
+
+#if HAVE_LINUX_IO_URING_H
+    if (as->ring_fd != -1 && gpio_backend == &gpio_backend_sysfs) {
+        async_uring_queue(as, op);
+        return 0;
+    }
+#endif
+
+    if (as->queue_tail)
+        as->queue_tail->next = op;
+    else
+        as->queue_head = op;
+    as->queue_tail = op;
+
+    return 0;
+}
+
+int ugpio_submit_get(ugpio_async_t *as, ugpio_t *ctx, ugpio_async_cb cb, void *userdata)
+{
+    return async_submit(as, ctx, 0, 0, cb, userdata);
+}
+
+int ugpio_submit_set(ugpio_async_t *as, ugpio_t *ctx, int value, ugpio_async_cb cb, void *userdata)
+{
+    return async_submit(as, ctx, 1, value, cb, userdata);
+}
+
+/* turn the outcome of the I/O into the result and invoke the callback */
+static void async_complete(ugpio_async_t *as, struct async_op *op, ssize_t res)
+{
+    ugpio_t *ctx = op->ctx;
+    ugpio_async_cb cb = op->cb;
+    void *userdata = op->userdata;
+    int result;
+
+    if (res < 0)
+        result = res;
+    else if (res != op->iov.iov_len)
+        result = -EIO;
+    else if (op->set)
+        result = 0;
+    else
+        result = !!(op->buffer[0] - '0');
+
+    if (op->set)
+        gpio_value_written(ctx, result == 0 ? op->value : -1);
+
+    /* recycle before the callback, so that it may queue again */
+    op->next = as->free_ops;
+    as->free_ops = op;
+    as->pending--;
+
+    if (cb)
+        cb(as, ctx, result, userdata);
+}
+
+int ugpio_async_run(ugpio_async_t *as, unsigned int min_complete)
+{
+    struct async_op *op, *next;
+    ssize_t res;
+    int n = 0;
+
+    /*
+     * Detach the queue first: operations submitted by the callbacks are
+     * queued for the next run, so a callback resubmitting its operation
+     * does not keep this loop busy forever.
+     */
+    op = as->queue_head;
+    as->queue_head = as->queue_tail = NULL;
+
+    for (; op; op = next) {
+        next = op->next;
+
+        if (op->set)
+            res = gpio_fd_write(op->ctx->fd_value, op->buffer, op->iov.iov_len);
+        else
+            res = gpio_fd_read(op->ctx->fd_value, op->buffer, op->iov.iov_len);
+
+        async_complete(as, op, (res < 0) ? -errno : res);
+        n++;
+    }
+
+#if HAVE_LINUX_IO_URING_H
+    if (as->ring_fd != -1) {
+        struct io_uring_cqe *cqe;
+        unsigned int head, tail;
+
+        /* the synchronous part already counts towards min_complete */
+        min_complete = (min_complete > n) ? min_complete - n : 0;
+        if (min_complete > as->in_ring)
+            min_complete = as->in_ring;
+
+        if ((as->to_submit || min_complete) && async_uring_enter(as, min_complete) == -1)
+            return n ? n : -1;
+
+        head = *as->cq_head;
+        tail = __atomic_load_n(as->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            cqe = &as->cqes[head & *as->cq_mask];
+            op = (struct async_op *)(unsigned long)cqe->user_data;
+            res = cqe->res;
+            head++;
+            __atomic_store_n(as->cq_head, head, __ATOMIC_RELEASE);
+            as->in_ring--;
+
+            async_complete(as, op, res);
+            n++;
+
+            tail = __atomic_load_n(as->cq_tail, __ATOMIC_ACQUIRE);
+        }
+    }
+#endif
+
+    return n;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_ASYNC_H
+#define UGPIO_ASYNC_H
+
+#include "ugpio.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Asynchronous value access
+ *
+ * Reads and writes of the value of many GPIO contexts are queued and then
+ * handed to the kernel together. With the sysfs backend and a kernel
+ * supporting io_uring, a whole batch is submitted and reaped with a single
+ * system call. Otherwise the queued operations are carried out one after
+ * another when the queue is run, so the API can be used unconditionally.
+ *
+ * A queue object must only be used by one thread at a time.
+ */
+
+struct ugpio_async;
+typedef struct ugpio_async ugpio_async_t;
+
+/**
+ * Callback invoked when a queued operation completed.
+ *
+ * @param as the queue object
+ * @param ctx the GPIO context of the operation
+ * @param result the value read (0 or 1) resp. 0 after a successful write,
+ *        a negative errno value on error
+ * @param userdata the pointer given when queueing the operation
+ */
+typedef void (*ugpio_async_cb)(ugpio_async_t *as, ugpio_t *ctx, int result, void *userdata);
+
+/**
+ * Create a queue object.
+ *
+ * @param entries the maximum number of operations in flight
+ * @return returns a ugpio_async_t object on success, NULL otherwise
+ */
+ugpio_async_t *ugpio_async_new(unsigned int entries);
+
+/**
+ * Release/free a queue object.
+ *
+ * Operations still in flight are waited for, their callbacks are not invoked.
+ *
+ * @param as a queue object
+ */
+void ugpio_async_free(ugpio_async_t *as);
+
+/**
+ * Check whether the queue object is backed by io_uring.
+ *
+ * @param as a queue object
+ * @return 1 if io_uring is used, 0 for the synchronous fallback
+ */
+int ugpio_async_is_uring(ugpio_async_t *as);
+
+/**
+ * Queue reading the value of a GPIO context.
+ *
+ * The value file is opened if necessary.
+ *
+ * @param as a queue object
+ * @param ctx a GPIO context
+ * @param cb the callback to invoke on completion
+ * @param userdata passed to the callback
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EBUSY - the maximum number of operations is in flight.
+ */
+int ugpio_submit_get(ugpio_async_t *as, ugpio_t *ctx, ugpio_async_cb cb, void *userdata);
+
+/**
+ * Queue writing the value of a GPIO context.
+ *
+ * The value file is opened if necessary.
+ *
+ * @param as a queue object
+ * @param ctx a GPIO context
+ * @param value the value to set
+ * @param cb the callback to invoke on completion, may be NULL
+ * @param userdata passed to the callback
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EBUSY - the maximum number of operations is in flight.
+ */
+int ugpio_submit_set(ugpio_async_t *as, ugpio_t *ctx, int value, ugpio_async_cb cb, void *userdata);
+
+/**
+ * Hand the queued operations to the kernel and process completions.
+ *
+ * Submitting and waiting is done in a single system call. The callbacks of
+ * all completed operations are invoked before this function returns.
+ * Operations submitted by these callbacks are handled by the next call.
+ *
+ * @param as a queue object
+ * @param min_complete the number of completions to wait for, 0 to only
+ *        submit and process what is already completed
+ * @return the number of completed operations, -1 on error with errno set
+ *         appropriately
+ */
+int ugpio_async_run(ugpio_async_t *as, unsigned int min_complete);
+
+/**
+ * Return the number of operations queued or in flight.
+ *
+ * @param as a queue object
+ */
+unsigned int ugpio_async_pending(ugpio_async_t *as);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_ASYNC_H */
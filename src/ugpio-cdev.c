@@ -0,0 +1,723 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+#if HAVE_DECL_GPIO_V2_GET_LINE_IOCTL
+
+#include <linux/gpio.h>
+
+#define CDEV_DEV_DIR    "/dev"
+#define CDEV_CONSUMER   "ugpio"
+
+static int cdev_ioctl(int fd, unsigned long request, void *arg)
+{
+    GPIO_STATS_SYSCALL();
+    return ioctl(fd, request, arg);
+}
+
+int (*gpio_cdev_ioctl)(int fd, unsigned long request, void *arg) = cdev_ioctl;
+
+char gpio_cdev_dir[PATH_MAX] = CDEV_DEV_DIR;
+
+/**
+ * A GPIO chip character device.
+ */
+struct cdev_chip {
+    /* file descriptor of /dev/gpiochipN */
+    int fd;
+    /* the N of /dev/gpiochipN */
+    unsigned int index;
+    /* the global number of the chip's first line */
+    unsigned int base;
+    /* the number of lines of the chip */
+    unsigned int ngpio;
+};
+
+/**
+ * A line of a GPIO chip, addressed by its global GPIO number.
+ */
+struct cdev_line {
+    /* index into the chip table, -1 if no chip provides this number */
+    int chip;
+    /* the offset of the line on the chip */
+    unsigned int offset;
+    /* line request file descriptor, -1 if not requested ('exported') */
+    int req_fd;
+    /* direction: 1 input, 0 output */
+    int dir_in;
+    /* active low flag */
+    int active_low;
+    /* GPIOF_TRIG_* flags */
+    unsigned int edge;
+};
+
+/**
+ * A file descriptor handed out by this backend.
+ */
+struct cdev_fd {
+    int used;
+    unsigned int gpio;
+    int attr;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    int scanned;
+    struct cdev_chip *chips;
+    unsigned int nchips;
+    struct cdev_line *lines;
+    unsigned int nlines;
+    struct cdev_fd *fds;
+    int nfds;
+} cdev = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int cdev_chip_cmp(const void *a, const void *b)
+{
+    const struct cdev_chip *x = a, *y = b;
+
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/*
+ * Read a small sysfs attribute of a chip into a string without the newline.
+ */
+static int cdev_read_attr(const char *chip, const char *name, char *buf, size_t size)
+{
+    char pathname[PATH_MAX];
+    ssize_t c;
+    int fd;
+
+    snprintf(pathname, sizeof(pathname), "%s/%s/%s", gpio_sysfs_root, chip, name);
+    if ((fd = open(pathname, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    c = read(fd, buf, size - 1);
+    close(fd);
+
+    if (c <= 0)
+        return -1;
+
+    buf[c] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+/*
+ * Look up the base number the kernel assigned to the chip in the legacy
+ * numbering space: /sys/class/gpio/gpiochipBASE/device/ contains gpiochipN.
+ * A device may register several chips, all of them show up below each of
+ * the chips' devices, so the label and the number of lines must match too.
+ */
+static int cdev_chip_base(unsigned int index, const struct gpiochip_info *info,
+                          unsigned int *base)
+{
+    char pathname[PATH_MAX];
+    char buf[sizeof(info->label) + 1];
+    struct dirent *de;
+    unsigned int b, n;
+    DIR *dir;
+    int rv = -1;
+
+    if ((dir = opendir(gpio_sysfs_root)) == NULL)
+        return -1;
+
+    while ((de = readdir(dir)) != NULL) {
+        if (sscanf(de->d_name, "gpiochip%u", &b) != 1)
+            continue;
+
+        snprintf(pathname, sizeof(pathname), "%s/%s/device/gpiochip%u",
+                 gpio_sysfs_root, de->d_name, index);
+        if (access(pathname, F_OK) != 0)
+            continue;
+
+        if (cdev_read_attr(de->d_name, "ngpio", buf, sizeof(buf)) == -1 ||
+            sscanf(buf, "%u", &n) != 1 || n != info->lines)
+            continue;
+
+        if (cdev_read_attr(de->d_name, "label", buf, sizeof(buf)) == -1 ||
+            strncmp(buf, info->label, sizeof(info->label)) != 0)
+            continue;
+
+        *base = b;
+        rv = 0;
+        break;
+    }
+
+    closedir(dir);
+    return rv;
+}
+
+/* must be called with the lock held */
+static int cdev_scan(void)
+{
+    struct gpiochip_info info;
+    struct cdev_chip *chips = NULL, *c;
+    unsigned int nchips = 0, nlines = 0, next_base = 0, i, j, index;
+    char pathname[PATH_MAX];
+    struct dirent *de;
+    DIR *dir;
+
+    if (cdev.scanned)
+        return 0;
+
+    if ((dir = opendir(gpio_cdev_dir)) == NULL)
+        return -1;
+
+    while ((de = readdir(dir)) != NULL) {
+        if (sscanf(de->d_name, "gpiochip%u", &index) != 1)
+            continue;
+
+        if ((c = realloc(chips, (nchips + 1) * sizeof(*chips))) == NULL)
+            goto err_free;
+        chips = c;
+        c = &chips[nchips];
+
+        if (snprintf(pathname, sizeof(pathname), "%s/%s", gpio_cdev_dir,
+                     de->d_name) >= (int)sizeof(pathname))
+            continue;
+        if ((c->fd = open(pathname, O_RDWR | O_CLOEXEC)) == -1)
+            continue;
+
+        if (gpio_cdev_ioctl(c->fd, GPIO_GET_CHIPINFO_IOCTL, &info) == -1) {
+            close(c->fd);
+            continue;
+        }
+
+        c->index = index;
+        c->ngpio = info.lines;
+        if (cdev_chip_base(index, &info, &c->base) == -1)
+            c->base = -1;
+        nchips++;
+    }
+
+    closedir(dir);
+    dir = NULL;
+
+    qsort(chips, nchips, sizeof(*chips), cdev_chip_cmp);
+
+    /* chips without legacy base are numbered behind all others */
+    for (i = 0; i < nchips; i++)
+        if (chips[i].base != -1 && chips[i].base + chips[i].ngpio > next_base)
+            next_base = chips[i].base + chips[i].ngpio;
+
+    for (i = 0; i < nchips; i++) {
+        if (chips[i].base == -1) {
+            chips[i].base = next_base;
+            next_base += chips[i].ngpio;
+        }
+    }
+    nlines = next_base;
+
+    if (nlines && (cdev.lines = malloc(nlines * sizeof(*cdev.lines))) == NULL)
+        goto err_free;
+
+    for (i = 0; i < nlines; i++) {
+        cdev.lines[i].chip = -1;
+        cdev.lines[i].req_fd = -1;
+    }
+
+    for (i = 0; i < nchips; i++) {
+        for (j = 0; j < chips[i].ngpio; j++) {
+            cdev.lines[chips[i].base + j].chip = i;
+            cdev.lines[chips[i].base + j].offset = j;
+        }
+    }
+
+    cdev.chips = chips;
+    cdev.nchips = nchips;
+    cdev.nlines = nlines;
+    cdev.scanned = 1;
+
+    return 0;
+
+err_free:
+    if (dir)
+        closedir(dir);
+    while (nchips--)
+        close(chips[nchips].fd);
+    free(chips);
+    return -1;
+}
+
+/* must be called with the lock held */
+static struct cdev_line *cdev_line(unsigned int gpio)
+{
+    if (cdev_scan() == -1)
+        return NULL;
+
+    if (gpio >= cdev.nlines || cdev.lines[gpio].chip == -1) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return &cdev.lines[gpio];
+}
+
+/* must be called with the lock held */
+static struct cdev_fd *cdev_fd(int fd)
+{
+    if (fd < 0 || fd >= cdev.nfds || !cdev.fds[fd].used) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    return &cdev.fds[fd];
+}
+
+/* must be called with the lock held */
+static int cdev_configure(struct cdev_line *line, int dir_in, int active_low,
+                          unsigned int edge, int value)
+{
+    struct gpio_v2_line_config config;
+
+    memset(&config, 0, sizeof(config));
+
+    if (active_low)
+        config.flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+
+    if (dir_in) {
+        config.flags |= GPIO_V2_LINE_FLAG_INPUT;
+        if (edge & GPIOF_TRIG_RISE)
+            config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+        if (edge & GPIOF_TRIG_FALL)
+            config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    } else {
+        config.flags |= GPIO_V2_LINE_FLAG_OUTPUT;
+        config.num_attrs = 1;
+        config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        config.attrs[0].attr.values = !!value;
+        config.attrs[0].mask = 1;
+    }
+
+    if (gpio_cdev_ioctl(line->req_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) == -1)
+        return -1;
+
+    line->dir_in = dir_in;
+    line->active_low = active_low;
+    line->edge = dir_in ? edge : 0;
+
+    return 0;
+}
+
+/* must be called with the lock held */
+static int cdev_get(struct cdev_line *line)
+{
+    struct gpio_v2_line_values values = { .bits = 0, .mask = 1 };
+
+    if (gpio_cdev_ioctl(line->req_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) == -1)
+        return -1;
+
+    return values.bits & 1;
+}
+
+/* must be called with the lock held */
+static int cdev_export(unsigned int gpio)
+{
+    struct gpio_v2_line_request req;
+    struct gpio_v2_line_info info;
+    struct cdev_line *line;
+    struct cdev_chip *chip;
+
+    if ((line = cdev_line(gpio)) == NULL)
+        return -1;
+
+    if (line->req_fd != -1) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    chip = &cdev.chips[line->chip];
+
+    memset(&info, 0, sizeof(info));
+    info.offset = line->offset;
+    if (gpio_cdev_ioctl(chip->fd, GPIO_V2_GET_LINEINFO_IOCTL, &info) == -1)
+        return -1;
+
+    /* request the line 'as is', i.e. without changing its direction */
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = line->offset;
+    req.num_lines = 1;
+    strncpy(req.consumer, CDEV_CONSUMER, sizeof(req.consumer) - 1);
+    if (info.flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW)
+        req.config.flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+
+    if (gpio_cdev_ioctl(chip->fd, GPIO_V2_GET_LINE_IOCTL, &req) == -1)
+        return -1;
+
+    /* edge events are drained without blocking when reading the value */
+    if (fcntl(req.fd, F_SETFL, O_NONBLOCK) == -1) {
+        close(req.fd);
+        return -1;
+    }
+
+    line->req_fd = req.fd;
+    line->dir_in = !(info.flags & GPIO_V2_LINE_FLAG_OUTPUT);
+    line->active_low = !!(info.flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW);
+    line->edge = 0;
+
+    return 0;
+}
+
+/* must be called with the lock held */
+static int cdev_unexport(unsigned int gpio)
+{
+    struct cdev_line *line;
+
+    if ((line = cdev_line(gpio)) == NULL)
+        return -1;
+
+    if (line->req_fd == -1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    close(line->req_fd);
+    line->req_fd = -1;
+
+    return 0;
+}
+
+static int cdev_open(unsigned int gpio, const char *key, int flags)
+{
+    struct cdev_line *line;
+    struct cdev_fd *fds;
+    int attr, fd, nfds;
+
+    if ((attr = gpio_key_attr(key)) == GPIO_ATTR_UNKNOWN) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    pthread_mutex_lock(&cdev.lock);
+
+    if (attr == GPIO_ATTR_EXPORT || attr == GPIO_ATTR_UNEXPORT) {
+        fd = eventfd(0, EFD_NONBLOCK | ((flags & O_CLOEXEC) ? EFD_CLOEXEC : 0));
+    } else {
+        if ((line = cdev_line(gpio)) == NULL || line->req_fd == -1) {
+            errno = ENOENT;
+            goto err_unlock;
+        }
+        /* all attribute descriptors refer to the line request, so that
+         * the value descriptor can be polled for edge events */
+        fd = fcntl(line->req_fd, (flags & O_CLOEXEC) ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+    }
+
+    if (fd == -1)
+        goto err_unlock;
+
+    if (fd >= cdev.nfds) {
+        nfds = fd + 16;
+        if ((fds = realloc(cdev.fds, nfds * sizeof(*fds))) == NULL) {
+            close(fd);
+            goto err_unlock;
+        }
+        memset(fds + cdev.nfds, 0, (nfds - cdev.nfds) * sizeof(*fds));
+        cdev.fds = fds;
+        cdev.nfds = nfds;
+    }
+
+    cdev.fds[fd].used = 1;
+    cdev.fds[fd].gpio = gpio;
+    cdev.fds[fd].attr = attr;
+
+    pthread_mutex_unlock(&cdev.lock);
+    return fd;
+
+err_unlock:
+    pthread_mutex_unlock(&cdev.lock);
+    return -1;
+}
+
+static int cdev_close(int fd)
+{
+    struct cdev_fd *f;
+
+    pthread_mutex_lock(&cdev.lock);
+    if ((f = cdev_fd(fd)) != NULL)
+        f->used = 0;
+    pthread_mutex_unlock(&cdev.lock);
+
+    if (f == NULL)
+        return -1;
+
+    return close(fd);
+}
+
+static ssize_t cdev_read(int fd, void *buf, size_t count)
+{
+    struct gpio_v2_line_event events[16];
+    struct cdev_line *line;
+    struct cdev_fd *f;
+    char text[16];
+    int len, val;
+
+    pthread_mutex_lock(&cdev.lock);
+
+    if ((f = cdev_fd(fd)) == NULL)
+        goto err_unlock;
+
+    if (f->attr == GPIO_ATTR_EXPORT || f->attr == GPIO_ATTR_UNEXPORT) {
+        errno = EINVAL;
+        goto err_unlock;
+    }
+
+    line = &cdev.lines[f->gpio];
+    if (line->req_fd == -1) {
+        errno = ENODEV;
+        goto err_unlock;
+    }
+
+    switch (f->attr) {
+    case GPIO_ATTR_DIRECTION:
+        len = snprintf(text, sizeof(text), "%s\n", line->dir_in ? "in" : "out");
+        break;
+    case GPIO_ATTR_ACTIVELOW:
+        len = snprintf(text, sizeof(text), "%d\n", line->active_low);
+        break;
+    case GPIO_ATTR_EDGE:
+        len = snprintf(text, sizeof(text), "%s\n", gpio_edge_name(line->edge));
+        break;
+    default:
+        /* reading the value acknowledges pending edges like sysfs does */
+        if (line->edge)
+            while (read(fd, events, sizeof(events)) == sizeof(events))
+                ;
+        if ((val = cdev_get(line)) == -1)
+            goto err_unlock;
+        len = snprintf(text, sizeof(text), "%d\n", val);
+        break;
+    }
+
+    pthread_mutex_unlock(&cdev.lock);
+
+    if (count > len)
+        count = len;
+    memcpy(buf, text, count);
+
+    return count;
+
+err_unlock:
+    pthread_mutex_unlock(&cdev.lock);
+    return -1;
+}
+
+static ssize_t cdev_write(int fd, const void *buf, size_t count)
+{
+    struct gpio_v2_line_values values;
+    struct cdev_line *line;
+    struct cdev_fd *f;
+    char text[16];
+    int rv = -1;
+    int edge, al, val = 0;
+
+    if (count >= sizeof(text)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memcpy(text, buf, count);
+    text[count] = '\0';
+
+    pthread_mutex_lock(&cdev.lock);
+
+    if ((f = cdev_fd(fd)) == NULL)
+        goto out;
+
+    if (f->attr == GPIO_ATTR_EXPORT) {
+        rv = cdev_export(strtoul(text, NULL, 10));
+        goto out;
+    }
+
+    if (f->attr == GPIO_ATTR_UNEXPORT) {
+        rv = cdev_unexport(strtoul(text, NULL, 10));
+        goto out;
+    }
+
+    line = &cdev.lines[f->gpio];
+    if (line->req_fd == -1) {
+        errno = ENODEV;
+        goto out;
+    }
+
+    switch (f->attr) {
+    case GPIO_ATTR_DIRECTION:
+        if (strncmp(text, "in", 2) == 0) {
+            rv = cdev_configure(line, 1, line->active_low, line->edge, 0);
+        } else if (strncmp(text, "out", 3) == 0 || strncmp(text, "low", 3) == 0 ||
+                   strncmp(text, "high", 4) == 0) {
+            /* 'high' and 'low' denote the physical level */
+            rv = cdev_configure(line, 0, line->active_low, 0,
+                                (text[0] == 'h') ^ line->active_low);
+        } else {
+            errno = EINVAL;
+        }
+        break;
+    case GPIO_ATTR_ACTIVELOW:
+        /* an output keeps its physical level */
+        if (!line->dir_in && (val = cdev_get(line)) == -1)
+            break;
+        al = (text[0] != '0');
+        rv = cdev_configure(line, line->dir_in, al, line->edge,
+                            line->dir_in ? 0 : val ^ line->active_low ^ al);
+        break;
+    case GPIO_ATTR_EDGE:
+        if ((edge = gpio_edge_parse(text, count)) == -1)
+            errno = EINVAL;
+        else if (edge && !line->dir_in)
+            errno = EIO;
+        else if (!line->dir_in)
+            /* an output has no edge, "none" leaves it untouched */
+            rv = 0;
+        else
+            rv = cdev_configure(line, line->dir_in, line->active_low, edge, 0);
+        break;
+    default:
+        if (line->dir_in) {
+            errno = EPERM;
+            break;
+        }
+        values.bits = (text[0] != '0');
+        values.mask = 1;
+        rv = gpio_cdev_ioctl(line->req_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+        break;
+    }
+
+out:
+    pthread_mutex_unlock(&cdev.lock);
+    return (rv == -1) ? -1 : count;
+}
+
+static int cdev_check(unsigned int gpio, const char *key)
+{
+    struct cdev_line *line;
+    int attr, rv;
+
+    if ((attr = gpio_key_attr(key)) == GPIO_ATTR_UNKNOWN)
+        return 0;
+
+    pthread_mutex_lock(&cdev.lock);
+
+    if (cdev_scan() == -1) {
+        rv = -1;
+    } else if (attr == GPIO_ATTR_EXPORT || attr == GPIO_ATTR_UNEXPORT) {
+        rv = 1;
+    } else {
+        line = cdev_line(gpio);
+        rv = (line != NULL && line->req_fd != -1);
+    }
+
+    pthread_mutex_unlock(&cdev.lock);
+
+    return rv;
+}
+
+/*
+ * Every line is requested on its own when exported, so the kernel's grouped
+ * access to the lines of one request does not apply: the lines of a port are
+ * still read and written with one ioctl each, just under a single lock.
+ */
+static int cdev_get_values(const int *fds, unsigned int num, uint64_t *bits)
+{
+    struct gpio_v2_line_event events[16];
+    struct cdev_line *line;
+    struct cdev_fd *f;
+    unsigned int i;
+    int rv = -1, val;
+
+    *bits = 0;
+
+    pthread_mutex_lock(&cdev.lock);
+
+    for (i = 0; i < num; i++) {
+        if ((f = cdev_fd(fds[i])) == NULL)
+            goto out;
+        if (f->attr != GPIO_ATTR_VALUE || cdev.lines[f->gpio].req_fd == -1) {
+            errno = EINVAL;
+            goto out;
+        }
+        line = &cdev.lines[f->gpio];
+        if (line->edge)
+            while (read(fds[i], events, sizeof(events)) == sizeof(events))
+                ;
+        if ((val = cdev_get(line)) == -1)
+            goto out;
+        if (val)
+            *bits |= UINT64_C(1) << i;
+    }
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&cdev.lock);
+    return rv;
+}
+
+static int cdev_set_values(const int *fds, unsigned int num, uint64_t mask, uint64_t bits)
+{
+    struct gpio_v2_line_values values;
+    struct cdev_line *line;
+    struct cdev_fd *f;
+    unsigned int i;
+    int rv = -1;
+
+    pthread_mutex_lock(&cdev.lock);
+
+    for (i = 0; i < num; i++) {
+        if (!(mask & (UINT64_C(1) << i)))
+            continue;
+        if ((f = cdev_fd(fds[i])) == NULL)
+            goto out;
+        line = &cdev.lines[f->gpio];
+        if (f->attr != GPIO_ATTR_VALUE || line->req_fd == -1 || line->dir_in) {
+            errno = line->dir_in ? EPERM : EINVAL;
+            goto out;
+        }
+        values.bits = !!(bits & (UINT64_C(1) << i));
+        values.mask = 1;
+        if (gpio_cdev_ioctl(line->req_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) == -1)
+            goto out;
+    }
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&cdev.lock);
+    return rv;
+}
+
+const struct gpio_backend gpio_backend_cdev = {
+    .name = "cdev",
+    .poll_events = POLLIN,
+    .open = cdev_open,
+    .close = cdev_close,
+    .read = cdev_read,
+    .write = cdev_write,
+    .check = cdev_check,
+    .get_values = cdev_get_values,
+    .set_values = cdev_set_values,
+};
+
+#endif  /* HAVE_DECL_GPIO_V2_GET_LINE_IOCTL */
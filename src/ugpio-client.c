@@ -0,0 +1,661 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+#include <ugpiod-proto.h>
+
+/* the attribute of export/unexport descriptors, handled locally */
+#define CLIENT_ATTR_CONTROL -1
+
+/**
+ * A file descriptor handed out by the client backend.
+ */
+struct client_fd {
+    int used;
+    unsigned int gpio;
+    /* enum ugpiod_attr or CLIENT_ATTR_CONTROL */
+    int attr;
+    /* export or unexport */
+    int export;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    /* the connection to the daemon, -1 if not connected */
+    int sock;
+    const struct ugpiod_shm *shm;
+    size_t shm_size;
+    struct client_fd *fds;
+    int nfds;
+    /* the number of GPIOs acquired and of value files subscribed */
+    unsigned int acquired;
+    unsigned int subscribed;
+    /*
+     * Set when the connection broke while GPIOs were held: the daemon
+     * released them, so all requests fail until they are released here too.
+     */
+    int lost;
+} client = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .path = UGPIOD_SOCKET,
+    .sock = -1,
+};
+
+/* must be called with the lock held */
+static void client_disconnect(void)
+{
+    if (client.sock != -1 && (client.acquired || client.subscribed))
+        client.lost = 1;
+
+    if (client.shm) {
+        munmap((void *)client.shm, client.shm_size);
+        client.shm = NULL;
+    }
+
+    if (client.sock != -1) {
+        close(client.sock);
+        client.sock = -1;
+    }
+}
+
+/* must be called with the lock held */
+static int client_exchange(const struct ugpiod_op *ops, int32_t *results, unsigned int num,
+                           const int *fds, unsigned int nfds, int *rfd)
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * UGPIOD_MAX_OPS)];
+    } control;
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t c;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void *)ops;
+    iov.iov_len = num * sizeof(*ops);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (nfds) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    while ((c = sendmsg(client.sock, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+        ;
+    if (c == -1)
+        return -1;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = results;
+    iov.iov_len = num * sizeof(*results);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    while ((c = recvmsg(client.sock, &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+        ;
+    if (c == -1)
+        return -1;
+
+    if (rfd)
+        *rfd = -1;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            if (rfd)
+                memcpy(rfd, CMSG_DATA(cmsg), sizeof(int));
+            else
+                close(*(int *)CMSG_DATA(cmsg));
+        }
+    }
+
+    if (c != num * sizeof(*results)) {
+        /* the daemon closed the connection */
+        errno = ECONNRESET;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* must be called with the lock held */
+static int client_connect(void)
+{
+    struct ugpiod_op hello = { .op = UGPIOD_OP_HELLO };
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    const struct ugpiod_shm *shm;
+    struct stat st;
+    int32_t nlines;
+    int fd, err;
+
+    if (client.sock != -1)
+        return 0;
+
+    if (client.lost) {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    if ((client.sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1)
+        return -1;
+
+    strcpy(addr.sun_path, client.path);
+    if (connect(client.sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        goto err_close;
+
+    if (client_exchange(&hello, &nlines, 1, NULL, 0, &fd) == -1)
+        goto err_close;
+
+    if (nlines < 0 || fd == -1) {
+        if (fd != -1)
+            close(fd);
+        errno = (nlines < 0) ? -nlines : EPROTO;
+        goto err_close;
+    }
+
+    if (fstat(fd, &st) == -1 ||
+        (shm = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        err = errno;
+        close(fd);
+        errno = err;
+        goto err_close;
+    }
+    close(fd);
+
+    client.shm = shm;
+    client.shm_size = st.st_size;
+
+    if (shm->magic != UGPIOD_SHM_MAGIC || shm->version != UGPIOD_SHM_VERSION ||
+        st.st_size < sizeof(*shm) + shm->nlines * sizeof(shm->lines[0])) {
+        client_disconnect();
+        errno = EPROTO;
+        return -1;
+    }
+
+    return 0;
+
+err_close:
+    err = errno;
+    client_disconnect();
+    errno = err;
+    return -1;
+}
+
+/**
+ * Send a batch of operations to the daemon, connecting if necessary.
+ * Must be called with the lock held.
+ */
+static int client_call(const struct ugpiod_op *ops, int32_t *results, unsigned int num,
+                       const int *fds, unsigned int nfds)
+{
+    int err;
+
+    if (client_connect() == -1)
+        return -1;
+
+    if (client_exchange(ops, results, num, fds, nfds, NULL) == -1) {
+        err = errno;
+        client_disconnect();
+        errno = client.lost ? ENOTCONN : err;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* must be called with the lock held */
+static int client_op(unsigned int op, int attr, unsigned int gpio, int arg, int fd)
+{
+    struct ugpiod_op o = { .op = op, .attr = attr, .gpio = gpio, .arg = arg };
+    int32_t result;
+
+    if (client_call(&o, &result, 1, &fd, fd != -1) == -1)
+        return -1;
+
+    if (result < 0) {
+        errno = -result;
+        return -1;
+    }
+
+    return result;
+}
+
+/* must be called with the lock held */
+static void client_settle(void)
+{
+    /* all GPIOs of a lost connection are released, so connect afresh */
+    if (client.lost && client.acquired == 0 && client.subscribed == 0)
+        client.lost = 0;
+}
+
+/* must be called with the lock held, return the live value or -1 */
+static int client_shm_value(unsigned int gpio)
+{
+    uint32_t line;
+
+    if (client.shm == NULL || gpio >= client.shm->nlines)
+        return -1;
+
+    line = atomic_load_explicit(&client.shm->lines[gpio], memory_order_acquire);
+    if (!(line & UGPIOD_LINE_LIVE))
+        return -1;
+
+    return !!(line & UGPIOD_LINE_VALUE);
+}
+
+/* must be called with the lock held */
+static struct client_fd *client_fd(int fd)
+{
+    if (fd < 0 || fd >= client.nfds || !client.fds[fd].used) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    return &client.fds[fd];
+}
+
+/* reading the value acknowledges pending edges like sysfs does */
+static void client_acknowledge(int fd)
+{
+    uint64_t events;
+
+    (void)!read(fd, &events, sizeof(events));
+}
+
+static int client_attr(int attr)
+{
+    switch (attr) {
+    case GPIO_ATTR_DIRECTION:
+        return UGPIOD_ATTR_DIRECTION;
+    case GPIO_ATTR_ACTIVELOW:
+        return UGPIOD_ATTR_ACTIVELOW;
+    case GPIO_ATTR_VALUE:
+        return UGPIOD_ATTR_VALUE;
+    case GPIO_ATTR_EDGE:
+        return UGPIOD_ATTR_EDGE;
+    default:
+        return CLIENT_ATTR_CONTROL;
+    }
+}
+
+static int client_open(unsigned int gpio, const char *key, int flags)
+{
+    struct client_fd *fds;
+    int attr, fd, nfds;
+
+    if ((attr = gpio_key_attr(key)) == GPIO_ATTR_UNKNOWN) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    pthread_mutex_lock(&client.lock);
+
+    if (attr != GPIO_ATTR_EXPORT && attr != GPIO_ATTR_UNEXPORT) {
+        switch (client_op(UGPIOD_OP_CHECK, client_attr(attr), gpio, 0, -1)) {
+        case -1:
+            goto err_unlock;
+        case 0:
+            errno = ENOENT;
+            goto err_unlock;
+        }
+    }
+
+    fd = eventfd(0, EFD_NONBLOCK | ((flags & O_CLOEXEC) ? EFD_CLOEXEC : 0));
+    if (fd == -1)
+        goto err_unlock;
+
+    if (fd >= client.nfds) {
+        nfds = fd + 16;
+        if ((fds = realloc(client.fds, nfds * sizeof(*fds))) == NULL)
+            goto err_close;
+        memset(fds + client.nfds, 0, (nfds - client.nfds) * sizeof(*fds));
+        client.fds = fds;
+        client.nfds = nfds;
+    }
+
+    /* the daemon signals edges on a duplicate of the descriptor */
+    if (attr == GPIO_ATTR_VALUE &&
+        client_op(UGPIOD_OP_SUBSCRIBE, UGPIOD_ATTR_VALUE, gpio, fd, fd) == -1)
+        goto err_close;
+
+    if (attr == GPIO_ATTR_VALUE)
+        client.subscribed++;
+
+    client.fds[fd].used = 1;
+    client.fds[fd].gpio = gpio;
+    client.fds[fd].attr = client_attr(attr);
+    client.fds[fd].export = (attr == GPIO_ATTR_EXPORT);
+
+    pthread_mutex_unlock(&client.lock);
+    return fd;
+
+err_close:
+    close(fd);
+err_unlock:
+    pthread_mutex_unlock(&client.lock);
+    return -1;
+}
+
+static int client_close(int fd)
+{
+    struct client_fd *f;
+
+    pthread_mutex_lock(&client.lock);
+
+    if ((f = client_fd(fd)) == NULL) {
+        pthread_mutex_unlock(&client.lock);
+        return -1;
+    }
+
+    /* without connection the daemon has dropped the subscription already */
+    if (f->attr == UGPIOD_ATTR_VALUE) {
+        if (client.sock != -1)
+            client_op(UGPIOD_OP_UNSUBSCRIBE, UGPIOD_ATTR_VALUE, f->gpio, fd, -1);
+        client.subscribed--;
+        client_settle();
+    }
+
+    f->used = 0;
+
+    pthread_mutex_unlock(&client.lock);
+
+    return close(fd);
+}
+
+static ssize_t client_read(int fd, void *buf, size_t count)
+{
+    struct client_fd *f;
+    char text[16];
+    int attr, len, v;
+
+    pthread_mutex_lock(&client.lock);
+
+    if ((f = client_fd(fd)) == NULL)
+        goto err_unlock;
+
+    /* f points into client.fds, which a concurrent open may move */
+    attr = f->attr;
+
+    if (attr == CLIENT_ATTR_CONTROL) {
+        errno = EINVAL;
+        goto err_unlock;
+    }
+
+    if (attr == UGPIOD_ATTR_VALUE) {
+        client_acknowledge(fd);
+        if ((v = client_shm_value(f->gpio)) == -1 &&
+            (v = client_op(UGPIOD_OP_READ, attr, f->gpio, 0, -1)) == -1)
+            goto err_unlock;
+    } else {
+        if ((v = client_op(UGPIOD_OP_READ, attr, f->gpio, 0, -1)) == -1)
+            goto err_unlock;
+    }
+
+    pthread_mutex_unlock(&client.lock);
+
+    switch (attr) {
+    case UGPIOD_ATTR_DIRECTION:
+        len = snprintf(text, sizeof(text), "%s\n", (v == UGPIOD_DIR_IN) ? "in" : "out");
+        break;
+    case UGPIOD_ATTR_EDGE:
+        len = snprintf(text, sizeof(text), "%s\n", gpio_edge_name(v));
+        break;
+    default:
+        len = snprintf(text, sizeof(text), "%d\n", v);
+        break;
+    }
+
+    if (count > len)
+        count = len;
+    memcpy(buf, text, count);
+
+    return count;
+
+err_unlock:
+    pthread_mutex_unlock(&client.lock);
+    return -1;
+}
+
+static ssize_t client_write(int fd, const void *buf, size_t count)
+{
+    struct client_fd *f;
+    char text[16];
+    int rv = -1;
+    int arg;
+
+    if (count >= sizeof(text)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memcpy(text, buf, count);
+    text[count] = '\0';
+
+    pthread_mutex_lock(&client.lock);
+
+    if ((f = client_fd(fd)) == NULL)
+        goto out;
+
+    switch (f->attr) {
+    case CLIENT_ATTR_CONTROL:
+        if (f->export) {
+            if ((rv = client_op(UGPIOD_OP_ACQUIRE, 0, strtoul(text, NULL, 10), 0, -1)) == 0)
+                client.acquired++;
+            goto out;
+        }
+        /* the daemon released the GPIOs of a lost connection already */
+        if (client.lost)
+            rv = 0;
+        else
+            rv = client_op(UGPIOD_OP_RELEASE, 0, strtoul(text, NULL, 10), 0, -1);
+        if (rv == 0 && client.acquired) {
+            client.acquired--;
+            client_settle();
+        }
+        goto out;
+    case UGPIOD_ATTR_DIRECTION:
+        if (strncmp(text, "in", 2) == 0) {
+            arg = UGPIOD_DIR_IN;
+        } else if (strncmp(text, "out", 3) == 0 || strncmp(text, "low", 3) == 0) {
+            arg = UGPIOD_DIR_OUT_LOW;
+        } else if (strncmp(text, "high", 4) == 0) {
+            arg = UGPIOD_DIR_OUT_HIGH;
+        } else {
+            errno = EINVAL;
+            goto out;
+        }
+        break;
+    case UGPIOD_ATTR_EDGE:
+        if ((arg = gpio_edge_parse(text, count)) == -1) {
+            errno = EINVAL;
+            goto out;
+        }
+        break;
+    default:
+        arg = (text[0] != '0');
+        break;
+    }
+
+    rv = client_op(UGPIOD_OP_WRITE, f->attr, f->gpio, arg, -1);
+
+out:
+    pthread_mutex_unlock(&client.lock);
+    return (rv == -1) ? -1 : count;
+}
+
+static int client_check(unsigned int gpio, const char *key)
+{
+    int attr, rv;
+
+    if ((attr = gpio_key_attr(key)) == GPIO_ATTR_UNKNOWN)
+        return 0;
+
+    if (attr == GPIO_ATTR_EXPORT || attr == GPIO_ATTR_UNEXPORT)
+        return 1;
+
+    pthread_mutex_lock(&client.lock);
+    rv = client_op(UGPIOD_OP_CHECK, client_attr(attr), gpio, 0, -1);
+    pthread_mutex_unlock(&client.lock);
+
+    return rv;
+}
+
+static int client_get_values(const int *fds, unsigned int num, uint64_t *bits)
+{
+    struct ugpiod_op ops[UGPIOD_MAX_OPS];
+    int32_t results[UGPIOD_MAX_OPS];
+    unsigned int idx[UGPIOD_MAX_OPS];
+    struct client_fd *f;
+    unsigned int i, n = 0;
+    int rv = -1;
+    int v;
+
+    *bits = 0;
+
+    pthread_mutex_lock(&client.lock);
+
+    if (client_connect() == -1)
+        goto out;
+
+    /* live values come from the shared memory, the rest in one request */
+    for (i = 0; i < num; i++) {
+        if ((f = client_fd(fds[i])) == NULL)
+            goto out;
+        if (f->attr != UGPIOD_ATTR_VALUE) {
+            errno = EINVAL;
+            goto out;
+        }
+        client_acknowledge(fds[i]);
+        if ((v = client_shm_value(f->gpio)) == -1) {
+            ops[n].op = UGPIOD_OP_READ;
+            ops[n].attr = UGPIOD_ATTR_VALUE;
+            ops[n].gpio = f->gpio;
+            ops[n].arg = 0;
+            idx[n++] = i;
+        } else if (v) {
+            *bits |= UINT64_C(1) << i;
+        }
+    }
+
+    if (n) {
+        if (client_call(ops, results, n, NULL, 0) == -1)
+            goto out;
+        for (i = 0; i < n; i++) {
+            if (results[i] < 0) {
+                errno = -results[i];
+                goto out;
+            }
+            if (results[i])
+                *bits |= UINT64_C(1) << idx[i];
+        }
+    }
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&client.lock);
+    return rv;
+}
+
+static int client_set_values(const int *fds, unsigned int num, uint64_t mask, uint64_t bits)
+{
+    struct ugpiod_op ops[UGPIOD_MAX_OPS];
+    int32_t results[UGPIOD_MAX_OPS];
+    struct client_fd *f;
+    unsigned int i, n = 0;
+    int rv = -1;
+
+    pthread_mutex_lock(&client.lock);
+
+    for (i = 0; i < num; i++) {
+        if (!(mask & (UINT64_C(1) << i)))
+            continue;
+        if ((f = client_fd(fds[i])) == NULL)
+            goto out;
+        if (f->attr != UGPIOD_ATTR_VALUE) {
+            errno = EINVAL;
+            goto out;
+        }
+        ops[n].op = UGPIOD_OP_WRITE;
+        ops[n].attr = UGPIOD_ATTR_VALUE;
+        ops[n].gpio = f->gpio;
+        ops[n].arg = !!(bits & (UINT64_C(1) << i));
+        n++;
+    }
+
+    if (n && client_call(ops, results, n, NULL, 0) == -1)
+        goto out;
+
+    for (i = 0; i < n; i++) {
+        if (results[i] < 0) {
+            errno = -results[i];
+            goto out;
+        }
+    }
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&client.lock);
+    return rv;
+}
+
+const struct gpio_backend gpio_backend_client = {
+    .name = "client",
+    .poll_events = POLLIN,
+    .open = client_open,
+    .close = client_close,
+    .read = client_read,
+    .write = client_write,
+    .check = client_check,
+    .get_values = client_get_values,
+    .set_values = client_set_values,
+};
+
+int ugpio_set_client_socket(const char *path)
+{
+    if (path == NULL)
+        path = UGPIOD_SOCKET;
+
+    if (strlen(path) >= sizeof(client.path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    pthread_mutex_lock(&client.lock);
+    client_disconnect();
+    strcpy(client.path, path);
+    pthread_mutex_unlock(&client.lock);
+
+    return 0;
+}
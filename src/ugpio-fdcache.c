@@ -0,0 +1,282 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+#define FDCACHE_BUCKETS 256
+
+/**
+ * An open attribute file of the low level API.
+ */
+struct fdcache_entry {
+    unsigned int gpio;
+    int attr;
+    int accmode;
+    int fd;
+    /* the backend the file descriptor belongs to */
+    const struct gpio_backend *backend;
+    /* set while a thread does I/O on the file descriptor without the lock */
+    int busy;
+    /* set when a busy entry was removed, the I/O thread releases it */
+    int removed;
+    /* next entry in the same hash bucket */
+    struct fdcache_entry *hnext;
+    /* LRU list, most recently used first */
+    struct fdcache_entry *prev;
+    struct fdcache_entry *next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    /* the maximum number of cached file descriptors, 0 disables the cache */
+    unsigned int max;
+    unsigned int count;
+    /* the backend the cached file descriptors belong to */
+    const struct gpio_backend *backend;
+    struct fdcache_entry *buckets[FDCACHE_BUCKETS];
+    struct fdcache_entry *head;
+    struct fdcache_entry *tail;
+} fdcache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .max = GPIO_FD_CACHE_DEFAULT,
+};
+
+static unsigned int fdcache_hash(unsigned int gpio, int attr, int accmode)
+{
+    return (gpio * 31 + attr * 7 + accmode) & (FDCACHE_BUCKETS - 1);
+}
+
+static void fdcache_release(struct fdcache_entry *e)
+{
+    e->backend->close(e->fd);
+    free(e);
+}
+
+/* must be called with the lock held */
+static void fdcache_remove(struct fdcache_entry *e)
+{
+    struct fdcache_entry **p;
+
+    p = &fdcache.buckets[fdcache_hash(e->gpio, e->attr, e->accmode)];
+    while (*p != e)
+        p = &(*p)->hnext;
+    *p = e->hnext;
+
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        fdcache.head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        fdcache.tail = e->prev;
+
+    fdcache.count--;
+
+    if (e->busy)
+        e->removed = 1;
+    else
+        fdcache_release(e);
+}
+
+/* must be called with the lock held */
+static void fdcache_flush(void)
+{
+    while (fdcache.head)
+        fdcache_remove(fdcache.head);
+}
+
+/* must be called with the lock held */
+static struct fdcache_entry *fdcache_get(unsigned int gpio, const char *key, int accmode)
+{
+    struct fdcache_entry *e;
+    unsigned int h;
+    int attr;
+
+    if (fdcache.backend != gpio_backend) {
+        fdcache_flush();
+        fdcache.backend = gpio_backend;
+    }
+
+    attr = gpio_key_attr(key);
+    h = fdcache_hash(gpio, attr, accmode);
+
+    for (e = fdcache.buckets[h]; e; e = e->hnext) {
+        if (e->gpio == gpio && e->attr == attr && e->accmode == accmode) {
+            /* move to the front of the LRU list */
+            if (e->prev) {
+                e->prev->next = e->next;
+                if (e->next)
+                    e->next->prev = e->prev;
+                else
+                    fdcache.tail = e->prev;
+                e->prev = NULL;
+                e->next = fdcache.head;
+                fdcache.head->prev = e;
+                fdcache.head = e;
+            }
+            return e;
+        }
+    }
+
+    if ((e = malloc(sizeof(*e))) == NULL)
+        return NULL;
+
+    if ((e->fd = gpio_backend->open(gpio, key, accmode | O_CLOEXEC)) == -1) {
+        free(e);
+        return NULL;
+    }
+
+    while (fdcache.count >= fdcache.max && fdcache.tail)
+        fdcache_remove(fdcache.tail);
+
+    e->gpio = gpio;
+    e->attr = attr;
+    e->accmode = accmode;
+    e->backend = gpio_backend;
+    e->busy = 0;
+    e->removed = 0;
+    e->hnext = fdcache.buckets[h];
+    fdcache.buckets[h] = e;
+    e->prev = NULL;
+    e->next = fdcache.head;
+    if (fdcache.head)
+        fdcache.head->prev = e;
+    else
+        fdcache.tail = e;
+    fdcache.head = e;
+    fdcache.count++;
+
+    return e;
+}
+
+int gpio_fdcache_enabled(void)
+{
+    return fdcache.max != 0;
+}
+
+static ssize_t fdcache_fd_io(int fd, int accmode, void *buf, size_t count)
+{
+    if (accmode == O_RDONLY)
+        return gpio_fd_read(fd, buf, count);
+
+    return gpio_fd_write(fd, buf, count);
+}
+
+/* the file is in use by another thread, so do the I/O on a private one */
+static ssize_t fdcache_uncached_io(unsigned int gpio, const char *key, int accmode,
+                                   void *buf, size_t count)
+{
+    ssize_t c;
+    int fd, err;
+
+    if ((fd = gpio_backend->open(gpio, key, accmode | O_CLOEXEC)) == -1)
+        return -1;
+
+    c = fdcache_fd_io(fd, accmode, buf, count);
+
+    err = errno;
+    gpio_backend->close(fd);
+    errno = err;
+
+    return c;
+}
+
+ssize_t gpio_fdcache_io(unsigned int gpio, const char *key, int accmode,
+                        void *buf, size_t count)
+{
+    struct fdcache_entry *e;
+    ssize_t c = -1;
+    int retry, err;
+
+    /*
+     * A cached file becomes stale when the GPIO was unexported by someone
+     * else, so on failure try once more with a freshly opened file.
+     */
+    for (retry = 0; retry < 2; retry++) {
+        pthread_mutex_lock(&fdcache.lock);
+
+        if ((e = fdcache_get(gpio, key, accmode)) == NULL) {
+            pthread_mutex_unlock(&fdcache.lock);
+            break;
+        }
+
+        /*
+         * Sysfs reads seek the shared file offset, so a file is used by
+         * one thread at a time; the others fall back to a private file.
+         */
+        if (e->busy) {
+            pthread_mutex_unlock(&fdcache.lock);
+            return fdcache_uncached_io(gpio, key, accmode, buf, count);
+        }
+
+        /* pin the entry and do the I/O without blocking other threads */
+        e->busy = 1;
+        pthread_mutex_unlock(&fdcache.lock);
+
+        c = fdcache_fd_io(e->fd, accmode, buf, count);
+        err = errno;
+
+        pthread_mutex_lock(&fdcache.lock);
+        e->busy = 0;
+        if (e->removed)
+            fdcache_release(e);
+        else if (c == -1)
+            fdcache_remove(e);
+        pthread_mutex_unlock(&fdcache.lock);
+
+        errno = err;
+        if (c != -1 || (err != ENODEV && err != ENOENT && err != EBADF))
+            break;
+    }
+
+    return c;
+}
+
+void gpio_fdcache_flush(void)
+{
+    pthread_mutex_lock(&fdcache.lock);
+    if (fdcache.backend)
+        fdcache_flush();
+    pthread_mutex_unlock(&fdcache.lock);
+}
+
+void gpio_fdcache_invalidate(unsigned int gpio)
+{
+    struct fdcache_entry *e, *next;
+
+    pthread_mutex_lock(&fdcache.lock);
+
+    for (e = fdcache.head; e; e = next) {
+        next = e->next;
+        if (e->gpio == gpio)
+            fdcache_remove(e);
+    }
+
+    pthread_mutex_unlock(&fdcache.lock);
+}
+
+int gpio_set_fd_cache_size(unsigned int max_fds)
+{
+    pthread_mutex_lock(&fdcache.lock);
+
+    fdcache.max = max_fds;
+    while (fdcache.count > fdcache.max)
+        fdcache_remove(fdcache.tail);
+
+    pthread_mutex_unlock(&fdcache.lock);
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+/**
+ * State of the debounce/glitch filter of a GPIO context.
+ *
+ * A level change is reported once the new level was stable for stable_ns
+ * after the last edge and at least min_pulse_ns passed since the first edge.
+ */
+struct gpio_filter {
+    uint64_t stable_ns;
+    uint64_t min_pulse_ns;
+    /* the last reported value, -1 if unknown */
+    int stable;
+    /* whether a level change is being validated */
+    int pending;
+    uint64_t first_edge_ns;
+    uint64_t last_edge_ns;
+    atomic_uint_fast64_t raw_edges;
+    atomic_uint_fast64_t absorbed;
+    atomic_uint_fast64_t transitions;
+};
+
+static void filter_inc(atomic_uint_fast64_t *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static uint64_t filter_deadline(struct gpio_filter *f)
+{
+    uint64_t a = f->first_edge_ns + f->min_pulse_ns;
+    uint64_t b = f->last_edge_ns + f->stable_ns;
+
+    return (a > b) ? a : b;
+}
+
+int ugpio_set_debounce(ugpio_t *ctx, uint64_t stable_ns, uint64_t min_pulse_ns)
+{
+    struct gpio_filter *f;
+
+    if (stable_ns == 0 && min_pulse_ns == 0) {
+        free(ctx->filter);
+        ctx->filter = NULL;
+        return 0;
+    }
+
+    if ((f = ctx->filter) == NULL) {
+        if ((f = calloc(1, sizeof(*f))) == NULL)
+            return -1;
+        f->stable = -1;
+        ctx->filter = f;
+    }
+
+    f->stable_ns = stable_ns;
+    f->min_pulse_ns = min_pulse_ns;
+
+    return 0;
+}
+
+int ugpio_get_filter_stats(ugpio_t *ctx, struct ugpio_filter_stats *stats)
+{
+    struct gpio_filter *f = ctx->filter;
+
+    if (f == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    stats->raw_edges = atomic_load_explicit(&f->raw_edges, memory_order_relaxed);
+    stats->absorbed = atomic_load_explicit(&f->absorbed, memory_order_relaxed);
+    stats->transitions = atomic_load_explicit(&f->transitions, memory_order_relaxed);
+
+    return 0;
+}
+
+void gpio_filter_free(ugpio_t *ctx)
+{
+    free(ctx->filter);
+    ctx->filter = NULL;
+}
+
+void gpio_filter_init(ugpio_t *ctx, int value)
+{
+    if (ctx->filter && !ctx->filter->pending)
+        ctx->filter->stable = value;
+}
+
+int gpio_filter_edge(ugpio_t *ctx, int value, uint64_t now, uint64_t *deadline)
+{
+    struct gpio_filter *f = ctx->filter;
+
+    *deadline = 0;
+    filter_inc(&f->raw_edges);
+
+    if (f->stable == -1 || value == -1) {
+        f->stable = value;
+        filter_inc(&f->transitions);
+        return 1;
+    }
+
+    if (f->pending) {
+        /* a bounce within the window, restart the stable time */
+        filter_inc(&f->absorbed);
+        f->last_edge_ns = now;
+        *deadline = filter_deadline(f);
+        return 0;
+    }
+
+    if (value == f->stable) {
+        /* the line already returned to the reported level */
+        filter_inc(&f->absorbed);
+        return 0;
+    }
+
+    f->pending = 1;
+    f->first_edge_ns = now;
+    f->last_edge_ns = now;
+    *deadline = filter_deadline(f);
+
+    return 0;
+}
+
+int gpio_filter_expire(ugpio_t *ctx, int value)
+{
+    struct gpio_filter *f = ctx->filter;
+
+    f->pending = 0;
+
+    if (value == f->stable) {
+        /* the level change was only a glitch */
+        filter_inc(&f->absorbed);
+        return 0;
+    }
+
+    f->stable = value;
+    filter_inc(&f->transitions);
+
+    return 1;
+}
@@ -9,70 +9,249 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <errno.h>
 
 #include <config.h>
 #include <ugpio.h>
 #include <ugpio-internal.h>
 
-int gpio_fd_open(unsigned int gpio, const char *key, int flags)
+const struct gpio_backend *gpio_backend = &gpio_backend_sysfs;
+
+static const struct gpio_backend *gpio_backends[] = {
+    &gpio_backend_sysfs,
+    &gpio_backend_sim,
+    &gpio_backend_client,
+#if HAVE_DECL_GPIO_V2_GET_LINE_IOCTL
+    &gpio_backend_cdev,
+#endif
+};
+
+int ugpio_set_backend(const char *name)
 {
-    char pathname[255];
-    int rv;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(gpio_backends); i++) {
+        if (strcmp(gpio_backends[i]->name, name) == 0) {
+            gpio_backend = gpio_backends[i];
+            return 0;
+        }
+    }
 
-    rv = snprintf(pathname, sizeof(pathname), key, gpio);
-    if (rv < 0 || rv >= sizeof(pathname)) {
-        errno = ENOMEM;
+    errno = ENOENT;
+    return -1;
+}
+
+const char *ugpio_get_backend(void)
+{
+    return gpio_backend->name;
+}
+
+ssize_t ugpio_snapshot(struct ugpio_line_state **states)
+{
+    if (gpio_backend->snapshot == NULL) {
+        *states = NULL;
+        errno = ENOSYS;
         return -1;
     }
 
-    return open(pathname, flags | O_NONBLOCK);
+    return gpio_backend->snapshot(states);
 }
 
-int gpio_fd_close(int fd)
+char gpio_sysfs_root[PATH_MAX] = GPIO_ROOT;
+
+int ugpio_set_sysfs_root(const char *path)
 {
-    return close(fd);
+    if (path == NULL)
+        path = GPIO_ROOT;
+
+    if (strlen(path) >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    /* cached file descriptors belong to the previous tree */
+    gpio_fdcache_flush();
+    strcpy(gpio_sysfs_root, path);
+
+    return 0;
 }
 
-ssize_t gpio_fd_read(int fd, void *buf, size_t count)
+const char *ugpio_get_sysfs_root(void)
+{
+    return gpio_sysfs_root;
+}
+
+/*
+ * Build the path of the attribute 'key' of 'gpio' below the sysfs root.
+ */
+int gpio_sysfs_path(char *buf, size_t size, const char *key, unsigned int gpio)
 {
-    ssize_t ret;
-    ssize_t n = 0;
+    int n, rv;
+
+    n = snprintf(buf, size, "%s/", gpio_sysfs_root);
+    if (n < 0 || n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
 
-    if (lseek(fd, 0, SEEK_SET) < 0)
+    rv = snprintf(buf + n, size - n, key, gpio);
+    if (rv < 0 || rv >= size - n) {
+        errno = ENAMETOOLONG;
         return -1;
+    }
+
+    return 0;
+}
+
+uint64_t gpio_now_ns(void)
+{
+    struct timespec ts;
 
-    do {
-        ret = read(fd, (char *)buf + n, count - n);
-        if (ret < 0) {
-            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
-                continue; /* try again */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the longest sleep before checking whether to stop */
+#define GPIO_MAX_SLEEP_NS 100000000
+
+/*
+ * Sleep until the absolute CLOCK_MONOTONIC time deadline, so that the time
+ * spent before does not delay the wakeup. Returns -1 as soon as *stop is set.
+ */
+int gpio_sleep_until(uint64_t deadline, atomic_int *stop)
+{
+    struct timespec ts;
+    uint64_t now, until;
+
+    for (;;) {
+        if (atomic_load_explicit(stop, memory_order_relaxed))
             return -1;
-        }
-        n += ret;
-    } while (n < count && ret);
 
-    return n;
+        now = gpio_now_ns();
+        if (now >= deadline)
+            return 0;
+
+        until = (deadline - now > GPIO_MAX_SLEEP_NS) ? now + GPIO_MAX_SLEEP_NS : deadline;
+        ts.tv_sec = until / 1000000000;
+        ts.tv_nsec = until % 1000000000;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+}
+
+static const struct {
+    const char *key;
+    enum gpio_attr attr;
+} gpio_keys[] = {
+    { GPIO_EXPORT,    GPIO_ATTR_EXPORT },
+    { GPIO_UNEXPORT,  GPIO_ATTR_UNEXPORT },
+    { GPIO_DIRECTION, GPIO_ATTR_DIRECTION },
+    { GPIO_ACTIVELOW, GPIO_ATTR_ACTIVELOW },
+    { GPIO_VALUE,     GPIO_ATTR_VALUE },
+    { GPIO_EDGE,      GPIO_ATTR_EDGE },
+};
+
+int gpio_key_attr(const char *key)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(gpio_keys); i++)
+        if (gpio_keys[i].key == key || strcmp(gpio_keys[i].key, key) == 0)
+            return gpio_keys[i].attr;
+
+    return GPIO_ATTR_UNKNOWN;
+}
+
+int gpio_fd_open(unsigned int gpio, const char *key, int flags)
+{
+    return gpio_backend->open(gpio, key, flags | O_NONBLOCK);
+}
+
+int gpio_fd_close(int fd)
+{
+    return gpio_backend->close(fd);
+}
+
+ssize_t gpio_fd_read(int fd, void *buf, size_t count)
+{
+    ssize_t c;
+
+#if UGPIO_STATS
+    if (gpio_stats_enabled)
+        c = gpio_stats_read(fd, buf, count);
+    else
+#endif
+        c = gpio_backend->read(fd, buf, count);
+
+    GPIO_PROBE3(gpio_fd_read, fd, count, c);
+    return c;
 }
 
 ssize_t gpio_fd_write(int fd, const void *buf, size_t count)
 {
-    ssize_t ret;
-    ssize_t n = 0;
+    ssize_t c;
+
+#if UGPIO_STATS
+    if (gpio_stats_enabled)
+        c = gpio_stats_write(fd, buf, count);
+    else
+#endif
+        c = gpio_backend->write(fd, buf, count);
 
-    do {
-        ret = write(fd, (char *)buf + n, count - n);
-        if (ret < 0) {
-            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
-                continue; /* try again */
+    GPIO_PROBE3(gpio_fd_write, fd, count, c);
+    return c;
+}
+
+int gpio_fd_get_values(const int *fds, unsigned int num, uint64_t *bits)
+{
+    unsigned int i;
+    char buffer;
+
+#if UGPIO_STATS
+    if (gpio_stats_enabled && gpio_backend->get_values)
+        return gpio_stats_get_values(fds, num, bits);
+#endif
+
+    if (gpio_backend->get_values)
+        return gpio_backend->get_values(fds, num, bits);
+
+    *bits = 0;
+    for (i = 0; i < num; i++) {
+        if (gpio_fd_read(fds[i], &buffer, sizeof(buffer)) != sizeof(buffer))
             return -1;
-        }
-        n += ret;
-    } while (n < count);
+        if (buffer != '0')
+            *bits |= UINT64_C(1) << i;
+    }
+
+    return 0;
+}
+
+int gpio_fd_set_values(const int *fds, unsigned int num, uint64_t mask, uint64_t bits)
+{
+    unsigned int i;
+
+#if UGPIO_STATS
+    if (gpio_stats_enabled && gpio_backend->set_values)
+        return gpio_stats_set_values(fds, num, mask, bits);
+#endif
+
+    if (gpio_backend->set_values)
+        return gpio_backend->set_values(fds, num, mask, bits);
+
+    for (i = 0; i < num; i++) {
+        if (!(mask & (UINT64_C(1) << i)))
+            continue;
+        if (gpio_fd_write(fds[i], (bits & (UINT64_C(1) << i)) ? "1" : "0", 2) != 2)
+            return -1;
+    }
 
-    return n;
+    return 0;
 }
 
 static const struct {
@@ -85,64 +264,71 @@ static const struct {
     { "both",    GPIOF_TRIG_FALL | GPIOF_TRIG_RISE },
 };
 
-int gpio_fd_get_edge(int fd)
+int gpio_edge_parse(const char *buf, size_t count)
 {
-    char buffer[16];
+    size_t len;
     int i;
 
-    if (gpio_fd_read(fd, buffer, sizeof(buffer)) == -1)
-        return -1;
-
-    for (i = 0; i < ARRAY_SIZE(ugpio_triggers); i++)
-        if (strncmp(buffer, ugpio_triggers[i].name, strlen(ugpio_triggers[i].name)) == 0)
-             break;
-
-    if (i >= ARRAY_SIZE(ugpio_triggers)) {
-        errno = EFAULT;
-        return -1;
+    for (i = 0; i < ARRAY_SIZE(ugpio_triggers); i++) {
+        len = strlen(ugpio_triggers[i].name);
+        if (len <= count && strncmp(buf, ugpio_triggers[i].name, len) == 0)
+            return ugpio_triggers[i].flags;
     }
 
-    return ugpio_triggers[i].flags;
+    errno = EFAULT;
+    return -1;
 }
 
-int gpio_fd_set_edge(int fd, unsigned int flags)
+const char *gpio_edge_name(unsigned int flags)
 {
     int i;
 
     for (i = 0; i < ARRAY_SIZE(ugpio_triggers); i++)
         if ((flags & GPIOF_TRIGGER_MASK) == ugpio_triggers[i].flags)
-            break;
+            return ugpio_triggers[i].name;
+
+    errno = EINVAL;
+    return NULL;
+}
+
+int gpio_fd_get_edge(int fd)
+{
+    char buffer[16];
+    ssize_t c;
 
-    if (i >= ARRAY_SIZE(ugpio_triggers)) {
-        errno = EINVAL;
+    if ((c = gpio_fd_read(fd, buffer, sizeof(buffer))) == -1)
         return -1;
-    }
 
-    return gpio_fd_write(fd, ugpio_triggers[i].name,
-                         strlen(ugpio_triggers[i].name) + 1);
+    return gpio_edge_parse(buffer, c);
+}
+
+int gpio_fd_set_edge(int fd, unsigned int flags)
+{
+    const char *name;
+
+    if ((name = gpio_edge_name(flags)) == NULL)
+        return -1;
+
+    return gpio_fd_write(fd, name, strlen(name) + 1);
 }
 
 ssize_t gpio_read(unsigned int gpio, const char *key, char *buf, size_t count)
 {
-    char pathname[255];
     ssize_t c;
     int fd;
 
-    fd = snprintf(pathname, sizeof(pathname), key, gpio);
-    if (fd < 0 || fd >= sizeof(pathname)) {
-        errno = ENOMEM;
-        return -1;
-    }
+    if (gpio_fdcache_enabled())
+        return gpio_fdcache_io(gpio, key, O_RDONLY, buf, count);
 
-    if ((fd = open(pathname, O_RDONLY | O_CLOEXEC)) == -1)
+    if ((fd = gpio_backend->open(gpio, key, O_RDONLY | O_CLOEXEC)) == -1)
         return -1;
 
     if ((c = gpio_fd_read(fd, buf, count)) == -1) {
-        close(fd);
+        gpio_fd_close(fd);
         return -1;
     }
 
-    if (close(fd) == -1)
+    if (gpio_fd_close(fd) == -1)
         return -1;
 
     return c;
@@ -150,45 +336,59 @@ ssize_t gpio_read(unsigned int gpio, const char *key, char *buf, size_t count)
 
 int gpio_write(unsigned int gpio, const char *key, const char *buf, size_t count)
 {
-    char pathname[255];
     int fd;
 
-    fd = snprintf(pathname, sizeof(pathname), key, gpio);
-    if (fd < 0 || fd >= sizeof(pathname)) {
-        errno = ENOMEM;
-        return -1;
-    }
+    if (gpio_fdcache_enabled())
+        return (gpio_fdcache_io(gpio, key, O_WRONLY, (void *)buf, count) != count) ? -1 : 0;
 
-    if ((fd = open(pathname, O_WRONLY)) == -1)
+    if ((fd = gpio_backend->open(gpio, key, O_WRONLY)) == -1)
         return -1;
 
     if (gpio_fd_write(fd, buf, count) != count) {
-        close(fd);
+        gpio_fd_close(fd);
         return -1;
     }
 
-    return close(fd);
+    return gpio_fd_close(fd);
 }
 
 int gpio_check(unsigned int gpio, const char *key)
 {
-    int fd;
-    char pathname[255];
+    return gpio_backend->check(gpio, key);
+}
 
-    snprintf(pathname, sizeof(pathname), key, gpio);
+int gpio_probe(unsigned int gpio, struct gpio_probe *probe)
+{
+    int rv;
 
-    fd = open(pathname, O_RDONLY | O_CLOEXEC);
+    if (gpio_backend->probe)
+        return gpio_backend->probe(gpio, probe);
 
-    /* file does not exist */
-    if (fd == -1 && errno == ENOENT)
-        return 0;
+    probe->flags = 0;
+    probe->valid = 0;
 
-    /* an unexpected error occured */
-    if (fd == -1)
+    if ((probe->exported = gpio_check(gpio, GPIO_VALUE)) < 1)
+        return probe->exported;
+
+    if ((rv = gpio_check(gpio, GPIO_DIRECTION)) < 0)
         return -1;
+    if (rv) {
+        probe->flags |= GPIOF_ALTERABLE_DIRECTION;
+        if ((rv = gpio_get_direction(gpio)) != -1) {
+            probe->flags |= rv;
+            probe->valid |= UGPIO_CHANGED_DIRECTION;
+        }
+    }
 
-    /* file exists, so cleanup */
-    close(fd);
+    if ((rv = gpio_check(gpio, GPIO_EDGE)) < 0)
+        return -1;
+    if (rv) {
+        probe->flags |= GPIOF_ALTERABLE_EDGE;
+        if ((rv = gpio_get_edge(gpio)) != -1) {
+            probe->flags |= rv;
+            probe->valid |= UGPIO_CHANGED_EDGE;
+        }
+    }
 
-    return 1;
+    return 0;
 }
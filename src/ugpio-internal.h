@@ -7,17 +7,24 @@
 #ifndef UGPIO_INTERNAL_H
 #define UGPIO_INTERNAL_H
 
+#include <sys/types.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 #endif
 
+/* the default sysfs root, the keys below are relative to the current one */
 #define GPIO_ROOT "/sys/class/gpio"
-#define GPIO_EXPORT    GPIO_ROOT "/export"
-#define GPIO_UNEXPORT  GPIO_ROOT "/unexport"
-#define GPIO_DIRECTION GPIO_ROOT "/gpio%d/direction"
-#define GPIO_ACTIVELOW GPIO_ROOT "/gpio%d/active_low"
-#define GPIO_VALUE     GPIO_ROOT "/gpio%d/value"
-#define GPIO_EDGE      GPIO_ROOT "/gpio%d/edge"
+#define GPIO_EXPORT    "export"
+#define GPIO_UNEXPORT  "unexport"
+#define GPIO_DIRECTION "gpio%d/direction"
+#define GPIO_ACTIVELOW "gpio%d/active_low"
+#define GPIO_VALUE     "gpio%d/value"
+#define GPIO_EDGE      "gpio%d/edge"
+#define GPIO_DIR       "gpio%d"
 
 /**
  * A structure describing a GPIO with configuration.
@@ -37,20 +44,220 @@ struct gpio {
     int fd_edge;
     /* a literal description string of this GPIO */
     const char *label;
+    /* debounce/glitch filter state, NULL if disabled */
+    struct gpio_filter *filter;
+    /* shadow state, see GPIOF_CACHED */
+    unsigned int cache_valid;
+    int value;
+    int active_low;
+    ugpio_change_cb change_cb;
+    void *change_userdata;
+#if UGPIO_STATS
+    /* operation statistics */
+    struct ugpio_stats stats;
+#endif
+};
+
+/*
+ * Record a value written to the context's value file other than through
+ * ugpio_set_value, -1 if the write failed and the level is unknown.
+ */
+void gpio_value_written(ugpio_t *ctx, int value);
+
+/**
+ * The attributes of a GPIO as addressed by the GPIO_* keys above.
+ */
+enum gpio_attr {
+    GPIO_ATTR_UNKNOWN = -1,
+    GPIO_ATTR_EXPORT,
+    GPIO_ATTR_UNEXPORT,
+    GPIO_ATTR_DIRECTION,
+    GPIO_ATTR_ACTIVELOW,
+    GPIO_ATTR_VALUE,
+    GPIO_ATTR_EDGE,
+};
+
+/**
+ * What a single discovery pass learned about a GPIO.
+ */
+struct gpio_probe {
+    /* whether the GPIO is exported at all */
+    int exported;
+    /* GPIOF_ALTERABLE_* and the direction/trigger flags which were read */
+    unsigned int flags;
+    /* UGPIO_CHANGED_DIRECTION/_EDGE for the attributes which were read */
+    unsigned int valid;
 };
 
+/**
+ * I/O backend
+ *
+ * All file operations of the library are routed through the currently
+ * selected backend. A backend hands out file descriptors for the attributes
+ * of a GPIO (see the GPIO_* keys) and reads/writes them using the textual
+ * format of the sysfs interface, so that all higher layers are independent
+ * of the actual backend.
+ */
+struct gpio_backend {
+    /* name used to select this backend */
+    const char *name;
+    /* poll() events signalled on the value file descriptor for edges */
+    short poll_events;
+    /* open the attribute 'key' of 'gpio', return a file descriptor */
+    int (*open)(unsigned int gpio, const char *key, int flags);
+    /* close a file descriptor returned by open */
+    int (*close)(int fd);
+    /* read the attribute from its beginning */
+    ssize_t (*read)(int fd, void *buf, size_t count);
+    /* write to the attribute */
+    ssize_t (*write)(int fd, const void *buf, size_t count);
+    /* check whether the attribute exists: 1 yes, 0 no, -1 on error */
+    int (*check)(unsigned int gpio, const char *key);
+    /* optional: read several value descriptors at once, bit i for fds[i] */
+    int (*get_values)(const int *fds, unsigned int num, uint64_t *bits);
+    /* optional: write the bits selected by mask to several value descriptors */
+    int (*set_values)(const int *fds, unsigned int num, uint64_t mask, uint64_t bits);
+    /* optional: discover all attributes of a GPIO in one pass */
+    int (*probe)(unsigned int gpio, struct gpio_probe *probe);
+    /* optional: wait until freshly exported GPIOs are accessible */
+    int (*wait_ready)(const unsigned int *gpios, size_t num, int timeout_ms);
+    /* optional: read the state of all exported GPIOs, see ugpio_snapshot */
+    ssize_t (*snapshot)(struct ugpio_line_state **states);
+};
+
+extern const struct gpio_backend gpio_backend_sysfs;
+extern const struct gpio_backend gpio_backend_sim;
+extern const struct gpio_backend gpio_backend_client;
+#if HAVE_DECL_GPIO_V2_GET_LINE_IOCTL
+extern const struct gpio_backend gpio_backend_cdev;
+
+/* the ioctl entry point of the cdev backend, replaceable for testing */
+extern int (*gpio_cdev_ioctl)(int fd, unsigned long request, void *arg);
+/* the directory of the gpiochipN devices, replaceable for testing */
+extern char gpio_cdev_dir[];
+#endif
+
+/* the currently selected backend */
+extern const struct gpio_backend *gpio_backend;
+
+/* the sysfs root, GPIO_ROOT unless changed by ugpio_set_sysfs_root */
+extern char gpio_sysfs_root[];
+
+int gpio_sysfs_path(char *buf, size_t size, const char *key, unsigned int gpio);
+
 /**
  * Internal helpers
  */
+uint64_t gpio_now_ns(void);
+int gpio_sleep_until(uint64_t deadline, atomic_int *stop);
+int gpio_key_attr(const char *key);
+int gpio_edge_parse(const char *buf, size_t count);
+const char *gpio_edge_name(unsigned int flags);
+
 int gpio_fd_open(unsigned int gpio, const char *key, int flags);
 int gpio_fd_close(int fd);
 ssize_t gpio_fd_read(int fd, void *buf, size_t count);
 ssize_t gpio_fd_write(int fd, const void *buf, size_t count);
+int gpio_fd_get_values(const int *fds, unsigned int num, uint64_t *bits);
+int gpio_fd_set_values(const int *fds, unsigned int num, uint64_t mask, uint64_t bits);
 int gpio_fd_get_edge(int fd);
 int gpio_fd_set_edge(int fd, unsigned int flags);
 
+/* default number of file descriptors kept open by the low level API */
+#define GPIO_FD_CACHE_DEFAULT 64
+
+int gpio_fdcache_enabled(void);
+ssize_t gpio_fdcache_io(unsigned int gpio, const char *key, int accmode,
+                        void *buf, size_t count);
+void gpio_fdcache_invalidate(unsigned int gpio);
+void gpio_fdcache_flush(void);
+
 ssize_t gpio_read(unsigned int gpio, const char *key, char *buf, size_t count);
 int gpio_write(unsigned int gpio, const char *key, const char *buf, size_t count);
 int gpio_check(unsigned int gpio, const char *key);
+int gpio_probe(unsigned int gpio, struct gpio_probe *probe);
+
+/**
+ * Debounce/glitch filter, applied by the event loop
+ *
+ * gpio_filter_edge returns 1 when the value is to be reported right away,
+ * otherwise 0 and the time at which gpio_filter_expire has to be called
+ * with the then current value in deadline (0 if no timer is needed).
+ */
+void gpio_filter_init(ugpio_t *ctx, int value);
+int gpio_filter_edge(ugpio_t *ctx, int value, uint64_t now, uint64_t *deadline);
+int gpio_filter_expire(ugpio_t *ctx, int value);
+void gpio_filter_free(ugpio_t *ctx);
+
+/*
+ * The time the event loop returned from its last wait, i.e. the best
+ * estimate of when the events being dispatched occurred.
+ */
+struct ugpio_loop;
+uint64_t gpio_loop_wakeup_ns(struct ugpio_loop *loop);
+
+/**
+ * Operation statistics, compiled in with --enable-stats
+ *
+ * The file descriptors of a context are bound to it, so that gpio_fd_read
+ * and gpio_fd_write can account their operations to the context. Backends
+ * count their system calls and retries with GPIO_STATS_SYSCALL and
+ * GPIO_STATS_RETRY, which account to the operation in progress.
+ */
+#if UGPIO_STATS
+extern int gpio_stats_enabled;
+
+void gpio_stats_bind(int fd, ugpio_t *ctx);
+void gpio_stats_unbind(int fd);
+void gpio_stats_syscall(int retry);
+ssize_t gpio_stats_read(int fd, void *buf, size_t count);
+ssize_t gpio_stats_write(int fd, const void *buf, size_t count);
+int gpio_stats_get_values(const int *fds, unsigned int num, uint64_t *bits);
+int gpio_stats_set_values(const int *fds, unsigned int num, uint64_t mask, uint64_t bits);
+
+#define GPIO_STATS_SYSCALL() \
+    do { if (gpio_stats_enabled) gpio_stats_syscall(0); } while (0)
+#define GPIO_STATS_RETRY() \
+    do { if (gpio_stats_enabled) gpio_stats_syscall(1); } while (0)
+#else
+#define gpio_stats_bind(fd, ctx) do { } while (0)
+#define gpio_stats_unbind(fd) do { } while (0)
+#define GPIO_STATS_SYSCALL() do { } while (0)
+#define GPIO_STATS_RETRY() do { } while (0)
+#endif
+
+/**
+ * Flight recorder and static tracepoints
+ *
+ * GPIO_PROBEn places a USDT probe into the code when sys/sdt.h is available,
+ * which is a single nop until a tracer attaches.
+ */
+extern int gpio_trace_enabled;
+
+void gpio_trace_record(unsigned int type, unsigned int gpio, int value, int error);
+
+#define GPIO_TRACE(type, gpio, value) \
+    do { \
+        if (__builtin_expect(gpio_trace_enabled, 0)) \
+            gpio_trace_record(type, gpio, value, 0); \
+    } while (0)
+
+/* record a failed operation, errno is preserved */
+#define GPIO_TRACE_ERROR(type, gpio) \
+    do { \
+        if (__builtin_expect(gpio_trace_enabled, 0)) \
+            gpio_trace_record(UGPIO_TRACE_ERROR, gpio, type, errno); \
+    } while (0)
+
+#if HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define GPIO_PROBE1(name, a) STAP_PROBE1(ugpio, name, a)
+#define GPIO_PROBE2(name, a, b) STAP_PROBE2(ugpio, name, a, b)
+#define GPIO_PROBE3(name, a, b, c) STAP_PROBE3(ugpio, name, a, b, c)
+#else
+#define GPIO_PROBE1(name, a) do { } while (0)
+#define GPIO_PROBE2(name, a, b) do { } while (0)
+#define GPIO_PROBE3(name, a, b, c) do { } while (0)
+#endif
 
 #endif  /* UGPIO_INTERNAL_H */
@@ -0,0 +1,444 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpio-internal.h>
+
+#define LOOP_MAX_EVENTS 64
+
+enum loop_source_type {
+    LOOP_SOURCE_WAKE,
+    LOOP_SOURCE_GPIO,
+    LOOP_SOURCE_TIMER,
+    LOOP_SOURCE_FILTER,
+};
+
+/**
+ * Anything the loop waits for.
+ */
+struct loop_source {
+    enum loop_source_type type;
+    /* the file descriptor registered with epoll */
+    int fd;
+    /* set when removed while the loop is dispatching */
+    int removed;
+    /* the GPIO context of LOOP_SOURCE_GPIO */
+    ugpio_t *ctx;
+    ugpio_loop_cb cb;
+    ugpio_timer_cb timer_cb;
+    void *userdata;
+    /* the filter timer of LOOP_SOURCE_GPIO, created on demand */
+    struct loop_source *filter_timer;
+    /* the LOOP_SOURCE_GPIO a LOOP_SOURCE_FILTER belongs to */
+    struct loop_source *owner;
+    struct loop_source *prev;
+    struct loop_source *next;
+};
+
+struct ugpio_timer {
+    struct loop_source source;
+};
+
+struct ugpio_loop {
+    /* the epoll instance */
+    int epfd;
+    /* eventfd used to wake up the loop from other threads */
+    struct loop_source wake;
+    /* set by ugpio_loop_stop */
+    volatile sig_atomic_t stopped;
+    /* whether callbacks are being dispatched */
+    int dispatching;
+    /* when epoll_wait returned for the events being dispatched */
+    uint64_t wakeup_ns;
+    /* all registered sources */
+    struct loop_source *sources;
+    /* the LOOP_SOURCE_GPIO sources indexed by their file descriptor */
+    struct loop_source **gpios;
+    int ngpios;
+    /* sources removed during dispatching, freed afterwards */
+    struct loop_source *garbage;
+};
+
+ugpio_loop_t *ugpio_loop_new(void)
+{
+    struct epoll_event ev = { .events = EPOLLIN };
+    ugpio_loop_t *loop;
+
+    if ((loop = calloc(1, sizeof(*loop))) == NULL)
+        return NULL;
+
+    loop->wake.type = LOOP_SOURCE_WAKE;
+
+    if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+        goto err_free;
+
+    if ((loop->wake.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+        goto err_close;
+
+    ev.data.ptr = &loop->wake;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wake.fd, &ev) == -1)
+        goto err_close_wake;
+
+    return loop;
+
+err_close_wake:
+    close(loop->wake.fd);
+err_close:
+    close(loop->epfd);
+err_free:
+    free(loop);
+    return NULL;
+}
+
+static void loop_collect_garbage(ugpio_loop_t *loop)
+{
+    struct loop_source *src;
+
+    while ((src = loop->garbage) != NULL) {
+        loop->garbage = src->next;
+        free(src);
+    }
+}
+
+static void loop_unlink(ugpio_loop_t *loop, struct loop_source *src)
+{
+    if (src->filter_timer)
+        loop_unlink(loop, src->filter_timer);
+    if (src->owner)
+        src->owner->filter_timer = NULL;
+
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+
+    if (src->type == LOOP_SOURCE_GPIO && loop->gpios[src->fd] == src)
+        loop->gpios[src->fd] = NULL;
+
+    if (src->prev)
+        src->prev->next = src->next;
+    else
+        loop->sources = src->next;
+    if (src->next)
+        src->next->prev = src->prev;
+
+    if (src->type == LOOP_SOURCE_TIMER || src->type == LOOP_SOURCE_FILTER)
+        close(src->fd);
+
+    if (loop->dispatching) {
+        /* the source might still be referenced by pending events */
+        src->removed = 1;
+        src->next = loop->garbage;
+        loop->garbage = src;
+    } else {
+        free(src);
+    }
+}
+
+void ugpio_loop_free(ugpio_loop_t *loop)
+{
+    if (loop == NULL)
+        return;
+
+    loop->dispatching = 0;
+    while (loop->sources)
+        loop_unlink(loop, loop->sources);
+    loop_collect_garbage(loop);
+
+    close(loop->wake.fd);
+    close(loop->epfd);
+    free(loop->gpios);
+    free(loop);
+}
+
+int ugpio_loop_fd(ugpio_loop_t *loop)
+{
+    return loop->epfd;
+}
+
+static int loop_link(ugpio_loop_t *loop, struct loop_source *src, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, src->fd, &ev) == -1)
+        return -1;
+
+    src->prev = NULL;
+    src->next = loop->sources;
+    if (loop->sources)
+        loop->sources->prev = src;
+    loop->sources = src;
+
+    return 0;
+}
+
+static int loop_read_value(struct loop_source *src)
+{
+    char buffer;
+
+    if (gpio_fd_read(src->fd, &buffer, sizeof(buffer)) != sizeof(buffer))
+        return -1;
+
+    return !!(buffer - '0');
+}
+
+/* a watched context is found through its value file descriptor */
+static struct loop_source *loop_find(ugpio_loop_t *loop, ugpio_t *ctx)
+{
+    struct loop_source *src;
+    int fd = ctx->fd_value;
+
+    if (fd < 0 || fd >= loop->ngpios)
+        return NULL;
+
+    src = loop->gpios[fd];
+    return (src && src->ctx == ctx) ? src : NULL;
+}
+
+static int loop_reserve(ugpio_loop_t *loop, int fd)
+{
+    struct loop_source **gpios;
+    int n;
+
+    if (fd < loop->ngpios)
+        return 0;
+
+    n = fd + 16;
+    if ((gpios = realloc(loop->gpios, n * sizeof(*gpios))) == NULL)
+        return -1;
+    memset(gpios + loop->ngpios, 0, (n - loop->ngpios) * sizeof(*gpios));
+    loop->gpios = gpios;
+    loop->ngpios = n;
+
+    return 0;
+}
+
+int ugpio_loop_add(ugpio_loop_t *loop, ugpio_t *ctx, ugpio_loop_cb cb, void *userdata)
+{
+    struct loop_source *src;
+
+    if (ugpio_open(ctx) == -1)
+        return -1;
+
+    if (loop_find(loop, ctx)) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    if (loop_reserve(loop, ctx->fd_value) == -1)
+        return -1;
+
+    if ((src = calloc(1, sizeof(*src))) == NULL)
+        return -1;
+
+    src->type = LOOP_SOURCE_GPIO;
+    src->fd = ctx->fd_value;
+    src->ctx = ctx;
+    src->cb = cb;
+    src->userdata = userdata;
+
+    /* sysfs reports an event until the value was read once */
+    gpio_filter_init(ctx, loop_read_value(src));
+
+    /* poll and epoll event bits are identical on Linux */
+    if (loop_link(loop, src, gpio_backend->poll_events) == -1) {
+        free(src);
+        return -1;
+    }
+    loop->gpios[src->fd] = src;
+
+    return 0;
+}
+
+int ugpio_loop_remove(ugpio_loop_t *loop, ugpio_t *ctx)
+{
+    struct loop_source *src;
+
+    if ((src = loop_find(loop, ctx)) == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    loop_unlink(loop, src);
+    return 0;
+}
+
+int ugpio_timer_set(ugpio_timer_t *timer, uint64_t interval_ns, int periodic)
+{
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+
+    its.it_value.tv_sec = interval_ns / 1000000000;
+    its.it_value.tv_nsec = interval_ns % 1000000000;
+    if (periodic)
+        its.it_interval = its.it_value;
+
+    return timerfd_settime(timer->source.fd, 0, &its, NULL);
+}
+
+ugpio_timer_t *ugpio_loop_add_timer(ugpio_loop_t *loop, uint64_t interval_ns, int periodic,
+                                    ugpio_timer_cb cb, void *userdata)
+{
+    ugpio_timer_t *timer;
+
+    if ((timer = calloc(1, sizeof(*timer))) == NULL)
+        return NULL;
+
+    timer->source.type = LOOP_SOURCE_TIMER;
+    timer->source.timer_cb = cb;
+    timer->source.userdata = userdata;
+
+    timer->source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer->source.fd == -1)
+        goto err_free;
+
+    if (ugpio_timer_set(timer, interval_ns, periodic) == -1)
+        goto err_close;
+
+    if (loop_link(loop, &timer->source, EPOLLIN) == -1)
+        goto err_close;
+
+    return timer;
+
+err_close:
+    close(timer->source.fd);
+err_free:
+    free(timer);
+    return NULL;
+}
+
+void ugpio_loop_remove_timer(ugpio_loop_t *loop, ugpio_timer_t *timer)
+{
+    if (timer)
+        loop_unlink(loop, &timer->source);
+}
+
+static int loop_arm_filter(ugpio_loop_t *loop, struct loop_source *src, uint64_t deadline)
+{
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+    struct loop_source *timer = src->filter_timer;
+
+    if (timer == NULL) {
+        if ((timer = calloc(1, sizeof(*timer))) == NULL)
+            return -1;
+
+        timer->type = LOOP_SOURCE_FILTER;
+        timer->owner = src;
+        timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer->fd == -1 || loop_link(loop, timer, EPOLLIN) == -1) {
+            if (timer->fd != -1)
+                close(timer->fd);
+            free(timer);
+            return -1;
+        }
+        src->filter_timer = timer;
+    }
+
+    its.it_value.tv_sec = deadline / 1000000000;
+    its.it_value.tv_nsec = deadline % 1000000000;
+
+    return timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void loop_dispatch(ugpio_loop_t *loop, struct loop_source *src)
+{
+    uint64_t expirations, deadline;
+    int value;
+
+    switch (src->type) {
+    case LOOP_SOURCE_WAKE:
+        (void)!read(src->fd, &expirations, sizeof(expirations));
+        break;
+    case LOOP_SOURCE_TIMER:
+        if (read(src->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            break;
+        src->timer_cb(loop, (ugpio_timer_t *)src, src->userdata);
+        break;
+    case LOOP_SOURCE_GPIO:
+        value = loop_read_value(src);
+        if (src->ctx->filter &&
+            !gpio_filter_edge(src->ctx, value, loop->wakeup_ns, &deadline)) {
+            /* without the timer the settled value would never be reported */
+            if (deadline == 0 || loop_arm_filter(loop, src, deadline) == 0)
+                break;
+            value = -1;
+        }
+        GPIO_TRACE(UGPIO_TRACE_EDGE, src->ctx->gpio, value);
+        if (src->cb)
+            src->cb(loop, src->ctx, value, src->userdata);
+        break;
+    case LOOP_SOURCE_FILTER:
+        if (read(src->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            break;
+        src = src->owner;
+        value = loop_read_value(src);
+        if (src->ctx->filter && !gpio_filter_expire(src->ctx, value))
+            break;
+        GPIO_TRACE(UGPIO_TRACE_EDGE, src->ctx->gpio, value);
+        if (src->cb)
+            src->cb(loop, src->ctx, value, src->userdata);
+        break;
+    }
+}
+
+uint64_t gpio_loop_wakeup_ns(ugpio_loop_t *loop)
+{
+    return loop->wakeup_ns;
+}
+
+int ugpio_loop_run_once(ugpio_loop_t *loop, int timeout_ms)
+{
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    struct loop_source *src;
+    int i, n;
+
+    n = epoll_wait(loop->epfd, events, LOOP_MAX_EVENTS, timeout_ms);
+    if (n == -1)
+        return (errno == EINTR) ? 0 : -1;
+
+    /* before reading any value, which would add its latency to the time */
+    loop->wakeup_ns = gpio_now_ns();
+
+    loop->dispatching = 1;
+    for (i = 0; i < n; i++) {
+        src = events[i].data.ptr;
+        if (!src->removed)
+            loop_dispatch(loop, src);
+    }
+    loop->dispatching = 0;
+
+    loop_collect_garbage(loop);
+
+    return n;
+}
+
+int ugpio_loop_run(ugpio_loop_t *loop)
+{
+    while (!loop->stopped)
+        if (ugpio_loop_run_once(loop, -1) == -1)
+            return -1;
+
+    loop->stopped = 0;
+    return 0;
+}
+
+void ugpio_loop_stop(ugpio_loop_t *loop)
+{
+    uint64_t one = 1;
+
+    loop->stopped = 1;
+    (void)!write(loop->wake.fd, &one, sizeof(one));
+}
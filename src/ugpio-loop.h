@@ -0,0 +1,170 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_LOOP_H
+#define UGPIO_LOOP_H
+
+#include "ugpio.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Event loop
+ *
+ * An event loop waits for edges on any number of GPIO contexts and for
+ * timers at once. It is based on epoll, so the cost of an iteration depends
+ * on the number of ready sources only. For each edge the loop reads the new
+ * value of the GPIO, which also re-arms the edge notification, and passes it
+ * to the callback of the context.
+ *
+ * A loop is meant to be run by a single thread, only ugpio_loop_stop may be
+ * called from other threads. Sources may be added and removed from within
+ * callbacks.
+ */
+
+struct ugpio_loop;
+typedef struct ugpio_loop ugpio_loop_t;
+
+struct ugpio_timer;
+typedef struct ugpio_timer ugpio_timer_t;
+
+/**
+ * Callback for edges of a GPIO context.
+ *
+ * @param loop the event loop
+ * @param ctx the GPIO context
+ * @param value the new value of the GPIO, -1 if it could not be read or
+ *        the filter of the context could not be armed
+ * @param userdata the pointer given at registration
+ */
+typedef void (*ugpio_loop_cb)(ugpio_loop_t *loop, ugpio_t *ctx, int value, void *userdata);
+
+/**
+ * Callback for timers.
+ *
+ * @param loop the event loop
+ * @param timer the timer
+ * @param userdata the pointer given at registration
+ */
+typedef void (*ugpio_timer_cb)(ugpio_loop_t *loop, ugpio_timer_t *timer, void *userdata);
+
+/**
+ * Create an event loop.
+ *
+ * @return returns a ugpio_loop_t object on success, NULL otherwise
+ */
+ugpio_loop_t *ugpio_loop_new(void);
+
+/**
+ * Release/free an event loop.
+ *
+ * All sources are removed, but the GPIO contexts are neither closed nor freed.
+ *
+ * @param loop an event loop
+ */
+void ugpio_loop_free(ugpio_loop_t *loop);
+
+/**
+ * Return the epoll file descriptor of the loop.
+ *
+ * The descriptor becomes readable when the loop has work to do, so it can
+ * be embedded into another event loop which then calls ugpio_loop_run_once
+ * with a timeout of 0.
+ *
+ * @param loop an event loop
+ */
+int ugpio_loop_fd(ugpio_loop_t *loop);
+
+/**
+ * Watch a GPIO context for edges.
+ *
+ * The context is opened if necessary. Which edges are reported depends on
+ * the edge configuration of the GPIO (see ugpio_set_edge).
+ *
+ * @param loop an event loop
+ * @param ctx a GPIO context
+ * @param cb the function to call on edges
+ * @param userdata a pointer passed to the callback
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EEXIST - the context is already watched by this loop.
+ */
+int ugpio_loop_add(ugpio_loop_t *loop, ugpio_t *ctx, ugpio_loop_cb cb, void *userdata);
+
+/**
+ * Stop watching a GPIO context.
+ *
+ * The context is looked up by its value file descriptor, so remove it from
+ * the loop before closing it.
+ *
+ * @param loop an event loop
+ * @param ctx a GPIO context
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         ENOENT - the context is not watched by this loop.
+ */
+int ugpio_loop_remove(ugpio_loop_t *loop, ugpio_t *ctx);
+
+/**
+ * Add a timer to the loop.
+ *
+ * @param loop an event loop
+ * @param interval_ns the time until the timer expires in nanoseconds
+ * @param periodic 1 to restart the timer after each expiry, 0 for a
+ *        one-shot timer which must still be removed with ugpio_loop_remove_timer
+ * @param cb the function to call when the timer expires
+ * @param userdata a pointer passed to the callback
+ * @return returns a ugpio_timer_t object on success, NULL otherwise
+ */
+ugpio_timer_t *ugpio_loop_add_timer(ugpio_loop_t *loop, uint64_t interval_ns, int periodic,
+                                    ugpio_timer_cb cb, void *userdata);
+
+/**
+ * Re-arm a timer.
+ *
+ * @param timer a timer
+ * @param interval_ns the time until the timer expires in nanoseconds,
+ *        0 disarms the timer
+ * @param periodic 1 to restart the timer after each expiry, 0 otherwise
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_timer_set(ugpio_timer_t *timer, uint64_t interval_ns, int periodic);
+
+/**
+ * Remove a timer from the loop and free it.
+ *
+ * @param loop an event loop
+ * @param timer a timer
+ */
+void ugpio_loop_remove_timer(ugpio_loop_t *loop, ugpio_timer_t *timer);
+
+/**
+ * Wait for events once and dispatch them.
+ *
+ * @param loop an event loop
+ * @param timeout_ms the maximum time to wait in milliseconds, -1 for infinite
+ * @return the number of dispatched events, -1 on error with errno set appropriately
+ */
+int ugpio_loop_run_once(ugpio_loop_t *loop, int timeout_ms);
+
+/**
+ * Run the loop until ugpio_loop_stop is called.
+ *
+ * @param loop an event loop
+ * @return 0 when stopped, -1 on error with errno set appropriately
+ */
+int ugpio_loop_run(ugpio_loop_t *loop);
+
+/**
+ * Stop a running loop.
+ *
+ * This function may be called from any thread and from signal handlers.
+ *
+ * @param loop an event loop
+ */
+void ugpio_loop_stop(ugpio_loop_t *loop);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_LOOP_H */
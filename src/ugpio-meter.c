@@ -0,0 +1,176 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpio-meter.h>
+#include <ugpio-internal.h>
+
+/**
+ * The published measurements are protected by a sequence lock: the loop
+ * makes the sequence odd while it updates them, readers retry when they saw
+ * an odd or changed sequence.
+ */
+struct ugpio_meter {
+    ugpio_loop_t *loop;
+    ugpio_t *ctx;
+    uint64_t window_ns;
+
+    atomic_uint seq;
+    struct ugpio_meter_reading reading;
+
+    /* private to the loop: the last rising and falling edge */
+    uint64_t last_rise;
+    uint64_t last_fall;
+    /* private to the loop: the current window */
+    uint64_t window_start;
+    uint64_t window_sum;
+    uint64_t window_periods;
+};
+
+static void meter_edge(ugpio_loop_t *loop, ugpio_t *ctx, int value, void *userdata)
+{
+    ugpio_meter_t *meter = userdata;
+    struct ugpio_meter_reading *r = &meter->reading;
+    uint64_t now = gpio_loop_wakeup_ns(loop);
+    uint64_t *last, *other;
+    unsigned int seq;
+
+    (void)ctx;
+
+    if (value == -1)
+        return;
+
+    seq = atomic_load_explicit(&meter->seq, memory_order_relaxed);
+    atomic_store_explicit(&meter->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    r->edges++;
+    r->last_edge_ns = now;
+
+    if (value) {
+        r->rising++;
+        last = &meter->last_rise;
+        other = &meter->last_fall;
+    } else {
+        r->falling++;
+        last = &meter->last_fall;
+        other = &meter->last_rise;
+    }
+
+    /* the pulse which just ended */
+    if (*other) {
+        if (value)
+            r->low_ns = now - *other;
+        else
+            r->high_ns = now - *other;
+
+        if (r->high_ns && r->low_ns)
+            r->duty_cycle = (double)r->high_ns / (r->high_ns + r->low_ns);
+    }
+
+    if (*last) {
+        r->period_ns = now - *last;
+        r->frequency = 1e9 / r->period_ns;
+
+        meter->window_sum += r->period_ns;
+        meter->window_periods++;
+    }
+    *last = now;
+
+    if (meter->window_ns) {
+        if (meter->window_start == 0) {
+            meter->window_start = now;
+        } else if (now - meter->window_start >= meter->window_ns) {
+            r->frequency_avg = meter->window_sum ?
+                1e9 * meter->window_periods / meter->window_sum : 0;
+            meter->window_start = now;
+            meter->window_sum = 0;
+            meter->window_periods = 0;
+        }
+    }
+
+    atomic_store_explicit(&meter->seq, seq + 2, memory_order_release);
+}
+
+ugpio_meter_t *ugpio_meter_new(ugpio_loop_t *loop, ugpio_t *ctx, uint64_t window_ns)
+{
+    ugpio_meter_t *meter;
+
+    if ((meter = calloc(1, sizeof(*meter))) == NULL)
+        return NULL;
+
+    meter->loop = loop;
+    meter->ctx = ctx;
+    meter->window_ns = window_ns;
+    atomic_init(&meter->seq, 0);
+
+    if (ugpio_loop_add(loop, ctx, meter_edge, meter) == -1) {
+        free(meter);
+        return NULL;
+    }
+
+    return meter;
+}
+
+void ugpio_meter_free(ugpio_meter_t *meter)
+{
+    if (meter == NULL)
+        return;
+
+    ugpio_loop_remove(meter->loop, meter->ctx);
+    free(meter);
+}
+
+void ugpio_meter_read(ugpio_meter_t *meter, struct ugpio_meter_reading *reading)
+{
+    unsigned int seq;
+
+    for (;;) {
+        seq = atomic_load_explicit(&meter->seq, memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        *reading = meter->reading;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&meter->seq, memory_order_relaxed) == seq)
+            break;
+    }
+
+    /* the signal stopped */
+    if (meter->window_ns && reading->last_edge_ns &&
+        gpio_now_ns() - reading->last_edge_ns > meter->window_ns) {
+        reading->frequency = 0;
+        reading->frequency_avg = 0;
+    }
+}
+
+void ugpio_meter_reset(ugpio_meter_t *meter)
+{
+    unsigned int seq = atomic_load_explicit(&meter->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&meter->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memset(&meter->reading, 0, sizeof(meter->reading));
+    meter->last_rise = 0;
+    meter->last_fall = 0;
+    meter->window_start = 0;
+    meter->window_sum = 0;
+    meter->window_periods = 0;
+
+    atomic_store_explicit(&meter->seq, seq + 2, memory_order_release);
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_METER_H
+#define UGPIO_METER_H
+
+#include "ugpio.h"
+#include "ugpio-loop.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Input capture
+ *
+ * A meter measures the edges of an input context configured for edges
+ * (GPIOF_TRIG_*) without involving the application: it registers itself
+ * with an event loop and updates its measurements from within the loop for
+ * every edge, typically with the loop running in a thread of its own.
+ * Any thread may query the measurements at any time, the query neither locks
+ * nor makes a syscall.
+ *
+ * The period is the time between two consecutive edges of the same polarity,
+ * so it is measured for rising, falling or both edges. The pulse widths need
+ * both edges. The average frequency is calculated over all periods completed
+ * within a window of the given length and is updated at the first edge after
+ * the window elapsed. If no edge arrived for longer than the window, both
+ * frequencies are reported as 0.
+ */
+
+/**
+ * The measurements of a meter.
+ */
+struct ugpio_meter_reading {
+    /* the number of edges, and of rising and falling edges */
+    uint64_t edges;
+    uint64_t rising;
+    uint64_t falling;
+    /* CLOCK_MONOTONIC time of the last edge in nanoseconds, 0 if none */
+    uint64_t last_edge_ns;
+    /* the last complete period, 0 if none */
+    uint64_t period_ns;
+    /* the last complete high and low pulse, 0 if none */
+    uint64_t high_ns;
+    uint64_t low_ns;
+    /* the frequency of the last period in Hz */
+    double frequency;
+    /* the average frequency of the last window in Hz */
+    double frequency_avg;
+    /* high_ns / (high_ns + low_ns), 0 if unknown */
+    double duty_cycle;
+};
+
+struct ugpio_meter;
+typedef struct ugpio_meter ugpio_meter_t;
+
+/**
+ * Create a meter and add its GPIO context to an event loop.
+ *
+ * @param loop the event loop handling the edges
+ * @param ctx a GPIO context configured for edges
+ * @param window_ns the length of the averaging window, 0 disables the
+ *        average frequency and the timeout of the frequencies
+ * @return returns a ugpio_meter_t object on success, NULL otherwise
+ */
+ugpio_meter_t *ugpio_meter_new(ugpio_loop_t *loop, ugpio_t *ctx, uint64_t window_ns);
+
+/**
+ * Remove the GPIO context from the event loop and release/free the meter.
+ *
+ * Like ugpio_loop_remove this must not be called while another thread runs
+ * the loop. The GPIO context is neither closed nor freed.
+ *
+ * @param meter a meter
+ */
+void ugpio_meter_free(ugpio_meter_t *meter);
+
+/**
+ * Get the measurements of a meter.
+ *
+ * @param meter a meter
+ * @param reading receives the measurements
+ */
+void ugpio_meter_read(ugpio_meter_t *meter, struct ugpio_meter_reading *reading);
+
+/**
+ * Reset all measurements of a meter.
+ *
+ * Like ugpio_meter_free this must not be called while another thread runs
+ * the loop.
+ *
+ * @param meter a meter
+ */
+void ugpio_meter_reset(ugpio_meter_t *meter);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_METER_H */
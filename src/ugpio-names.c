@@ -0,0 +1,554 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+#if HAVE_DECL_GPIO_V2_GET_LINE_IOCTL
+#include <linux/gpio.h>
+#endif
+
+#define NAMES_CACHE     "/run/ugpio-names"
+#define NAMES_MAGIC     "ugpio-names 1"
+#define NAMES_BOOT_ID   "/proc/sys/kernel/random/boot_id"
+#define NAMES_DEV_DIR   "/dev"
+
+/**
+ * A name of a line: the line name reported by the chip driver or
+ * "LABEL:OFFSET" built from the label of the chip.
+ */
+struct names_entry {
+    char *name;
+    uint32_t hash;
+    unsigned int gpio;
+};
+
+struct names_chip {
+    unsigned int base;
+    unsigned int ngpio;
+    char dir[NAME_MAX + 1];
+    char label[64];
+};
+
+static struct {
+    pthread_mutex_t lock;
+    /* whether entries/table reflect the chips identified by fingerprint */
+    int valid;
+    uint64_t fingerprint;
+    struct names_entry *entries;
+    size_t num;
+    size_t size;
+    /* open addressing, entry index + 1 or 0 for a free slot */
+    uint32_t *table;
+    size_t mask;
+    /* the persistent cache, empty if disabled */
+    char cache[PATH_MAX];
+} names = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cache = NAMES_CACHE,
+};
+
+/* FNV-1a */
+static uint64_t names_hash(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    while (len--) {
+        h ^= *p++;
+        h *= UINT64_C(0x100000001b3);
+    }
+
+    return h;
+}
+
+#define NAMES_HASH_INIT UINT64_C(0xcbf29ce484222325)
+
+static int names_is_chip(const char *name)
+{
+    const char *p;
+
+    if (strncmp(name, "gpiochip", 8) != 0 || name[8] == '\0')
+        return 0;
+
+    for (p = name + 8; *p; p++)
+        if (*p < '0' || *p > '9')
+            return 0;
+
+    return 1;
+}
+
+/*
+ * Identify the current set of chips without reading any of their
+ * attributes: the directory entries of sysfs are recreated whenever a chip
+ * is added or removed, which gives them a new inode number, and the boot id
+ * covers chips probed in another order after a reboot. The entries are
+ * combined order-independently as readdir does not sort them.
+ */
+static int names_fingerprint(uint64_t *fingerprint)
+{
+    uint64_t fp, h;
+    struct dirent *de;
+    char boot[64];
+    ssize_t c = 0;
+    DIR *dir;
+    int fd;
+
+    fp = names_hash(NAMES_HASH_INIT, gpio_sysfs_root, strlen(gpio_sysfs_root));
+
+    if ((fd = open(NAMES_BOOT_ID, O_RDONLY | O_CLOEXEC)) != -1) {
+        c = read(fd, boot, sizeof(boot));
+        close(fd);
+    }
+    if (c > 0)
+        fp = names_hash(fp, boot, c);
+
+    if ((dir = opendir(gpio_sysfs_root)) == NULL)
+        return -1;
+
+    while ((de = readdir(dir)) != NULL) {
+        if (!names_is_chip(de->d_name))
+            continue;
+        h = names_hash(NAMES_HASH_INIT, de->d_name, strlen(de->d_name));
+        h = names_hash(h, &de->d_ino, sizeof(de->d_ino));
+        fp += h;
+    }
+
+    closedir(dir);
+
+    *fingerprint = fp;
+    return 0;
+}
+
+static void names_clear(void)
+{
+    size_t i;
+
+    for (i = 0; i < names.num; i++)
+        free(names.entries[i].name);
+
+    free(names.entries);
+    free(names.table);
+    names.entries = NULL;
+    names.table = NULL;
+    names.num = 0;
+    names.size = 0;
+    names.mask = 0;
+    names.valid = 0;
+}
+
+static struct names_entry *names_find(const char *name, uint32_t hash)
+{
+    struct names_entry *e;
+    size_t i;
+
+    if (names.table == NULL)
+        return NULL;
+
+    for (i = hash & names.mask; names.table[i]; i = (i + 1) & names.mask) {
+        e = &names.entries[names.table[i] - 1];
+        if (e->hash == hash && strcmp(e->name, name) == 0)
+            return e;
+    }
+
+    return NULL;
+}
+
+/* the first entry of a name wins, so line names shadow nothing by accident */
+static int names_add(const char *name, unsigned int gpio)
+{
+    struct names_entry *e;
+
+    if (names.num == names.size) {
+        names.size = names.size ? 2 * names.size : 256;
+        if ((e = realloc(names.entries, names.size * sizeof(*e))) == NULL)
+            return -1;
+        names.entries = e;
+    }
+
+    e = &names.entries[names.num];
+    if ((e->name = strdup(name)) == NULL)
+        return -1;
+    e->hash = names_hash(NAMES_HASH_INIT, name, strlen(name));
+    e->gpio = gpio;
+    names.num++;
+
+    return 0;
+}
+
+/* the table is at most half full, duplicate names are dropped */
+static int names_build_table(void)
+{
+    size_t size = 16, i, j, k;
+    struct names_entry *e;
+
+    while (size < 2 * names.num)
+        size *= 2;
+
+    if ((names.table = calloc(size, sizeof(*names.table))) == NULL)
+        return -1;
+    names.mask = size - 1;
+
+    for (i = 0, j = 0; i < names.num; i++) {
+        e = &names.entries[i];
+        if (names_find(e->name, e->hash)) {
+            free(e->name);
+            continue;
+        }
+        names.entries[j] = *e;
+        for (k = e->hash & names.mask; names.table[k]; k = (k + 1) & names.mask)
+            ;
+        names.table[k] = ++j;
+    }
+    names.num = j;
+
+    return 0;
+}
+
+/*
+ * Read a small attribute into a string without the trailing newline.
+ */
+static int names_read_at(int dfd, const char *name, char *buf, size_t size)
+{
+    ssize_t c;
+    int fd;
+
+    if ((fd = openat(dfd, name, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    while ((c = read(fd, buf, size - 1)) < 0 && errno == EINTR)
+        ;
+
+    close(fd);
+
+    if (c <= 0)
+        return -1;
+
+    buf[c] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static int names_chip_cmp(const void *a, const void *b)
+{
+    const struct names_chip *x = a, *y = b;
+
+    return (x->base > y->base) - (x->base < y->base);
+}
+
+/*
+ * The names the driver assigned to the lines, e.g. from the device tree's
+ * gpio-line-names, are only available from the character device. It is
+ * found as gpiochipM below the device of the sysfs chip.
+ */
+static int names_scan_lines(const struct names_chip *chip)
+{
+#if HAVE_DECL_GPIO_V2_GET_LINE_IOCTL
+    struct gpio_v2_line_info info;
+    char pathname[PATH_MAX];
+    struct dirent *de;
+    unsigned int offset;
+    DIR *dir;
+    int fd = -1, rv = 0;
+
+    snprintf(pathname, sizeof(pathname), "%s/%s/device", gpio_sysfs_root, chip->dir);
+    if ((dir = opendir(pathname)) == NULL)
+        return 0;
+
+    while ((de = readdir(dir)) != NULL) {
+        if (!names_is_chip(de->d_name))
+            continue;
+        snprintf(pathname, sizeof(pathname), NAMES_DEV_DIR "/%s", de->d_name);
+        fd = open(pathname, O_RDONLY | O_CLOEXEC);
+        break;
+    }
+
+    closedir(dir);
+
+    if (fd == -1)
+        return 0;
+
+    for (offset = 0; offset < chip->ngpio; offset++) {
+        memset(&info, 0, sizeof(info));
+        info.offset = offset;
+        if (gpio_cdev_ioctl(fd, GPIO_V2_GET_LINEINFO_IOCTL, &info) == -1)
+            break;
+        info.name[sizeof(info.name) - 1] = '\0';
+        if (info.name[0] == '\0' || strchr(info.name, '\n'))
+            continue;
+        if ((rv = names_add(info.name, chip->base + offset)) == -1)
+            break;
+    }
+
+    close(fd);
+    return rv;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Index all chips below the sysfs root. Line names come first, so a line
+ * name which happens to look like "LABEL:OFFSET" wins.
+ */
+static int names_scan(void)
+{
+    struct names_chip *chips = NULL, *c;
+    char buffer[32], name[sizeof(c->label) + 16];
+    size_t nchips = 0, i;
+    unsigned int offset;
+    struct dirent *de;
+    DIR *dir;
+    int dfd, rv = -1;
+
+    if ((dir = opendir(gpio_sysfs_root)) == NULL)
+        return -1;
+
+    while ((de = readdir(dir)) != NULL) {
+        if (!names_is_chip(de->d_name))
+            continue;
+
+        if ((c = realloc(chips, (nchips + 1) * sizeof(*chips))) == NULL)
+            goto out;
+        chips = c;
+        c = &chips[nchips];
+
+        if ((dfd = openat(dirfd(dir), de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+            continue;
+        if (names_read_at(dfd, "base", buffer, sizeof(buffer)) == -1 ||
+            sscanf(buffer, "%u", &c->base) != 1 ||
+            names_read_at(dfd, "ngpio", buffer, sizeof(buffer)) == -1 ||
+            sscanf(buffer, "%u", &c->ngpio) != 1 ||
+            names_read_at(dfd, "label", c->label, sizeof(c->label)) == -1) {
+            close(dfd);
+            continue;
+        }
+        close(dfd);
+
+        strcpy(c->dir, de->d_name);
+        nchips++;
+    }
+
+    if (nchips)
+        qsort(chips, nchips, sizeof(*chips), names_chip_cmp);
+
+    for (i = 0; i < nchips; i++)
+        if (names_scan_lines(&chips[i]) == -1)
+            goto out;
+
+    for (i = 0; i < nchips; i++) {
+        for (offset = 0; offset < chips[i].ngpio; offset++) {
+            snprintf(name, sizeof(name), "%s:%u", chips[i].label, offset);
+            if (names_add(name, chips[i].base + offset) == -1)
+                goto out;
+        }
+    }
+
+    rv = 0;
+
+out:
+    closedir(dir);
+    free(chips);
+    return rv;
+}
+
+/*
+ * Load the index from the cache file. Returns 1 when it was loaded, 0 when
+ * there is no usable cache for this fingerprint and -1 on errors.
+ */
+static int names_cache_load(uint64_t fingerprint)
+{
+    char header[64], *line = NULL, *end;
+    size_t size = 0;
+    unsigned long gpio;
+    ssize_t len;
+    FILE *f;
+    int rv = 0;
+
+    if (names.cache[0] == '\0' || (f = fopen(names.cache, "re")) == NULL)
+        return 0;
+
+    snprintf(header, sizeof(header), NAMES_MAGIC " %016llx\n", (unsigned long long)fingerprint);
+
+    if (getline(&line, &size, f) == -1 || strcmp(line, header) != 0)
+        goto out;
+
+    while ((len = getline(&line, &size, f)) != -1) {
+        if (len && line[len - 1] == '\n')
+            line[--len] = '\0';
+        errno = 0;
+        gpio = strtoul(line, &end, 10);
+        if (errno || end == line || *end != ' ' || end[1] == '\0' || gpio > UINT_MAX) {
+            names_clear();
+            goto out;
+        }
+        if (names_add(end + 1, gpio) == -1) {
+            rv = -1;
+            goto out;
+        }
+    }
+
+    rv = 1;
+
+out:
+    free(line);
+    fclose(f);
+    return rv;
+}
+
+/*
+ * Replace the cache file atomically. Failures are not reported, without a
+ * cache the next process simply scans again.
+ */
+static void names_cache_save(uint64_t fingerprint)
+{
+    char pathname[PATH_MAX];
+    size_t i;
+    FILE *f;
+    int fd;
+
+    if (names.cache[0] == '\0')
+        return;
+
+    if (snprintf(pathname, sizeof(pathname), "%s.XXXXXX", names.cache) >= sizeof(pathname))
+        return;
+
+    if ((fd = mkostemp(pathname, O_CLOEXEC)) == -1)
+        return;
+
+    if (fchmod(fd, 0644) == -1 || (f = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        goto err_unlink;
+    }
+
+    fprintf(f, NAMES_MAGIC " %016llx\n", (unsigned long long)fingerprint);
+    for (i = 0; i < names.num; i++)
+        fprintf(f, "%u %s\n", names.entries[i].gpio, names.entries[i].name);
+
+    if (fclose(f) == EOF)
+        goto err_unlink;
+
+    if (rename(pathname, names.cache) == 0)
+        return;
+
+err_unlink:
+    unlink(pathname);
+}
+
+/* must be called with the lock held */
+static int names_update(void)
+{
+    uint64_t fingerprint;
+    int rv;
+
+    if (names_fingerprint(&fingerprint) == -1)
+        return -1;
+
+    if (names.valid && names.fingerprint == fingerprint)
+        return 0;
+
+    names_clear();
+
+    if ((rv = names_cache_load(fingerprint)) == -1)
+        goto err_clear;
+
+    if (rv == 0 && names_scan() == -1)
+        goto err_clear;
+
+    if (names_build_table() == -1)
+        goto err_clear;
+
+    if (rv == 0)
+        names_cache_save(fingerprint);
+
+    names.fingerprint = fingerprint;
+    names.valid = 1;
+
+    return 0;
+
+err_clear:
+    names_clear();
+    return -1;
+}
+
+int ugpio_set_name_cache(const char *path)
+{
+    if (path == NULL)
+        path = NAMES_CACHE;
+
+    if (strlen(path) >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    pthread_mutex_lock(&names.lock);
+    strcpy(names.cache, path);
+    names_clear();
+    pthread_mutex_unlock(&names.lock);
+
+    return 0;
+}
+
+int ugpio_lookup_name(const char *name, unsigned int *gpio)
+{
+    struct names_entry *e;
+    uint32_t hash;
+    int rv = -1;
+
+    if (name == NULL || name[0] == '\0') {
+        errno = EINVAL;
+        return -1;
+    }
+
+    hash = names_hash(NAMES_HASH_INIT, name, strlen(name));
+
+    pthread_mutex_lock(&names.lock);
+
+    /*
+     * Check the fingerprint on every lookup: a chip re-probed with another
+     * base moves its names to other GPIOs, so a hit in the index alone
+     * could return the number of a line which has nothing to do with it.
+     */
+    if (names_update() == -1)
+        goto out;
+
+    if ((e = names_find(name, hash)) == NULL) {
+        errno = ENOENT;
+        goto out;
+    }
+
+    *gpio = e->gpio;
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&names.lock);
+    return rv;
+}
+
+ugpio_t *ugpio_request_by_name(const char *name, unsigned int flags, const char *label)
+{
+    unsigned int gpio;
+
+    if (ugpio_lookup_name(name, &gpio) == -1)
+        return NULL;
+
+    return ugpio_request_one(gpio, flags, label ? label : name);
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_PINMAP_HPP
+#define UGPIO_PINMAP_HPP
+
+#if __cplusplus < 201703L
+# error "ugpio-pinmap.hpp requires C++17"
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "ugpio.hpp"
+
+/**
+ * Compile-time pin maps
+ *
+ * A board layout which is fixed at build time is declared as a type: each
+ * pin is a ugpio::pin with its GPIO number, GPIOF_* flags and polarity, and
+ * a ugpio::pin_map lists the pins of the board. Duplicate GPIO numbers and
+ * conflicting flags are rejected by static_assert. Pins are addressed by
+ * their type, and the grouped reads and writes go through a port of all pins
+ * with the directions and polarities folded into constant masks, so there are
+ * neither lookup tables nor branches on flags at runtime, and a write only
+ * touches the outputs whose values changed.
+ *
+ * The polarity is handled in the library: the values of an active-low pin
+ * are inverted when read and written, and GPIOF_INIT_HIGH of an active-low
+ * output means logically high, so the line is initialized low.
+ *
+ *     using led    = ugpio::pin<17, GPIOF_OUT_INIT_LOW>;
+ *     using relay  = ugpio::pin<22, GPIOF_OUT_INIT_LOW, ugpio::active_low>;
+ *     using button = ugpio::pin<27, GPIOF_IN | GPIOF_TRIG_FALL, ugpio::active_low>;
+ *     using board  = ugpio::pin_map<led, relay, button>;
+ *
+ *     board b("myboard");
+ *     b.set<relay>(1);
+ *     b.write(board::mask<led, relay>);
+ *     if (b.get<button>() == 1) ...
+ */
+
+namespace ugpio {
+
+enum polarity {
+    active_high,
+    active_low,
+};
+
+/**
+ * A pin of a pin map.
+ */
+template <unsigned int Gpio, unsigned int Flags, polarity Polarity = active_high>
+struct pin {
+    static constexpr unsigned int gpio = Gpio;
+    static constexpr unsigned int flags = Flags;
+    static constexpr bool inverted = Polarity == active_low;
+    static constexpr bool output = (Flags & GPIOF_DIR_IN) == 0;
+
+    static_assert((Flags & (GPIOF_REQUESTED | GPIOF_DIRECTION_UNKNOWN)) == 0,
+                  "GPIOF_REQUESTED and GPIOF_DIRECTION_UNKNOWN are set by the library");
+    static_assert(output || (Flags & GPIOF_INIT_HIGH) == 0,
+                  "an input cannot have an initial value");
+    static_assert(!output || (Flags & GPIOF_TRIGGER_MASK) == 0,
+                  "an output cannot trigger on edges");
+
+    /* the flags passed to ugpio_request_one, with the initial value of an
+     * active-low output inverted */
+    static constexpr unsigned int request_flags =
+        (output && inverted) ? (Flags ^ GPIOF_INIT_HIGH) : Flags;
+};
+
+namespace detail {
+
+template <typename P, typename... Pins>
+struct index_of;
+
+template <typename P, typename... Rest>
+struct index_of<P, P, Rest...> : std::integral_constant<std::size_t, 0> {};
+
+template <typename P, typename First, typename... Rest>
+struct index_of<P, First, Rest...>
+    : std::integral_constant<std::size_t, 1 + index_of<P, Rest...>::value> {};
+
+template <typename P>
+struct index_of<P> {
+    static_assert(sizeof(P) == 0, "the pin is not part of the pin map");
+};
+
+template <typename... Pins>
+constexpr bool unique_gpios()
+{
+    constexpr unsigned int gpios[] = { Pins::gpio... };
+
+    for (std::size_t i = 0; i < sizeof...(Pins); i++)
+        for (std::size_t j = i + 1; j < sizeof...(Pins); j++)
+            if (gpios[i] == gpios[j])
+                return false;
+
+    return true;
+}
+
+template <typename... Pins>
+constexpr std::uint64_t bits_where(const bool (&cond)[sizeof...(Pins)])
+{
+    std::uint64_t bits = 0;
+
+    for (std::size_t i = 0; i < sizeof...(Pins); i++)
+        if (cond[i])
+            bits |= std::uint64_t(1) << i;
+
+    return bits;
+}
+
+} // namespace detail
+
+/**
+ * The pins of a board, bit i of the grouped values is the i-th pin.
+ */
+template <typename... Pins>
+class pin_map {
+    static constexpr std::size_t num = sizeof...(Pins);
+
+    static_assert(num > 0 && num <= UGPIO_PORT_MAX, "a pin map has 1 to UGPIO_PORT_MAX pins");
+    static_assert(detail::unique_gpios<Pins...>(), "a GPIO is used by more than one pin");
+
+public:
+    /** the bit of a pin in the grouped values */
+    template <typename P>
+    static constexpr std::size_t index = detail::index_of<P, Pins...>::value;
+
+    /** the bits of some pins */
+    template <typename... P>
+    static constexpr std::uint64_t mask = (std::uint64_t(0) | ... | (std::uint64_t(1) << index<P>));
+
+    /** the bits of all outputs and of all active-low pins */
+    static constexpr std::uint64_t outputs = detail::bits_where<Pins...>({ Pins::output... });
+    static constexpr std::uint64_t inverted = detail::bits_where<Pins...>({ Pins::inverted... });
+
+    static constexpr std::size_t size() noexcept { return num; }
+
+    /**
+     * Request and open all pins. If one of them fails, the pins requested so
+     * far are released again and std::system_error is thrown.
+     */
+    explicit pin_map(const char *label = nullptr)
+        : lines_{ { line(Pins::gpio, Pins::request_flags, label)... } },
+          port_(handles(std::make_index_sequence<num>()).data(), num)
+    {
+    }
+
+    pin_map(pin_map &&) noexcept = default;
+    pin_map &operator=(pin_map &&) noexcept = default;
+
+    /**
+     * The line of a pin. After writing it directly, call ugpio_port_invalidate
+     * on port().native_handle(), so that the next write() does not skip it.
+     */
+    template <typename P>
+    line &get_line() noexcept { return lines_[index<P>]; }
+
+    /** the port of all pins, bit i is the i-th pin */
+    line_set &port() noexcept { return port_; }
+
+    /** @return the logical value of a pin, -1 on error with errno set appropriately */
+    template <typename P>
+    int get() const noexcept
+    {
+        int value = lines_[index<P>].get();
+
+        if constexpr (P::inverted)
+            return value == -1 ? -1 : !value;
+        else
+            return value;
+    }
+
+    /** @return 0 on success, -1 on error with errno set appropriately */
+    template <typename P>
+    int set(int value) noexcept
+    {
+        static_assert(P::output, "the pin is not an output");
+
+        constexpr std::uint64_t bit = mask<P>;
+
+        return port_.set_all(bit, (value ? bit : 0) ^ (inverted & bit));
+    }
+
+    /**
+     * Read the logical values of all pins.
+     *
+     * @param bits receives the values
+     * @return 0 on success, -1 on error with errno set appropriately
+     */
+    int read(std::uint64_t &bits) const noexcept
+    {
+        std::uint64_t raw;
+
+        if (port_.get_all(raw) == -1)
+            return -1;
+
+        bits = raw ^ inverted;
+        return 0;
+    }
+
+    /**
+     * Write the logical values of all outputs, the bits of inputs are ignored.
+     *
+     * @param bits the values to write
+     * @return 0 on success, -1 on error with errno set appropriately
+     */
+    int write(std::uint64_t bits) noexcept
+    {
+        return port_.set_all(outputs, bits ^ inverted);
+    }
+
+private:
+    template <std::size_t... I>
+    std::array<ugpio_t *, num> handles(std::index_sequence<I...>) const noexcept
+    {
+        return { { lines_[I].native_handle()... } };
+    }
+
+    std::array<line, num> lines_;
+    /* declared after the lines, so that it is freed before them */
+    line_set port_;
+};
+
+} // namespace ugpio
+
+#endif  /* UGPIO_PINMAP_HPP */
@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+/**
+ * A group of GPIOs accessed as a bitmask.
+ */
+struct ugpio_port {
+    /* the number of GPIOs */
+    unsigned int num;
+    /* the GPIO contexts, bit i of the port is ctxs[i] */
+    ugpio_t **ctxs;
+    /* the value file descriptors of the contexts */
+    int *fds;
+    /* the values last written to the port */
+    uint64_t shadow;
+    /* the bits of shadow which are known to be valid */
+    uint64_t known;
+    /* the pool of the contexts if they were requested by the port */
+    ugpio_t *pool;
+};
+
+static ugpio_port_t *ugpio_port_alloc(size_t num)
+{
+    ugpio_port_t *port;
+
+    if (num == 0 || num > UGPIO_PORT_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((port = calloc(1, sizeof(*port))) == NULL)
+        return NULL;
+
+    port->ctxs = calloc(num, sizeof(*port->ctxs));
+    port->fds = calloc(num, sizeof(*port->fds));
+    if (port->ctxs == NULL || port->fds == NULL) {
+        free(port->ctxs);
+        free(port->fds);
+        free(port);
+        return NULL;
+    }
+
+    return port;
+}
+
+ugpio_port_t *ugpio_port_new(ugpio_t **ctxs, size_t num)
+{
+    ugpio_port_t *port;
+    uint64_t opened = 0;
+    size_t i;
+
+    if ((port = ugpio_port_alloc(num)) == NULL)
+        return NULL;
+
+    for (port->num = 0; port->num < num; port->num++) {
+        port->ctxs[port->num] = ctxs[port->num];
+        if (ctxs[port->num]->fd_value == -1)
+            opened |= UINT64_C(1) << port->num;
+        if ((port->fds[port->num] = ugpio_open(ctxs[port->num])) == -1)
+            goto err_close;
+    }
+
+    return port;
+
+err_close:
+    /* contexts which were open before stay open */
+    for (i = 0; i < port->num; i++)
+        if (opened & (UINT64_C(1) << i))
+            ugpio_close(ctxs[i]);
+    ugpio_port_free(port);
+    return NULL;
+}
+
+ugpio_port_t *ugpio_port_request(const unsigned int *gpios, size_t num,
+                                 unsigned int flags, const char *label)
+{
+    ugpio_port_t *port;
+    size_t i;
+
+    if ((port = ugpio_port_alloc(num)) == NULL)
+        return NULL;
+
+    if ((port->pool = ugpio_request_many(gpios, num, flags, label)) == NULL)
+        goto err_free;
+
+    for (port->num = 0; port->num < num; port->num++)
+        port->ctxs[port->num] = &port->pool[port->num];
+
+    for (i = 0; i < num; i++)
+        if ((port->fds[i] = ugpio_open(port->ctxs[i])) == -1)
+            goto err_free;
+
+    return port;
+
+err_free:
+    ugpio_port_free(port);
+    return NULL;
+}
+
+void ugpio_port_free(ugpio_port_t *port)
+{
+    if (port == NULL)
+        return;
+
+    if (port->pool)
+        ugpio_free_many(port->pool);
+
+    free(port->fds);
+    free(port->ctxs);
+    free(port);
+}
+
+size_t ugpio_port_size(ugpio_port_t *port)
+{
+    return port->num;
+}
+
+ugpio_t *ugpio_port_ctx(ugpio_port_t *port, size_t idx)
+{
+    if (idx >= port->num) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return port->ctxs[idx];
+}
+
+int ugpio_get_port(ugpio_port_t *port, uint64_t *bits)
+{
+    return gpio_fd_get_values(port->fds, port->num, bits);
+}
+
+/* keep the shadow state of the contexts in line with the port */
+static void ugpio_port_written(ugpio_port_t *port, uint64_t changed, uint64_t value, int failed)
+{
+    unsigned int i;
+
+    for (i = 0; i < port->num; i++)
+        if (changed & (UINT64_C(1) << i))
+            gpio_value_written(port->ctxs[i], failed ? -1 : !!(value & (UINT64_C(1) << i)));
+}
+
+int ugpio_set_port(ugpio_port_t *port, uint64_t mask, uint64_t value)
+{
+    uint64_t changed;
+
+    if (port->num < UGPIO_PORT_MAX)
+        mask &= (UINT64_C(1) << port->num) - 1;
+
+    /* skip all lines which are known to have the requested value already */
+    changed = mask & (~port->known | (port->shadow ^ value));
+    if (changed == 0)
+        return 0;
+
+    if (gpio_fd_set_values(port->fds, port->num, changed, value) == -1) {
+        port->known &= ~changed;
+        ugpio_port_written(port, changed, value, 1);
+        return -1;
+    }
+
+    ugpio_port_written(port, changed, value, 0);
+    port->shadow = (port->shadow & ~changed) | (value & changed);
+    port->known |= changed;
+
+    return 0;
+}
+
+void ugpio_port_invalidate(ugpio_port_t *port)
+{
+    port->known = 0;
+}
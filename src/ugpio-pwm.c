@@ -0,0 +1,343 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-pwm.h>
+#include <ugpio-internal.h>
+
+/**
+ * A channel of the PWM engine.
+ */
+struct pwm_channel {
+    ugpio_t *ctx;
+    uint64_t period_ns;
+    uint64_t phase_ns;
+    /* written by ugpio_pwm_set_duty, read at the start of each period */
+    _Atomic uint64_t duty_ns;
+    /* the time of the next edge of this channel */
+    uint64_t next;
+    /* the start of the current period */
+    uint64_t period_start;
+    /* whether the next edge is the end of the high time */
+    int falling;
+    /* the level last written, -1 if unknown */
+    int level;
+    /* the level to write once the due edges are handled, -1 for none */
+    int pending;
+    /* the outcome of the last write: 1 written, 0 skipped, -1 failed */
+    int written;
+    struct ugpio_pwm_stats stats;
+};
+
+struct ugpio_pwm {
+    struct pwm_channel *channels;
+    int num;
+    /* the timeline: channel numbers as a min-heap ordered by next edge */
+    int *heap;
+    /* the channels with a pending write */
+    int *due;
+    /* the time the engine was started */
+    uint64_t start;
+    pthread_t thread;
+    int running;
+    atomic_int stop;
+    /* protects the statistics of the channels */
+    pthread_mutex_t lock;
+};
+
+ugpio_pwm_t *ugpio_pwm_new(void)
+{
+    ugpio_pwm_t *pwm;
+
+    if ((pwm = calloc(1, sizeof(*pwm))) == NULL)
+        return NULL;
+
+    pthread_mutex_init(&pwm->lock, NULL);
+
+    return pwm;
+}
+
+void ugpio_pwm_free(ugpio_pwm_t *pwm)
+{
+    if (pwm == NULL)
+        return;
+
+    ugpio_pwm_stop(pwm);
+    pthread_mutex_destroy(&pwm->lock);
+    free(pwm->due);
+    free(pwm->heap);
+    free(pwm->channels);
+    free(pwm);
+}
+
+int ugpio_pwm_add(ugpio_pwm_t *pwm, ugpio_t *ctx, uint64_t period_ns,
+                  uint64_t duty_ns, uint64_t phase_ns)
+{
+    struct pwm_channel *channels, *ch;
+    int *heap, *due;
+
+    if (pwm->running) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (period_ns == 0 || duty_ns > period_ns) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    channels = realloc(pwm->channels, (pwm->num + 1) * sizeof(*channels));
+    if (channels == NULL)
+        return -1;
+    pwm->channels = channels;
+
+    if ((heap = realloc(pwm->heap, (pwm->num + 1) * sizeof(*heap))) == NULL)
+        return -1;
+    pwm->heap = heap;
+
+    if ((due = realloc(pwm->due, (pwm->num + 1) * sizeof(*due))) == NULL)
+        return -1;
+    pwm->due = due;
+
+    /* opened last, so that a failing allocation leaves nothing open */
+    if (ugpio_open(ctx) == -1)
+        return -1;
+
+    ch = &pwm->channels[pwm->num];
+    memset(ch, 0, sizeof(*ch));
+    ch->ctx = ctx;
+    ch->period_ns = period_ns;
+    ch->phase_ns = phase_ns;
+    atomic_init(&ch->duty_ns, duty_ns);
+
+    return pwm->num++;
+}
+
+int ugpio_pwm_set_duty(ugpio_pwm_t *pwm, int channel, uint64_t duty_ns)
+{
+    if (channel < 0 || channel >= pwm->num ||
+        duty_ns > pwm->channels[channel].period_ns) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    atomic_store_explicit(&pwm->channels[channel].duty_ns, duty_ns, memory_order_relaxed);
+    return 0;
+}
+
+static int pwm_before(ugpio_pwm_t *pwm, int a, int b)
+{
+    return pwm->channels[pwm->heap[a]].next < pwm->channels[pwm->heap[b]].next;
+}
+
+static void pwm_swap(ugpio_pwm_t *pwm, int a, int b)
+{
+    int tmp = pwm->heap[a];
+
+    pwm->heap[a] = pwm->heap[b];
+    pwm->heap[b] = tmp;
+}
+
+/* restore the heap order after the next edge of the first channel moved */
+static void pwm_sift_down(ugpio_pwm_t *pwm)
+{
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < pwm->num) {
+        if (child + 1 < pwm->num && pwm_before(pwm, child + 1, child))
+            child++;
+        if (!pwm_before(pwm, child, i))
+            break;
+        pwm_swap(pwm, i, child);
+        i = child;
+    }
+}
+
+/* write the pending level of a channel, called without the lock */
+static void pwm_write(struct pwm_channel *ch)
+{
+    int level = ch->pending;
+
+    ch->pending = -1;
+
+    if (ch->level == level) {
+        ch->written = 0;
+        return;
+    }
+
+    if (ugpio_set_value(ch->ctx, level) == -1) {
+        ch->written = -1;
+        ch->level = -1;
+        return;
+    }
+
+    ch->written = 1;
+    ch->level = level;
+}
+
+/* handle the due edge of a channel and schedule its next one */
+static void pwm_edge(struct pwm_channel *ch, uint64_t start, uint64_t now)
+{
+    uint64_t late = now - ch->next;
+    uint64_t duty;
+
+    if (ch->stats.edges == 0 || late < ch->stats.lateness_min_ns)
+        ch->stats.lateness_min_ns = late;
+    if (late > ch->stats.lateness_max_ns)
+        ch->stats.lateness_max_ns = late;
+    ch->stats.lateness_sum_ns += late;
+    ch->stats.edges++;
+
+    if (ch->falling) {
+        ch->pending = 0;
+        ch->falling = 0;
+        ch->next = ch->period_start + ch->period_ns;
+        return;
+    }
+
+    ch->period_start = ch->next;
+    ch->stats.periods++;
+    ch->stats.elapsed_ns = ch->period_start - (start + ch->phase_ns);
+
+    duty = atomic_load_explicit(&ch->duty_ns, memory_order_relaxed);
+    if (duty == 0) {
+        ch->pending = 0;
+        ch->next = ch->period_start + ch->period_ns;
+    } else if (duty >= ch->period_ns) {
+        ch->pending = 1;
+        ch->next = ch->period_start + ch->period_ns;
+    } else {
+        ch->pending = 1;
+        ch->falling = 1;
+        ch->next = ch->period_start + duty;
+    }
+}
+
+static void *pwm_thread(void *arg)
+{
+    ugpio_pwm_t *pwm = arg;
+    struct pwm_channel *ch;
+    uint64_t now;
+    int i, ndue;
+
+    for (;;) {
+        ch = &pwm->channels[pwm->heap[0]];
+        if (gpio_sleep_until(ch->next, &pwm->stop) == -1)
+            break;
+
+        now = gpio_now_ns();
+
+        /*
+         * Schedule all edges which are due by now, then write the levels
+         * without the lock so that reading the statistics does not wait
+         * for the GPIO writes.
+         */
+        ndue = 0;
+        pthread_mutex_lock(&pwm->lock);
+        while ((ch = &pwm->channels[pwm->heap[0]])->next <= now) {
+            if (ch->pending == -1)
+                pwm->due[ndue++] = pwm->heap[0];
+            pwm_edge(ch, pwm->start, now);
+            pwm_sift_down(pwm);
+        }
+        pthread_mutex_unlock(&pwm->lock);
+
+        for (i = 0; i < ndue; i++)
+            pwm_write(&pwm->channels[pwm->due[i]]);
+
+        pthread_mutex_lock(&pwm->lock);
+        for (i = 0; i < ndue; i++) {
+            ch = &pwm->channels[pwm->due[i]];
+            if (ch->written != 0)
+                ch->stats.writes++;
+            if (ch->written == -1)
+                ch->stats.errors++;
+        }
+        pthread_mutex_unlock(&pwm->lock);
+    }
+
+    return NULL;
+}
+
+int ugpio_pwm_start(ugpio_pwm_t *pwm)
+{
+    int i;
+
+    if (pwm->running) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (pwm->num == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pwm->start = gpio_now_ns();
+    for (i = 0; i < pwm->num; i++) {
+        memset(&pwm->channels[i].stats, 0, sizeof(pwm->channels[i].stats));
+        pwm->channels[i].next = pwm->start + pwm->channels[i].phase_ns;
+        pwm->channels[i].falling = 0;
+        pwm->channels[i].level = -1;
+        pwm->channels[i].pending = -1;
+        pwm->heap[i] = i;
+    }
+
+    /* sorting by phase yields a valid heap */
+    for (i = 1; i < pwm->num; i++) {
+        int j = i;
+
+        while (j > 0 && pwm_before(pwm, j, j - 1)) {
+            pwm_swap(pwm, j, j - 1);
+            j--;
+        }
+    }
+
+    atomic_store(&pwm->stop, 0);
+
+    if ((errno = pthread_create(&pwm->thread, NULL, pwm_thread, pwm)) != 0)
+        return -1;
+
+    pwm->running = 1;
+    return 0;
+}
+
+int ugpio_pwm_stop(ugpio_pwm_t *pwm)
+{
+    if (!pwm->running)
+        return 0;
+
+    atomic_store(&pwm->stop, 1);
+
+    if ((errno = pthread_join(pwm->thread, NULL)) != 0)
+        return -1;
+
+    pwm->running = 0;
+    return 0;
+}
+
+int ugpio_pwm_get_stats(ugpio_pwm_t *pwm, int channel, struct ugpio_pwm_stats *stats)
+{
+    if (channel < 0 || channel >= pwm->num) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&pwm->lock);
+    *stats = pwm->channels[channel].stats;
+    pthread_mutex_unlock(&pwm->lock);
+
+    return 0;
+}
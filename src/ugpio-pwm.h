@@ -0,0 +1,131 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_PWM_H
+#define UGPIO_PWM_H
+
+#include "ugpio.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Software PWM
+ *
+ * A PWM engine drives any number of output contexts from a single thread.
+ * The edges of all channels are merged into one timeline ordered by time,
+ * the thread sleeps until the next edge is due and then handles all edges
+ * due at that time. A line is only written when its level changes, so a
+ * duty cycle of 0 or 100% costs no writes at all.
+ *
+ * The duty cycle of a channel can be changed at any time from any thread
+ * without locking, the new value is used from the next period on.
+ */
+
+/**
+ * Statistics of a PWM channel.
+ *
+ * The lateness of an edge is the time from when it was due until it was
+ * handled. The achieved frequency is (periods - 1) * 1e9 / elapsed_ns, the
+ * jitter is lateness_max_ns - lateness_min_ns.
+ */
+struct ugpio_pwm_stats {
+    /* the number of periods started */
+    uint64_t periods;
+    /* the number of writes to the line and how many of them failed */
+    uint64_t writes;
+    uint64_t errors;
+    /* the smallest, largest and summed up lateness of the edges */
+    uint64_t lateness_min_ns;
+    uint64_t lateness_max_ns;
+    uint64_t lateness_sum_ns;
+    /* the number of edges the lateness was summed up for */
+    uint64_t edges;
+    /* the time from the start of the first until the start of the last period */
+    uint64_t elapsed_ns;
+};
+
+struct ugpio_pwm;
+typedef struct ugpio_pwm ugpio_pwm_t;
+
+/**
+ * Create a PWM engine.
+ *
+ * @return returns a ugpio_pwm_t object on success, NULL otherwise
+ */
+ugpio_pwm_t *ugpio_pwm_new(void);
+
+/**
+ * Release/free a PWM engine, stopping it if necessary.
+ *
+ * The GPIO contexts are neither closed nor freed.
+ *
+ * @param pwm a PWM engine
+ */
+void ugpio_pwm_free(ugpio_pwm_t *pwm);
+
+/**
+ * Add a channel to a PWM engine.
+ *
+ * Channels can only be added while the engine is not running.
+ *
+ * @param pwm a PWM engine
+ * @param ctx an output context
+ * @param period_ns the period of the channel
+ * @param duty_ns the initial high time, at most period_ns
+ * @param phase_ns the delay of the first period after the start
+ * @return the channel number on success, -1 on error with errno set
+ *         appropriately:
+ *         EBUSY - the engine is running,
+ *         EINVAL - the period is 0 or shorter than the duty cycle.
+ */
+int ugpio_pwm_add(ugpio_pwm_t *pwm, ugpio_t *ctx, uint64_t period_ns,
+                  uint64_t duty_ns, uint64_t phase_ns);
+
+/**
+ * Change the duty cycle of a channel.
+ *
+ * This does not block and can be called from any thread.
+ *
+ * @param pwm a PWM engine
+ * @param channel a channel number as returned by ugpio_pwm_add
+ * @param duty_ns the high time, at most the period of the channel
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_pwm_set_duty(ugpio_pwm_t *pwm, int channel, uint64_t duty_ns);
+
+/**
+ * Start the thread of a PWM engine.
+ *
+ * The statistics are reset.
+ *
+ * @param pwm a PWM engine
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_pwm_start(ugpio_pwm_t *pwm);
+
+/**
+ * Stop the thread of a PWM engine and wait for it to terminate.
+ *
+ * The lines keep their current level.
+ *
+ * @param pwm a PWM engine
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_pwm_stop(ugpio_pwm_t *pwm);
+
+/**
+ * Get the statistics of a channel, also while the engine is running.
+ *
+ * @param pwm a PWM engine
+ * @param channel a channel number as returned by ugpio_pwm_add
+ * @param stats receives the statistics
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_pwm_get_stats(ugpio_pwm_t *pwm, int channel, struct ugpio_pwm_stats *stats);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_PWM_H */
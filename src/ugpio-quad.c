@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpio-quad.h>
+#include <ugpio-internal.h>
+
+/* marks an illegal transition in quad_table */
+#define QUAD_ERROR 2
+
+/**
+ * The step for a transition, indexed by the old state in bits 2-3 and the
+ * new state in bits 0-1, where a state is A in bit 1 and B in bit 0.
+ * Forward is 00 -> 10 -> 11 -> 01 -> 00.
+ */
+static const signed char quad_table[16] = {
+    /* from 00 */  0, -1,  1, QUAD_ERROR,
+    /* from 01 */  1,  0, QUAD_ERROR, -1,
+    /* from 10 */ -1, QUAD_ERROR,  0,  1,
+    /* from 11 */ QUAD_ERROR,  1, -1,  0,
+};
+
+struct ugpio_quad {
+    ugpio_loop_t *loop;
+    ugpio_t *a;
+    ugpio_t *b;
+    uint64_t window_ns;
+
+    _Atomic int64_t position;
+    atomic_int direction;
+    atomic_uint_fast64_t errors;
+    /* the velocity in transitions per 1000 seconds */
+    _Atomic int64_t velocity;
+    _Atomic uint64_t last_edge;
+
+    /* private to the loop: the current state and window */
+    unsigned int state;
+    uint64_t window_start;
+    int64_t window_position;
+};
+
+static int quad_sample(ugpio_t *ctx)
+{
+    char buffer;
+
+    if (gpio_fd_read(ctx->fd_value, &buffer, sizeof(buffer)) != sizeof(buffer))
+        return -1;
+
+    return buffer != '0';
+}
+
+static void quad_edge(ugpio_loop_t *loop, ugpio_t *ctx, int value, void *userdata)
+{
+    ugpio_quad_t *quad = userdata;
+    int64_t position;
+    uint64_t now;
+    unsigned int state;
+    int other, step;
+
+    /* a failed read of the edge value leaves the state untouched */
+    if (value == -1)
+        return;
+
+    /* the edge of one line comes with its value, the other one is sampled */
+    if ((other = quad_sample((ctx == quad->a) ? quad->b : quad->a)) == -1)
+        return;
+
+    if (ctx == quad->a)
+        state = (value << 1) | other;
+    else
+        state = (other << 1) | value;
+
+    step = quad_table[(quad->state << 2) | state];
+    quad->state = state;
+
+    if (step == QUAD_ERROR) {
+        atomic_fetch_add_explicit(&quad->errors, 1, memory_order_relaxed);
+        return;
+    }
+    if (step == 0)
+        return;
+
+    position = atomic_fetch_add_explicit(&quad->position, step, memory_order_relaxed) + step;
+    atomic_store_explicit(&quad->direction, step, memory_order_relaxed);
+
+    if (quad->window_ns == 0)
+        return;
+
+    now = gpio_loop_wakeup_ns(loop);
+    atomic_store_explicit(&quad->last_edge, now, memory_order_relaxed);
+
+    if (quad->window_start == 0) {
+        quad->window_start = now;
+        quad->window_position = position;
+    } else if (now - quad->window_start >= quad->window_ns) {
+        atomic_store_explicit(&quad->velocity,
+                              (position - quad->window_position) * INT64_C(1000000000000) /
+                              (int64_t)(now - quad->window_start),
+                              memory_order_relaxed);
+        quad->window_start = now;
+        quad->window_position = position;
+    }
+}
+
+ugpio_quad_t *ugpio_quad_new(ugpio_loop_t *loop, ugpio_t *a, ugpio_t *b, uint64_t window_ns)
+{
+    ugpio_quad_t *quad;
+    int va, vb;
+
+    if (a == b) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((quad = calloc(1, sizeof(*quad))) == NULL)
+        return NULL;
+
+    quad->loop = loop;
+    quad->a = a;
+    quad->b = b;
+    quad->window_ns = window_ns;
+    atomic_init(&quad->position, 0);
+    atomic_init(&quad->direction, 0);
+    atomic_init(&quad->errors, 0);
+    atomic_init(&quad->velocity, 0);
+    atomic_init(&quad->last_edge, 0);
+
+    if (ugpio_loop_add(loop, a, quad_edge, quad) == -1)
+        goto err_free;
+
+    if (ugpio_loop_add(loop, b, quad_edge, quad) == -1)
+        goto err_remove;
+
+    if ((va = quad_sample(a)) == -1 || (vb = quad_sample(b)) == -1)
+        goto err_remove_b;
+
+    quad->state = (va << 1) | vb;
+
+    return quad;
+
+err_remove_b:
+    ugpio_loop_remove(loop, b);
+err_remove:
+    ugpio_loop_remove(loop, a);
+err_free:
+    free(quad);
+    return NULL;
+}
+
+void ugpio_quad_free(ugpio_quad_t *quad)
+{
+    if (quad == NULL)
+        return;
+
+    ugpio_loop_remove(quad->loop, quad->b);
+    ugpio_loop_remove(quad->loop, quad->a);
+    free(quad);
+}
+
+void ugpio_quad_read(ugpio_quad_t *quad, struct ugpio_quad_reading *reading)
+{
+    uint64_t last_edge;
+
+    reading->position = atomic_load_explicit(&quad->position, memory_order_relaxed);
+    reading->direction = atomic_load_explicit(&quad->direction, memory_order_relaxed);
+    reading->errors = atomic_load_explicit(&quad->errors, memory_order_relaxed);
+    reading->velocity = atomic_load_explicit(&quad->velocity, memory_order_relaxed) / 1000.0;
+
+    /* the encoder stopped */
+    last_edge = atomic_load_explicit(&quad->last_edge, memory_order_relaxed);
+    if (quad->window_ns && gpio_now_ns() - last_edge > quad->window_ns)
+        reading->velocity = 0;
+}
+
+void ugpio_quad_set_position(ugpio_quad_t *quad, int64_t position)
+{
+    atomic_store_explicit(&quad->position, position, memory_order_relaxed);
+}
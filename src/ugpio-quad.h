@@ -0,0 +1,92 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_QUAD_H
+#define UGPIO_QUAD_H
+
+#include "ugpio.h"
+#include "ugpio-loop.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Quadrature decoder
+ *
+ * A decoder follows the A and B lines of a rotary encoder. Both input
+ * contexts have to be configured for both edges (GPIOF_TRIG_RISE |
+ * GPIOF_TRIG_FALL). The decoder registers them with an event loop and for
+ * each edge samples both lines and steps a state table from within the loop,
+ * typically with the loop running in a thread of its own. Every valid
+ * transition counts, so a full cycle of the encoder moves the position by 4.
+ * The position increases when A leads B.
+ *
+ * When both lines changed since the last edge, one or more edges were missed
+ * and the direction is unknown: the transition is counted as an error and
+ * the position is left alone.
+ *
+ * The position, direction and error count are kept in atomic variables, so
+ * any thread may query them at any time without locking.
+ */
+
+/**
+ * The state of a decoder.
+ */
+struct ugpio_quad_reading {
+    /* the position in transitions */
+    int64_t position;
+    /* the direction of the last transition: 1, -1 or 0 if none yet */
+    int direction;
+    /* the number of illegal transitions */
+    uint64_t errors;
+    /* the velocity in transitions per second over the last window */
+    double velocity;
+};
+
+struct ugpio_quad;
+typedef struct ugpio_quad ugpio_quad_t;
+
+/**
+ * Create a decoder and add its GPIO contexts to an event loop.
+ *
+ * @param loop the event loop handling the edges
+ * @param a the GPIO context of the A line
+ * @param b the GPIO context of the B line
+ * @param window_ns the length of the window the velocity is measured over,
+ *        0 disables the velocity; if no edge arrived for longer than the
+ *        window, the velocity is reported as 0
+ * @return returns a ugpio_quad_t object on success, NULL otherwise
+ */
+ugpio_quad_t *ugpio_quad_new(ugpio_loop_t *loop, ugpio_t *a, ugpio_t *b, uint64_t window_ns);
+
+/**
+ * Remove the GPIO contexts from the event loop and release/free the decoder.
+ *
+ * Like ugpio_loop_remove this must not be called while another thread runs
+ * the loop. The GPIO contexts are neither closed nor freed.
+ *
+ * @param quad a decoder
+ */
+void ugpio_quad_free(ugpio_quad_t *quad);
+
+/**
+ * Get the state of a decoder.
+ *
+ * @param quad a decoder
+ * @param reading receives the state
+ */
+void ugpio_quad_read(ugpio_quad_t *quad, struct ugpio_quad_reading *reading);
+
+/**
+ * Set the position of a decoder, e.g. when a reference mark was reached.
+ *
+ * @param quad a decoder
+ * @param position the new position
+ */
+void ugpio_quad_set_position(ugpio_quad_t *quad, int64_t position);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_QUAD_H */
@@ -0,0 +1,219 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpio-ring.h>
+#include <ugpio-internal.h>
+
+#define RING_CACHELINE 64
+
+/**
+ * Producer and consumer indices live on separate cache lines, and each side
+ * keeps a private copy of the other side's index so that it only touches the
+ * shared line when the ring looks full (producer) or empty (consumer).
+ */
+struct ugpio_ring {
+    size_t mask;
+    struct ugpio_event *events;
+
+    /* producer side */
+    _Alignas(RING_CACHELINE) atomic_size_t head;
+    size_t tail_cache;
+    atomic_uint_fast64_t overflows;
+
+    /* consumer side */
+    _Alignas(RING_CACHELINE) atomic_size_t tail;
+    size_t head_cache;
+};
+
+ugpio_ring_t *ugpio_ring_new(size_t capacity)
+{
+    ugpio_ring_t *ring;
+    size_t size = 1;
+
+    while (size < capacity)
+        size <<= 1;
+
+    if ((ring = aligned_alloc(RING_CACHELINE, sizeof(*ring))) == NULL)
+        return NULL;
+
+    memset(ring, 0, sizeof(*ring));
+
+    if ((ring->events = calloc(size, sizeof(*ring->events))) == NULL) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->overflows, 0);
+
+    return ring;
+}
+
+void ugpio_ring_free(ugpio_ring_t *ring)
+{
+    if (ring == NULL)
+        return;
+
+    free(ring->events);
+    free(ring);
+}
+
+int ugpio_ring_push(ugpio_ring_t *ring, const struct ugpio_event *event)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - ring->tail_cache > ring->mask) {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->tail_cache > ring->mask) {
+            atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+            return -1;
+        }
+    }
+
+    ring->events[head & ring->mask] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return 0;
+}
+
+size_t ugpio_ring_pop(ugpio_ring_t *ring, struct ugpio_event *events, size_t max)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t n, i;
+
+    if (ring->head_cache == tail)
+        ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    n = ring->head_cache - tail;
+    if (n > max)
+        n = max;
+
+    for (i = 0; i < n; i++)
+        events[i] = ring->events[(tail + i) & ring->mask];
+
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+
+    return n;
+}
+
+size_t ugpio_ring_count(ugpio_ring_t *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire) -
+           atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+void ugpio_ring_get_stats(ugpio_ring_t *ring, struct ugpio_ring_stats *stats)
+{
+    stats->popped = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    stats->pushed = atomic_load_explicit(&ring->head, memory_order_acquire);
+    stats->overflows = atomic_load_explicit(&ring->overflows, memory_order_relaxed);
+}
+
+/**
+ * A capture thread recording edges into rings.
+ */
+struct ugpio_capture {
+    ugpio_loop_t *loop;
+    pthread_t thread;
+    int running;
+};
+
+static void capture_edge(ugpio_loop_t *loop, ugpio_t *ctx, int value, void *userdata)
+{
+    struct ugpio_event event;
+
+    event.timestamp_ns = gpio_loop_wakeup_ns(loop);
+    event.gpio = ctx->gpio;
+    event.value = value;
+
+    ugpio_ring_push(userdata, &event);
+}
+
+static void *capture_thread(void *arg)
+{
+    ugpio_capture_t *cap = arg;
+
+    ugpio_loop_run(cap->loop);
+
+    return NULL;
+}
+
+ugpio_capture_t *ugpio_capture_new(void)
+{
+    ugpio_capture_t *cap;
+
+    if ((cap = calloc(1, sizeof(*cap))) == NULL)
+        return NULL;
+
+    if ((cap->loop = ugpio_loop_new()) == NULL) {
+        free(cap);
+        return NULL;
+    }
+
+    return cap;
+}
+
+void ugpio_capture_free(ugpio_capture_t *cap)
+{
+    if (cap == NULL)
+        return;
+
+    ugpio_capture_stop(cap);
+    ugpio_loop_free(cap->loop);
+    free(cap);
+}
+
+int ugpio_capture_add(ugpio_capture_t *cap, ugpio_t *ctx, ugpio_ring_t *ring)
+{
+    if (cap->running) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    return ugpio_loop_add(cap->loop, ctx, capture_edge, ring);
+}
+
+int ugpio_capture_start(ugpio_capture_t *cap)
+{
+    if (cap->running) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if ((errno = pthread_create(&cap->thread, NULL, capture_thread, cap)) != 0)
+        return -1;
+
+    cap->running = 1;
+    return 0;
+}
+
+int ugpio_capture_stop(ugpio_capture_t *cap)
+{
+    if (!cap->running)
+        return 0;
+
+    ugpio_loop_stop(cap->loop);
+
+    if ((errno = pthread_join(cap->thread, NULL)) != 0)
+        return -1;
+
+    cap->running = 0;
+    return 0;
+}
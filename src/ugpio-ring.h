@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_RING_H
+#define UGPIO_RING_H
+
+#include "ugpio.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Edge event rings and capture thread
+ *
+ * A capture thread waits for edges on a set of GPIO contexts and records
+ * each edge with a CLOCK_MONOTONIC timestamp into a ring. Rings are lock-free
+ * single-producer/single-consumer queues: the capture thread is the only
+ * producer, and exactly one consumer thread may drain each ring. Use one ring
+ * per GPIO or share a ring between a group of GPIOs handled by the same
+ * consumer. When a ring is full, new events are dropped and counted.
+ */
+
+/**
+ * A recorded edge.
+ */
+struct ugpio_event {
+    /* the GPIO number */
+    uint32_t gpio;
+    /* the value after the edge, -1 if it could not be read */
+    int32_t value;
+    /* CLOCK_MONOTONIC time in nanoseconds the capture thread woke up for the edge */
+    uint64_t timestamp_ns;
+};
+
+/**
+ * Statistics of a ring.
+ */
+struct ugpio_ring_stats {
+    /* events stored in the ring */
+    uint64_t pushed;
+    /* events taken from the ring */
+    uint64_t popped;
+    /* events dropped because the ring was full */
+    uint64_t overflows;
+};
+
+struct ugpio_ring;
+typedef struct ugpio_ring ugpio_ring_t;
+
+struct ugpio_capture;
+typedef struct ugpio_capture ugpio_capture_t;
+
+/**
+ * Create a ring.
+ *
+ * @param capacity the minimum number of events the ring can hold, it is
+ *        rounded up to a power of two
+ * @return returns a ugpio_ring_t object on success, NULL otherwise
+ */
+ugpio_ring_t *ugpio_ring_new(size_t capacity);
+
+/**
+ * Release/free a ring.
+ *
+ * @param ring a ring
+ */
+void ugpio_ring_free(ugpio_ring_t *ring);
+
+/**
+ * Store an event in the ring (producer side).
+ *
+ * @param ring a ring
+ * @param event the event to store
+ * @return 0 on success, -1 if the ring is full and the event was dropped
+ */
+int ugpio_ring_push(ugpio_ring_t *ring, const struct ugpio_event *event);
+
+/**
+ * Take events from the ring (consumer side).
+ *
+ * @param ring a ring
+ * @param events an array receiving the events, oldest first
+ * @param max the size of the array
+ * @return the number of events taken, 0 if the ring is empty
+ */
+size_t ugpio_ring_pop(ugpio_ring_t *ring, struct ugpio_event *events, size_t max);
+
+/**
+ * Return the number of events currently in the ring.
+ *
+ * @param ring a ring
+ */
+size_t ugpio_ring_count(ugpio_ring_t *ring);
+
+/**
+ * Get the statistics of a ring.
+ *
+ * @param ring a ring
+ * @param stats receives the statistics
+ */
+void ugpio_ring_get_stats(ugpio_ring_t *ring, struct ugpio_ring_stats *stats);
+
+/**
+ * Create a capture thread object.
+ *
+ * @return returns a ugpio_capture_t object on success, NULL otherwise
+ */
+ugpio_capture_t *ugpio_capture_new(void);
+
+/**
+ * Release/free a capture thread object, stopping the thread if necessary.
+ *
+ * The GPIO contexts and rings are neither closed nor freed.
+ *
+ * @param cap a capture thread object
+ */
+void ugpio_capture_free(ugpio_capture_t *cap);
+
+/**
+ * Record the edges of a GPIO context into a ring.
+ *
+ * GPIOs can only be added while the capture thread is not running.
+ *
+ * @param cap a capture thread object
+ * @param ctx a GPIO context configured for edges
+ * @param ring the ring to store the events in
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EBUSY - the capture thread is running.
+ */
+int ugpio_capture_add(ugpio_capture_t *cap, ugpio_t *ctx, ugpio_ring_t *ring);
+
+/**
+ * Start the capture thread.
+ *
+ * @param cap a capture thread object
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_capture_start(ugpio_capture_t *cap);
+
+/**
+ * Stop the capture thread and wait for it to terminate.
+ *
+ * @param cap a capture thread object
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_capture_stop(ugpio_capture_t *cap);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_RING_H */
@@ -0,0 +1,809 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-sim.h>
+#include <ugpio-internal.h>
+
+/**
+ * A line of the simulated chip.
+ */
+struct sim_line {
+    /* whether the line is exported */
+    int exported;
+    /* direction: 1 input, 0 output */
+    int dir_in;
+    /* active low flag */
+    int active_low;
+    /* physical level on the line */
+    int level;
+    /* GPIOF_TRIG_* flags */
+    unsigned int edge;
+    /* output line driving this input, or -1 */
+    int source;
+    /* first input driven by this output, or -1 */
+    int sinks;
+    /* next input driven by the same output, or -1 */
+    int sink_next;
+    /* first open value file descriptor, or -1 */
+    int value_fds;
+    /* number of edges signalled */
+    long edges;
+    /* edge generator */
+    pthread_t generator;
+    int generating;
+    atomic_int gen_stop;
+    unsigned long gen_period_ns;
+    unsigned long gen_count;
+};
+
+/**
+ * A file descriptor handed out by the simulated chip.
+ */
+struct sim_fd {
+    int used;
+    unsigned int gpio;
+    int attr;
+    /* whether an edge was signalled but not yet acknowledged */
+    int pending;
+    /* next value file descriptor of the same line, or -1 */
+    int next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct sim_line *lines;
+    unsigned int ngpio;
+    struct sim_fd *fds;
+    int nfds;
+    int open_fds;
+} sim = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int sim_setup(unsigned int ngpio)
+{
+    struct sim_line *lines;
+    unsigned int i;
+
+    if ((lines = calloc(ngpio, sizeof(*lines))) == NULL)
+        return -1;
+
+    for (i = 0; i < ngpio; i++) {
+        lines[i].dir_in = 1;
+        lines[i].source = -1;
+        lines[i].sinks = -1;
+        lines[i].sink_next = -1;
+        lines[i].value_fds = -1;
+    }
+
+    free(sim.lines);
+    sim.lines = lines;
+    sim.ngpio = ngpio;
+
+    return 0;
+}
+
+/* must be called with the lock held */
+static struct sim_line *sim_line(unsigned int gpio)
+{
+    if (sim.lines == NULL && sim_setup(UGPIO_SIM_DEFAULT_LINES) == -1)
+        return NULL;
+
+    if (gpio >= sim.ngpio) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return &sim.lines[gpio];
+}
+
+/* must be called with the lock held */
+static void sim_set_level(unsigned int gpio, int level)
+{
+    struct sim_line *line = &sim.lines[gpio];
+    unsigned int trigger;
+    uint64_t one = 1;
+    int sink, fd;
+
+    level = !!level;
+    if (line->level == level)
+        return;
+
+    line->level = level;
+
+    if (!line->dir_in) {
+        for (sink = line->sinks; sink != -1; sink = sim.lines[sink].sink_next)
+            sim_set_level(sink, level);
+        return;
+    }
+
+    if (!line->exported)
+        return;
+
+    trigger = (level ^ line->active_low) ? GPIOF_TRIG_RISE : GPIOF_TRIG_FALL;
+    if (!(line->edge & trigger))
+        return;
+
+    line->edges++;
+    for (fd = line->value_fds; fd != -1; fd = sim.fds[fd].next) {
+        if (!sim.fds[fd].pending)
+            (void)!write(fd, &one, sizeof(one));
+        sim.fds[fd].pending = 1;
+    }
+}
+
+/* must be called with the lock held */
+static void sim_acknowledge(int fd)
+{
+    uint64_t events;
+
+    if (sim.fds[fd].pending) {
+        (void)!read(fd, &events, sizeof(events));
+        sim.fds[fd].pending = 0;
+    }
+}
+
+/* must be called with the lock held */
+static struct sim_fd *sim_fd(int fd)
+{
+    if (fd < 0 || fd >= sim.nfds || !sim.fds[fd].used) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    return &sim.fds[fd];
+}
+
+static int sim_open(unsigned int gpio, const char *key, int flags)
+{
+    struct sim_line *line = NULL;
+    struct sim_fd *fds;
+    int attr, fd, nfds;
+
+    if ((attr = gpio_key_attr(key)) == GPIO_ATTR_UNKNOWN) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    pthread_mutex_lock(&sim.lock);
+
+    if (attr != GPIO_ATTR_EXPORT && attr != GPIO_ATTR_UNEXPORT) {
+        if ((line = sim_line(gpio)) == NULL || !line->exported) {
+            errno = ENOENT;
+            goto err_unlock;
+        }
+    }
+
+    fd = eventfd(0, EFD_NONBLOCK | ((flags & O_CLOEXEC) ? EFD_CLOEXEC : 0));
+    if (fd == -1)
+        goto err_unlock;
+
+    if (fd >= sim.nfds) {
+        nfds = fd + 16;
+        if ((fds = realloc(sim.fds, nfds * sizeof(*fds))) == NULL) {
+            close(fd);
+            goto err_unlock;
+        }
+        memset(fds + sim.nfds, 0, (nfds - sim.nfds) * sizeof(*fds));
+        sim.fds = fds;
+        sim.nfds = nfds;
+    }
+
+    sim.fds[fd].used = 1;
+    sim.fds[fd].gpio = gpio;
+    sim.fds[fd].attr = attr;
+    sim.fds[fd].pending = 0;
+    sim.fds[fd].next = -1;
+    sim.open_fds++;
+
+    if (attr == GPIO_ATTR_VALUE) {
+        sim.fds[fd].next = line->value_fds;
+        line->value_fds = fd;
+    }
+
+    pthread_mutex_unlock(&sim.lock);
+    return fd;
+
+err_unlock:
+    pthread_mutex_unlock(&sim.lock);
+    return -1;
+}
+
+static int sim_close(int fd)
+{
+    struct sim_fd *f;
+    int *p;
+
+    pthread_mutex_lock(&sim.lock);
+
+    if ((f = sim_fd(fd)) == NULL) {
+        pthread_mutex_unlock(&sim.lock);
+        return -1;
+    }
+
+    if (f->attr == GPIO_ATTR_VALUE) {
+        for (p = &sim.lines[f->gpio].value_fds; *p != -1; p = &sim.fds[*p].next) {
+            if (*p == fd) {
+                *p = f->next;
+                break;
+            }
+        }
+    }
+
+    f->used = 0;
+    sim.open_fds--;
+
+    pthread_mutex_unlock(&sim.lock);
+
+    return close(fd);
+}
+
+static ssize_t sim_read(int fd, void *buf, size_t count)
+{
+    struct sim_line *line;
+    struct sim_fd *f;
+    char text[16];
+    int len;
+
+    pthread_mutex_lock(&sim.lock);
+
+    if ((f = sim_fd(fd)) == NULL)
+        goto err_unlock;
+
+    if (f->attr == GPIO_ATTR_EXPORT || f->attr == GPIO_ATTR_UNEXPORT) {
+        errno = EINVAL;
+        goto err_unlock;
+    }
+
+    line = &sim.lines[f->gpio];
+    if (!line->exported) {
+        errno = ENODEV;
+        goto err_unlock;
+    }
+
+    switch (f->attr) {
+    case GPIO_ATTR_DIRECTION:
+        len = snprintf(text, sizeof(text), "%s\n", line->dir_in ? "in" : "out");
+        break;
+    case GPIO_ATTR_ACTIVELOW:
+        len = snprintf(text, sizeof(text), "%d\n", line->active_low);
+        break;
+    case GPIO_ATTR_EDGE:
+        len = snprintf(text, sizeof(text), "%s\n", gpio_edge_name(line->edge));
+        break;
+    default:
+        /* reading the value acknowledges pending edges like sysfs does */
+        sim_acknowledge(fd);
+        len = snprintf(text, sizeof(text), "%d\n", line->level ^ line->active_low);
+        break;
+    }
+
+    pthread_mutex_unlock(&sim.lock);
+
+    if (count > len)
+        count = len;
+    memcpy(buf, text, count);
+
+    return count;
+
+err_unlock:
+    pthread_mutex_unlock(&sim.lock);
+    return -1;
+}
+
+static int sim_export(unsigned int gpio, int export)
+{
+    struct sim_line *line;
+
+    if ((line = sim_line(gpio)) == NULL)
+        return -1;
+
+    if (export) {
+        if (line->exported) {
+            errno = EBUSY;
+            return -1;
+        }
+        line->exported = 1;
+        line->dir_in = 1;
+        line->active_low = 0;
+        line->edge = 0;
+        line->edges = 0;
+    } else {
+        if (!line->exported) {
+            errno = EINVAL;
+            return -1;
+        }
+        line->exported = 0;
+    }
+
+    return 0;
+}
+
+static ssize_t sim_write(int fd, const void *buf, size_t count)
+{
+    struct sim_line *line;
+    struct sim_fd *f;
+    char text[16];
+    int rv = -1;
+    int edge;
+
+    if (count >= sizeof(text)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memcpy(text, buf, count);
+    text[count] = '\0';
+
+    pthread_mutex_lock(&sim.lock);
+
+    if ((f = sim_fd(fd)) == NULL)
+        goto out;
+
+    if (f->attr == GPIO_ATTR_EXPORT || f->attr == GPIO_ATTR_UNEXPORT) {
+        rv = sim_export(strtoul(text, NULL, 10), f->attr == GPIO_ATTR_EXPORT);
+        goto out;
+    }
+
+    line = &sim.lines[f->gpio];
+    if (!line->exported) {
+        errno = ENODEV;
+        goto out;
+    }
+
+    switch (f->attr) {
+    case GPIO_ATTR_DIRECTION:
+        if (strncmp(text, "in", 2) == 0) {
+            line->dir_in = 1;
+            rv = 0;
+        } else if (strncmp(text, "out", 3) == 0 || strncmp(text, "low", 3) == 0 ||
+                   strncmp(text, "high", 4) == 0) {
+            line->dir_in = 0;
+            line->edge = 0;
+            line->level = -1;
+            sim_set_level(f->gpio, text[0] == 'h');
+            rv = 0;
+        } else {
+            errno = EINVAL;
+        }
+        break;
+    case GPIO_ATTR_ACTIVELOW:
+        line->active_low = (text[0] != '0');
+        rv = 0;
+        break;
+    case GPIO_ATTR_EDGE:
+        if ((edge = gpio_edge_parse(text, count)) == -1) {
+            errno = EINVAL;
+        } else if (edge && !line->dir_in) {
+            errno = EIO;
+        } else {
+            line->edge = edge;
+            rv = 0;
+        }
+        break;
+    default:
+        if (line->dir_in) {
+            errno = EPERM;
+        } else {
+            sim_set_level(f->gpio, (text[0] != '0') ^ line->active_low);
+            rv = 0;
+        }
+        break;
+    }
+
+out:
+    pthread_mutex_unlock(&sim.lock);
+    return (rv == -1) ? -1 : count;
+}
+
+static int sim_check(unsigned int gpio, const char *key)
+{
+    struct sim_line *line;
+    int attr, rv;
+
+    if ((attr = gpio_key_attr(key)) == GPIO_ATTR_UNKNOWN)
+        return 0;
+
+    if (attr == GPIO_ATTR_EXPORT || attr == GPIO_ATTR_UNEXPORT)
+        return 1;
+
+    pthread_mutex_lock(&sim.lock);
+    line = sim_line(gpio);
+    rv = (line != NULL && line->exported);
+    pthread_mutex_unlock(&sim.lock);
+
+    return rv;
+}
+
+static int sim_get_values(const int *fds, unsigned int num, uint64_t *bits)
+{
+    struct sim_line *line;
+    struct sim_fd *f;
+    unsigned int i;
+    int rv = -1;
+
+    *bits = 0;
+
+    pthread_mutex_lock(&sim.lock);
+
+    for (i = 0; i < num; i++) {
+        if ((f = sim_fd(fds[i])) == NULL)
+            goto out;
+        line = &sim.lines[f->gpio];
+        if (f->attr != GPIO_ATTR_VALUE || !line->exported) {
+            errno = EINVAL;
+            goto out;
+        }
+        sim_acknowledge(fds[i]);
+        if (line->level ^ line->active_low)
+            *bits |= UINT64_C(1) << i;
+    }
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&sim.lock);
+    return rv;
+}
+
+static int sim_set_values(const int *fds, unsigned int num, uint64_t mask, uint64_t bits)
+{
+    struct sim_line *line;
+    struct sim_fd *f;
+    unsigned int i;
+    int rv = -1;
+
+    pthread_mutex_lock(&sim.lock);
+
+    for (i = 0; i < num; i++) {
+        if (!(mask & (UINT64_C(1) << i)))
+            continue;
+        if ((f = sim_fd(fds[i])) == NULL)
+            goto out;
+        line = &sim.lines[f->gpio];
+        if (f->attr != GPIO_ATTR_VALUE || !line->exported || line->dir_in) {
+            errno = line->dir_in ? EPERM : EINVAL;
+            goto out;
+        }
+        sim_set_level(f->gpio, !!(bits & (UINT64_C(1) << i)) ^ line->active_low);
+    }
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&sim.lock);
+    return rv;
+}
+
+static ssize_t sim_snapshot(struct ugpio_line_state **states)
+{
+    struct ugpio_line_state *s;
+    struct sim_line *line;
+    unsigned int i;
+    ssize_t num = 0;
+
+    *states = NULL;
+
+    pthread_mutex_lock(&sim.lock);
+
+    for (i = 0; i < sim.ngpio; i++)
+        num += sim.lines[i].exported;
+
+    if (num == 0)
+        goto out;
+
+    if ((s = malloc(num * sizeof(*s))) == NULL) {
+        num = -1;
+        goto out;
+    }
+
+    for (i = 0, num = 0; i < sim.ngpio; i++) {
+        line = &sim.lines[i];
+        if (!line->exported)
+            continue;
+        s[num].gpio = i;
+        s[num].direction = line->dir_in ? GPIOF_DIR_IN : GPIOF_DIR_OUT;
+        s[num].active_low = line->active_low;
+        s[num].value = line->level ^ line->active_low;
+        s[num].edge = line->edge;
+        num++;
+    }
+    *states = s;
+
+out:
+    pthread_mutex_unlock(&sim.lock);
+    return num;
+}
+
+const struct gpio_backend gpio_backend_sim = {
+    .name = "sim",
+    .poll_events = POLLIN,
+    .open = sim_open,
+    .close = sim_close,
+    .read = sim_read,
+    .write = sim_write,
+    .check = sim_check,
+    .get_values = sim_get_values,
+    .set_values = sim_set_values,
+    .snapshot = sim_snapshot,
+};
+
+int ugpio_sim_init(unsigned int ngpio)
+{
+    int rv = -1;
+
+    ugpio_sim_cleanup();
+
+    pthread_mutex_lock(&sim.lock);
+
+    if (sim.open_fds)
+        errno = EBUSY;
+    else
+        rv = sim_setup(ngpio);
+
+    pthread_mutex_unlock(&sim.lock);
+
+    return rv;
+}
+
+void ugpio_sim_cleanup(void)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&sim.lock);
+    for (i = 0; i < sim.ngpio; i++) {
+        if (sim.lines[i].generating) {
+            pthread_mutex_unlock(&sim.lock);
+            ugpio_sim_generator_stop(i);
+            pthread_mutex_lock(&sim.lock);
+        }
+    }
+
+    if (!sim.open_fds) {
+        free(sim.lines);
+        sim.lines = NULL;
+        sim.ngpio = 0;
+        free(sim.fds);
+        sim.fds = NULL;
+        sim.nfds = 0;
+    }
+    pthread_mutex_unlock(&sim.lock);
+}
+
+int ugpio_sim_set_input(unsigned int gpio, int level)
+{
+    struct sim_line *line;
+    int rv = -1;
+
+    pthread_mutex_lock(&sim.lock);
+
+    if ((line = sim_line(gpio)) == NULL)
+        goto out;
+
+    if (line->source != -1) {
+        errno = EBUSY;
+        goto out;
+    }
+
+    sim_set_level(gpio, level);
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&sim.lock);
+    return rv;
+}
+
+int ugpio_sim_get_level(unsigned int gpio)
+{
+    struct sim_line *line;
+    int rv = -1;
+
+    pthread_mutex_lock(&sim.lock);
+    if ((line = sim_line(gpio)) != NULL)
+        rv = line->level;
+    pthread_mutex_unlock(&sim.lock);
+
+    return rv;
+}
+
+/* must be called with the lock held */
+static void sim_unwire(unsigned int input)
+{
+    struct sim_line *line = &sim.lines[input];
+    int *p;
+
+    if (line->source == -1)
+        return;
+
+    for (p = &sim.lines[line->source].sinks; *p != -1; p = &sim.lines[*p].sink_next) {
+        if (*p == input) {
+            *p = line->sink_next;
+            break;
+        }
+    }
+
+    line->source = -1;
+    line->sink_next = -1;
+}
+
+int ugpio_sim_connect(unsigned int output, unsigned int input)
+{
+    struct sim_line *out, *in;
+    int rv = -1;
+
+    pthread_mutex_lock(&sim.lock);
+
+    if ((out = sim_line(output)) == NULL || (in = sim_line(input)) == NULL)
+        goto unlock;
+
+    if (output == input) {
+        errno = EINVAL;
+        goto unlock;
+    }
+
+    sim_unwire(input);
+    in->source = output;
+    in->sink_next = out->sinks;
+    out->sinks = input;
+    sim_set_level(input, out->level);
+    rv = 0;
+
+unlock:
+    pthread_mutex_unlock(&sim.lock);
+    return rv;
+}
+
+int ugpio_sim_disconnect(unsigned int input)
+{
+    int rv = -1;
+
+    pthread_mutex_lock(&sim.lock);
+    if (sim_line(input) != NULL) {
+        sim_unwire(input);
+        rv = 0;
+    }
+    pthread_mutex_unlock(&sim.lock);
+
+    return rv;
+}
+
+int ugpio_sim_toggle(unsigned int gpio, unsigned int count)
+{
+    struct sim_line *line;
+    int rv = -1;
+
+    pthread_mutex_lock(&sim.lock);
+
+    if ((line = sim_line(gpio)) == NULL)
+        goto out;
+
+    if (line->source != -1) {
+        errno = EBUSY;
+        goto out;
+    }
+
+    while (count--)
+        sim_set_level(gpio, !line->level);
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&sim.lock);
+    return rv;
+}
+
+static void *sim_generator(void *arg)
+{
+    unsigned int gpio = (uintptr_t)arg;
+    struct sim_line *line;
+    unsigned long count, n;
+    uint64_t next;
+
+    pthread_mutex_lock(&sim.lock);
+    line = &sim.lines[gpio];
+    count = line->gen_count;
+    pthread_mutex_unlock(&sim.lock);
+
+    next = gpio_now_ns();
+
+    for (n = 0; count == 0 || n < count; n++) {
+        next += line->gen_period_ns;
+        if (gpio_sleep_until(next, &line->gen_stop) == -1)
+            break;
+
+        pthread_mutex_lock(&sim.lock);
+        if (line->source == -1)
+            sim_set_level(gpio, !line->level);
+        pthread_mutex_unlock(&sim.lock);
+    }
+
+    return NULL;
+}
+
+int ugpio_sim_generator_start(unsigned int gpio, unsigned long period_ns,
+                              unsigned long count)
+{
+    struct sim_line *line;
+    int rv = -1;
+
+    pthread_mutex_lock(&sim.lock);
+
+    if ((line = sim_line(gpio)) == NULL)
+        goto out;
+
+    if (line->generating) {
+        errno = EBUSY;
+        goto out;
+    }
+
+    line->gen_period_ns = period_ns;
+    line->gen_count = count;
+    line->generating = 1;
+    atomic_store(&line->gen_stop, 0);
+
+    if ((errno = pthread_create(&line->generator, NULL, sim_generator,
+                                (void *)(uintptr_t)gpio)) != 0) {
+        line->generating = 0;
+        goto out;
+    }
+    rv = 0;
+
+out:
+    pthread_mutex_unlock(&sim.lock);
+    return rv;
+}
+
+int ugpio_sim_generator_stop(unsigned int gpio)
+{
+    struct sim_line *line;
+    pthread_t thread;
+
+    pthread_mutex_lock(&sim.lock);
+
+    if ((line = sim_line(gpio)) == NULL) {
+        pthread_mutex_unlock(&sim.lock);
+        return -1;
+    }
+
+    if (!line->generating) {
+        pthread_mutex_unlock(&sim.lock);
+        errno = ESRCH;
+        return -1;
+    }
+
+    line->generating = 0;
+    atomic_store(&line->gen_stop, 1);
+    thread = line->generator;
+
+    pthread_mutex_unlock(&sim.lock);
+
+    return (errno = pthread_join(thread, NULL)) ? -1 : 0;
+}
+
+long ugpio_sim_edge_count(unsigned int gpio)
+{
+    struct sim_line *line;
+    long rv = -1;
+
+    pthread_mutex_lock(&sim.lock);
+    if ((line = sim_line(gpio)) != NULL)
+        rv = line->edges;
+    pthread_mutex_unlock(&sim.lock);
+
+    return rv;
+}
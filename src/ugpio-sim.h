@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_SIM_H
+#define UGPIO_SIM_H
+
+#include "ugpio.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Simulated GPIO chip
+ *
+ * When the "sim" backend is selected with ugpio_set_backend, all GPIOs live
+ * in memory and no kernel interface is involved. The lines behave like their
+ * sysfs counterparts: they have to be exported, can be configured as input or
+ * output and report edges on the value file descriptor (wait for the events
+ * returned by ugpio_fd_events). Inputs are either driven by the functions
+ * below or wired to an output line (loopback).
+ *
+ * If no chip was set up explicitly, a chip with UGPIO_SIM_DEFAULT_LINES lines
+ * is created on first use.
+ */
+
+#define UGPIO_SIM_DEFAULT_LINES      64
+
+/**
+ * (Re-)Create the simulated chip.
+ *
+ * @param ngpio the number of lines, numbered 0 to ngpio - 1
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EBUSY - there are still open file descriptors of the old chip.
+ */
+int ugpio_sim_init(unsigned int ngpio);
+
+/**
+ * Release the simulated chip.
+ *
+ * Stops all edge generators and frees all memory of the chip.
+ */
+void ugpio_sim_cleanup(void);
+
+/**
+ * Drive the level of a simulated input.
+ *
+ * The level is the physical level on the line, i.e. it is inverted when
+ * the line is configured as 'active low'. An edge is signalled when the
+ * logical value changes and the edge setting of the line matches.
+ *
+ * @param gpio the GPIO number
+ * @param level 0 for LOW, 1 for HIGH
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EBUSY - the line is wired to an output.
+ */
+int ugpio_sim_set_input(unsigned int gpio, int level);
+
+/**
+ * Get the physical level of a simulated line.
+ *
+ * @param gpio the GPIO number
+ * @return 0 or 1 on success, -1 on error with errno set appropriately
+ */
+int ugpio_sim_get_level(unsigned int gpio);
+
+/**
+ * Wire an output line to an input line.
+ *
+ * Afterwards every level change of the output is seen on the input. An
+ * output may drive multiple inputs, an input is driven by at most one output.
+ *
+ * @param output the GPIO number of the driving line
+ * @param input the GPIO number of the driven line
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_sim_connect(unsigned int output, unsigned int input);
+
+/**
+ * Remove the wiring of an input line.
+ *
+ * @param input the GPIO number of the driven line
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_sim_disconnect(unsigned int input);
+
+/**
+ * Toggle the level of a simulated input several times in a row.
+ *
+ * @param gpio the GPIO number
+ * @param count the number of level changes to generate
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_sim_toggle(unsigned int gpio, unsigned int count);
+
+/**
+ * Start a background thread toggling a simulated input periodically.
+ *
+ * A generator has to be stopped with ugpio_sim_generator_stop before a new
+ * one can be started on the same line, even when it has already finished.
+ *
+ * @param gpio the GPIO number
+ * @param period_ns the time between two level changes in nanoseconds
+ * @param count the number of level changes to generate, 0 for infinite
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EBUSY - a generator is already running for this line.
+ */
+int ugpio_sim_generator_start(unsigned int gpio, unsigned long period_ns,
+                              unsigned long count);
+
+/**
+ * Stop the edge generator of a simulated input.
+ *
+ * @param gpio the GPIO number
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_sim_generator_stop(unsigned int gpio);
+
+/**
+ * Return the number of edges signalled on a simulated line so far.
+ *
+ * @param gpio the GPIO number
+ * @return the number of edges, -1 on error with errno set appropriately
+ */
+long ugpio_sim_edge_count(unsigned int gpio);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_SIM_H */
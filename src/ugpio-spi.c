@@ -0,0 +1,255 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-spi.h>
+#include <ugpio-internal.h>
+
+/**
+ * An output line of the serial interface.
+ */
+struct spi_line {
+    /* the GPIO context, NULL if not used */
+    ugpio_t *ctx;
+    /* the value file descriptor, -1 if not used */
+    int fd;
+    /* the level last written by the current transfer, -1 if unknown */
+    int level;
+};
+
+struct ugpio_spi {
+    struct spi_line sclk;
+    struct spi_line mosi;
+    struct spi_line cs;
+    /* the value file descriptor of the data input, -1 if not used */
+    int miso;
+    unsigned int flags;
+    /* half of the clock period, 0 for as fast as possible */
+    uint64_t half_period_ns;
+    struct ugpio_spi_stats stats;
+};
+
+/* open a context, and remember it if it was not open before */
+static int spi_open(ugpio_t *ctx, ugpio_t **opened, unsigned int *num_opened)
+{
+    int was_closed = ctx->fd_value == -1;
+    int fd;
+
+    if ((fd = ugpio_open(ctx)) != -1 && was_closed)
+        opened[(*num_opened)++] = ctx;
+
+    return fd;
+}
+
+static int spi_line_init(struct spi_line *line, ugpio_t *ctx,
+                         ugpio_t **opened, unsigned int *num_opened)
+{
+    line->ctx = ctx;
+    line->level = -1;
+    line->fd = -1;
+
+    if (ctx == NULL)
+        return 0;
+
+    if ((line->fd = spi_open(ctx, opened, num_opened)) == -1)
+        return -1;
+
+    return 0;
+}
+
+ugpio_spi_t *ugpio_spi_new(ugpio_t *sclk, ugpio_t *mosi, ugpio_t *miso, ugpio_t *cs,
+                           unsigned int flags)
+{
+    ugpio_t *opened[4];
+    unsigned int num_opened = 0, i;
+    ugpio_spi_t *spi;
+
+    if (sclk == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((spi = calloc(1, sizeof(*spi))) == NULL)
+        return NULL;
+
+    spi->flags = flags;
+    spi->miso = -1;
+
+    if (spi_line_init(&spi->sclk, sclk, opened, &num_opened) == -1 ||
+        spi_line_init(&spi->mosi, mosi, opened, &num_opened) == -1 ||
+        spi_line_init(&spi->cs, cs, opened, &num_opened) == -1)
+        goto err_close;
+
+    if (miso && (spi->miso = spi_open(miso, opened, &num_opened)) == -1)
+        goto err_close;
+
+    return spi;
+
+err_close:
+    /* contexts which were open before stay open */
+    for (i = 0; i < num_opened; i++)
+        ugpio_close(opened[i]);
+    free(spi);
+    return NULL;
+}
+
+void ugpio_spi_free(ugpio_spi_t *spi)
+{
+    free(spi);
+}
+
+void ugpio_spi_set_speed(ugpio_spi_t *spi, uint32_t hz)
+{
+    spi->half_period_ns = hz ? 500000000 / hz : 0;
+}
+
+/* write a line unless it already has the level */
+static int spi_set(struct spi_line *line, int level)
+{
+    if (line->level == level || line->fd == -1)
+        return 0;
+
+    if (gpio_fd_write(line->fd, level ? "1" : "0", 2) != 2) {
+        line->level = -1;
+        gpio_value_written(line->ctx, -1);
+        return -1;
+    }
+
+    line->level = level;
+    gpio_value_written(line->ctx, level);
+    return 0;
+}
+
+static int spi_get(ugpio_spi_t *spi)
+{
+    char buffer;
+
+    if (gpio_fd_read(spi->miso, &buffer, sizeof(buffer)) != sizeof(buffer))
+        return -1;
+
+    return buffer != '0';
+}
+
+/*
+ * The clock rates possible with GPIOs are far too high for sleeping, so
+ * busy wait until half a clock period passed since the last edge.
+ */
+static void spi_delay(ugpio_spi_t *spi, uint64_t *edge)
+{
+    uint64_t now;
+
+    if (spi->half_period_ns == 0)
+        return;
+
+    while ((now = gpio_now_ns()) - *edge < spi->half_period_ns)
+        ;
+
+    *edge = now;
+}
+
+int ugpio_spi_transfer(ugpio_spi_t *spi, const void *tx, void *rx, size_t len)
+{
+    const unsigned char *out = tx;
+    unsigned char *in = rx;
+    int cpol = !!(spi->flags & UGPIO_SPI_CPOL);
+    int cpha = !!(spi->flags & UGPIO_SPI_CPHA);
+    int cs_active = !!(spi->flags & UGPIO_SPI_CS_HIGH);
+    uint64_t start, edge;
+    unsigned char txbyte, rxbyte;
+    size_t i;
+    int bit, shift, bitval, rv = -1;
+
+    start = edge = gpio_now_ns();
+
+    /* the lines may have been written by others since the last transfer */
+    spi->sclk.level = spi->mosi.level = spi->cs.level = -1;
+
+    if (spi_set(&spi->sclk, cpol) == -1 || spi_set(&spi->cs, !cs_active) == -1)
+        goto out;
+
+    if (spi->flags & UGPIO_SPI_CS_PULSE) {
+        spi_delay(spi, &edge);
+        if (spi_set(&spi->cs, cs_active) == -1)
+            goto out;
+        spi_delay(spi, &edge);
+        if (spi_set(&spi->cs, !cs_active) == -1)
+            goto out;
+    } else {
+        if (spi_set(&spi->cs, cs_active) == -1)
+            goto out;
+    }
+
+    for (i = 0; i < len; i++) {
+        txbyte = out ? out[i] : 0;
+        rxbyte = 0;
+
+        for (bit = 0; bit < 8; bit++) {
+            shift = (spi->flags & UGPIO_SPI_LSB_FIRST) ? bit : 7 - bit;
+            bitval = (txbyte >> shift) & 1;
+
+            /* with CPHA=0 the data must be valid before the leading edge */
+            if (!cpha && spi_set(&spi->mosi, bitval) == -1)
+                goto out;
+            spi_delay(spi, &edge);
+            if (spi_set(&spi->sclk, !cpol) == -1)
+                goto out;
+
+            if (cpha) {
+                if (spi_set(&spi->mosi, bitval) == -1)
+                    goto out;
+            } else if (spi->miso != -1) {
+                if ((bitval = spi_get(spi)) == -1)
+                    goto out;
+                rxbyte |= bitval << shift;
+            }
+
+            spi_delay(spi, &edge);
+            if (spi_set(&spi->sclk, cpol) == -1)
+                goto out;
+
+            if (cpha && spi->miso != -1) {
+                if ((bitval = spi_get(spi)) == -1)
+                    goto out;
+                rxbyte |= bitval << shift;
+            }
+        }
+
+        if (in)
+            in[i] = rxbyte;
+        spi->stats.bits += 8;
+    }
+
+    rv = 0;
+
+out:
+    /* deselect resp. latch the shifted data */
+    if (!(spi->flags & UGPIO_SPI_CS_PULSE)) {
+        spi_delay(spi, &edge);
+        spi_set(&spi->cs, !cs_active);
+    }
+
+    spi->stats.transfers++;
+    spi->stats.busy_ns += gpio_now_ns() - start;
+
+    return rv;
+}
+
+void ugpio_spi_get_stats(ugpio_spi_t *spi, struct ugpio_spi_stats *stats)
+{
+    *stats = spi->stats;
+}
+
+void ugpio_spi_reset_stats(ugpio_spi_t *spi)
+{
+    memset(&spi->stats, 0, sizeof(spi->stats));
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_SPI_H
+#define UGPIO_SPI_H
+
+#include "ugpio.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Bit-banged serial interface
+ *
+ * Shifts whole buffers in and out through a clock, data out, data in and
+ * chip select line, e.g. to talk to SPI devices or to 74HC595/74HC165 shift
+ * register chains. Lines are accessed through their value file descriptors
+ * directly and only written when their level changes, so the bit rate is
+ * limited by the backend only, unless a lower clock rate is configured.
+ *
+ * The contexts must be configured as outputs resp. input beforehand.
+ */
+
+/* clock polarity: the clock idles high */
+#define UGPIO_SPI_CPOL               (1 << 0)
+/* clock phase: data is sampled on the trailing clock edge */
+#define UGPIO_SPI_CPHA               (1 << 1)
+
+#define UGPIO_SPI_MODE_0             (0)
+#define UGPIO_SPI_MODE_1             (UGPIO_SPI_CPHA)
+#define UGPIO_SPI_MODE_2             (UGPIO_SPI_CPOL)
+#define UGPIO_SPI_MODE_3             (UGPIO_SPI_CPOL | UGPIO_SPI_CPHA)
+
+/* shift the least significant bit of each byte first */
+#define UGPIO_SPI_LSB_FIRST          (1 << 2)
+/* the chip select line is active high */
+#define UGPIO_SPI_CS_HIGH            (1 << 3)
+/*
+ * pulse the chip select line before shifting instead of holding it active
+ * during the transfer, e.g. the parallel load of a 74HC165
+ */
+#define UGPIO_SPI_CS_PULSE           (1 << 4)
+
+/**
+ * Throughput statistics of a serial interface.
+ *
+ * The achieved bit rate is bits * 1e9 / busy_ns.
+ */
+struct ugpio_spi_stats {
+    /* the number of transfers */
+    uint64_t transfers;
+    /* the number of bits shifted */
+    uint64_t bits;
+    /* the time spent in transfers */
+    uint64_t busy_ns;
+};
+
+struct ugpio_spi;
+typedef struct ugpio_spi ugpio_spi_t;
+
+/**
+ * Create a serial interface.
+ *
+ * The value files of the contexts are opened if necessary.
+ *
+ * @param sclk the clock output
+ * @param mosi the data output, NULL when only reading
+ * @param miso the data input, NULL when only writing
+ * @param cs the chip select resp. latch output, may be NULL
+ * @param flags one of the UGPIO_SPI_MODE_* or-ed with other UGPIO_SPI_* flags
+ * @return returns a ugpio_spi_t object on success, NULL otherwise
+ */
+ugpio_spi_t *ugpio_spi_new(ugpio_t *sclk, ugpio_t *mosi, ugpio_t *miso, ugpio_t *cs,
+                           unsigned int flags);
+
+/**
+ * Release/free a serial interface.
+ *
+ * The GPIO contexts are neither closed nor freed.
+ *
+ * @param spi a serial interface
+ */
+void ugpio_spi_free(ugpio_spi_t *spi);
+
+/**
+ * Limit the clock rate.
+ *
+ * @param spi a serial interface
+ * @param hz the maximum clock rate, 0 for as fast as possible (the default)
+ */
+void ugpio_spi_set_speed(ugpio_spi_t *spi, uint32_t hz);
+
+/**
+ * Shift a buffer out and in at the same time.
+ *
+ * @param spi a serial interface
+ * @param tx the bytes to shift out, NULL to shift out zeros
+ * @param rx receives the bytes shifted in, may be NULL
+ * @param len the number of bytes
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_spi_transfer(ugpio_spi_t *spi, const void *tx, void *rx, size_t len);
+
+/**
+ * Get the throughput statistics.
+ *
+ * @param spi a serial interface
+ * @param stats receives the statistics
+ */
+void ugpio_spi_get_stats(ugpio_spi_t *spi, struct ugpio_spi_stats *stats);
+
+/**
+ * Reset the throughput statistics.
+ *
+ * @param spi a serial interface
+ */
+void ugpio_spi_reset_stats(ugpio_spi_t *spi);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_SPI_H */
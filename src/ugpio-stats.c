@@ -0,0 +1,229 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+#if UGPIO_STATS
+
+/* the file descriptor table is allocated in pages of this many entries */
+#define STATS_FD_PAGE  1024
+#define STATS_FD_PAGES 1024
+
+int gpio_stats_enabled;
+
+static struct ugpio_stats stats_global;
+
+/* the statistics of the context each file descriptor belongs to */
+static struct ugpio_stats **stats_fds[STATS_FD_PAGES];
+static pthread_mutex_t stats_fds_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the context statistics of the operation in progress in this thread */
+static __thread struct ugpio_stats *stats_current;
+
+void gpio_stats_bind(int fd, ugpio_t *ctx)
+{
+    struct ugpio_stats **page;
+    unsigned int p = fd / STATS_FD_PAGE;
+
+    if (fd < 0 || p >= STATS_FD_PAGES)
+        return;
+
+    if ((page = __atomic_load_n(&stats_fds[p], __ATOMIC_ACQUIRE)) == NULL) {
+        pthread_mutex_lock(&stats_fds_lock);
+        if ((page = stats_fds[p]) == NULL) {
+            page = calloc(STATS_FD_PAGE, sizeof(*page));
+            __atomic_store_n(&stats_fds[p], page, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&stats_fds_lock);
+        if (page == NULL)
+            return;
+    }
+
+    __atomic_store_n(&page[fd % STATS_FD_PAGE], ctx ? &ctx->stats : NULL, __ATOMIC_RELEASE);
+}
+
+void gpio_stats_unbind(int fd)
+{
+    gpio_stats_bind(fd, NULL);
+}
+
+static struct ugpio_stats *stats_lookup(int fd)
+{
+    struct ugpio_stats **page;
+    unsigned int p = fd / STATS_FD_PAGE;
+
+    if (fd < 0 || p >= STATS_FD_PAGES)
+        return NULL;
+
+    if ((page = __atomic_load_n(&stats_fds[p], __ATOMIC_ACQUIRE)) == NULL)
+        return NULL;
+
+    return __atomic_load_n(&page[fd % STATS_FD_PAGE], __ATOMIC_ACQUIRE);
+}
+
+static void stats_add(uint64_t *counter, uint64_t n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static void stats_record(struct ugpio_stats *stats, int write, uint64_t ns, int failed)
+{
+    unsigned int bucket;
+
+    if (stats == NULL)
+        return;
+
+    bucket = (ns < 2) ? 0 : 63 - __builtin_clzll(ns);
+    if (bucket >= UGPIO_STATS_BUCKETS)
+        bucket = UGPIO_STATS_BUCKETS - 1;
+
+    if (write) {
+        stats_add(&stats->writes, 1);
+        stats_add(&stats->write_hist[bucket], 1);
+    } else {
+        stats_add(&stats->reads, 1);
+        stats_add(&stats->read_hist[bucket], 1);
+    }
+
+    if (failed)
+        stats_add(&stats->errors, 1);
+}
+
+void gpio_stats_syscall(int retry)
+{
+    uint64_t *global = retry ? &stats_global.retries : &stats_global.syscalls;
+
+    stats_add(global, 1);
+
+    if (stats_current)
+        stats_add(retry ? &stats_current->retries : &stats_current->syscalls, 1);
+}
+
+ssize_t gpio_stats_read(int fd, void *buf, size_t count)
+{
+    uint64_t start = gpio_now_ns();
+    ssize_t c;
+
+    stats_current = stats_lookup(fd);
+    c = gpio_backend->read(fd, buf, count);
+
+    start = gpio_now_ns() - start;
+    stats_record(&stats_global, 0, start, c == -1);
+    stats_record(stats_current, 0, start, c == -1);
+    stats_current = NULL;
+
+    return c;
+}
+
+ssize_t gpio_stats_write(int fd, const void *buf, size_t count)
+{
+    uint64_t start = gpio_now_ns();
+    ssize_t c;
+
+    stats_current = stats_lookup(fd);
+    c = gpio_backend->write(fd, buf, count);
+
+    start = gpio_now_ns() - start;
+    stats_record(&stats_global, 1, start, c == -1);
+    stats_record(stats_current, 1, start, c == -1);
+    stats_current = NULL;
+
+    return c;
+}
+
+/* grouped operations count once globally and once for each context involved */
+int gpio_stats_get_values(const int *fds, unsigned int num, uint64_t *bits)
+{
+    uint64_t start = gpio_now_ns();
+    unsigned int i;
+    int rv;
+
+    rv = gpio_backend->get_values(fds, num, bits);
+
+    start = gpio_now_ns() - start;
+    stats_record(&stats_global, 0, start, rv == -1);
+    for (i = 0; i < num; i++)
+        stats_record(stats_lookup(fds[i]), 0, start, rv == -1);
+
+    return rv;
+}
+
+int gpio_stats_set_values(const int *fds, unsigned int num, uint64_t mask, uint64_t bits)
+{
+    uint64_t start = gpio_now_ns();
+    unsigned int i;
+    int rv;
+
+    rv = gpio_backend->set_values(fds, num, mask, bits);
+
+    start = gpio_now_ns() - start;
+    stats_record(&stats_global, 1, start, rv == -1);
+    for (i = 0; i < num; i++)
+        if (mask & (UINT64_C(1) << i))
+            stats_record(stats_lookup(fds[i]), 1, start, rv == -1);
+
+    return rv;
+}
+
+int ugpio_stats_enable(int enable)
+{
+    __atomic_store_n(&gpio_stats_enabled, !!enable, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int ugpio_stats_get(ugpio_t *ctx, struct ugpio_stats *stats)
+{
+    uint64_t *src = (uint64_t *)(ctx ? &ctx->stats : &stats_global);
+    uint64_t *dst = (uint64_t *)stats;
+    size_t i;
+
+    /* all members are uint64_t counters */
+    for (i = 0; i < sizeof(*stats) / sizeof(uint64_t); i++)
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+int ugpio_stats_reset(ugpio_t *ctx)
+{
+    uint64_t *dst = (uint64_t *)(ctx ? &ctx->stats : &stats_global);
+    size_t i;
+
+    for (i = 0; i < sizeof(struct ugpio_stats) / sizeof(uint64_t); i++)
+        __atomic_store_n(&dst[i], 0, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+#else
+
+int ugpio_stats_enable(int enable)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int ugpio_stats_get(ugpio_t *ctx, struct ugpio_stats *stats)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int ugpio_stats_reset(ugpio_t *ctx)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
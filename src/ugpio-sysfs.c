@@ -0,0 +1,509 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+static int sysfs_open(unsigned int gpio, const char *key, int flags)
+{
+    char pathname[PATH_MAX];
+
+    if (gpio_sysfs_path(pathname, sizeof(pathname), key, gpio) == -1)
+        return -1;
+
+    return open(pathname, flags);
+}
+
+static int sysfs_close(int fd)
+{
+    return close(fd);
+}
+
+static ssize_t sysfs_read(int fd, void *buf, size_t count)
+{
+    ssize_t ret;
+    ssize_t n = 0;
+
+    GPIO_STATS_SYSCALL();
+    if (lseek(fd, 0, SEEK_SET) < 0)
+        return -1;
+
+    do {
+        GPIO_STATS_SYSCALL();
+        ret = read(fd, (char *)buf + n, count - n);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                GPIO_STATS_RETRY();
+                continue; /* try again */
+            }
+            return -1;
+        }
+        n += ret;
+    } while (n < count && ret);
+
+    return n;
+}
+
+static ssize_t sysfs_write(int fd, const void *buf, size_t count)
+{
+    ssize_t ret;
+    ssize_t n = 0;
+
+    do {
+        GPIO_STATS_SYSCALL();
+        /*
+         * sysfs attributes ignore the file position, writing at offset 0
+         * also keeps the attribute intact in a fake tree of plain files
+         */
+        ret = pwrite(fd, (char *)buf + n, count - n, n);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                GPIO_STATS_RETRY();
+                continue; /* try again */
+            }
+            return -1;
+        }
+        n += ret;
+    } while (n < count);
+
+    return n;
+}
+
+static int sysfs_check(unsigned int gpio, const char *key)
+{
+    int fd;
+    char pathname[PATH_MAX];
+
+    if (gpio_sysfs_path(pathname, sizeof(pathname), key, gpio) == -1)
+        return -1;
+
+    fd = open(pathname, O_RDONLY | O_CLOEXEC);
+
+    /* file does not exist */
+    if (fd == -1 && errno == ENOENT)
+        return 0;
+
+    /* an unexpected error occured */
+    if (fd == -1)
+        return -1;
+
+    /* file exists, so cleanup */
+    close(fd);
+
+    return 1;
+}
+
+/*
+ * Reading with pread at offset 0 saves the lseek of sysfs_read and still
+ * re-arms the edge notification of the value file.
+ */
+static int sysfs_get_values(const int *fds, unsigned int num, uint64_t *bits)
+{
+    unsigned int i;
+    ssize_t ret;
+    char buffer;
+
+    *bits = 0;
+    for (i = 0; i < num; i++) {
+        GPIO_STATS_SYSCALL();
+        while ((ret = pread(fds[i], &buffer, sizeof(buffer), 0)) < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+                return -1;
+            GPIO_STATS_RETRY();
+        }
+        if (ret != sizeof(buffer)) {
+            errno = EIO;
+            return -1;
+        }
+        if (buffer != '0')
+            *bits |= UINT64_C(1) << i;
+    }
+
+    return 0;
+}
+
+/*
+ * Read an attribute relative to the GPIO directory. Returns the number of
+ * bytes read, 0 when the attribute does not exist and -1 on other errors.
+ */
+static ssize_t sysfs_read_at(int dfd, const char *name, char *buf, size_t count)
+{
+    ssize_t c;
+    int fd;
+
+    if ((fd = openat(dfd, name, O_RDONLY | O_CLOEXEC)) == -1)
+        return (errno == ENOENT) ? 0 : -1;
+
+    while ((c = read(fd, buf, count)) < 0 && errno == EINTR)
+        ;
+
+    close(fd);
+
+    /* an existing attribute is never empty */
+    if (c == 0) {
+        errno = EIO;
+        return -1;
+    }
+
+    return c;
+}
+
+/*
+ * Opening the gpioN directory once and resolving the attributes relative to
+ * it tells whether the GPIO is exported, whether its direction and edge are
+ * alterable and their current settings in a few syscalls, instead of a full
+ * path lookup plus open/close for each check and read.
+ */
+static int sysfs_probe(unsigned int gpio, struct gpio_probe *probe)
+{
+    char pathname[PATH_MAX];
+    char buffer[16];
+    ssize_t c;
+    int dfd, rv;
+
+    probe->exported = 0;
+    probe->flags = 0;
+    probe->valid = 0;
+
+    if (gpio_sysfs_path(pathname, sizeof(pathname), GPIO_DIR, gpio) == -1)
+        return -1;
+
+    if ((dfd = open(pathname, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return (errno == ENOENT) ? 0 : -1;
+
+    if ((rv = faccessat(dfd, "value", F_OK, 0)) == -1) {
+        rv = (errno == ENOENT) ? 0 : -1;
+        goto out;
+    }
+
+    probe->exported = 1;
+
+    if ((c = sysfs_read_at(dfd, "direction", buffer, sizeof(buffer))) == -1) {
+        rv = -1;
+        goto out;
+    }
+    if (c) {
+        probe->flags |= GPIOF_ALTERABLE_DIRECTION;
+        probe->flags |= (buffer[0] == 'i') ? GPIOF_DIR_IN : GPIOF_DIR_OUT;
+        probe->valid |= UGPIO_CHANGED_DIRECTION;
+    }
+
+    if ((c = sysfs_read_at(dfd, "edge", buffer, sizeof(buffer))) == -1) {
+        rv = -1;
+        goto out;
+    }
+    if (c) {
+        probe->flags |= GPIOF_ALTERABLE_EDGE;
+        if ((rv = gpio_edge_parse(buffer, c)) != -1) {
+            probe->flags |= rv;
+            probe->valid |= UGPIO_CHANGED_EDGE;
+        }
+    }
+
+    rv = 0;
+
+out:
+    close(dfd);
+    return rv;
+}
+
+/* sysfs does not announce new directories, so look again this often */
+#define SYSFS_READY_POLL_MS 10
+
+/*
+ * A GPIO is ready when its value (and direction, if present) may be
+ * accessed by us, i.e. udev finished adjusting the permissions.
+ */
+static int sysfs_ready(unsigned int gpio)
+{
+    char pathname[PATH_MAX];
+
+    if (gpio_sysfs_path(pathname, sizeof(pathname), GPIO_VALUE, gpio) == -1)
+        return 0;
+    if (faccessat(AT_FDCWD, pathname, R_OK | W_OK, AT_EACCESS) == -1)
+        return 0;
+
+    if (gpio_sysfs_path(pathname, sizeof(pathname), GPIO_DIRECTION, gpio) == -1)
+        return 0;
+    if (faccessat(AT_FDCWD, pathname, W_OK, AT_EACCESS) == -1 && errno != ENOENT)
+        return 0;
+
+    return 1;
+}
+
+/*
+ * Permission changes by udev raise IN_ATTRIB on the gpioN directories, so
+ * wait for these instead of sleeping. Directories which do not exist yet are
+ * watched as soon as they appear.
+ */
+static int sysfs_wait_ready(const unsigned int *gpios, size_t num, int timeout_ms)
+{
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char pathname[PATH_MAX];
+    uint64_t deadline = 0, now;
+    unsigned char *state;
+    struct pollfd pfd;
+    size_t i, pending;
+    int wait_ms, rv = -1;
+
+    /* 0: not watched, 1: watched, 2: ready */
+    if ((state = calloc(num, sizeof(*state))) == NULL)
+        return -1;
+
+    if ((pfd.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+        goto out_free;
+    pfd.events = POLLIN;
+
+    if (timeout_ms >= 0)
+        deadline = gpio_now_ns() + (uint64_t)timeout_ms * 1000000;
+
+    for (;;) {
+        pending = 0;
+        for (i = 0; i < num; i++) {
+            if (state[i] == 2)
+                continue;
+            if (state[i] == 0) {
+                if (gpio_sysfs_path(pathname, sizeof(pathname), GPIO_DIR, gpios[i]) == 0 &&
+                    inotify_add_watch(pfd.fd, pathname, IN_ATTRIB | IN_CREATE) != -1)
+                    state[i] = 1;
+            }
+            if (sysfs_ready(gpios[i]))
+                state[i] = 2;
+            else
+                pending++;
+        }
+
+        if (pending == 0)
+            break;
+
+        wait_ms = SYSFS_READY_POLL_MS;
+        if (deadline) {
+            now = gpio_now_ns();
+            if (now >= deadline) {
+                errno = ETIMEDOUT;
+                goto out_close;
+            }
+            if ((deadline - now) / 1000000 < wait_ms)
+                wait_ms = (deadline - now + 999999) / 1000000;
+        }
+
+        if (poll(&pfd, 1, wait_ms) == -1 && errno != EINTR)
+            goto out_close;
+
+        /* only the wakeup matters, the readiness is checked above */
+        while (read(pfd.fd, events, sizeof(events)) > 0)
+            ;
+    }
+
+    rv = 0;
+
+out_close:
+    close(pfd.fd);
+out_free:
+    free(state);
+    return rv;
+}
+
+/* lines read by one snapshot thread at least, and threads used at most */
+#define SYSFS_SNAPSHOT_CHUNK    64
+#define SYSFS_SNAPSHOT_THREADS  8
+
+struct sysfs_snapshot_job {
+    int rootfd;
+    struct ugpio_line_state *states;
+    size_t num;
+};
+
+/*
+ * Read the attributes of a line relative to its gpioN directory, which in
+ * turn is resolved relative to the root. Returns 0 when the line vanished.
+ */
+static int sysfs_snapshot_line(int rootfd, struct ugpio_line_state *state)
+{
+    char name[16];
+    char buffer[16];
+    ssize_t c;
+    int dfd;
+
+    snprintf(name, sizeof(name), "gpio%u", (unsigned int)state->gpio);
+    if ((dfd = openat(rootfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return 0;
+
+    if ((c = sysfs_read_at(dfd, "value", buffer, sizeof(buffer))) == 0) {
+        close(dfd);
+        return 0;
+    }
+    state->value = (c > 0) ? (buffer[0] == '1') : -1;
+
+    c = sysfs_read_at(dfd, "direction", buffer, sizeof(buffer));
+    state->direction = (c > 0) ? ((buffer[0] == 'i') ? GPIOF_DIR_IN : GPIOF_DIR_OUT) : -1;
+
+    c = sysfs_read_at(dfd, "active_low", buffer, sizeof(buffer));
+    state->active_low = (c > 0) ? (buffer[0] == '1') : -1;
+
+    c = sysfs_read_at(dfd, "edge", buffer, sizeof(buffer));
+    state->edge = (c > 0) ? gpio_edge_parse(buffer, c) : -1;
+
+    close(dfd);
+    return 1;
+}
+
+static void *sysfs_snapshot_thread(void *arg)
+{
+    struct sysfs_snapshot_job *job = arg;
+    size_t i;
+
+    /* vanished lines are marked with an invalid number and dropped later */
+    for (i = 0; i < job->num; i++)
+        if (!sysfs_snapshot_line(job->rootfd, &job->states[i]))
+            job->states[i].gpio = UINT32_MAX;
+
+    return NULL;
+}
+
+static int sysfs_snapshot_cmp(const void *a, const void *b)
+{
+    const struct ugpio_line_state *x = a, *y = b;
+
+    return (x->gpio > y->gpio) - (x->gpio < y->gpio);
+}
+
+/*
+ * The root directory is listed once; every line then costs an open of its
+ * directory plus an open/read/close per attribute, without any path lookup
+ * from the root. Large systems are split into chunks read by several
+ * threads, the calling thread reading the first chunk itself.
+ */
+static ssize_t sysfs_snapshot(struct ugpio_line_state **states)
+{
+    struct sysfs_snapshot_job jobs[SYSFS_SNAPSHOT_THREADS];
+    pthread_t threads[SYSFS_SNAPSHOT_THREADS];
+    struct ugpio_line_state *s = NULL, *tmp;
+    size_t num = 0, size = 0, per_job, i, j;
+    size_t njobs, first;
+    int rootfd, dupfd, started[SYSFS_SNAPSHOT_THREADS];
+    struct dirent *de;
+    unsigned long gpio;
+    long cpus;
+    char *end;
+    DIR *dir;
+
+    *states = NULL;
+
+    if ((rootfd = open(gpio_sysfs_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return -1;
+
+    /* closedir closes the descriptor passed to fdopendir */
+    if ((dupfd = fcntl(rootfd, F_DUPFD_CLOEXEC, 0)) == -1)
+        goto err_close;
+    if ((dir = fdopendir(dupfd)) == NULL) {
+        close(dupfd);
+        goto err_close;
+    }
+
+    /* gpioN only: gpiochipN, export and unexport live here as well */
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "gpio", 4) != 0 || !isdigit((unsigned char)de->d_name[4]))
+            continue;
+        errno = 0;
+        gpio = strtoul(de->d_name + 4, &end, 10);
+        if (*end != '\0' || errno || gpio >= UINT32_MAX)
+            continue;
+
+        if (num == size) {
+            size = size ? 2 * size : 64;
+            if ((tmp = realloc(s, size * sizeof(*s))) == NULL)
+                goto err_closedir;
+            s = tmp;
+        }
+        s[num++].gpio = gpio;
+    }
+
+    closedir(dir);
+
+    if (num == 0) {
+        close(rootfd);
+        return 0;
+    }
+
+    qsort(s, num, sizeof(*s), sysfs_snapshot_cmp);
+
+    njobs = (num + SYSFS_SNAPSHOT_CHUNK - 1) / SYSFS_SNAPSHOT_CHUNK;
+    if (njobs > SYSFS_SNAPSHOT_THREADS)
+        njobs = SYSFS_SNAPSHOT_THREADS;
+    if ((cpus = sysconf(_SC_NPROCESSORS_ONLN)) > 0 && njobs > (size_t)cpus)
+        njobs = cpus;
+    per_job = (num + njobs - 1) / njobs;
+
+    for (i = 0; i < njobs; i++) {
+        first = (i * per_job < num) ? i * per_job : num;
+        jobs[i].rootfd = rootfd;
+        jobs[i].states = s + first;
+        jobs[i].num = (num - first < per_job) ? num - first : per_job;
+        /* a chunk without a thread is simply read here */
+        started[i] = (i > 0 && pthread_create(&threads[i], NULL, sysfs_snapshot_thread, &jobs[i]) == 0);
+    }
+
+    for (i = 0; i < njobs; i++)
+        if (!started[i])
+            sysfs_snapshot_thread(&jobs[i]);
+
+    for (i = 1; i < njobs; i++)
+        if (started[i])
+            pthread_join(threads[i], NULL);
+
+    close(rootfd);
+
+    for (i = j = 0; i < num; i++)
+        if (s[i].gpio != UINT32_MAX)
+            s[j++] = s[i];
+
+    if (j == 0) {
+        free(s);
+        return 0;
+    }
+
+    *states = s;
+    return j;
+
+err_closedir:
+    closedir(dir);
+err_close:
+    close(rootfd);
+    free(s);
+    return -1;
+}
+
+const struct gpio_backend gpio_backend_sysfs = {
+    .name = "sysfs",
+    .poll_events = POLLPRI | POLLERR,
+    .open = sysfs_open,
+    .close = sysfs_close,
+    .read = sysfs_read,
+    .write = sysfs_write,
+    .check = sysfs_check,
+    .get_values = sysfs_get_values,
+    .probe = sysfs_probe,
+    .wait_ready = sysfs_wait_ready,
+    .snapshot = sysfs_snapshot,
+};
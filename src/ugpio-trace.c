@@ -0,0 +1,236 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+/**
+ * The flight recorder ring of a thread.
+ *
+ * Only the owning thread writes, readers copy the records and drop the ones
+ * which were overwritten meanwhile.
+ */
+struct trace_ring {
+    uint32_t tid;
+    /* the number of records ever written */
+    uint64_t head;
+    struct trace_ring *next;
+    struct ugpio_trace_record records[];
+};
+
+int gpio_trace_enabled;
+
+/* the number of records per ring, a power of two */
+static size_t trace_size;
+/* all rings ever created, threads which exited included */
+static struct trace_ring *trace_rings;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct trace_ring *trace_ring;
+
+static const char *trace_names[] = {
+    [UGPIO_TRACE_REQUEST] = "request",
+    [UGPIO_TRACE_FREE] = "free",
+    [UGPIO_TRACE_OPEN] = "open",
+    [UGPIO_TRACE_GET] = "get",
+    [UGPIO_TRACE_SET] = "set",
+    [UGPIO_TRACE_EDGE] = "edge",
+    [UGPIO_TRACE_ERROR] = "error",
+};
+
+int ugpio_trace_enable(size_t records)
+{
+    size_t size = 1;
+
+    if (records == 0) {
+        __atomic_store_n(&gpio_trace_enabled, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    if (trace_size == 0) {
+        while (size < records)
+            size <<= 1;
+        trace_size = size;
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    __atomic_store_n(&gpio_trace_enabled, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static struct trace_ring *trace_ring_new(void)
+{
+    struct trace_ring *ring;
+
+    ring = calloc(1, sizeof(*ring) + trace_size * sizeof(ring->records[0]));
+    if (ring == NULL)
+        return NULL;
+
+    ring->tid = syscall(SYS_gettid);
+
+    pthread_mutex_lock(&trace_lock);
+    ring->next = trace_rings;
+    trace_rings = ring;
+    pthread_mutex_unlock(&trace_lock);
+
+    return ring;
+}
+
+void gpio_trace_record(unsigned int type, unsigned int gpio, int value, int error)
+{
+    struct trace_ring *ring = trace_ring;
+    struct ugpio_trace_record *r;
+    int saved = errno;
+
+    if (ring == NULL && (ring = trace_ring = trace_ring_new()) == NULL) {
+        errno = saved;
+        return;
+    }
+
+    r = &ring->records[ring->head & (trace_size - 1)];
+    r->timestamp_ns = gpio_now_ns();
+    r->tid = ring->tid;
+    r->type = type;
+    r->error = error;
+    r->gpio = gpio;
+    r->value = value;
+
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    errno = saved;
+}
+
+static int trace_cmp(const void *a, const void *b)
+{
+    const struct ugpio_trace_record *ra = a, *rb = b;
+
+    return (ra->timestamp_ns > rb->timestamp_ns) - (ra->timestamp_ns < rb->timestamp_ns);
+}
+
+/* copy the valid records of a ring, return their number */
+static size_t trace_copy(struct trace_ring *ring, struct ugpio_trace_record *dst)
+{
+    uint64_t head, tail, i;
+    size_t n = 0;
+
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    tail = (head > trace_size) ? head - trace_size : 0;
+
+    for (i = tail; i < head; i++)
+        dst[n++] = ring->records[i & (trace_size - 1)];
+
+    /* drop what the owner overwrote while copying */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    if (head > trace_size && head - trace_size > tail) {
+        i = head - trace_size - tail;
+        if (i >= n)
+            return 0;
+        memmove(dst, dst + i, (n - i) * sizeof(*dst));
+        n -= i;
+    }
+
+    return n;
+}
+
+size_t ugpio_trace_snapshot(struct ugpio_trace_record *records, size_t max)
+{
+    struct ugpio_trace_record *all;
+    struct trace_ring *ring;
+    size_t num = 0, n = 0;
+
+    pthread_mutex_lock(&trace_lock);
+
+    for (ring = trace_rings; ring; ring = ring->next)
+        num++;
+
+    if (num && (all = malloc(num * trace_size * sizeof(*all))) != NULL) {
+        for (ring = trace_rings; ring; ring = ring->next)
+            n += trace_copy(ring, all + n);
+
+        qsort(all, n, sizeof(*all), trace_cmp);
+
+        /* keep the most recent ones */
+        if (n > max) {
+            memmove(all, all + n - max, max * sizeof(*all));
+            n = max;
+        }
+        memcpy(records, all, n * sizeof(*all));
+        free(all);
+    }
+
+    pthread_mutex_unlock(&trace_lock);
+
+    return n;
+}
+
+int ugpio_trace_dump(int fd)
+{
+    struct ugpio_trace_record *records;
+    struct trace_ring *ring;
+    size_t i, n, max = 0;
+    const char *name;
+    FILE *f;
+    int rv = 0;
+
+    pthread_mutex_lock(&trace_lock);
+    for (ring = trace_rings; ring; ring = ring->next)
+        max += trace_size;
+    pthread_mutex_unlock(&trace_lock);
+
+    if (max == 0)
+        return 0;
+
+    if ((records = malloc(max * sizeof(*records))) == NULL)
+        return -1;
+
+    n = ugpio_trace_snapshot(records, max);
+
+    if ((fd = dup(fd)) == -1 || (f = fdopen(fd, "w")) == NULL) {
+        if (fd != -1)
+            close(fd);
+        free(records);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        name = (records[i].type < ARRAY_SIZE(trace_names)) ? trace_names[records[i].type] : NULL;
+        if (fprintf(f, "%llu.%09llu %u %s gpio%u ",
+                    (unsigned long long)(records[i].timestamp_ns / 1000000000),
+                    (unsigned long long)(records[i].timestamp_ns % 1000000000),
+                    records[i].tid, name ? name : "?", records[i].gpio) < 0)
+            rv = -1;
+
+        /* errors carry the type of the failed operation as value */
+        if (records[i].type == UGPIO_TRACE_ERROR && records[i].value > 0 &&
+            records[i].value < ARRAY_SIZE(trace_names))
+            name = trace_names[records[i].value];
+        else
+            name = NULL;
+
+        if (name && fprintf(f, "%s: %s\n", name, strerror(records[i].error)) < 0)
+            rv = -1;
+        else if (!name && fprintf(f, "%d\n", records[i].value) < 0)
+            rv = -1;
+    }
+
+    if (fclose(f) != 0)
+        rv = -1;
+
+    free(records);
+    return rv;
+}
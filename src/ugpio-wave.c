@@ -0,0 +1,165 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-wave.h>
+#include <ugpio-internal.h>
+
+struct ugpio_wave {
+    ugpio_port_t *port;
+    struct ugpio_wave_step *steps;
+    size_t num;
+    uint64_t period_ns;
+    unsigned int repeat;
+    pthread_t thread;
+    int running;
+    atomic_int stop;
+    /* protects stats */
+    pthread_mutex_t lock;
+    struct ugpio_wave_stats stats;
+};
+
+ugpio_wave_t *ugpio_wave_new(ugpio_port_t *port, const struct ugpio_wave_step *steps,
+                             size_t num, uint64_t period_ns, unsigned int repeat)
+{
+    ugpio_wave_t *wave;
+    size_t i;
+
+    for (i = 0; i < num; i++) {
+        if ((i && steps[i].offset_ns < steps[i - 1].offset_ns) ||
+            (repeat != 1 && steps[i].offset_ns >= period_ns)) {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    if (num == 0 || (repeat != 1 && period_ns == 0)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((wave = calloc(1, sizeof(*wave))) == NULL)
+        return NULL;
+
+    if ((wave->steps = malloc(num * sizeof(*steps))) == NULL) {
+        free(wave);
+        return NULL;
+    }
+
+    memcpy(wave->steps, steps, num * sizeof(*steps));
+    wave->port = port;
+    wave->num = num;
+    wave->period_ns = period_ns;
+    wave->repeat = repeat;
+    pthread_mutex_init(&wave->lock, NULL);
+
+    return wave;
+}
+
+void ugpio_wave_free(ugpio_wave_t *wave)
+{
+    if (wave == NULL)
+        return;
+
+    ugpio_wave_stop(wave);
+    pthread_mutex_destroy(&wave->lock);
+    free(wave->steps);
+    free(wave);
+}
+
+static void *wave_thread(void *arg)
+{
+    ugpio_wave_t *wave = arg;
+    struct ugpio_wave_stats *stats = &wave->stats;
+    uint64_t start, base, deadline, now, late;
+    unsigned int round;
+    size_t i;
+    int rv;
+
+    start = gpio_now_ns();
+
+    for (round = 0; wave->repeat == 0 || round < wave->repeat; round++) {
+        base = start + (uint64_t)round * wave->period_ns;
+
+        for (i = 0; i < wave->num; i++) {
+            deadline = base + wave->steps[i].offset_ns;
+            if (gpio_sleep_until(deadline, &wave->stop) == -1)
+                return NULL;
+
+            rv = ugpio_set_port(wave->port, wave->steps[i].mask, wave->steps[i].value);
+            now = gpio_now_ns();
+            late = now - deadline;
+
+            pthread_mutex_lock(&wave->lock);
+            if (stats->steps == 0 || late < stats->lateness_min_ns)
+                stats->lateness_min_ns = late;
+            if (late > stats->lateness_max_ns)
+                stats->lateness_max_ns = late;
+            stats->lateness_sum_ns += late;
+            stats->steps++;
+            if (rv == -1)
+                stats->errors++;
+            stats->requested_ns = deadline - start;
+            stats->achieved_ns = now - start;
+            pthread_mutex_unlock(&wave->lock);
+        }
+    }
+
+    return NULL;
+}
+
+int ugpio_wave_start(ugpio_wave_t *wave)
+{
+    if (wave->running) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    memset(&wave->stats, 0, sizeof(wave->stats));
+    atomic_store(&wave->stop, 0);
+
+    if ((errno = pthread_create(&wave->thread, NULL, wave_thread, wave)) != 0)
+        return -1;
+
+    wave->running = 1;
+    return 0;
+}
+
+int ugpio_wave_wait(ugpio_wave_t *wave)
+{
+    if (!wave->running)
+        return 0;
+
+    if ((errno = pthread_join(wave->thread, NULL)) != 0)
+        return -1;
+
+    wave->running = 0;
+    return 0;
+}
+
+int ugpio_wave_stop(ugpio_wave_t *wave)
+{
+    atomic_store(&wave->stop, 1);
+
+    return ugpio_wave_wait(wave);
+}
+
+void ugpio_wave_get_stats(ugpio_wave_t *wave, struct ugpio_wave_stats *stats)
+{
+    pthread_mutex_lock(&wave->lock);
+    *stats = wave->stats;
+    pthread_mutex_unlock(&wave->lock);
+}
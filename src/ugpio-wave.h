@@ -0,0 +1,127 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_WAVE_H
+#define UGPIO_WAVE_H
+
+#include "ugpio.h"
+
+UGPIO_BEGIN_DECLS
+
+/**
+ * Waveform generator
+ *
+ * A waveform is a list of steps, each setting some lines of a port at a
+ * given time offset from the start. A dedicated thread plays the steps,
+ * sleeping until the absolute deadline of each step, so that errors do not
+ * accumulate. The achieved timing is recorded and can be compared with the
+ * requested one.
+ *
+ * For low jitter, the calling thread may give the generator thread a
+ * realtime priority by setting its own scheduling policy before starting
+ * it, since the policy is inherited.
+ */
+
+/**
+ * A step of a waveform.
+ */
+struct ugpio_wave_step {
+    /* the time of the step, relative to the start of the waveform */
+    uint64_t offset_ns;
+    /* the lines of the port to set, bit i for line i */
+    uint64_t mask;
+    /* the values of the lines selected by mask */
+    uint64_t value;
+};
+
+/**
+ * Timing statistics of a waveform.
+ *
+ * The lateness of a step is the time from its deadline until its lines were
+ * set. The jitter is lateness_max_ns - lateness_min_ns.
+ */
+struct ugpio_wave_stats {
+    /* the number of steps played */
+    uint64_t steps;
+    /* the number of steps for which setting the port failed */
+    uint64_t errors;
+    /* the smallest, largest and summed up lateness */
+    uint64_t lateness_min_ns;
+    uint64_t lateness_max_ns;
+    uint64_t lateness_sum_ns;
+    /* time from the start until the last step played, requested and achieved */
+    uint64_t requested_ns;
+    uint64_t achieved_ns;
+};
+
+struct ugpio_wave;
+typedef struct ugpio_wave ugpio_wave_t;
+
+/**
+ * Create a waveform.
+ *
+ * The steps are copied. Their offsets must not decrease and, when the
+ * waveform is repeated, be smaller than the period.
+ *
+ * @param port the port to play the waveform on, its lines must be outputs
+ * @param steps the steps of the waveform
+ * @param num the number of steps
+ * @param period_ns the length of one repetition
+ * @param repeat how often to play the steps, 0 for an endless loop
+ * @return returns a ugpio_wave_t object on success, NULL otherwise
+ */
+ugpio_wave_t *ugpio_wave_new(ugpio_port_t *port, const struct ugpio_wave_step *steps,
+                             size_t num, uint64_t period_ns, unsigned int repeat);
+
+/**
+ * Release/free a waveform, stopping it if necessary.
+ *
+ * The port is neither closed nor freed.
+ *
+ * @param wave a waveform
+ */
+void ugpio_wave_free(ugpio_wave_t *wave);
+
+/**
+ * Start playing the waveform in a new thread.
+ *
+ * The statistics are reset.
+ *
+ * @param wave a waveform
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EBUSY - the waveform is already playing.
+ */
+int ugpio_wave_start(ugpio_wave_t *wave);
+
+/**
+ * Wait until the waveform was played completely.
+ *
+ * @param wave a waveform
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_wave_wait(ugpio_wave_t *wave);
+
+/**
+ * Stop playing the waveform and wait for the thread to terminate.
+ *
+ * The lines keep the values of the last step played.
+ *
+ * @param wave a waveform
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_wave_stop(ugpio_wave_t *wave);
+
+/**
+ * Get the timing statistics, also while the waveform is playing.
+ *
+ * @param wave a waveform
+ * @param stats receives the statistics
+ */
+void ugpio_wave_get_stats(ugpio_wave_t *wave, struct ugpio_wave_stats *stats);
+
+UGPIO_END_DECLS
+
+#endif  /* UGPIO_WAVE_H */
@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,100 +18,194 @@
 #include <ugpio.h>
 #include <ugpio-internal.h>
 
-ugpio_t *ugpio_request(unsigned int gpio, const char *label)
-{
-    ugpio_t *ctx;
-    int is_requested, val;
+/**
+ * The header in front of the contexts handed out by ugpio_request_many.
+ */
+struct ugpio_pool {
+    size_t num;
+    ugpio_t ctxs[];
+};
 
-    if ((ctx = malloc(sizeof(*ctx))) == NULL)
-        return NULL;
+static struct ugpio_pool *ugpio_pool(ugpio_t *ctxs)
+{
+    return (struct ugpio_pool *)((char *)ctxs - offsetof(struct ugpio_pool, ctxs));
+}
 
+static void ugpio_init(ugpio_t *ctx, unsigned int gpio, unsigned int flags, const char *label)
+{
     ctx->gpio = gpio;
-    ctx->flags = GPIOF_CLOEXEC | GPIOF_DIRECTION_UNKNOWN;
+    ctx->flags = flags;
     ctx->label = label;
     ctx->fd_value = -1;
     ctx->fd_active_low = -1;
     ctx->fd_direction = -1;
     ctx->fd_edge = -1;
+    ctx->filter = NULL;
+    ctx->cache_valid = 0;
+    ctx->change_cb = NULL;
+#if UGPIO_STATS
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+#endif
+}
 
-    if ((is_requested = gpio_is_requested(ctx->gpio)) < 0)
+ugpio_t *ugpio_request(unsigned int gpio, const char *label)
+{
+    struct gpio_probe probe;
+    ugpio_t *ctx;
+
+    if ((ctx = malloc(sizeof(*ctx))) == NULL)
+        return NULL;
+
+    ugpio_init(ctx, gpio, GPIOF_CLOEXEC | GPIOF_DIRECTION_UNKNOWN, label);
+
+    if (gpio_probe(ctx->gpio, &probe) < 0)
         goto error_free;
 
-    if (!is_requested) {
+    if (!probe.exported) {
         if (gpio_request(ctx->gpio, ctx->label) < 0)
             goto error_free;
 
         ctx->flags |= GPIOF_REQUESTED;
-    }
-
-    if (gpio_alterable_direction(ctx->gpio)) {
-        ctx->flags |= GPIOF_ALTERABLE_DIRECTION;
 
-        if ((val = gpio_get_direction(ctx->gpio)) != -1) {
-            ctx->flags &= ~GPIOF_DIRECTION_UNKNOWN;
-            ctx->flags |= val;
-        }
+        /* the attributes appear with the export */
+        if (gpio_probe(ctx->gpio, &probe) < 0)
+            goto error_release;
     }
 
-    if (gpio_alterable_edge(ctx->gpio)) {
-        ctx->flags |= GPIOF_ALTERABLE_EDGE;
-
-        if ((val = gpio_get_edge(ctx->gpio)) != -1) {
-            ctx->flags &= ~GPIOF_TRIGGER_MASK;
-            ctx->flags |= val;
-        }
-    }
+    ctx->flags |= probe.flags;
+    if (probe.valid & UGPIO_CHANGED_DIRECTION)
+        ctx->flags &= ~GPIOF_DIRECTION_UNKNOWN;
+    ctx->cache_valid = probe.valid;
 
     return ctx;
 
+error_release:
+    gpio_free(ctx->gpio);
 error_free:
     free(ctx);
     return NULL;
 }
 
-ugpio_t *ugpio_request_one(unsigned int gpio, unsigned int flags, const char *label)
+/* request and configure an initialized context */
+static int ugpio_setup(ugpio_t *ctx)
 {
-    ugpio_t *ctx;
     int is_requested;
 
-    if ((ctx = malloc(sizeof(*ctx))) == NULL)
-        return NULL;
-
-    ctx->gpio = gpio;
-    ctx->flags = flags;
-    ctx->label = label;
-    ctx->fd_value = -1;
-    ctx->fd_active_low = -1;
-    ctx->fd_direction = -1;
-    ctx->fd_edge = -1;
-
     if ((is_requested = gpio_is_requested(ctx->gpio)) < 0)
-        goto error_free;
+        return -1;
 
     is_requested = gpio_request_one(ctx->gpio, ctx->flags, ctx->label);
     if (is_requested < 0)
-        goto error_free;
+        return -1;
     else if (is_requested)
         ctx->flags |= GPIOF_REQUESTED;
 
+    /* the direction was just configured as requested */
+    ctx->cache_valid |= UGPIO_CHANGED_DIRECTION;
+
+    return 0;
+}
+
+/* undo ugpio_setup, the context memory itself is left alone */
+static void ugpio_release(ugpio_t *ctx)
+{
+    /* files left open by the caller must not refer to the freed statistics */
+    gpio_stats_unbind(ctx->fd_value);
+    gpio_stats_unbind(ctx->fd_active_low);
+    gpio_stats_unbind(ctx->fd_direction);
+    gpio_stats_unbind(ctx->fd_edge);
+
+    if (ctx->flags & GPIOF_REQUESTED)
+        gpio_free(ctx->gpio);
+
+    gpio_filter_free(ctx);
+}
+
+ugpio_t *ugpio_request_one(unsigned int gpio, unsigned int flags, const char *label)
+{
+    ugpio_t *ctx;
+
+    if ((ctx = malloc(sizeof(*ctx))) == NULL)
+        return NULL;
+
+    ugpio_init(ctx, gpio, flags, label);
+
+    if (ugpio_setup(ctx) < 0) {
+        free(ctx);
+        return NULL;
+    }
+
     return ctx;
+}
 
-error_free:
-    free(ctx);
+ugpio_t *ugpio_request_many(const unsigned int *gpios, size_t num,
+                            unsigned int flags, const char *label)
+{
+    struct ugpio_pool *pool;
+    size_t i;
+    int err;
+
+    if (num == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((pool = calloc(1, sizeof(*pool) + num * sizeof(pool->ctxs[0]))) == NULL)
+        return NULL;
+
+    pool->num = num;
+
+    for (i = 0; i < num; i++) {
+        ugpio_init(&pool->ctxs[i], gpios[i], flags, label);
+        if (ugpio_setup(&pool->ctxs[i]) < 0)
+            goto err_free;
+    }
+
+    return pool->ctxs;
+
+err_free:
+    err = errno;
+    while (i--)
+        ugpio_release(&pool->ctxs[i]);
+    free(pool);
+    errno = err;
     return NULL;
 }
 
+ugpio_t *ugpio_many_ctx(ugpio_t *pool, size_t idx)
+{
+    if (idx >= ugpio_pool(pool)->num) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return &pool[idx];
+}
+
 void ugpio_free(ugpio_t *ctx)
 {
     if (ctx == NULL)
         return;
 
-    if (ctx->flags & GPIOF_REQUESTED)
-        gpio_free(ctx->gpio);
-
+    ugpio_release(ctx);
     free(ctx);
 }
 
+void ugpio_free_many(ugpio_t *pool)
+{
+    size_t i;
+
+    if (pool == NULL)
+        return;
+
+    for (i = ugpio_pool(pool)->num; i--; ) {
+        ugpio_close(&pool[i]);
+        ugpio_release(&pool[i]);
+    }
+
+    free(ugpio_pool(pool));
+}
+
 int ugpio_open(ugpio_t *ctx)
 {
     int flags;
@@ -122,6 +217,12 @@ int ugpio_open(ugpio_t *ctx)
     flags |= (ctx->flags & GPIOF_CLOEXEC) ? O_CLOEXEC : 0;
 
     ctx->fd_value = gpio_fd_open(ctx->gpio, GPIO_VALUE, flags);
+    gpio_stats_bind(ctx->fd_value, ctx);
+
+    if (ctx->fd_value == -1)
+        GPIO_TRACE_ERROR(UGPIO_TRACE_OPEN, ctx->gpio);
+    else
+        GPIO_TRACE(UGPIO_TRACE_OPEN, ctx->gpio, ctx->fd_value);
 
     return ctx->fd_value;
 }
@@ -141,6 +242,7 @@ int ugpio_full_open(ugpio_t *ctx)
         if (ctx->fd_active_low == -1) {
             return -1;
         }
+        gpio_stats_bind(ctx->fd_active_low, ctx);
     }
 
     if (ctx->fd_direction == -1 && ctx->flags & GPIOF_ALTERABLE_DIRECTION) {
@@ -148,6 +250,7 @@ int ugpio_full_open(ugpio_t *ctx)
         if (ctx->fd_direction == -1) {
             return -1;
         }
+        gpio_stats_bind(ctx->fd_direction, ctx);
     }
 
     if (ctx->fd_edge == -1 && ctx->flags & GPIOF_ALTERABLE_EDGE) {
@@ -155,6 +258,7 @@ int ugpio_full_open(ugpio_t *ctx)
         if (ctx->fd_edge == -1) {
             return -1;
         }
+        gpio_stats_bind(ctx->fd_edge, ctx);
     }
 
     return 0;
@@ -166,21 +270,25 @@ void ugpio_close(ugpio_t *ctx)
         return;
 
     if (ctx->fd_value != -1) {
+        gpio_stats_unbind(ctx->fd_value);
         gpio_fd_close(ctx->fd_value);
         ctx->fd_value = -1;
     }
 
     if (ctx->fd_active_low != -1) {
+        gpio_stats_unbind(ctx->fd_active_low);
         gpio_fd_close(ctx->fd_active_low);
         ctx->fd_active_low = -1;
     }
 
     if (ctx->fd_direction != -1) {
+        gpio_stats_unbind(ctx->fd_direction);
         gpio_fd_close(ctx->fd_direction);
         ctx->fd_direction = -1;
     }
 
     if (ctx->fd_edge != -1) {
+        gpio_stats_unbind(ctx->fd_edge);
         gpio_fd_close(ctx->fd_edge);
         ctx->fd_edge = -1;
     }
@@ -191,13 +299,41 @@ int ugpio_fd(ugpio_t *ctx)
     return ctx->fd_value;
 }
 
+int ugpio_fd_events(ugpio_t *ctx)
+{
+    return gpio_backend->poll_events;
+}
+
+static int ugpio_cached(ugpio_t *ctx, unsigned int what)
+{
+    return (ctx->flags & GPIOF_CACHED) && (ctx->cache_valid & what);
+}
+
+void gpio_value_written(ugpio_t *ctx, int value)
+{
+    if (value == -1) {
+        ctx->cache_valid &= ~UGPIO_CHANGED_VALUE;
+        return;
+    }
+
+    ctx->value = value;
+    ctx->cache_valid |= UGPIO_CHANGED_VALUE;
+}
+
 int ugpio_get_value(ugpio_t *ctx)
 {
     char buffer;
 
-    if (gpio_fd_read(ctx->fd_value, &buffer, sizeof(buffer)) < sizeof(buffer))
+    /* only values written by ourself can be cached, inputs change anytime */
+    if (ugpio_cached(ctx, UGPIO_CHANGED_VALUE) && !(ctx->flags & GPIOF_DIR_IN))
+        return ctx->value;
+
+    if (gpio_fd_read(ctx->fd_value, &buffer, sizeof(buffer)) != sizeof(buffer)) {
+        GPIO_TRACE_ERROR(UGPIO_TRACE_GET, ctx->gpio);
         return -1;
+    }
 
+    GPIO_TRACE(UGPIO_TRACE_GET, ctx->gpio, !!(buffer - '0'));
     return !!(buffer - '0');
 }
 
@@ -205,28 +341,51 @@ int ugpio_set_value(ugpio_t *ctx, int value)
 {
     ssize_t c;
 
+    value = !!value;
+    if (ugpio_cached(ctx, UGPIO_CHANGED_VALUE) && ctx->value == value)
+        return 0;
+
     c = gpio_fd_write(ctx->fd_value, value ? "1" : "0", 2);
+    if (c != 2) {
+        GPIO_TRACE_ERROR(UGPIO_TRACE_SET, ctx->gpio);
+        gpio_value_written(ctx, -1);
+        return -1;
+    }
 
-    return (c != 2) ? -1 : 0;
+    GPIO_TRACE(UGPIO_TRACE_SET, ctx->gpio, value);
+    gpio_value_written(ctx, value);
+    return 0;
 }
 
 int ugpio_get_activelow(ugpio_t *ctx)
 {
     char buffer;
 
-    if (gpio_fd_read(ctx->fd_active_low, &buffer, sizeof(buffer)) < sizeof(buffer))
+    if (ugpio_cached(ctx, UGPIO_CHANGED_ACTIVELOW))
+        return ctx->active_low;
+
+    if (gpio_fd_read(ctx->fd_active_low, &buffer, sizeof(buffer)) != sizeof(buffer))
         return -1;
 
-    return buffer - '0';
+    ctx->active_low = buffer - '0';
+    ctx->cache_valid |= UGPIO_CHANGED_ACTIVELOW;
+    return ctx->active_low;
 }
 
 int ugpio_set_activelow(ugpio_t *ctx, int value)
 {
     ssize_t c;
 
+    /* the logical value of an output changes with the active low flag */
+    ctx->cache_valid &= ~(UGPIO_CHANGED_ACTIVELOW | UGPIO_CHANGED_VALUE);
+
     c = gpio_fd_write(ctx->fd_active_low, value ? "1" : "0", 2);
+    if (c != 2)
+        return -1;
 
-    return (c != 2) ? -1 : 0;
+    ctx->active_low = !!value;
+    ctx->cache_valid |= UGPIO_CHANGED_ACTIVELOW;
+    return 0;
 }
 
 int ugpio_alterable_direction(ugpio_t *ctx)
@@ -238,19 +397,29 @@ int ugpio_get_direction(ugpio_t *ctx)
 {
     char buffer;
 
-    if (gpio_fd_read(ctx->fd_direction, &buffer, sizeof(buffer)) < sizeof(buffer))
+    if (ugpio_cached(ctx, UGPIO_CHANGED_DIRECTION))
+        return ctx->flags & GPIOF_DIR_IN;
+
+    if (gpio_fd_read(ctx->fd_direction, &buffer, sizeof(buffer)) != sizeof(buffer))
         return -1;
 
-    return (buffer == 'i') ? GPIOF_DIR_IN : GPIOF_DIR_OUT;
+    ctx->flags &= ~(GPIOF_DIRECTION_UNKNOWN | GPIOF_DIR_IN);
+    ctx->flags |= (buffer == 'i') ? GPIOF_DIR_IN : GPIOF_DIR_OUT;
+    ctx->cache_valid |= UGPIO_CHANGED_DIRECTION;
+
+    return ctx->flags & GPIOF_DIR_IN;
 }
 
 int ugpio_direction_input(ugpio_t *ctx)
 {
+    ctx->cache_valid &= ~(UGPIO_CHANGED_DIRECTION | UGPIO_CHANGED_VALUE);
+
     if (gpio_fd_write(ctx->fd_direction, "in", 3) < 0)
         return -1;
 
     ctx->flags &= ~GPIOF_DIRECTION_UNKNOWN;
     ctx->flags |= GPIOF_DIR_IN;
+    ctx->cache_valid |= UGPIO_CHANGED_DIRECTION;
     return 0;
 }
 
@@ -258,10 +427,14 @@ int ugpio_direction_output(ugpio_t *ctx, int value)
 {
     char *val = value ? "high" : "low";
 
+    /* 'high' and 'low' are physical levels, so the value is unknown here */
+    ctx->cache_valid &= ~(UGPIO_CHANGED_DIRECTION | UGPIO_CHANGED_VALUE);
+
     if (gpio_fd_write(ctx->fd_direction, val, strlen(val) + 1) < 0)
         return -1;
 
-    ctx->flags &= ~GPIOF_DIR_IN;
+    ctx->flags &= ~(GPIOF_DIRECTION_UNKNOWN | GPIOF_DIR_IN);
+    ctx->cache_valid |= UGPIO_CHANGED_DIRECTION;
     return 0;
 }
 
@@ -272,11 +445,109 @@ int ugpio_alterable_edge(ugpio_t *ctx)
 
 int ugpio_get_edge(ugpio_t *ctx)
 {
+    int flags;
 
-    return gpio_fd_get_edge(ctx->fd_edge);
+    if (ugpio_cached(ctx, UGPIO_CHANGED_EDGE))
+        return ctx->flags & GPIOF_TRIGGER_MASK;
+
+    if ((flags = gpio_fd_get_edge(ctx->fd_edge)) == -1)
+        return -1;
+
+    ctx->flags &= ~GPIOF_TRIGGER_MASK;
+    ctx->flags |= flags;
+    ctx->cache_valid |= UGPIO_CHANGED_EDGE;
+
+    return flags;
 }
 
 int ugpio_set_edge(ugpio_t *ctx, int flags)
 {
-    return gpio_fd_set_edge(ctx->fd_edge, flags);
+    ctx->cache_valid &= ~UGPIO_CHANGED_EDGE;
+
+    if (gpio_fd_set_edge(ctx->fd_edge, flags) == -1)
+        return -1;
+
+    ctx->flags &= ~GPIOF_TRIGGER_MASK;
+    ctx->flags |= flags & GPIOF_TRIGGER_MASK;
+    ctx->cache_valid |= UGPIO_CHANGED_EDGE;
+    return 0;
+}
+
+void ugpio_set_cached(ugpio_t *ctx, int enable)
+{
+    if (enable)
+        ctx->flags |= GPIOF_CACHED;
+    else
+        ctx->flags &= ~GPIOF_CACHED;
+}
+
+void ugpio_set_change_hook(ugpio_t *ctx, ugpio_change_cb cb, void *userdata)
+{
+    ctx->change_cb = cb;
+    ctx->change_userdata = userdata;
+}
+
+/* read an attribute via the open file descriptor, or by path otherwise */
+static int ugpio_refresh_read(ugpio_t *ctx, int fd, const char *key, char *buf, size_t count)
+{
+    if (fd != -1)
+        return gpio_fd_read(fd, buf, count);
+
+    return gpio_read(ctx->gpio, key, buf, count);
+}
+
+int ugpio_refresh(ugpio_t *ctx)
+{
+    unsigned int valid = 0;
+    int changed = 0;
+    char buffer[16];
+    ssize_t c;
+    int val;
+
+    if (ugpio_refresh_read(ctx, ctx->fd_direction, GPIO_DIRECTION, buffer, 1) == 1) {
+        val = (buffer[0] == 'i') ? GPIOF_DIR_IN : GPIOF_DIR_OUT;
+        if ((ctx->flags & (GPIOF_DIR_IN | GPIOF_DIRECTION_UNKNOWN)) != val)
+            changed |= UGPIO_CHANGED_DIRECTION;
+        ctx->flags &= ~(GPIOF_DIRECTION_UNKNOWN | GPIOF_DIR_IN);
+        ctx->flags |= val;
+        valid |= UGPIO_CHANGED_DIRECTION;
+    } else if (ctx->flags & GPIOF_ALTERABLE_DIRECTION) {
+        return -1;
+    }
+
+    if (ugpio_refresh_read(ctx, ctx->fd_active_low, GPIO_ACTIVELOW, buffer, 1) != 1)
+        return -1;
+    val = buffer[0] - '0';
+    if (!(ctx->cache_valid & UGPIO_CHANGED_ACTIVELOW) || ctx->active_low != val)
+        changed |= UGPIO_CHANGED_ACTIVELOW;
+    ctx->active_low = val;
+    valid |= UGPIO_CHANGED_ACTIVELOW;
+
+    c = ugpio_refresh_read(ctx, ctx->fd_edge, GPIO_EDGE, buffer, sizeof(buffer));
+    if (c > 0 && (val = gpio_edge_parse(buffer, c)) != -1) {
+        if ((ctx->flags & GPIOF_TRIGGER_MASK) != val)
+            changed |= UGPIO_CHANGED_EDGE;
+        ctx->flags &= ~GPIOF_TRIGGER_MASK;
+        ctx->flags |= val;
+        valid |= UGPIO_CHANGED_EDGE;
+    } else if (ctx->flags & GPIOF_ALTERABLE_EDGE) {
+        return -1;
+    }
+
+    if (!(ctx->flags & GPIOF_DIR_IN)) {
+        if (ugpio_refresh_read(ctx, ctx->fd_value, GPIO_VALUE, buffer, 1) != 1)
+            return -1;
+        val = !!(buffer[0] - '0');
+        if ((ctx->cache_valid & UGPIO_CHANGED_VALUE) && ctx->value != val)
+            changed |= UGPIO_CHANGED_VALUE;
+        ctx->value = val;
+        valid |= UGPIO_CHANGED_VALUE;
+    }
+
+    ctx->cache_valid = valid;
+
+    if (changed && ctx->change_cb)
+        ctx->change_cb(ctx, changed, ctx->change_userdata);
+
+    return changed;
 }
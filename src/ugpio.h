@@ -7,7 +7,9 @@
 #ifndef UGPIO_H
 #define UGPIO_H
 
+#include <sys/types.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "ugpio-version.h"
 
 #ifdef  __cplusplus
@@ -40,10 +42,26 @@ UGPIO_BEGIN_DECLS
 #define GPIOF_ALTERABLE_DIRECTION    (1 << 6)
 #define GPIOF_DIRECTION_UNKNOWN      (1 << 7)
 #define GPIOF_ALTERABLE_EDGE         (1 << 8)
+#define GPIOF_CACHED                 (1 << 9)
 
 struct gpio;
 typedef struct gpio ugpio_t;
 
+/* attributes reported by ugpio_refresh */
+#define UGPIO_CHANGED_DIRECTION      (1 << 0)
+#define UGPIO_CHANGED_ACTIVELOW      (1 << 1)
+#define UGPIO_CHANGED_EDGE           (1 << 2)
+#define UGPIO_CHANGED_VALUE          (1 << 3)
+
+/**
+ * Callback for configuration changes detected by ugpio_refresh.
+ *
+ * @param ctx a GPIO context
+ * @param changed one or more UGPIO_CHANGED_* or-ed together
+ * @param userdata the pointer given to ugpio_set_change_hook
+ */
+typedef void (*ugpio_change_cb)(ugpio_t *ctx, int changed, void *userdata);
+
 /**
  * Low level API
  */
@@ -54,6 +72,23 @@ int gpio_request_array(const struct gpio *array, size_t num);
 int gpio_free(unsigned int gpio);
 void gpio_free_array(const struct gpio *array, size_t num);
 
+/**
+ * Request and configure several GPIOs, waiting for them to become accessible.
+ *
+ * After an export, udev usually needs some time to adjust the permissions of
+ * the new attribute files. This function first exports all GPIOs of the
+ * array, then waits for all of them concurrently and finally configures them
+ * as specified by their flags. On error, all GPIOs exported by this call are
+ * released again.
+ *
+ * @param array the GPIOs to request
+ * @param num the number of elements in array
+ * @param timeout_ms how long to wait for the GPIOs at most, -1 for no limit
+ * @return 0 on success, -1 on error with errno set appropriately
+ *         (ETIMEDOUT when the GPIOs did not become accessible in time)
+ */
+int gpio_request_array_wait(const struct gpio *array, size_t num, int timeout_ms);
+
 int gpio_alterable_direction(unsigned int gpio);
 int gpio_get_direction(unsigned int gpio);
 int gpio_direction_input(unsigned int gpio);
@@ -70,6 +105,77 @@ int gpio_set_edge_str(unsigned int gpio, const char *edge);
 int gpio_set_edge(unsigned int gpio, unsigned int flags);
 int gpio_get_edge(unsigned int gpio);
 
+/**
+ * Limit the number of file descriptors kept open by the low level API.
+ *
+ * The low level functions keep the attribute files they used open, so that
+ * repeated accesses to the same GPIO cost no open/close. When the limit is
+ * reached, the least recently used file is closed. A limit of 0 disables the
+ * cache, the default is 64.
+ *
+ * @param max_fds the maximum number of open file descriptors
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int gpio_set_fd_cache_size(unsigned int max_fds);
+
+/**
+ * Backend selection
+ *
+ * By default the library uses the kernel's sysfs gpio interface. Another
+ * backend can be selected at runtime:
+ *  - "cdev": the GPIO character devices /dev/gpiochipN. Requesting a GPIO
+ *    requests the line for this process, each value access is a single ioctl.
+ *    GPIO numbers are the same as in sysfs when the kernel provides the
+ *    legacy numbering, otherwise the chips are numbered consecutively.
+ *  - "sim": an in-memory simulated GPIO chip (see ugpio-sim.h).
+ *  - "client": the GPIOs owned by the ugpiod daemon. Several processes can
+ *    hold the same GPIO, a GPIO is exported as long as any of them holds it.
+ *    Values of outputs and of inputs supporting edges are read from memory
+ *    shared with the daemon, all other accesses are requests to the daemon.
+ *    If the connection breaks while GPIOs are held, the daemon releases
+ *    them: all requests then fail with ENOTCONN until the process has
+ *    released its GPIOs as well, the next request connects again.
+ * Select the backend before requesting any GPIO, contexts and file
+ * descriptors are bound to the backend they were opened with.
+ *
+ * @param name the name of the backend, e.g. "sysfs", "cdev" or "sim"
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         ENOENT - there is no backend with the given name.
+ */
+int ugpio_set_backend(const char *name);
+
+/**
+ * Return the name of the currently selected backend.
+ */
+const char *ugpio_get_backend(void);
+
+/**
+ * Use another directory instead of /sys/class/gpio with the sysfs backend.
+ *
+ * This is mainly useful for tests and benchmarks running against a fake
+ * tree. As with the backend, change it before requesting any GPIO.
+ *
+ * @param path the new root directory, NULL for the default
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_set_sysfs_root(const char *path);
+
+/**
+ * Return the current sysfs root directory.
+ */
+const char *ugpio_get_sysfs_root(void);
+
+/**
+ * Use another socket than /run/ugpiod.sock with the client backend.
+ *
+ * An existing connection to the daemon is closed, so the daemon releases
+ * all GPIOs held through it. Change it before requesting any GPIO.
+ *
+ * @param path the path of the daemon's socket, NULL for the default
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_set_client_socket(const char *path);
+
 /**
  * Higher level API
  *
@@ -113,6 +219,41 @@ ugpio_t *ugpio_request_one(unsigned int gpio, unsigned int flags, const char *la
  */
 void ugpio_free(ugpio_t *ctx);
 
+/**
+ * Request several GPIO contexts at once.
+ *
+ * All contexts are allocated from one contiguous pool and each GPIO is
+ * requested like with ugpio_request_one using the same flags and label.
+ * If one of the GPIOs fails, all GPIOs requested so far are released again
+ * in reverse order. Use ugpio_many_ctx to access the single contexts and
+ * release the pool with ugpio_free_many, never with ugpio_free.
+ *
+ * @param gpios an array of GPIO numbers to request
+ * @param num the number of GPIOs in the array
+ * @param flags a combination of or-ed GPIOF_* constants
+ * @param label an optional label for these GPIOs
+ * @return returns the pool on success, NULL otherwise
+ */
+ugpio_t *ugpio_request_many(const unsigned int *gpios, size_t num,
+                            unsigned int flags, const char *label);
+
+/**
+ * Return a GPIO context of a pool.
+ *
+ * @param pool a pool returned by ugpio_request_many
+ * @param idx the index of the GPIO in the array passed to ugpio_request_many
+ * @return the GPIO context, NULL with errno set to EINVAL if idx is out of
+ *         range
+ */
+ugpio_t *ugpio_many_ctx(ugpio_t *pool, size_t idx);
+
+/**
+ * Close and release/free all GPIO contexts of a pool.
+ *
+ * @param pool a pool returned by ugpio_request_many
+ */
+void ugpio_free_many(ugpio_t *pool);
+
 /**
  * Open the GPIO.
  *
@@ -154,6 +295,18 @@ void ugpio_close(ugpio_t *ctx);
  */
 int ugpio_fd(ugpio_t *ctx);
 
+/**
+ * Return the poll events which signal an edge on the GPIO context's value
+ * file descriptor.
+ *
+ * This is POLLPRI | POLLERR for the sysfs backend, but may differ for other
+ * backends. After an event, read the value with ugpio_get_value to acknowledge it.
+ *
+ * @param ctx a GPIO context
+ * @return the events to pass to poll() for the file descriptor
+ */
+int ugpio_fd_events(ugpio_t *ctx);
+
 /**
  * Get the GPIO context's current value.
  *
@@ -269,6 +422,411 @@ int ugpio_get_edge(ugpio_t *ctx);
  */
 int ugpio_set_edge(ugpio_t *ctx, int flags);
 
+/**
+ * Enable or disable the shadow state cache of the GPIO context.
+ *
+ * With the cache enabled (the GPIOF_CACHED flag, which can also be passed to
+ * ugpio_request_one) the library remembers what it read and wrote:
+ * ugpio_get_direction, ugpio_get_activelow and ugpio_get_edge return the
+ * remembered configuration without a syscall, ugpio_get_value of an output
+ * returns the value last written and ugpio_set_value skips writes which would
+ * not change the value. Inputs are always read from the GPIO.
+ *
+ * Changes made by other processes are not seen until ugpio_refresh is called.
+ *
+ * @param ctx a GPIO context
+ * @param enable 1 to enable, 0 to disable the cache
+ */
+void ugpio_set_cached(ugpio_t *ctx, int enable);
+
+/**
+ * Re-read the configuration of the GPIO context.
+ *
+ * Re-validates the shadow state cache. If any attribute changed since it was
+ * last read or written, the change hook is called.
+ *
+ * @param ctx a GPIO context
+ * @return 0 or one or more UGPIO_CHANGED_* or-ed together on success,
+ *         -1 on error with errno set appropriately
+ */
+int ugpio_refresh(ugpio_t *ctx);
+
+/**
+ * Set a function to be called when ugpio_refresh detects a change.
+ *
+ * @param ctx a GPIO context
+ * @param cb the function to call, NULL to remove the hook
+ * @param userdata a pointer passed to the callback
+ */
+void ugpio_set_change_hook(ugpio_t *ctx, ugpio_change_cb cb, void *userdata);
+
+/**
+ * Port API
+ *
+ * A port groups up to UGPIO_PORT_MAX GPIO contexts so that they can be read
+ * and written as a bitmask, bit i corresponding to the i-th context. The port
+ * uses the fastest grouped access the selected backend provides: the daemon
+ * client batches all lines into one request, and the simulation handles them
+ * in a single call. With the cdev backend, each line is a line request of its
+ * own, so there is no grouped access: a port takes the backend lock once, but
+ * still issues one ioctl per line. sysfs has one value file per line anyway.
+ */
+
+#define UGPIO_PORT_MAX               64
+
+struct ugpio_port;
+typedef struct ugpio_port ugpio_port_t;
+
+/**
+ * Create a port from existing GPIO contexts.
+ *
+ * The contexts are opened if necessary, but remain owned by the caller and
+ * must not be freed before the port.
+ *
+ * @param ctxs an array of GPIO contexts
+ * @param num the number of contexts, 1 to UGPIO_PORT_MAX
+ * @return returns a ugpio_port_t object on success, NULL otherwise
+ */
+ugpio_port_t *ugpio_port_new(ugpio_t **ctxs, size_t num);
+
+/**
+ * Request GPIOs and create a port from them.
+ *
+ * All GPIOs are requested with ugpio_request_many using the same flags and
+ * label and is opened. If one of the GPIOs fails, all GPIOs requested so far
+ * are released again. The contexts are owned by the port.
+ *
+ * @param gpios an array of GPIO numbers
+ * @param num the number of GPIOs, 1 to UGPIO_PORT_MAX
+ * @param flags a combination of or-ed GPIOF_* constants
+ * @param label an optional label for the GPIOs
+ * @return returns a ugpio_port_t object on success, NULL otherwise
+ */
+ugpio_port_t *ugpio_port_request(const unsigned int *gpios, size_t num,
+                                 unsigned int flags, const char *label);
+
+/**
+ * Release/free a port.
+ *
+ * Contexts requested by ugpio_port_request are closed and freed, too.
+ *
+ * @param port a port
+ */
+void ugpio_port_free(ugpio_port_t *port);
+
+/**
+ * Return the number of GPIOs of a port.
+ *
+ * @param port a port
+ */
+size_t ugpio_port_size(ugpio_port_t *port);
+
+/**
+ * Return the GPIO context of a port's bit.
+ *
+ * @param port a port
+ * @param idx the bit number
+ * @return the GPIO context, NULL on error with errno set appropriately
+ */
+ugpio_t *ugpio_port_ctx(ugpio_port_t *port, size_t idx);
+
+/**
+ * Read the current values of all GPIOs of a port.
+ *
+ * @param port a port
+ * @param bits receives the values, bit i for the i-th GPIO
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_get_port(ugpio_port_t *port, uint64_t *bits);
+
+/**
+ * Set the values of some GPIOs of a port.
+ *
+ * Only the GPIOs selected by mask are written. The port remembers the
+ * values written and skips all GPIOs which already have the requested value.
+ * Call ugpio_port_invalidate when the GPIOs were changed by other means.
+ *
+ * @param port a port
+ * @param mask the GPIOs to write, bit i for the i-th GPIO
+ * @param value the values to write, bit i for the i-th GPIO
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_set_port(ugpio_port_t *port, uint64_t mask, uint64_t value);
+
+/**
+ * Forget the values remembered by ugpio_set_port.
+ *
+ * The next write of a GPIO is issued even if the value did not change.
+ *
+ * @param port a port
+ */
+void ugpio_port_invalidate(ugpio_port_t *port);
+
+/**
+ * Debounce and glitch filter
+ *
+ * A GPIO context may filter its edges before they are passed to the callback
+ * of an event loop (see ugpio-loop.h) or recorded by a capture thread (see
+ * ugpio-ring.h). A level change is reported only once the new level was
+ * stable for stable_ns after the last edge (debounce) and at least
+ * min_pulse_ns passed since the first edge of the change (glitch filter).
+ * Edges in between are absorbed and wake up no application code.
+ */
+
+/**
+ * Statistics of the filter of a GPIO context.
+ */
+struct ugpio_filter_stats {
+    /* edges seen on the GPIO */
+    uint64_t raw_edges;
+    /* edges suppressed by the filter */
+    uint64_t absorbed;
+    /* level changes reported */
+    uint64_t transitions;
+};
+
+/**
+ * Configure the debounce/glitch filter of a GPIO context.
+ *
+ * @param ctx a GPIO context
+ * @param stable_ns the time the level must be stable after the last edge
+ * @param min_pulse_ns the minimum time between the first edge of a level
+ *        change and its report
+ * @return 0 on success, -1 on error with errno set appropriately.
+ *         Passing 0 for both times disables the filter.
+ */
+int ugpio_set_debounce(ugpio_t *ctx, uint64_t stable_ns, uint64_t min_pulse_ns);
+
+/**
+ * Get the statistics of the filter of a GPIO context.
+ *
+ * @param ctx a GPIO context
+ * @param stats receives the statistics
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         EINVAL - the filter is not enabled.
+ */
+int ugpio_get_filter_stats(ugpio_t *ctx, struct ugpio_filter_stats *stats);
+
+/**
+ * Operation statistics
+ *
+ * When the library was configured with --enable-stats, the value, edge,
+ * direction and active low accesses of all GPIO contexts can be counted and
+ * timed, per context and in a global aggregate which also covers the low
+ * level API. Recording is off by default and switched on at runtime with
+ * ugpio_stats_enable. Without --enable-stats, the instrumentation is not
+ * compiled in at all and these functions fail with ENOSYS.
+ *
+ * Latencies are recorded in histograms with logarithmic buckets: bucket 0
+ * counts operations which took less than 2 ns, bucket i those which took
+ * from 2^i up to 2^(i+1) ns, and the last bucket all slower ones.
+ */
+
+#define UGPIO_STATS_BUCKETS          32
+
+/**
+ * Operation statistics of a GPIO context or of the whole library.
+ */
+struct ugpio_stats {
+    /* the number of read and write operations */
+    uint64_t reads;
+    uint64_t writes;
+    /* the number of system calls done for them */
+    uint64_t syscalls;
+    /* the number of system calls repeated after EINTR or EAGAIN */
+    uint64_t retries;
+    /* the number of failed operations */
+    uint64_t errors;
+    /* latency histograms of the read and write operations */
+    uint64_t read_hist[UGPIO_STATS_BUCKETS];
+    uint64_t write_hist[UGPIO_STATS_BUCKETS];
+};
+
+/**
+ * Switch the recording of statistics on or off.
+ *
+ * @param enable 1 to record statistics, 0 to stop recording
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         ENOSYS - the library was built without --enable-stats.
+ */
+int ugpio_stats_enable(int enable);
+
+/**
+ * Get the statistics of a GPIO context or the global aggregate.
+ *
+ * Only operations on the file descriptors opened by ugpio_open or
+ * ugpio_full_open are accounted to a context.
+ *
+ * @param ctx a GPIO context, NULL for the global aggregate
+ * @param stats receives the statistics
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         ENOSYS - the library was built without --enable-stats.
+ */
+int ugpio_stats_get(ugpio_t *ctx, struct ugpio_stats *stats);
+
+/**
+ * Reset the statistics of a GPIO context or the global aggregate.
+ *
+ * @param ctx a GPIO context, NULL for the global aggregate
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         ENOSYS - the library was built without --enable-stats.
+ */
+int ugpio_stats_reset(ugpio_t *ctx);
+
+/**
+ * Flight recorder
+ *
+ * When enabled, each thread records the library operations it performs into
+ * a ring of binary records of its own, so that the last operations before a
+ * problem can be reconstructed. Recording costs no locks and no system
+ * calls, when disabled it costs a single branch per operation.
+ */
+
+#define UGPIO_TRACE_REQUEST          1
+#define UGPIO_TRACE_FREE             2
+#define UGPIO_TRACE_OPEN             3
+#define UGPIO_TRACE_GET              4
+#define UGPIO_TRACE_SET              5
+#define UGPIO_TRACE_EDGE             6
+#define UGPIO_TRACE_ERROR            7
+
+/**
+ * A recorded operation.
+ */
+struct ugpio_trace_record {
+    /* CLOCK_MONOTONIC time of the operation in nanoseconds */
+    uint64_t timestamp_ns;
+    /* the id of the thread */
+    uint32_t tid;
+    /* one of UGPIO_TRACE_* */
+    uint16_t type;
+    /* the errno value of UGPIO_TRACE_ERROR, 0 otherwise */
+    uint16_t error;
+    /* the GPIO number */
+    uint32_t gpio;
+    /* the value read or written, the file descriptor opened or the
+     * UGPIO_TRACE_* type of the operation which failed */
+    int32_t value;
+};
+
+/**
+ * Start or stop recording.
+ *
+ * The size of the rings is fixed when recording is enabled the first time,
+ * later calls only resume recording.
+ *
+ * @param records the number of records kept per thread, 0 to stop recording
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_trace_enable(size_t records);
+
+/**
+ * Get the recorded operations of all threads.
+ *
+ * @param records an array receiving the records, ordered by time
+ * @param max the size of the array, the most recent records are returned
+ *        when there are more
+ * @return the number of records stored in the array
+ */
+size_t ugpio_trace_snapshot(struct ugpio_trace_record *records, size_t max);
+
+/**
+ * Write the recorded operations of all threads as text, one per line.
+ *
+ * @param fd the file descriptor to write to
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_trace_dump(int fd);
+
+/**
+ * System snapshot
+ *
+ * ugpio_snapshot reads the state of all exported GPIOs at once, e.g. for
+ * diagnostics. With the sysfs backend, the root directory is listed once
+ * and all attributes are read relative to it; on systems with many exported
+ * GPIOs the lines are split across several threads. The lines are not
+ * requested, so the snapshot also covers GPIOs exported by other processes.
+ */
+
+/**
+ * The state of an exported GPIO.
+ */
+struct ugpio_line_state {
+    /* the GPIO number */
+    uint32_t gpio;
+    /* GPIOF_DIR_IN or GPIOF_DIR_OUT, -1 if it could not be read */
+    int8_t direction;
+    /* 0 or 1, -1 if it could not be read */
+    int8_t active_low;
+    /* the logical value 0 or 1, -1 if it could not be read */
+    int8_t value;
+    /* GPIOF_TRIG_* flags, -1 if the GPIO does not support edges */
+    int8_t edge;
+};
+
+/**
+ * Take a snapshot of all exported GPIOs.
+ *
+ * @param states receives an array of the states ordered by GPIO number,
+ *        to be released with free(), NULL if no GPIO is exported
+ * @return the number of states on success, -1 on error with errno set appropriately:
+ *         ENOSYS - the selected backend cannot enumerate its GPIOs.
+ */
+ssize_t ugpio_snapshot(struct ugpio_line_state **states);
+
+/**
+ * Line names
+ *
+ * GPIOs can be looked up by name instead of by number. A line is known by
+ * the name its chip driver assigned to it (e.g. from gpio-line-names in the
+ * device tree, available when the library was built with the GPIO character
+ * device support) and by "LABEL:OFFSET", the label of its chip and its
+ * offset within the chip. If several lines have the same name, the one with
+ * the lowest number wins. Numbers are those of the sysfs interface.
+ *
+ * The library indexes the chips below the sysfs root once and persists the
+ * index in a cache file, by default /run/ugpio-names. The cache is only used
+ * as long as the same chips are present in the same boot, which is checked
+ * by listing the sysfs root without reading any chip attribute. Within a
+ * process, lookups are served from a hash table after repeating this check,
+ * so chips appearing, vanishing or being re-probed later are picked up.
+ */
+
+/**
+ * Use another cache file for the line names index.
+ *
+ * The cache is written atomically by whichever process builds the index and
+ * may write to its directory, other processes just do not persist it. The
+ * index of this process is dropped and rebuilt on the next lookup.
+ *
+ * @param path the path of the cache file, NULL for the default,
+ *        an empty string to disable the cache
+ * @return 0 on success, -1 on error with errno set appropriately
+ */
+int ugpio_set_name_cache(const char *path);
+
+/**
+ * Look up the number of a GPIO by its name.
+ *
+ * @param name a line name or "LABEL:OFFSET"
+ * @param gpio receives the GPIO number
+ * @return 0 on success, -1 on error with errno set appropriately:
+ *         ENOENT - there is no line with the given name.
+ */
+int ugpio_lookup_name(const char *name, unsigned int *gpio);
+
+/**
+ * Request a GPIO context by the name of the GPIO.
+ *
+ * Like ugpio_request_one for the GPIO found by ugpio_lookup_name.
+ *
+ * @param name a line name or "LABEL:OFFSET"
+ * @param flags a combination of or-ed GPIOF_* constants
+ * @param label an optional label for this GPIO, the name if NULL
+ * @return returns a ugpio_t object on success, NULL otherwise
+ */
+ugpio_t *ugpio_request_by_name(const char *name, unsigned int flags, const char *label);
+
 UGPIO_END_DECLS
 
 #endif  /* UGPIO_H */
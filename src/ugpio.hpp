@@ -0,0 +1,388 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIO_HPP
+#define UGPIO_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+#include "ugpio.h"
+#include "ugpio-loop.h"
+
+#if __cplusplus >= 202002L && defined(__has_include)
+# if __has_include(<coroutine>)
+#  include <coroutine>
+#  define UGPIO_HAVE_COROUTINES 1
+# endif
+#endif
+
+/**
+ * C++ wrapper
+ *
+ * The classes below own the C objects they wrap and release them in their
+ * destructors, so no file descriptor or exported GPIO is leaked when an
+ * exception unwinds the stack. They can be moved but not copied.
+ *
+ * Constructors throw std::system_error when the underlying C function fails.
+ * All other member functions are noexcept and report errors the way the C
+ * functions do, so the fast paths for reading and writing values compile down
+ * to the plain C calls.
+ *
+ * With C++20, an edge_watch can be awaited from a coroutine: the coroutine is
+ * suspended until the next edge and resumed from within the loop, so any
+ * number of lines can be waited for by a single thread running the loop.
+ */
+
+namespace ugpio {
+
+namespace detail {
+
+/* std::exchange(p, nullptr) for C++11 */
+template <typename T>
+inline T *take(T *&p) noexcept
+{
+    T *old = p;
+    p = nullptr;
+    return old;
+}
+
+} // namespace detail
+
+[[noreturn]] inline void throw_errno(const char *what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+/**
+ * A requested and opened GPIO context.
+ */
+class line {
+public:
+    line() noexcept = default;
+
+    /**
+     * Request and open a GPIO, see ugpio_request_one.
+     */
+    line(unsigned int gpio, unsigned int flags, const char *label = nullptr)
+        : ctx_(ugpio_request_one(gpio, flags, label))
+    {
+        if (ctx_ == nullptr)
+            throw_errno("ugpio_request_one");
+        if (ugpio_open(ctx_) == -1) {
+            int err = errno;
+            ugpio_free(ctx_);
+            errno = err;
+            throw_errno("ugpio_open");
+        }
+    }
+
+    /**
+     * Take over a GPIO context, it is closed and freed by the destructor.
+     */
+    explicit line(ugpio_t *ctx) noexcept : ctx_(ctx) {}
+
+    line(line &&other) noexcept : ctx_(detail::take(other.ctx_)) {}
+
+    line &operator=(line &&other) noexcept
+    {
+        if (this != &other)
+            reset(detail::take(other.ctx_));
+        return *this;
+    }
+
+    line(const line &) = delete;
+    line &operator=(const line &) = delete;
+
+    ~line() { reset(); }
+
+    /**
+     * Close and free the GPIO context and take over another one.
+     */
+    void reset(ugpio_t *ctx = nullptr) noexcept
+    {
+        if (ctx_) {
+            ugpio_close(ctx_);
+            ugpio_free(ctx_);
+        }
+        ctx_ = ctx;
+    }
+
+    /**
+     * Give up ownership of the GPIO context.
+     */
+    ugpio_t *release() noexcept { return detail::take(ctx_); }
+
+    ugpio_t *native_handle() const noexcept { return ctx_; }
+    explicit operator bool() const noexcept { return ctx_ != nullptr; }
+
+    int fd() const noexcept { return ugpio_fd(ctx_); }
+
+    /** @return the value, -1 on error with errno set appropriately */
+    int get() const noexcept { return ugpio_get_value(ctx_); }
+
+    /** @return 0 on success, -1 on error with errno set appropriately */
+    int set(int value) noexcept { return ugpio_set_value(ctx_, value); }
+
+private:
+    ugpio_t *ctx_ = nullptr;
+};
+
+/**
+ * A set of GPIOs requested, opened and accessed as a port.
+ */
+class line_set {
+public:
+    line_set() noexcept = default;
+
+    /**
+     * Request and open GPIOs, see ugpio_port_request.
+     */
+    line_set(const unsigned int *gpios, std::size_t num, unsigned int flags,
+             const char *label = nullptr)
+        : port_(ugpio_port_request(gpios, num, flags, label))
+    {
+        if (port_ == nullptr)
+            throw_errno("ugpio_port_request");
+    }
+
+    template <std::size_t N>
+    line_set(const unsigned int (&gpios)[N], unsigned int flags, const char *label = nullptr)
+        : line_set(gpios, N, flags, label)
+    {
+    }
+
+    /**
+     * Create a port from GPIO contexts which stay owned by the caller, see
+     * ugpio_port_new.
+     */
+    line_set(ugpio_t **ctxs, std::size_t num) : port_(ugpio_port_new(ctxs, num))
+    {
+        if (port_ == nullptr)
+            throw_errno("ugpio_port_new");
+    }
+
+    line_set(line_set &&other) noexcept : port_(detail::take(other.port_)) {}
+
+    line_set &operator=(line_set &&other) noexcept
+    {
+        if (this != &other) {
+            ugpio_port_free(port_);
+            port_ = detail::take(other.port_);
+        }
+        return *this;
+    }
+
+    line_set(const line_set &) = delete;
+    line_set &operator=(const line_set &) = delete;
+
+    ~line_set() { ugpio_port_free(port_); }
+
+    ugpio_port_t *native_handle() const noexcept { return port_; }
+    explicit operator bool() const noexcept { return port_ != nullptr; }
+
+    std::size_t size() const noexcept { return ugpio_port_size(port_); }
+
+    /** @return the GPIO context of bit idx, owned by the set */
+    ugpio_t *operator[](std::size_t idx) const noexcept { return ugpio_port_ctx(port_, idx); }
+
+    /** @return the value of bit idx, -1 on error with errno set appropriately */
+    int get(std::size_t idx) const noexcept { return ugpio_get_value(ugpio_port_ctx(port_, idx)); }
+
+    /** @return 0 on success, -1 on error with errno set appropriately */
+    int set(std::size_t idx, int value) noexcept
+    {
+        return ugpio_set_value(ugpio_port_ctx(port_, idx), value);
+    }
+
+    /** @return 0 on success, -1 on error with errno set appropriately */
+    int get_all(std::uint64_t &bits) const noexcept { return ugpio_get_port(port_, &bits); }
+
+    /** @return 0 on success, -1 on error with errno set appropriately */
+    int set_all(std::uint64_t mask, std::uint64_t value) noexcept
+    {
+        return ugpio_set_port(port_, mask, value);
+    }
+
+private:
+    ugpio_port_t *port_ = nullptr;
+};
+
+/**
+ * An event loop.
+ */
+class loop {
+public:
+    loop() : loop_(ugpio_loop_new())
+    {
+        if (loop_ == nullptr)
+            throw_errno("ugpio_loop_new");
+    }
+
+    loop(loop &&other) noexcept : loop_(detail::take(other.loop_)) {}
+
+    loop &operator=(loop &&other) noexcept
+    {
+        if (this != &other) {
+            ugpio_loop_free(loop_);
+            loop_ = detail::take(other.loop_);
+        }
+        return *this;
+    }
+
+    loop(const loop &) = delete;
+    loop &operator=(const loop &) = delete;
+
+    ~loop() { ugpio_loop_free(loop_); }
+
+    ugpio_loop_t *native_handle() const noexcept { return loop_; }
+
+    int fd() const noexcept { return ugpio_loop_fd(loop_); }
+    int run() noexcept { return ugpio_loop_run(loop_); }
+    int run_once(int timeout_ms = -1) noexcept { return ugpio_loop_run_once(loop_, timeout_ms); }
+    void stop() noexcept { ugpio_loop_stop(loop_); }
+
+private:
+    ugpio_loop_t *loop_ = nullptr;
+};
+
+/**
+ * Edges of a line delivered by an event loop.
+ *
+ * The line stays registered with the loop for the lifetime of the watch, so
+ * no edge is lost between two waits: an edge arriving while nobody waits is
+ * remembered, and the next wait completes immediately with the latest value.
+ * The watch must be destroyed before the loop and the line, and must not be
+ * destroyed while a coroutine is suspended on it.
+ */
+class edge_watch {
+public:
+    edge_watch(loop &l, line &ln) : state_(new state)
+    {
+        state_->loop = l.native_handle();
+        state_->ctx = ln.native_handle();
+        if (ugpio_loop_add(state_->loop, state_->ctx, &edge_watch::on_edge, state_.get()) == -1)
+            throw_errno("ugpio_loop_add");
+    }
+
+    edge_watch(edge_watch &&) noexcept = default;
+    edge_watch &operator=(edge_watch &&other) noexcept
+    {
+        if (this != &other) {
+            unregister();
+            state_ = std::move(other.state_);
+        }
+        return *this;
+    }
+
+    edge_watch(const edge_watch &) = delete;
+    edge_watch &operator=(const edge_watch &) = delete;
+
+    ~edge_watch() { unregister(); }
+
+    explicit operator bool() const noexcept { return state_ != nullptr; }
+
+    /**
+     * Take the latest edge without waiting.
+     *
+     * @return the value after the edge, -1 if it could not be read or with
+     *         errno set to EBADF if the watch was moved from, -2 if there
+     *         was no edge since the last call
+     */
+    int poll() noexcept
+    {
+        if (!state_) {
+            errno = EBADF;
+            return -1;
+        }
+        if (!state_->pending)
+            return -2;
+        state_->pending = false;
+        return state_->value;
+    }
+
+#if UGPIO_HAVE_COROUTINES
+    class awaiter {
+    public:
+        explicit awaiter(edge_watch &w) noexcept : w_(w) {}
+
+        bool await_ready() const noexcept { return !w_.state_ || w_.state_->pending; }
+
+        bool await_suspend(std::coroutine_handle<> h) noexcept
+        {
+            /* only one coroutine can wait for the edges of a watch */
+            if (w_.state_->waiter) {
+                err_ = EBUSY;
+                return false;
+            }
+            w_.state_->waiter = h;
+            return true;
+        }
+
+        /**
+         * @return the value after the edge, -1 if it could not be read or
+         *         with errno set to EBADF if the watch was moved from or to
+         *         EBUSY if another coroutine already waits for it
+         */
+        int await_resume() noexcept
+        {
+            if (err_) {
+                errno = err_;
+                return -1;
+            }
+            return w_.poll();
+        }
+
+    private:
+        edge_watch &w_;
+        int err_ = 0;
+    };
+
+    /**
+     * Suspend the coroutine until the next edge.
+     */
+    awaiter operator co_await() noexcept { return awaiter(*this); }
+#endif
+
+private:
+    struct state {
+        ugpio_loop_t *loop = nullptr;
+        ugpio_t *ctx = nullptr;
+        bool pending = false;
+        int value = -1;
+#if UGPIO_HAVE_COROUTINES
+        std::coroutine_handle<> waiter;
+#endif
+    };
+
+    static void on_edge(ugpio_loop_t *, ugpio_t *, int value, void *userdata) noexcept
+    {
+        state *s = static_cast<state *>(userdata);
+
+        s->value = value;
+        s->pending = true;
+#if UGPIO_HAVE_COROUTINES
+        if (s->waiter)
+            std::exchange(s->waiter, nullptr).resume();
+#endif
+    }
+
+    void unregister() noexcept
+    {
+        if (state_)
+            ugpio_loop_remove(state_->loop, state_->ctx);
+    }
+
+    std::unique_ptr<state> state_;
+};
+
+} // namespace ugpio
+
+#endif  /* UGPIO_HPP */
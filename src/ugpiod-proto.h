@@ -0,0 +1,100 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef UGPIOD_PROTO_H
+#define UGPIOD_PROTO_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * ugpiod protocol
+ *
+ * The daemon owns all GPIOs, clients talk to it over a SOCK_SEQPACKET Unix
+ * socket. A request is an array of up to UGPIOD_MAX_OPS operations, the
+ * reply is an array of one int32_t result per operation: a value >= 0 on
+ * success, -errno on failure. Operations are independent, a failing one does
+ * not stop the remaining ones. File descriptors are passed as SCM_RIGHTS:
+ * each UGPIOD_OP_SUBSCRIBE of a request consumes the next descriptor sent
+ * with the request, which has to be an eventfd, and the reply to UGPIOD_OP_HELLO carries the shared
+ * memory segment.
+ *
+ * Attribute values are binary: a direction is one of UGPIOD_DIR_*, an edge
+ * is a combination of GPIOF_TRIG_*, active_low and value are 0 or 1.
+ */
+
+#define UGPIOD_SOCKET       "/run/ugpiod.sock"
+#define UGPIOD_MAX_OPS      64
+
+#define UGPIOD_SHM_MAGIC    0x7567706fu
+#define UGPIOD_SHM_VERSION  1
+
+enum ugpiod_opcode {
+    /* start a session, returns the number of lines in the shared memory */
+    UGPIOD_OP_HELLO,
+    /* take a reference on a GPIO, like writing to export */
+    UGPIOD_OP_ACQUIRE,
+    /* drop the reference, like writing to unexport */
+    UGPIOD_OP_RELEASE,
+    /* whether the attribute exists for this client: 1 or 0 */
+    UGPIOD_OP_CHECK,
+    /* read an attribute */
+    UGPIOD_OP_READ,
+    /* write arg to an attribute */
+    UGPIOD_OP_WRITE,
+    /* signal edges of the GPIO on the passed eventfd, arg identifies it */
+    UGPIOD_OP_SUBSCRIBE,
+    /* stop the subscription identified by arg */
+    UGPIOD_OP_UNSUBSCRIBE,
+};
+
+enum ugpiod_attr {
+    UGPIOD_ATTR_DIRECTION,
+    UGPIOD_ATTR_ACTIVELOW,
+    UGPIOD_ATTR_VALUE,
+    UGPIOD_ATTR_EDGE,
+};
+
+enum ugpiod_direction {
+    UGPIOD_DIR_IN,
+    UGPIOD_DIR_OUT_LOW,
+    UGPIOD_DIR_OUT_HIGH,
+};
+
+/**
+ * An operation of a request.
+ */
+struct ugpiod_op {
+    uint16_t op;
+    /* an enum ugpiod_attr for CHECK, READ and WRITE */
+    uint16_t attr;
+    uint32_t gpio;
+    int32_t arg;
+};
+
+/* the value of the line */
+#define UGPIOD_LINE_VALUE   (1u << 0)
+/* the value is kept up to date by the daemon */
+#define UGPIOD_LINE_LIVE    (1u << 1)
+
+/**
+ * The shared memory segment, mapped read-only by the clients.
+ *
+ * The daemon keeps the value of a line up to date while the line is held by
+ * at least one client and is either an output or an input with edge
+ * support, and marks it live. Clients read the value of live lines from here
+ * without asking the daemon.
+ */
+struct ugpiod_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nlines;
+    uint32_t reserved;
+    /* UGPIOD_LINE_* of each line */
+    _Atomic uint32_t lines[];
+};
+
+#endif  /* UGPIOD_PROTO_H */
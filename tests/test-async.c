@@ -0,0 +1,182 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <ftw.h>
+#include <limits.h>
+
+#include <ugpio.h>
+#include <ugpio-async.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define ENTRIES	4
+
+struct record {
+	int count;
+	int result;
+	ugpio_t *ctx;
+	/* queue the same operation again from the callback */
+	int resubmit;
+};
+
+static char root[] = "/tmp/test-async-XXXXXX";
+static int order;
+
+static void write_file(const char *name, const char *content)
+{
+	char pathname[PATH_MAX];
+	FILE *f;
+
+	snprintf(pathname, sizeof(pathname), "%s/%s", root, name);
+	REQUIRE((f = fopen(pathname, "w")) != NULL);
+	fputs(content, f);
+	fclose(f);
+}
+
+static int read_file(const char *name)
+{
+	char pathname[PATH_MAX];
+	FILE *f;
+	int c;
+
+	snprintf(pathname, sizeof(pathname), "%s/%s", root, name);
+	if ((f = fopen(pathname, "r")) == NULL)
+		return -1;
+	c = fgetc(f);
+	fclose(f);
+
+	return c;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static void on_complete(ugpio_async_t *as, ugpio_t *ctx, int result, void *userdata)
+{
+	struct record *r = userdata;
+
+	CHECK(ctx == r->ctx);
+	r->count = ++order;
+	r->result = result;
+
+	if (r->resubmit) {
+		r->resubmit--;
+		CHECK(ugpio_submit_get(as, ctx, on_complete, r) == 0);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct record records[ENTRIES + 1] = { { 0 } };
+	char path[PATH_MAX];
+	ugpio_async_t *as;
+	ugpio_t *out, *in;
+	int i;
+
+	/* sysfs files are read and written through io_uring, if available */
+	REQUIRE(mkdtemp(root) != NULL);
+	write_file("export", "");
+	write_file("unexport", "");
+	snprintf(path, sizeof(path), "%s/gpio3", root);
+	REQUIRE(mkdir(path, 0755) == 0);
+	write_file("gpio3/direction", "in\n");
+	write_file("gpio3/value", "1\n");
+	REQUIRE(ugpio_set_sysfs_root(root) == 0);
+	REQUIRE((in = ugpio_request_one(3, GPIOF_IN, NULL)) != NULL);
+	REQUIRE((as = ugpio_async_new(ENTRIES)) != NULL);
+	if (ugpio_async_is_uring(as)) {
+		records[0].ctx = in;
+		records[1].ctx = in;
+		CHECK(ugpio_submit_get(as, in, on_complete, &records[0]) == 0);
+		CHECK(ugpio_submit_set(as, in, 0, on_complete, &records[1]) == 0);
+		CHECK(ugpio_async_pending(as) == 2);
+		CHECK(ugpio_async_run(as, 2) == 2);
+		CHECK(ugpio_async_pending(as) == 0);
+		CHECK(records[0].count && records[0].result == 1);
+		CHECK(records[1].count && records[1].result == 0);
+		CHECK(read_file("gpio3/value") == '0');
+	}
+	ugpio_async_free(as);
+	ugpio_close(in);
+	ugpio_free(in);
+	nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	memset(records, 0, sizeof(records));
+	order = 0;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((out = ugpio_request_one(0, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+	REQUIRE((in = ugpio_request_one(1, GPIOF_IN, NULL)) != NULL);
+
+	/* other backends are run synchronously */
+	REQUIRE((as = ugpio_async_new(ENTRIES)) != NULL);
+	CHECK(ugpio_async_is_uring(as) == 0);
+	CHECK(ugpio_async_run(as, 0) == 0);
+
+	/* queued operations are carried out in order when the queue is run */
+	records[0].ctx = out;
+	records[1].ctx = in;
+	records[2].ctx = in;
+	CHECK(ugpio_sim_set_input(1, 1) == 0);
+	CHECK(ugpio_submit_set(as, out, 1, on_complete, &records[0]) == 0);
+	CHECK(ugpio_submit_get(as, in, on_complete, &records[1]) == 0);
+	CHECK(ugpio_submit_set(as, in, 0, on_complete, &records[2]) == 0);
+	CHECK(ugpio_async_pending(as) == 3);
+	CHECK(ugpio_sim_get_level(0) == 0);
+
+	CHECK(ugpio_async_run(as, 3) == 3);
+	CHECK(ugpio_async_pending(as) == 0);
+	CHECK(records[0].count == 1 && records[0].result == 0);
+	CHECK(records[1].count == 2 && records[1].result == 1);
+	CHECK(records[2].count == 3 && records[2].result < 0);
+	CHECK(ugpio_sim_get_level(0) == 1);
+
+	/* a write without a callback */
+	CHECK(ugpio_submit_set(as, out, 0, NULL, NULL) == 0);
+	CHECK(ugpio_async_run(as, 1) == 1);
+	CHECK(ugpio_sim_get_level(0) == 0);
+	CHECK(ugpio_get_value(out) == 0);
+
+	/* no more operations than entries are in flight */
+	for (i = 0; i < ENTRIES; i++) {
+		records[i].ctx = in;
+		CHECK(ugpio_submit_get(as, in, on_complete, &records[i]) == 0);
+	}
+	records[ENTRIES].ctx = in;
+	CHECK(ugpio_submit_get(as, in, on_complete, &records[ENTRIES]) == -1 && errno == EBUSY);
+	CHECK(ugpio_async_run(as, ENTRIES) == ENTRIES);
+
+	/* operations queued by a callback are handled by the next run */
+	order = 0;
+	records[0].resubmit = 2;
+	CHECK(ugpio_submit_get(as, in, on_complete, &records[0]) == 0);
+	CHECK(ugpio_async_run(as, 1) == 1);
+	CHECK(ugpio_async_pending(as) == 1);
+	CHECK(ugpio_async_run(as, 1) == 1);
+	CHECK(ugpio_async_run(as, 1) == 1);
+	CHECK(ugpio_async_pending(as) == 0);
+	CHECK(records[0].count == 3);
+	CHECK(ugpio_async_run(as, 0) == 0);
+
+	/* operations still queued are dropped silently */
+	order = 0;
+	records[1].count = 0;
+	CHECK(ugpio_submit_get(as, in, on_complete, &records[1]) == 0);
+	ugpio_async_free(as);
+	CHECK(records[1].count == 0);
+
+	ugpio_close(out);
+	ugpio_free(out);
+	ugpio_close(in);
+	ugpio_free(in);
+
+	return TEST_RESULT();
+}
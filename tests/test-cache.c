@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <ugpio.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+static int hook_calls;
+static int hook_changed;
+
+static void on_change(ugpio_t *ctx, int changed, void *userdata)
+{
+	hook_calls++;
+	hook_changed = changed;
+}
+
+int main(int argc, char *argv[])
+{
+	ugpio_port_t *port;
+	ugpio_t *ctx;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+
+	REQUIRE((ctx = ugpio_request(0, NULL)) != NULL);
+	REQUIRE(ugpio_full_open(ctx) == 0);
+	CHECK(ugpio_direction_output(ctx, 0) == 0);
+	ugpio_set_cached(ctx, 1);
+	CHECK(ugpio_refresh(ctx) >= 0);
+	ugpio_set_change_hook(ctx, on_change, NULL);
+
+	/* writes of the remembered value are skipped */
+	CHECK(ugpio_set_value(ctx, 1) == 0);
+	CHECK(ugpio_sim_get_level(0) == 1);
+	CHECK(gpio_set_value(0, 0) == 0);
+	CHECK(ugpio_get_value(ctx) == 1);
+	CHECK(ugpio_set_value(ctx, 1) == 0);
+	CHECK(ugpio_sim_get_level(0) == 0);
+
+	/* a refresh picks up the change behind the back of the context */
+	CHECK(ugpio_refresh(ctx) == UGPIO_CHANGED_VALUE);
+	CHECK(hook_calls == 1 && hook_changed == UGPIO_CHANGED_VALUE);
+	CHECK(ugpio_get_value(ctx) == 0);
+	CHECK(ugpio_set_value(ctx, 1) == 0);
+	CHECK(ugpio_sim_get_level(0) == 1);
+	CHECK(ugpio_refresh(ctx) == 0);
+	CHECK(hook_calls == 1);
+
+	/* the configuration is remembered as well */
+	CHECK(ugpio_get_direction(ctx) == GPIOF_DIR_OUT);
+	CHECK(gpio_direction_input(0) == 0);
+	CHECK(ugpio_get_direction(ctx) == GPIOF_DIR_OUT);
+	CHECK(ugpio_refresh(ctx) == UGPIO_CHANGED_DIRECTION);
+	CHECK(ugpio_get_direction(ctx) == GPIOF_DIR_IN);
+	CHECK(ugpio_direction_output(ctx, 1) == 0);
+
+	CHECK(ugpio_get_activelow(ctx) == 0);
+	CHECK(gpio_set_activelow(0, 1) == 0);
+	CHECK(ugpio_get_activelow(ctx) == 0);
+	CHECK(ugpio_refresh(ctx) & UGPIO_CHANGED_ACTIVELOW);
+	CHECK(ugpio_get_activelow(ctx) == 1);
+	CHECK(ugpio_set_activelow(ctx, 0) == 0);
+
+	/* writes through a port keep the shadow of the context in sync */
+	CHECK(ugpio_set_value(ctx, 1) == 0);
+	REQUIRE((port = ugpio_port_new(&ctx, 1)) != NULL);
+	CHECK(ugpio_set_port(port, 1, 0) == 0);
+	CHECK(ugpio_sim_get_level(0) == 0);
+	CHECK(ugpio_get_value(ctx) == 0);
+	CHECK(ugpio_set_value(ctx, 1) == 0);
+	CHECK(ugpio_sim_get_level(0) == 1);
+	ugpio_port_free(port);
+
+	/* without the cache every access goes to the GPIO */
+	ugpio_set_cached(ctx, 0);
+	CHECK(gpio_set_value(0, 0) == 0);
+	CHECK(ugpio_get_value(ctx) == 0);
+	CHECK(ugpio_set_value(ctx, 0) == 0);
+	CHECK(gpio_set_value(0, 1) == 0);
+	CHECK(ugpio_set_value(ctx, 0) == 0);
+	CHECK(ugpio_sim_get_level(0) == 0);
+
+	ugpio_close(ctx);
+	ugpio_free(ctx);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-internal.h>
+
+#include "test.h"
+
+#if HAVE_DECL_GPIO_V2_GET_LINE_IOCTL
+
+#include <linux/gpio.h>
+
+/*
+ * A fake kernel behind the replaceable ioctl entry point: two chips of one
+ * parent device, as registered by MFD drivers, in a temporary directory
+ * standing in for /dev and /sys/class/gpio.
+ */
+#define FAKE_CHIPS	2
+#define FAKE_LINES	8
+
+struct fake_line {
+	/* the line request, -1 if not requested */
+	int req_fd;
+	uint64_t flags;
+	/* the physical level */
+	int level;
+};
+
+static const struct {
+	const char *label;
+	unsigned int ngpio;
+	unsigned int base;
+} fake_chip_info[FAKE_CHIPS] = {
+	{ "pmic-gpio", 8, 0 },
+	{ "pmic-gpo", 4, 8 },
+};
+
+static struct fake_line fake_lines[FAKE_CHIPS][FAKE_LINES];
+static ino_t fake_inodes[FAKE_CHIPS];
+static char fake_root[] = "/tmp/ugpio-test-cdev.XXXXXX";
+
+static int fake_chip(int fd)
+{
+	struct stat st;
+	int i;
+
+	if (fstat(fd, &st) == 0)
+		for (i = 0; i < FAKE_CHIPS; i++)
+			if (st.st_ino == fake_inodes[i])
+				return i;
+
+	return -1;
+}
+
+static struct fake_line *fake_request(int fd)
+{
+	int c, o;
+
+	for (c = 0; c < FAKE_CHIPS; c++)
+		for (o = 0; o < FAKE_LINES; o++)
+			if (fake_lines[c][o].req_fd == fd)
+				return &fake_lines[c][o];
+
+	return NULL;
+}
+
+/* the library closes released requests, their numbers get reused */
+static void fake_forget(int fd)
+{
+	struct fake_line *line;
+
+	while ((line = fake_request(fd)) != NULL)
+		line->req_fd = -1;
+}
+
+static int fake_ioctl(int fd, unsigned long request, void *arg)
+{
+	struct gpio_v2_line_config *config;
+	struct gpio_v2_line_values *values;
+	struct gpio_v2_line_request *req;
+	struct gpio_v2_line_info *info;
+	struct gpiochip_info *chip;
+	struct fake_line *line;
+	int c, active_low;
+	unsigned int i;
+
+	switch (request) {
+	case GPIO_GET_CHIPINFO_IOCTL:
+		if ((c = fake_chip(fd)) == -1)
+			break;
+		chip = arg;
+		memset(chip, 0, sizeof(*chip));
+		snprintf(chip->name, sizeof(chip->name), "gpiochip%d", c);
+		snprintf(chip->label, sizeof(chip->label), "%s", fake_chip_info[c].label);
+		chip->lines = fake_chip_info[c].ngpio;
+		return 0;
+	case GPIO_V2_GET_LINEINFO_IOCTL:
+		info = arg;
+		if ((c = fake_chip(fd)) == -1 || info->offset >= fake_chip_info[c].ngpio)
+			break;
+		info->flags = fake_lines[c][info->offset].flags;
+		return 0;
+	case GPIO_V2_GET_LINE_IOCTL:
+		req = arg;
+		if ((c = fake_chip(fd)) == -1 || req->num_lines != 1 ||
+		    req->offsets[0] >= fake_chip_info[c].ngpio)
+			break;
+		line = &fake_lines[c][req->offsets[0]];
+		if (line->req_fd != -1 && fcntl(line->req_fd, F_GETFD) != -1) {
+			errno = EBUSY;
+			return -1;
+		}
+		if ((req->fd = eventfd(0, 0)) == -1)
+			return -1;
+		fake_forget(req->fd);
+		line->req_fd = req->fd;
+		line->flags = req->config.flags;
+		return 0;
+	case GPIO_V2_LINE_SET_CONFIG_IOCTL:
+		if ((line = fake_request(fd)) == NULL)
+			break;
+		config = arg;
+		line->flags = config->flags;
+		active_low = !!(config->flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW);
+		for (i = 0; i < config->num_attrs; i++)
+			if (config->attrs[i].attr.id == GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES)
+				line->level = (config->attrs[i].attr.values & 1) ^ active_low;
+		return 0;
+	case GPIO_V2_LINE_GET_VALUES_IOCTL:
+		if ((line = fake_request(fd)) == NULL)
+			break;
+		values = arg;
+		active_low = !!(line->flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW);
+		values->bits = (line->level ^ active_low) & values->mask;
+		return 0;
+	case GPIO_V2_LINE_SET_VALUES_IOCTL:
+		if ((line = fake_request(fd)) == NULL)
+			break;
+		if (!(line->flags & GPIO_V2_LINE_FLAG_OUTPUT)) {
+			errno = EPERM;
+			return -1;
+		}
+		values = arg;
+		active_low = !!(line->flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW);
+		if (values->mask & 1)
+			line->level = (values->bits & 1) ^ active_low;
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+static void write_file(const char *path, const char *content)
+{
+	FILE *f;
+
+	REQUIRE((f = fopen(path, "w")) != NULL);
+	fputs(content, f);
+	fclose(f);
+}
+
+static void make_tree(void)
+{
+	char path[PATH_MAX], text[32];
+	struct stat st;
+	int c, d;
+
+	REQUIRE(mkdtemp(fake_root) != NULL);
+
+	snprintf(path, sizeof(path), "%s/dev", fake_root);
+	REQUIRE(mkdir(path, 0755) == 0);
+	snprintf(path, sizeof(path), "%s/sys", fake_root);
+	REQUIRE(mkdir(path, 0755) == 0);
+
+	for (c = 0; c < FAKE_CHIPS; c++) {
+		snprintf(path, sizeof(path), "%s/dev/gpiochip%d", fake_root, c);
+		write_file(path, "");
+		REQUIRE(stat(path, &st) == 0);
+		fake_inodes[c] = st.st_ino;
+
+		snprintf(path, sizeof(path), "%s/sys/gpiochip%u", fake_root, fake_chip_info[c].base);
+		REQUIRE(mkdir(path, 0755) == 0);
+		snprintf(path, sizeof(path), "%s/sys/gpiochip%u/device", fake_root, fake_chip_info[c].base);
+		REQUIRE(mkdir(path, 0755) == 0);
+		/* the parent device lists all of its chips */
+		for (d = 0; d < FAKE_CHIPS; d++) {
+			snprintf(path, sizeof(path), "%s/sys/gpiochip%u/device/gpiochip%d",
+				 fake_root, fake_chip_info[c].base, d);
+			REQUIRE(mkdir(path, 0755) == 0);
+		}
+		snprintf(path, sizeof(path), "%s/sys/gpiochip%u/label", fake_root, fake_chip_info[c].base);
+		snprintf(text, sizeof(text), "%s\n", fake_chip_info[c].label);
+		write_file(path, text);
+		snprintf(path, sizeof(path), "%s/sys/gpiochip%u/ngpio", fake_root, fake_chip_info[c].base);
+		snprintf(text, sizeof(text), "%u\n", fake_chip_info[c].ngpio);
+		write_file(path, text);
+	}
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static uint64_t line_flags(int chip, int offset)
+{
+	return fake_lines[chip][offset].flags;
+}
+
+static int is_output(int chip, int offset)
+{
+	return !!(line_flags(chip, offset) & GPIO_V2_LINE_FLAG_OUTPUT);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[PATH_MAX];
+	ugpio_t *ctx;
+	int c, o, fd;
+
+	for (c = 0; c < FAKE_CHIPS; c++)
+		for (o = 0; o < FAKE_LINES; o++)
+			fake_lines[c][o].req_fd = -1;
+
+	make_tree();
+
+	snprintf(path, sizeof(path), "%s/sys", fake_root);
+	REQUIRE(ugpio_set_sysfs_root(path) == 0);
+	snprintf(gpio_cdev_dir, PATH_MAX, "%s/dev", fake_root);
+	gpio_cdev_ioctl = fake_ioctl;
+	REQUIRE(ugpio_set_backend("cdev") == 0);
+	gpio_set_fd_cache_size(0);
+
+	/* both chips of the device keep their own base */
+	CHECK(gpio_request(9, NULL) == 0);
+	CHECK(fake_lines[1][1].req_fd != -1);
+	CHECK(fake_lines[0][1].req_fd == -1);
+	fd = fake_lines[1][1].req_fd;
+	CHECK(gpio_free(9) == 0);
+	CHECK(fcntl(fd, F_GETFD) == -1 && errno == EBADF);
+	CHECK(gpio_request(12, NULL) == -1);
+
+	/* an output stays an output although its edge is configured */
+	CHECK(gpio_request_one(2, GPIOF_OUT_INIT_HIGH, NULL) == 1);
+	CHECK(is_output(0, 2));
+	CHECK(fake_lines[0][2].level == 1);
+	CHECK(gpio_get_direction(2) == GPIOF_DIR_OUT);
+	CHECK(gpio_get_value(2) == 1);
+	CHECK(gpio_set_value(2, 0) == 0);
+	CHECK(fake_lines[0][2].level == 0);
+	CHECK(gpio_set_edge(2, 0) == 0);
+	CHECK(is_output(0, 2));
+	CHECK(gpio_set_edge(2, GPIOF_TRIG_RISE) == -1 && errno == EIO);
+	CHECK(is_output(0, 2));
+
+	/* active low on an output keeps the physical level */
+	CHECK(gpio_set_value(2, 1) == 0);
+	CHECK(gpio_set_activelow(2, 1) == 0);
+	CHECK(fake_lines[0][2].level == 1);
+	CHECK(gpio_get_value(2) == 0);
+	CHECK(gpio_set_activelow(2, 0) == 0);
+
+	/* output -> input with edges -> output */
+	CHECK(gpio_direction_input(2) == 0);
+	CHECK(!is_output(0, 2));
+	CHECK(gpio_set_edge(2, GPIOF_TRIG_RISE | GPIOF_TRIG_FALL) == 0);
+	CHECK(line_flags(0, 2) & GPIO_V2_LINE_FLAG_EDGE_RISING);
+	CHECK(line_flags(0, 2) & GPIO_V2_LINE_FLAG_EDGE_FALLING);
+	CHECK(gpio_get_edge(2) == (GPIOF_TRIG_RISE | GPIOF_TRIG_FALL));
+	CHECK(gpio_set_value(2, 1) == -1);
+	CHECK(gpio_direction_output(2, 1) == 0);
+	CHECK(is_output(0, 2));
+	CHECK(!(line_flags(0, 2) & (GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING)));
+	CHECK(gpio_get_edge(2) == 0);
+	CHECK(fake_lines[0][2].level == 1);
+	CHECK(gpio_free(2) == 0);
+
+	/* the high level API configures inputs with edges and outputs */
+	CHECK((ctx = ugpio_request_one(3, GPIOF_IN | GPIOF_TRIG_RISE, NULL)) != NULL);
+	if (ctx) {
+		CHECK(!is_output(0, 3));
+		CHECK(line_flags(0, 3) & GPIO_V2_LINE_FLAG_EDGE_RISING);
+		CHECK(!(line_flags(0, 3) & GPIO_V2_LINE_FLAG_EDGE_FALLING));
+		CHECK((fd = ugpio_open(ctx)) >= 0);
+		fake_lines[0][3].level = 1;
+		CHECK(ugpio_get_value(ctx) == 1);
+		ugpio_close(ctx);
+		ugpio_free(ctx);
+	}
+
+	CHECK((ctx = ugpio_request_one(10, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+	if (ctx) {
+		CHECK(is_output(1, 2));
+		CHECK(ugpio_open(ctx) >= 0);
+		CHECK(ugpio_set_value(ctx, 1) == 0);
+		CHECK(fake_lines[1][2].level == 1);
+		CHECK(ugpio_get_value(ctx) == 1);
+		ugpio_close(ctx);
+		ugpio_free(ctx);
+	}
+
+	nftw(fake_root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+	return TEST_RESULT();
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+	return TEST_SKIP;
+}
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <ugpio.h>
+#include <ugpiod-proto.h>
+
+#include "test.h"
+
+#define LINES	8
+
+static char dir[] = "/tmp/test-client-XXXXXX";
+static char socket_path[64];
+
+/* the socket file already exists between the bind and the listen of the daemon */
+static int daemon_listening(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int sock, rv;
+
+	if ((sock = socket(AF_UNIX, SOCK_SEQPACKET, 0)) == -1)
+		return 0;
+	strcpy(addr.sun_path, socket_path);
+	rv = connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+	close(sock);
+
+	return rv;
+}
+
+static pid_t daemon_start(void)
+{
+	char lines[16];
+	pid_t pid;
+	int i;
+
+	snprintf(lines, sizeof(lines), "%d", LINES);
+
+	if ((pid = fork()) == 0) {
+		execl(UGPIOD_PATH, "ugpiod", "-b", "sim", "-n", lines, "-s", socket_path, NULL);
+		_exit(TEST_SKIP);
+	}
+
+	/* wait until the daemon accepts connections */
+	for (i = 0; pid > 0 && i < 200 && !daemon_listening(); i++)
+		test_sleep_ms(10);
+
+	return pid;
+}
+
+static int daemon_stop(pid_t pid)
+{
+	int status;
+
+	kill(pid, SIGTERM);
+	if (waitpid(pid, &status, 0) == -1)
+		return -1;
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*
+ * send a batch of operations along with an optional fd, and receive the
+ * results, and the fd of a HELLO
+ */
+static int exchange(int sock, const struct ugpiod_op *ops, int32_t *results, unsigned int num,
+		    int sfd, int *rfd)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct iovec iov = { (void *)ops, num * sizeof(*ops) };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	struct cmsghdr *cmsg;
+
+	if (sfd != -1) {
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &sfd, sizeof(int));
+	}
+
+	if (sendmsg(sock, &msg, 0) == -1)
+		return -1;
+
+	iov.iov_base = results;
+	iov.iov_len = num * sizeof(*results);
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	if (recvmsg(sock, &msg, 0) != num * sizeof(*results))
+		return -1;
+
+	*rfd = -1;
+	if ((cmsg = CMSG_FIRSTHDR(&msg)) != NULL && cmsg->cmsg_type == SCM_RIGHTS)
+		memcpy(rfd, CMSG_DATA(cmsg), sizeof(int));
+
+	return 0;
+}
+
+/* the protocol spoken by hand */
+static void test_protocol(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct ugpiod_op ops[6] = {
+		{ .op = UGPIOD_OP_ACQUIRE, .gpio = 3 },
+		{ .op = UGPIOD_OP_WRITE, .attr = UGPIOD_ATTR_DIRECTION, .gpio = 3, .arg = UGPIOD_DIR_OUT_HIGH },
+		{ .op = UGPIOD_OP_READ, .attr = UGPIOD_ATTR_VALUE, .gpio = 3 },
+		{ .op = UGPIOD_OP_READ, .attr = UGPIOD_ATTR_VALUE, .gpio = LINES },
+		{ .op = 1000, .gpio = 3 },
+		{ .op = UGPIOD_OP_RELEASE, .gpio = 3 },
+	};
+	struct ugpiod_op hello = { .op = UGPIOD_OP_HELLO };
+	struct ugpiod_op subscribe = {
+		.op = UGPIOD_OP_SUBSCRIBE, .attr = UGPIOD_ATTR_VALUE, .gpio = 3, .arg = 1
+	};
+	const struct ugpiod_shm *shm;
+	int32_t results[6];
+	struct stat st;
+	int sock, fd, evfd, pipefd[2];
+
+	REQUIRE((sock = socket(AF_UNIX, SOCK_SEQPACKET, 0)) != -1);
+	strcpy(addr.sun_path, socket_path);
+	REQUIRE(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+	/* the session starts with the shared memory, which is read-only */
+	REQUIRE(exchange(sock, &hello, results, 1, -1, &fd) == 0);
+	CHECK(results[0] == LINES);
+	REQUIRE(fd != -1);
+	REQUIRE(fstat(fd, &st) == 0);
+	CHECK(mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) == MAP_FAILED);
+	REQUIRE((shm = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED);
+	close(fd);
+	CHECK(shm->magic == UGPIOD_SHM_MAGIC && shm->version == UGPIOD_SHM_VERSION);
+	CHECK(shm->nlines == LINES);
+
+	/* the operations of a batch are independent of each other */
+	REQUIRE(exchange(sock, ops, results, 6, -1, &fd) == 0);
+	CHECK(results[0] >= 0);
+	CHECK(results[1] == 0);
+	CHECK(results[2] == 1);
+	CHECK(results[3] < 0);
+	CHECK(results[4] == -EINVAL);
+	CHECK(results[5] == 0);
+	CHECK(fd == -1);
+
+	/* an output held by a client is live in the shared memory */
+	REQUIRE(exchange(sock, ops, results, 3, -1, &fd) == 0);
+	CHECK(shm->lines[3] == (UGPIOD_LINE_VALUE | UGPIOD_LINE_LIVE));
+
+	/* edges are only signalled to an eventfd, which cannot block the daemon */
+	REQUIRE(pipe(pipefd) == 0);
+	REQUIRE(exchange(sock, &subscribe, results, 1, pipefd[1], &fd) == 0);
+	CHECK(results[0] == -EINVAL);
+	close(pipefd[0]);
+	close(pipefd[1]);
+	REQUIRE((evfd = eventfd(0, EFD_CLOEXEC)) != -1);
+	REQUIRE(exchange(sock, &subscribe, results, 1, evfd, &fd) == 0);
+	CHECK(results[0] == 0);
+	close(evfd);
+
+	/* and the daemon releases it when the client goes away */
+	close(sock);
+	test_sleep_ms(50);
+	CHECK(shm->lines[3] == 0);
+
+	munmap((void *)shm, st.st_size);
+}
+
+int main(int argc, char *argv[])
+{
+	ugpio_t *ctx, *other;
+	pid_t pid;
+
+	REQUIRE(mkdtemp(dir) != NULL);
+	snprintf(socket_path, sizeof(socket_path), "%s/ugpiod.sock", dir);
+
+	REQUIRE((pid = daemon_start()) > 0);
+	if (access(socket_path, F_OK) == -1) {
+		daemon_stop(pid);
+		rmdir(dir);
+		return TEST_SKIP;
+	}
+
+	test_protocol();
+
+	REQUIRE(ugpio_set_backend("client") == 0);
+	REQUIRE(ugpio_set_client_socket(socket_path) == 0);
+
+	/* values go through the daemon */
+	REQUIRE((ctx = ugpio_request_one(0, GPIOF_OUT_INIT_HIGH, NULL)) != NULL);
+	REQUIRE(ugpio_open(ctx) >= 0);
+	CHECK(gpio_get_direction(0) == GPIOF_DIR_OUT);
+	CHECK(ugpio_get_value(ctx) == 1);
+	CHECK(ugpio_set_value(ctx, 0) == 0);
+	CHECK(ugpio_get_value(ctx) == 0);
+	CHECK(ugpio_request_one(LINES, GPIOF_IN, NULL) == NULL);
+
+	/* a lost daemon fails all requests until the GPIOs are released */
+	CHECK(daemon_stop(pid) == 0);
+	REQUIRE((pid = daemon_start()) > 0);
+	CHECK(ugpio_set_value(ctx, 1) == -1 && errno == ENOTCONN);
+	CHECK(ugpio_request_one(1, GPIOF_IN, NULL) == NULL && errno == ENOTCONN);
+	ugpio_close(ctx);
+	ugpio_free(ctx);
+
+	/* then the next request connects again */
+	REQUIRE((other = ugpio_request_one(1, GPIOF_OUT_INIT_HIGH, NULL)) != NULL);
+	REQUIRE(ugpio_open(other) >= 0);
+	CHECK(ugpio_get_value(other) == 1);
+	ugpio_close(other);
+	ugpio_free(other);
+
+	CHECK(daemon_stop(pid) == 0);
+	CHECK(access(socket_path, F_OK) == -1);
+	rmdir(dir);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <ftw.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-sim.h>
+/* gpio_request_array_wait takes an array of the internal struct gpio */
+#include <ugpio-internal.h>
+
+#include "test.h"
+
+static char root[] = "/tmp/test-export-XXXXXX";
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void write_file(const char *name, const char *content)
+{
+	char pathname[PATH_MAX];
+	FILE *f;
+
+	snprintf(pathname, sizeof(pathname), "%s/%s", root, name);
+	REQUIRE((f = fopen(pathname, "w")) != NULL);
+	fputs(content, f);
+	fclose(f);
+}
+
+static int file_contains(const char *name, const char *content)
+{
+	char pathname[PATH_MAX], buffer[64] = "";
+	FILE *f;
+
+	snprintf(pathname, sizeof(pathname), "%s/%s", root, name);
+	if ((f = fopen(pathname, "r")) == NULL)
+		return 0;
+	(void)!fread(buffer, 1, sizeof(buffer) - 1, f);
+	fclose(f);
+
+	return strstr(buffer, content) != NULL;
+}
+
+/* plays udev: the attribute files show up a while after the export */
+static void *udev(void *arg)
+{
+	char pathname[PATH_MAX];
+
+	test_sleep_ms(30);
+
+	snprintf(pathname, sizeof(pathname), "%s/gpio5", root);
+	mkdir(pathname, 0755);
+	write_file("gpio5/direction", "out\n");
+	write_file("gpio5/edge", "none\n");
+	write_file("gpio5/active_low", "0\n");
+	write_file("gpio5/value", "0\n");
+
+	return NULL;
+}
+
+/* wraps the sysfs discovery pass to step in after the export */
+static int probe_calls, probe_fail;
+
+static int probe_hook(unsigned int gpio, struct gpio_probe *probe)
+{
+	char pathname[PATH_MAX];
+
+	if (++probe_calls == 2) {
+		if (probe_fail) {
+			errno = EIO;
+			return -1;
+		}
+
+		/* plays the kernel: the export creates the attributes */
+		snprintf(pathname, sizeof(pathname), "%s/gpio%u", root, gpio);
+		mkdir(pathname, 0755);
+		snprintf(pathname, sizeof(pathname), "gpio%u/direction", gpio);
+		write_file(pathname, "in\n");
+		snprintf(pathname, sizeof(pathname), "gpio%u/value", gpio);
+		write_file(pathname, "0\n");
+	}
+
+	return gpio_backend_sysfs.probe(gpio, probe);
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+	struct gpio array[2] = {
+		{ .gpio = 5, .flags = GPIOF_IN | GPIOF_TRIG_RISE },
+		{ .gpio = 7, .flags = GPIOF_IN },
+	};
+	struct gpio sim_array[3] = {
+		{ .gpio = 0, .flags = GPIOF_OUT_INIT_HIGH },
+		{ .gpio = 1, .flags = GPIOF_IN | GPIOF_TRIG_FALL },
+		{ .gpio = 2, .flags = GPIOF_IN },
+	};
+	struct gpio_backend probing = gpio_backend_sysfs;
+	char pathname[PATH_MAX];
+	pthread_t thread;
+	uint64_t start;
+	ugpio_t *ctx;
+
+	/* a fake sysfs tree where nobody exports anything */
+	REQUIRE(mkdtemp(root) != NULL);
+	write_file("export", "");
+	write_file("unexport", "");
+	REQUIRE(ugpio_set_sysfs_root(root) == 0);
+	REQUIRE(gpio_set_fd_cache_size(0) == 0);
+
+	/* the GPIOs are configured once their files became accessible */
+	start = now_ns();
+	REQUIRE(pthread_create(&thread, NULL, udev, NULL) == 0);
+	CHECK(gpio_request_array_wait(array, 1, 2000) == 0);
+	CHECK(now_ns() - start >= 30 * UINT64_C(1000000));
+	pthread_join(thread, NULL);
+	CHECK(file_contains("export", "5"));
+	CHECK(file_contains("gpio5/direction", "in"));
+	CHECK(file_contains("gpio5/edge", "rising"));
+
+	/* GPIOs not showing up in time are released again */
+	write_file("export", "");
+	start = now_ns();
+	CHECK(gpio_request_array_wait(array + 1, 1, 50) == -1 && errno == ETIMEDOUT);
+	CHECK(now_ns() - start >= 50 * UINT64_C(1000000));
+	CHECK(file_contains("export", "7"));
+	CHECK(file_contains("unexport", "7"));
+
+	/* GPIOs already requested are not requested again, nor released */
+	write_file("export", "");
+	write_file("unexport", "");
+	CHECK(gpio_request_array_wait(array, 2, 50) == -1 && errno == ETIMEDOUT);
+	CHECK(!file_contains("export", "5"));
+	CHECK(!file_contains("unexport", "5"));
+	CHECK(file_contains("unexport", "7"));
+
+	/* exported GPIOs are discovered in one pass, without exporting them */
+	write_file("export", "");
+	write_file("unexport", "");
+	snprintf(pathname, sizeof(pathname), "%s/gpio9", root);
+	mkdir(pathname, 0755);
+	write_file("gpio9/direction", "out\n");
+	write_file("gpio9/edge", "both\n");
+	write_file("gpio9/value", "1\n");
+	REQUIRE((ctx = ugpio_request(9, NULL)) != NULL);
+	CHECK(!file_contains("export", "9"));
+	CHECK((ctx->flags & (GPIOF_ALTERABLE_DIRECTION | GPIOF_ALTERABLE_EDGE)) ==
+	      (GPIOF_ALTERABLE_DIRECTION | GPIOF_ALTERABLE_EDGE));
+	CHECK(!(ctx->flags & GPIOF_DIR_IN));
+	CHECK((ctx->flags & GPIOF_TRIGGER_MASK) == GPIOF_TRIGGER_MASK);
+	CHECK(!(ctx->flags & (GPIOF_REQUESTED | GPIOF_DIRECTION_UNKNOWN)));
+	CHECK(ctx->cache_valid == (UGPIO_CHANGED_DIRECTION | UGPIO_CHANGED_EDGE));
+	ugpio_free(ctx);
+	CHECK(!file_contains("unexport", "9"));
+
+	/* unexported GPIOs are probed again once exported */
+	gpio_backend = &probing;
+	probing.probe = probe_hook;
+	probe_calls = 0;
+	REQUIRE((ctx = ugpio_request(11, NULL)) != NULL);
+	CHECK(probe_calls == 2);
+	CHECK(file_contains("export", "11"));
+	CHECK((ctx->flags & (GPIOF_ALTERABLE_DIRECTION | GPIOF_ALTERABLE_EDGE)) ==
+	      GPIOF_ALTERABLE_DIRECTION);
+	CHECK((ctx->flags & GPIOF_DIR_IN) && !(ctx->flags & GPIOF_DIRECTION_UNKNOWN));
+	CHECK(ctx->flags & GPIOF_REQUESTED);
+	CHECK(ctx->cache_valid == UGPIO_CHANGED_DIRECTION);
+	ugpio_free(ctx);
+	CHECK(file_contains("unexport", "11"));
+
+	/* a failing probe after the export releases the GPIO again */
+	write_file("unexport", "");
+	probe_calls = 0;
+	probe_fail = 1;
+	CHECK(ugpio_request(13, NULL) == NULL && errno == EIO);
+	CHECK(probe_calls == 2);
+	CHECK(file_contains("export", "13"));
+	CHECK(file_contains("unexport", "13"));
+	gpio_backend = &gpio_backend_sysfs;
+
+	nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+	/* backends exporting synchronously need no waiting */
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	CHECK(gpio_request_array_wait(sim_array, 3, 0) == 0);
+	CHECK(ugpio_sim_get_level(0) == 1);
+	CHECK(gpio_get_direction(1) == GPIOF_DIR_IN);
+	CHECK(gpio_get_edge(1) == GPIOF_TRIG_FALL);
+	gpio_free_array(sim_array, 3);
+
+	/* on error, the GPIOs exported so far are released */
+	sim_array[2].gpio = 8;
+	CHECK(gpio_request_array_wait(sim_array, 3, 0) == -1);
+	CHECK(gpio_is_requested(0) == 0);
+	CHECK(gpio_is_requested(1) == 0);
+
+	return TEST_RESULT();
+}
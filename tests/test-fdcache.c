@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <config.h>
+#include <ugpio.h>
+#include <ugpio-sim.h>
+#include <ugpio-internal.h>
+
+#include "test.h"
+
+#define THREAD_READS	20000
+
+/* the simulated attribute files are eventfds, count the open ones */
+static int open_files(void)
+{
+	char path[PATH_MAX], target[64];
+	struct dirent *de;
+	ssize_t len;
+	int count = 0;
+	DIR *dir;
+
+	if ((dir = opendir("/proc/self/fd")) == NULL)
+		return -1;
+
+	while ((de = readdir(dir)) != NULL) {
+		snprintf(path, sizeof(path), "/proc/self/fd/%s", de->d_name);
+		if ((len = readlink(path, target, sizeof(target) - 1)) == -1)
+			continue;
+		target[len] = '\0';
+		if (strcmp(target, "anon_inode:[eventfd]") == 0)
+			count++;
+	}
+
+	closedir(dir);
+	return count;
+}
+
+static void *reader(void *arg)
+{
+	int *errors = arg;
+	int i;
+
+	for (i = 0; i < THREAD_READS; i++)
+		if (gpio_get_value(0) != 1)
+			(*errors)++;
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[2];
+	int errors[2] = { 0 };
+	int i;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+
+	for (i = 0; i < 4; i++) {
+		REQUIRE(gpio_request(i, NULL) == 0);
+		CHECK(gpio_direction_input(i) == 0);
+	}
+
+	/* repeated accesses keep the files open */
+	CHECK(gpio_get_value(0) == 0);
+	i = open_files();
+	CHECK(i > 0);
+	CHECK(gpio_get_value(0) == 0);
+	CHECK(gpio_get_direction(0) == GPIOF_DIR_IN);
+	CHECK(gpio_get_value(0) == 0);
+	CHECK(open_files() == i + 1);
+
+	/* the least recently used files are closed when the limit is reached */
+	CHECK(gpio_set_fd_cache_size(2) == 0);
+	CHECK(open_files() == 2);
+	for (i = 0; i < 4; i++)
+		CHECK(gpio_get_value(i) == 0);
+	CHECK(open_files() == 2);
+	CHECK(gpio_set_fd_cache_size(0) == 0);
+	CHECK(open_files() == 0);
+	CHECK(gpio_get_value(3) == 0);
+	CHECK(open_files() == 0);
+
+	/* freeing a GPIO closes its files */
+	CHECK(gpio_set_fd_cache_size(64) == 0);
+	CHECK(gpio_get_value(3) == 0);
+	CHECK(gpio_get_direction(3) == GPIOF_DIR_IN);
+	i = open_files();
+	CHECK(gpio_free(3) == 0);
+	CHECK(open_files() < i);
+
+	/* a file gone stale behind the back of the cache is dropped */
+	CHECK(gpio_get_value(2) == 0);
+	i = open_files();
+	CHECK(gpio_write(-1, GPIO_UNEXPORT, "2\n", 2) == 0);
+	CHECK(gpio_get_value(2) == -1 && errno == ENOENT);
+	CHECK(open_files() == i - 1);
+	CHECK(gpio_request(2, NULL) == 0);
+	CHECK(gpio_direction_input(2) == 0);
+	CHECK(ugpio_sim_set_input(2, 1) == 0);
+	CHECK(gpio_get_value(2) == 1);
+
+	/* threads reading the same GPIO do not disturb each other */
+	CHECK(ugpio_sim_set_input(0, 1) == 0);
+	for (i = 0; i < 2; i++)
+		REQUIRE(pthread_create(&threads[i], NULL, reader, &errors[i]) == 0);
+	for (i = 0; i < 2; i++)
+		pthread_join(threads[i], NULL);
+	CHECK(errors[0] == 0 && errors[1] == 0);
+
+	for (i = 0; i < 3; i++)
+		CHECK(gpio_free(i) == 0);
+
+	/* all files are closed with the cache disabled, so the chip can go */
+	CHECK(gpio_set_fd_cache_size(0) == 0);
+	CHECK(open_files() == 0);
+	CHECK(ugpio_sim_init(8) == 0);
+
+	return TEST_RESULT();
+}
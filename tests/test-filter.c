@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define MS	UINT64_C(1000000)
+
+static int reports;
+static int reported_value;
+static uint64_t reported_ns;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void on_edge(ugpio_loop_t *loop, ugpio_t *ctx, int value, void *userdata)
+{
+	reports++;
+	reported_value = value;
+	reported_ns = now_ns();
+}
+
+/* run the loop for about ms milliseconds */
+static void run_for(ugpio_loop_t *loop, unsigned int ms)
+{
+	uint64_t end = now_ns() + ms * MS;
+	uint64_t now;
+
+	while ((now = now_ns()) < end)
+		ugpio_loop_run_once(loop, (end - now) / MS + 1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ugpio_filter_stats stats;
+	ugpio_loop_t *loop;
+	uint64_t edge_ns;
+	ugpio_t *ctx;
+	int i;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((loop = ugpio_loop_new()) != NULL);
+	REQUIRE((ctx = ugpio_request_one(0, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL)) != NULL);
+
+	CHECK(ugpio_get_filter_stats(ctx, &stats) == -1 && errno == EINVAL);
+
+	/* debounce: a bouncing edge is reported once, after the level settled */
+	CHECK(ugpio_set_debounce(ctx, 50 * MS, 0) == 0);
+	CHECK(ugpio_loop_add(loop, ctx, on_edge, NULL) == 0);
+
+	for (i = 0; i < 5; i++) {
+		CHECK(ugpio_sim_toggle(0, 1) == 0);
+		edge_ns = now_ns();
+		run_for(loop, 2);
+	}
+	CHECK(reports == 0);
+	run_for(loop, 150);
+	CHECK(reports == 1 && reported_value == 1);
+	CHECK(reported_ns >= edge_ns + 50 * MS);
+
+	CHECK(ugpio_get_filter_stats(ctx, &stats) == 0);
+	CHECK(stats.raw_edges == 5);
+	CHECK(stats.absorbed == 4);
+	CHECK(stats.transitions == 1);
+
+	/* a glitch returning to the reported level is not reported at all */
+	CHECK(ugpio_sim_set_input(0, 0) == 0);
+	run_for(loop, 2);
+	CHECK(ugpio_sim_set_input(0, 1) == 0);
+	run_for(loop, 120);
+	CHECK(reports == 1);
+	CHECK(ugpio_get_filter_stats(ctx, &stats) == 0);
+	CHECK(stats.raw_edges == 7);
+	CHECK(stats.transitions == 1);
+
+	/* glitch filter: a single edge is held back for the minimum pulse width */
+	CHECK(ugpio_set_debounce(ctx, 0, 30 * MS) == 0);
+	CHECK(ugpio_sim_set_input(0, 0) == 0);
+	edge_ns = now_ns();
+	run_for(loop, 100);
+	CHECK(reports == 2 && reported_value == 0);
+	CHECK(reported_ns >= edge_ns + 30 * MS);
+
+	/* without a filter edges are reported right away */
+	CHECK(ugpio_set_debounce(ctx, 0, 0) == 0);
+	CHECK(ugpio_get_filter_stats(ctx, &stats) == -1 && errno == EINVAL);
+	CHECK(ugpio_sim_toggle(0, 3) == 0);
+	CHECK(ugpio_loop_run_once(loop, 100) == 1);
+	CHECK(reports == 3 && reported_value == 1);
+
+	CHECK(ugpio_loop_remove(loop, ctx) == 0);
+	ugpio_loop_free(loop);
+	ugpio_close(ctx);
+	ugpio_free(ctx);
+
+	return TEST_RESULT();
+}
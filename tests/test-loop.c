@@ -0,0 +1,147 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <poll.h>
+
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define LINES	3
+
+static ugpio_t *ctxs[LINES];
+
+struct record {
+	int count;
+	int value;
+	/* remove the context from the loop on its next edge */
+	int remove;
+};
+
+static struct record records[LINES];
+static int timer_count;
+
+static void on_edge(ugpio_loop_t *loop, ugpio_t *ctx, int value, void *userdata)
+{
+	struct record *r = userdata;
+
+	CHECK(ctx == ctxs[r - records]);
+	r->count++;
+	r->value = value;
+
+	if (r->remove)
+		CHECK(ugpio_loop_remove(loop, ctx) == 0);
+}
+
+static void on_timer(ugpio_loop_t *loop, ugpio_timer_t *timer, void *userdata)
+{
+	int *stop_after = userdata;
+
+	if (++timer_count == *stop_after)
+		ugpio_loop_stop(loop);
+}
+
+static int loop_readable(ugpio_loop_t *loop)
+{
+	struct pollfd pfd = { .fd = ugpio_loop_fd(loop), .events = POLLIN };
+
+	return poll(&pfd, 1, 0) == 1;
+}
+
+int main(int argc, char *argv[])
+{
+	ugpio_timer_t *timer;
+	ugpio_loop_t *loop;
+	int i, stop_after;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((loop = ugpio_loop_new()) != NULL);
+
+	for (i = 0; i < LINES; i++) {
+		ctxs[i] = ugpio_request_one(i, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL);
+		REQUIRE(ctxs[i] != NULL);
+		CHECK(ugpio_loop_add(loop, ctxs[i], on_edge, &records[i]) == 0);
+	}
+
+	CHECK(ugpio_loop_add(loop, ctxs[0], on_edge, &records[0]) == -1 && errno == EEXIST);
+
+	/* nothing to do */
+	CHECK(!loop_readable(loop));
+	CHECK(ugpio_loop_run_once(loop, 10) == 0);
+
+	/* each edge goes to the callback of its context */
+	CHECK(ugpio_sim_set_input(1, 1) == 0);
+	CHECK(loop_readable(loop));
+	CHECK(ugpio_loop_run_once(loop, 100) == 1);
+	CHECK(records[0].count == 0);
+	CHECK(records[1].count == 1 && records[1].value == 1);
+	CHECK(records[2].count == 0);
+
+	CHECK(ugpio_sim_set_input(0, 1) == 0);
+	CHECK(ugpio_sim_set_input(2, 1) == 0);
+	CHECK(ugpio_loop_run_once(loop, 100) == 2);
+	CHECK(records[0].count == 1 && records[0].value == 1);
+	CHECK(records[2].count == 1 && records[2].value == 1);
+
+	/* reading the value re-arms the edge notification */
+	CHECK(ugpio_sim_set_input(1, 0) == 0);
+	CHECK(ugpio_loop_run_once(loop, 100) == 1);
+	CHECK(records[1].count == 2 && records[1].value == 0);
+	CHECK(ugpio_loop_run_once(loop, 10) == 0);
+
+	/* a context removing itself from within its callback */
+	records[2].remove = 1;
+	CHECK(ugpio_sim_set_input(2, 0) == 0);
+	CHECK(ugpio_loop_run_once(loop, 100) == 1);
+	CHECK(records[2].count == 2);
+	CHECK(ugpio_sim_set_input(2, 1) == 0);
+	CHECK(ugpio_loop_run_once(loop, 10) == 0);
+	CHECK(records[2].count == 2);
+	CHECK(ugpio_loop_remove(loop, ctxs[2]) == -1 && errno == ENOENT);
+
+	/* and can be added again */
+	records[2].remove = 0;
+	CHECK(ugpio_loop_add(loop, ctxs[2], on_edge, &records[2]) == 0);
+	CHECK(ugpio_sim_set_input(2, 0) == 0);
+	CHECK(ugpio_loop_run_once(loop, 100) == 1);
+	CHECK(records[2].count == 3 && records[2].value == 0);
+
+	/* a one-shot timer fires once */
+	stop_after = 0;
+	REQUIRE((timer = ugpio_loop_add_timer(loop, 1000000, 0, on_timer, &stop_after)) != NULL);
+	CHECK(ugpio_loop_run_once(loop, 1000) == 1);
+	CHECK(timer_count == 1);
+	CHECK(ugpio_loop_run_once(loop, 20) == 0);
+	CHECK(timer_count == 1);
+
+	/* a periodic timer stops the loop from within its callback */
+	timer_count = 0;
+	stop_after = 5;
+	CHECK(ugpio_timer_set(timer, 1000000, 1) == 0);
+	CHECK(ugpio_loop_run(loop) == 0);
+	CHECK(timer_count == 5);
+
+	/* a disarmed timer stays quiet, only the wakeup of the stop is left */
+	CHECK(ugpio_timer_set(timer, 0, 0) == 0);
+	test_sleep_ms(5);
+	CHECK(ugpio_loop_run_once(loop, 0) == 1);
+	CHECK(ugpio_loop_run_once(loop, 10) == 0);
+	CHECK(timer_count == 5);
+	ugpio_loop_remove_timer(loop, timer);
+
+	for (i = 0; i < LINES; i++) {
+		CHECK(ugpio_loop_remove(loop, ctxs[i]) == 0);
+		ugpio_close(ctxs[i]);
+		ugpio_free(ctxs[i]);
+	}
+
+	ugpio_loop_free(loop);
+
+	return TEST_RESULT();
+}
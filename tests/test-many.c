@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <ugpio.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int gpios[] = { 4, 2, 6, 0 };
+	static const unsigned int broken[] = { 1, 3, 8, 5 };
+	ugpio_t *pool, *ctx;
+	size_t i;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+
+	CHECK(ugpio_request_many(gpios, 0, GPIOF_IN, NULL) == NULL && errno == EINVAL);
+
+	/* the contexts are handed out in the order of the array */
+	REQUIRE((pool = ugpio_request_many(gpios, 4, GPIOF_OUT_INIT_HIGH, "many")) != NULL);
+	for (i = 0; i < 4; i++) {
+		REQUIRE((ctx = ugpio_many_ctx(pool, i)) != NULL);
+		CHECK(gpio_is_requested(gpios[i]) == 1);
+		CHECK(ugpio_sim_get_level(gpios[i]) == 1);
+		CHECK(ugpio_open(ctx) >= 0);
+		CHECK(ugpio_set_value(ctx, i & 1) == 0);
+		CHECK(ugpio_sim_get_level(gpios[i]) == (i & 1));
+	}
+	CHECK(ugpio_many_ctx(pool, 4) == NULL && errno == EINVAL);
+
+	/* the pool releases and closes all of its contexts */
+	ugpio_free_many(pool);
+	for (i = 0; i < 4; i++)
+		CHECK(gpio_is_requested(gpios[i]) == 0);
+
+	/* on error, the GPIOs requested so far are released again */
+	CHECK(ugpio_request_many(broken, 4, GPIOF_IN, NULL) == NULL);
+	CHECK(gpio_is_requested(1) == 0);
+	CHECK(gpio_is_requested(3) == 0);
+	CHECK(gpio_is_requested(5) == 0);
+
+	/* and can be requested again */
+	REQUIRE((pool = ugpio_request_many(broken, 2, GPIOF_IN, NULL)) != NULL);
+	CHECK(gpio_is_requested(1) == 1 && gpio_is_requested(3) == 1);
+	ugpio_free_many(pool);
+
+	ugpio_free_many(NULL);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpio-meter.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define MS	UINT64_C(1000000)
+
+static ugpio_loop_t *loop;
+
+/* changes the input and lets the loop handle the edge, then holds the level */
+static void edge(int level, int hold_ms)
+{
+	CHECK(ugpio_sim_set_input(0, level) == 0);
+	CHECK(ugpio_loop_run_once(loop, 100) == 1);
+	test_sleep_ms(hold_ms);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ugpio_meter_reading reading;
+	ugpio_meter_t *meter;
+	ugpio_t *ctx;
+	int i;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((loop = ugpio_loop_new()) != NULL);
+	REQUIRE((ctx = ugpio_request_one(0, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL)) != NULL);
+
+	REQUIRE((meter = ugpio_meter_new(loop, ctx, 50 * MS)) != NULL);
+	CHECK(ugpio_meter_new(loop, ctx, 0) == NULL && errno == EEXIST);
+
+	/* nothing measured yet */
+	ugpio_meter_read(meter, &reading);
+	CHECK(reading.edges == 0 && reading.last_edge_ns == 0);
+	CHECK(reading.period_ns == 0 && reading.frequency == 0 && reading.duty_cycle == 0);
+
+	/* a signal high for 4 ms and low for 6 ms */
+	for (i = 0; i < 3; i++) {
+		edge(1, 4);
+		edge(0, 6);
+	}
+
+	ugpio_meter_read(meter, &reading);
+	CHECK(reading.edges == 6);
+	CHECK(reading.rising == 3 && reading.falling == 3);
+	CHECK(reading.last_edge_ns > 0);
+	CHECK(reading.period_ns >= 10 * MS && reading.period_ns < 100 * MS);
+	CHECK(reading.high_ns >= 4 * MS && reading.high_ns < reading.period_ns);
+	CHECK(reading.low_ns >= 6 * MS && reading.low_ns < reading.period_ns);
+	CHECK(reading.frequency > 10 && reading.frequency <= 100);
+	CHECK(reading.duty_cycle > 0 && reading.duty_cycle < 1);
+	/* the first window did not elapse yet */
+	CHECK(reading.frequency_avg == 0);
+
+	/* the average is updated by the first edge after the window */
+	test_sleep_ms(30);
+	edge(1, 0);
+	ugpio_meter_read(meter, &reading);
+	CHECK(reading.frequency_avg > 0 && reading.frequency_avg <= 100);
+
+	/* the frequencies time out once the signal stopped */
+	test_sleep_ms(60);
+	ugpio_meter_read(meter, &reading);
+	CHECK(reading.frequency == 0 && reading.frequency_avg == 0);
+	CHECK(reading.edges == 7);
+
+	ugpio_meter_reset(meter);
+	ugpio_meter_read(meter, &reading);
+	CHECK(reading.edges == 0 && reading.rising == 0 && reading.period_ns == 0);
+	CHECK(reading.high_ns == 0 && reading.low_ns == 0);
+
+	/* a single edge measures no period */
+	edge(0, 0);
+	ugpio_meter_read(meter, &reading);
+	CHECK(reading.edges == 1 && reading.falling == 1);
+	CHECK(reading.period_ns == 0);
+
+	/* the meter leaves the loop with it */
+	ugpio_meter_free(meter);
+	CHECK(ugpio_sim_set_input(0, 1) == 0);
+	CHECK(ugpio_loop_run_once(loop, 10) == 0);
+	REQUIRE((meter = ugpio_meter_new(loop, ctx, 0)) != NULL);
+
+	/* without a window the frequency never times out */
+	edge(0, 5);
+	edge(1, 0);
+	edge(0, 60);
+	ugpio_meter_read(meter, &reading);
+	CHECK(reading.frequency > 0);
+	CHECK(reading.frequency_avg == 0);
+	ugpio_meter_free(meter);
+
+	ugpio_free(ctx);
+	ugpio_loop_free(loop);
+
+	return TEST_RESULT();
+}
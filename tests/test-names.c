@@ -0,0 +1,145 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <sys/stat.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <ugpio.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+static char root[] = "/tmp/test-names-XXXXXX";
+
+static void write_file(const char *dir, const char *name, const char *content)
+{
+	char pathname[PATH_MAX];
+	FILE *f;
+
+	snprintf(pathname, sizeof(pathname), "%s/%s/%s", root, dir, name);
+	REQUIRE((f = fopen(pathname, "w")) != NULL);
+	fputs(content, f);
+	fclose(f);
+}
+
+static void add_chip(const char *dir, const char *base, const char *ngpio, const char *label)
+{
+	char pathname[PATH_MAX];
+
+	snprintf(pathname, sizeof(pathname), "%s/%s", root, dir);
+	REQUIRE(mkdir(pathname, 0755) == 0);
+	write_file(dir, "base", base);
+	write_file(dir, "ngpio", ngpio);
+	write_file(dir, "label", label);
+}
+
+static void remove_chip(const char *dir)
+{
+	static const char *attrs[] = { "base", "ngpio", "label" };
+	char pathname[PATH_MAX];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		snprintf(pathname, sizeof(pathname), "%s/%s/%s", root, dir, attrs[i]);
+		unlink(pathname);
+	}
+	snprintf(pathname, sizeof(pathname), "%s/%s", root, dir);
+	rmdir(pathname);
+}
+
+/* the number of a name, -1 if it is not found */
+static long lookup(const char *name)
+{
+	unsigned int gpio;
+
+	if (ugpio_lookup_name(name, &gpio) == -1)
+		return -1;
+
+	return gpio;
+}
+
+int main(int argc, char *argv[])
+{
+	char cache[PATH_MAX], line[128];
+	ugpio_t *ctx;
+	FILE *f;
+
+	REQUIRE(mkdtemp(root) != NULL);
+	snprintf(cache, sizeof(cache), "%s/names", root);
+
+	add_chip("gpiochip0", "0\n", "4\n", "foo\n");
+	add_chip("gpiochip32", "32\n", "2\n", "bar\n");
+	/* not a chip */
+	add_chip("gpiochipX", "8\n", "2\n", "baz\n");
+
+	REQUIRE(ugpio_set_sysfs_root(root) == 0);
+	REQUIRE(ugpio_set_name_cache(cache) == 0);
+
+	/* names are built from the chip labels and line offsets */
+	CHECK(lookup("foo:0") == 0);
+	CHECK(lookup("foo:3") == 3);
+	CHECK(lookup("bar:1") == 33);
+	CHECK(lookup("foo:4") == -1 && errno == ENOENT);
+	CHECK(lookup("baz:0") == -1 && errno == ENOENT);
+	CHECK(lookup("") == -1 && errno == EINVAL);
+
+	/* the index is persisted */
+	REQUIRE((f = fopen(cache, "r")) != NULL);
+	CHECK(fgets(line, sizeof(line), f) != NULL);
+	CHECK(strncmp(line, "ugpio-names 1 ", 14) == 0);
+	fclose(f);
+
+	/* a re-probed chip is picked up by the next lookup */
+	remove_chip("gpiochip32");
+	add_chip("gpiochip64", "64\n", "2\n", "bar\n");
+	CHECK(lookup("bar:1") == 65);
+	CHECK(lookup("foo:3") == 3);
+
+	/* and a vanished chip as well */
+	remove_chip("gpiochip64");
+	CHECK(lookup("bar:1") == -1 && errno == ENOENT);
+
+	/* the index of another process is taken from the cache */
+	REQUIRE((f = fopen(cache, "r+")) != NULL);
+	CHECK(fgets(line, sizeof(line), f) != NULL);
+	REQUIRE(fseek(f, 0, SEEK_SET) == 0);
+	fputs(line, f);
+	fputs("7 other\n", f);
+	REQUIRE(ftruncate(fileno(f), ftell(f)) == 0);
+	fclose(f);
+	REQUIRE(ugpio_set_name_cache(cache) == 0);
+	CHECK(lookup("other") == 7);
+	CHECK(lookup("foo:0") == -1);
+
+	/* a broken cache is ignored */
+	REQUIRE((f = fopen(cache, "w")) != NULL);
+	fputs("garbage\n", f);
+	fclose(f);
+	REQUIRE(ugpio_set_name_cache(cache) == 0);
+	CHECK(lookup("foo:2") == 2);
+	CHECK(lookup("other") == -1);
+
+	/* without a cache the chips are scanned */
+	unlink(cache);
+	REQUIRE(ugpio_set_name_cache("") == 0);
+	CHECK(lookup("foo:1") == 1);
+	CHECK(access(cache, F_OK) == -1);
+
+	/* requesting by name */
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((ctx = ugpio_request_by_name("foo:3", GPIOF_OUT_INIT_HIGH, NULL)) != NULL);
+	CHECK(ugpio_sim_get_level(3) == 1);
+	ugpio_free(ctx);
+	CHECK(ugpio_request_by_name("bar:0", GPIOF_IN, NULL) == NULL && errno == ENOENT);
+
+	remove_chip("gpiochip0");
+	remove_chip("gpiochipX");
+	rmdir(root);
+
+	return TEST_RESULT();
+}
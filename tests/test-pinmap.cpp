@@ -0,0 +1,92 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <system_error>
+#include <utility>
+
+#include <ugpio-pinmap.hpp>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+using led    = ugpio::pin<0, GPIOF_OUT_INIT_LOW>;
+using relay  = ugpio::pin<1, GPIOF_OUT_INIT_HIGH, ugpio::active_low>;
+using button = ugpio::pin<2, GPIOF_IN, ugpio::active_low>;
+using board  = ugpio::pin_map<led, relay, button>;
+
+/* the last pin does not exist on the simulated chip */
+using broken = ugpio::pin_map<ugpio::pin<3, GPIOF_IN>, ugpio::pin<100, GPIOF_IN>>;
+
+static_assert(board::size() == 3);
+static_assert(board::index<button> == 2);
+static_assert(board::mask<led, relay> == 0x3);
+static_assert(board::outputs == 0x3);
+static_assert(board::inverted == 0x6);
+static_assert(relay::request_flags == GPIOF_OUT_INIT_LOW);
+
+int main(int argc, char *argv[])
+{
+	std::uint64_t bits;
+	ugpio_t *ctx;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+
+	{
+		board b("test");
+
+		/* an active-low output initialized high drives the line low */
+		CHECK(ugpio_sim_get_level(0) == 0);
+		CHECK(ugpio_sim_get_level(1) == 0);
+		CHECK(b.get<relay>() == 1);
+
+		CHECK(b.set<relay>(0) == 0);
+		CHECK(ugpio_sim_get_level(1) == 1);
+		CHECK(b.set<led>(1) == 0);
+		CHECK(ugpio_sim_get_level(0) == 1);
+
+		/* grouped writes skip inputs and invert active-low pins */
+		CHECK(b.write(board::mask<relay, button>) == 0);
+		CHECK(ugpio_sim_get_level(0) == 0);
+		CHECK(ugpio_sim_get_level(1) == 0);
+
+		CHECK(ugpio_sim_set_input(2, 0) == 0);
+		CHECK(b.get<button>() == 1);
+		CHECK(b.read(bits) == 0);
+		CHECK(bits == (board::mask<relay, button>));
+
+		CHECK(ugpio_sim_set_input(2, 1) == 0);
+		CHECK(b.write(board::mask<led>) == 0);
+		CHECK(b.read(bits) == 0);
+		CHECK(bits == board::mask<led>);
+
+		/* the pins move with the map */
+		board c(std::move(b));
+		CHECK(c.get<led>() == 1);
+		CHECK(c.get_line<led>().native_handle() != nullptr);
+
+		/* lines written directly are written again once the port forgot them */
+		CHECK(c.get_line<led>().set(0) == 0);
+		ugpio_port_invalidate(c.port().native_handle());
+		CHECK(c.write(board::mask<led>) == 0);
+		CHECK(ugpio_sim_get_level(0) == 1);
+	}
+
+	/* the pins are released with the map */
+	REQUIRE((ctx = ugpio_request_one(1, GPIOF_IN, NULL)) != NULL);
+	ugpio_free(ctx);
+
+	/* a failing pin releases the pins requested before */
+	try {
+		broken b;
+		CHECK(!"pin map with a missing GPIO was created");
+	} catch (const std::system_error &e) {
+	}
+	REQUIRE((ctx = ugpio_request_one(3, GPIOF_IN, NULL)) != NULL);
+	ugpio_free(ctx);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+/* the physical levels of the simulated lines first to first + num - 1 */
+static uint64_t sim_levels(unsigned int first, unsigned int num)
+{
+	uint64_t bits = 0;
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		if (ugpio_sim_get_level(first + i) == 1)
+			bits |= UINT64_C(1) << i;
+
+	return bits;
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int outputs[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	ugpio_t *inputs[4], *ctxs[3];
+	ugpio_port_t *port;
+	uint64_t bits;
+	int i;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(16) == 0);
+
+	CHECK(ugpio_port_request(outputs, 0, GPIOF_OUT_INIT_LOW, NULL) == NULL && errno == EINVAL);
+	CHECK(ugpio_port_new(inputs, UGPIO_PORT_MAX + 1) == NULL && errno == EINVAL);
+
+	/* a port owning its contexts, only the masked bits are written */
+	REQUIRE((port = ugpio_port_request(outputs, 8, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+	CHECK(ugpio_port_size(port) == 8);
+	CHECK(ugpio_port_ctx(port, 7) != NULL);
+	CHECK(ugpio_port_ctx(port, 8) == NULL && errno == EINVAL);
+
+	CHECK(ugpio_set_port(port, 0x0f, 0x05) == 0);
+	CHECK(sim_levels(0, 8) == 0x05);
+	CHECK(ugpio_set_port(port, 0x02, 0xff) == 0);
+	CHECK(sim_levels(0, 8) == 0x07);
+	CHECK(ugpio_set_port(port, 0xff, 0xa0) == 0);
+	CHECK(sim_levels(0, 8) == 0xa0);
+	CHECK(ugpio_get_port(port, &bits) == 0);
+	CHECK(bits == 0xa0);
+
+	/* bits outside the port are ignored */
+	CHECK(ugpio_set_port(port, ~UINT64_C(0), 0x100) == 0);
+	CHECK(sim_levels(0, 9) == 0x00);
+
+	/* a line changed behind the back of the port is skipped until invalidated */
+	CHECK(ugpio_set_port(port, 0x01, 0x01) == 0);
+	CHECK(ugpio_set_value(ugpio_port_ctx(port, 0), 0) == 0);
+	CHECK(ugpio_set_port(port, 0x01, 0x01) == 0);
+	CHECK(sim_levels(0, 8) == 0x00);
+	ugpio_port_invalidate(port);
+	CHECK(ugpio_set_port(port, 0x01, 0x01) == 0);
+	CHECK(sim_levels(0, 8) == 0x01);
+
+	ugpio_port_free(port);
+
+	/* a port over contexts of the caller */
+	for (i = 0; i < 4; i++)
+		REQUIRE((inputs[i] = ugpio_request_one(8 + i, GPIOF_IN, NULL)) != NULL);
+
+	REQUIRE((port = ugpio_port_new(inputs, 4)) != NULL);
+	CHECK(ugpio_sim_set_input(9, 1) == 0);
+	CHECK(ugpio_sim_set_input(11, 1) == 0);
+	CHECK(ugpio_get_port(port, &bits) == 0);
+	CHECK(bits == 0x0a);
+	CHECK(ugpio_port_ctx(port, 1) == inputs[1]);
+	ugpio_port_free(port);
+
+	/* the contexts survive the port */
+	CHECK(ugpio_fd(inputs[1]) >= 0);
+	CHECK(ugpio_get_value(inputs[1]) == 1);
+
+	/* a failed port closes only the contexts it opened itself */
+	ugpio_close(inputs[1]);
+	ugpio_close(inputs[2]);
+	ctxs[0] = inputs[2];
+	ctxs[1] = inputs[0];
+	ctxs[2] = inputs[1];
+	CHECK(gpio_free(9) == 0);
+	CHECK(ugpio_port_new(ctxs, 3) == NULL);
+	CHECK(ugpio_fd(inputs[2]) == -1);
+	CHECK(ugpio_fd(inputs[0]) >= 0);
+	CHECK(ugpio_fd(inputs[1]) == -1);
+
+	for (i = 0; i < 4; i++) {
+		ugpio_close(inputs[i]);
+		ugpio_free(inputs[i]);
+	}
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-pwm.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define MS	UINT64_C(1000000)
+
+int main(int argc, char *argv[])
+{
+	struct ugpio_pwm_stats stats;
+	ugpio_t *ctxs[3], *probe;
+	ugpio_pwm_t *pwm;
+	long edges;
+	int i, ch[3];
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	for (i = 0; i < 3; i++)
+		REQUIRE((ctxs[i] = ugpio_request_one(i, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+
+	/* line 0 is looped back to line 4, which counts its edges */
+	REQUIRE((probe = ugpio_request_one(4, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL)) != NULL);
+	REQUIRE(ugpio_sim_connect(0, 4) == 0);
+
+	REQUIRE((pwm = ugpio_pwm_new()) != NULL);
+	CHECK(ugpio_pwm_add(pwm, ctxs[0], 0, 0, 0) == -1 && errno == EINVAL);
+	CHECK(ugpio_pwm_add(pwm, ctxs[0], 4 * MS, 5 * MS, 0) == -1 && errno == EINVAL);
+
+	CHECK((ch[0] = ugpio_pwm_add(pwm, ctxs[0], 4 * MS, 2 * MS, 0)) >= 0);
+	CHECK((ch[1] = ugpio_pwm_add(pwm, ctxs[1], 3 * MS, 0, 0)) >= 0);
+	CHECK((ch[2] = ugpio_pwm_add(pwm, ctxs[2], 5 * MS, 5 * MS, 1 * MS)) >= 0);
+	CHECK(ch[0] != ch[1] && ch[1] != ch[2]);
+	CHECK(ugpio_pwm_set_duty(pwm, ch[0], 5 * MS) == -1 && errno == EINVAL);
+	CHECK(ugpio_pwm_get_stats(pwm, 3, &stats) == -1 && errno == EINVAL);
+
+	CHECK(ugpio_pwm_start(pwm) == 0);
+	CHECK(ugpio_pwm_add(pwm, ctxs[0], 4 * MS, 0, 0) == -1 && errno == EBUSY);
+	test_sleep_ms(50);
+
+	/* a duty cycle between 0 and 100% toggles the line up to twice per period */
+	CHECK(ugpio_pwm_get_stats(pwm, ch[0], &stats) == 0);
+	CHECK(stats.periods >= 6);
+	CHECK(stats.writes > 0 && stats.writes <= 2 * stats.periods);
+	CHECK(stats.errors == 0);
+	CHECK(stats.edges >= stats.writes);
+	CHECK(stats.lateness_min_ns <= stats.lateness_max_ns);
+	CHECK(stats.elapsed_ns >= (stats.periods - 1) * 4 * MS);
+	edges = ugpio_sim_edge_count(4);
+	CHECK(edges > 0 && edges <= stats.writes);
+
+	/* 0 and 100% cost no writes besides the initial level */
+	CHECK(ugpio_pwm_get_stats(pwm, ch[1], &stats) == 0);
+	CHECK(stats.periods >= 8);
+	CHECK(stats.writes == 1);
+	CHECK(ugpio_sim_get_level(1) == 0);
+	CHECK(ugpio_pwm_get_stats(pwm, ch[2], &stats) == 0);
+	CHECK(stats.writes == 1);
+	CHECK(ugpio_sim_get_level(2) == 1);
+
+	/* a new duty cycle is used from the next period on */
+	CHECK(ugpio_pwm_set_duty(pwm, ch[0], 0) == 0);
+	test_sleep_ms(10);
+	edges = ugpio_sim_edge_count(4);
+	test_sleep_ms(20);
+	CHECK(ugpio_sim_edge_count(4) == edges);
+	CHECK(ugpio_sim_get_level(0) == 0);
+
+	CHECK(ugpio_pwm_stop(pwm) == 0);
+	CHECK(ugpio_pwm_get_stats(pwm, ch[2], &stats) == 0);
+	CHECK(ugpio_sim_get_level(2) == 1);
+
+	/* the statistics start over with the next start */
+	CHECK(ugpio_pwm_set_duty(pwm, ch[0], 1 * MS) == 0);
+	CHECK(ugpio_pwm_start(pwm) == 0);
+	test_sleep_ms(10);
+	CHECK(ugpio_pwm_stop(pwm) == 0);
+	CHECK(ugpio_pwm_get_stats(pwm, ch[0], &stats) == 0);
+	CHECK(stats.periods >= 1 && stats.periods <= 4);
+	CHECK(stats.writes >= 1);
+
+	ugpio_pwm_free(pwm);
+
+	ugpio_close(probe);
+	ugpio_free(probe);
+	for (i = 0; i < 3; i++) {
+		ugpio_close(ctxs[i]);
+		ugpio_free(ctxs[i]);
+	}
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-loop.h>
+#include <ugpio-quad.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define MS	UINT64_C(1000000)
+
+static ugpio_loop_t *loop;
+
+/* drive the A and B lines to the levels of state (A in bit 1, B in bit 0) */
+static void step(unsigned int state)
+{
+	int a = ugpio_sim_get_level(0), b = ugpio_sim_get_level(1);
+
+	if (a != (state >> 1)) {
+		CHECK(ugpio_sim_set_input(0, state >> 1) == 0);
+		CHECK(ugpio_loop_run_once(loop, 100) == 1);
+	}
+	if (b != (state & 1)) {
+		CHECK(ugpio_sim_set_input(1, state & 1) == 0);
+		CHECK(ugpio_loop_run_once(loop, 100) == 1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int forward[] = { 2, 3, 1, 0 };
+	struct ugpio_quad_reading r;
+	ugpio_quad_t *quad;
+	ugpio_t *a, *b;
+	int i;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((loop = ugpio_loop_new()) != NULL);
+	REQUIRE((a = ugpio_request_one(0, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL)) != NULL);
+	REQUIRE((b = ugpio_request_one(1, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL)) != NULL);
+
+	CHECK(ugpio_quad_new(loop, a, a, 0) == NULL && errno == EINVAL);
+	REQUIRE((quad = ugpio_quad_new(loop, a, b, 20 * MS)) != NULL);
+
+	ugpio_quad_read(quad, &r);
+	CHECK(r.position == 0 && r.direction == 0 && r.errors == 0 && r.velocity == 0);
+
+	/* A leading B counts up, each transition counts */
+	for (i = 0; i < 4; i++) {
+		step(forward[i]);
+		ugpio_quad_read(quad, &r);
+		CHECK(r.position == i + 1 && r.direction == 1);
+	}
+
+	/* B leading A counts down */
+	for (i = 2; i >= 0; i--)
+		step(forward[i]);
+	step(0);
+	ugpio_quad_read(quad, &r);
+	CHECK(r.position == 0 && r.direction == -1 && r.errors == 0);
+
+	/* both lines changed at once: an error, the position stays */
+	CHECK(ugpio_sim_set_input(0, 1) == 0);
+	CHECK(ugpio_sim_set_input(1, 1) == 0);
+	CHECK(ugpio_loop_run_once(loop, 100) == 2);
+	ugpio_quad_read(quad, &r);
+	CHECK(r.position == 0 && r.errors == 1);
+
+	/* and the decoder carries on from the new state */
+	step(1);
+	ugpio_quad_read(quad, &r);
+	CHECK(r.position == 1 && r.direction == 1);
+
+	ugpio_quad_set_position(quad, 100);
+	step(0);
+	ugpio_quad_read(quad, &r);
+	CHECK(r.position == 101);
+
+	/* the velocity is measured over the window, and drops to 0 when idle */
+	for (i = 0; i < 8; i++) {
+		step(forward[i % 4]);
+		test_sleep_ms(5);
+	}
+	ugpio_quad_read(quad, &r);
+	CHECK(r.position == 109);
+	CHECK(r.velocity > 0);
+	test_sleep_ms(30);
+	ugpio_quad_read(quad, &r);
+	CHECK(r.velocity == 0);
+
+	ugpio_quad_free(quad);
+	CHECK(ugpio_loop_run_once(loop, 0) == 0);
+
+	ugpio_loop_free(loop);
+	ugpio_close(a);
+	ugpio_free(a);
+	ugpio_close(b);
+	ugpio_free(b);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-ring.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define SPSC_EVENTS	200000
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void *producer(void *arg)
+{
+	struct ugpio_event ev = { 0 };
+	ugpio_ring_t *ring = arg;
+	uint32_t i;
+
+	for (i = 0; i < SPSC_EVENTS; i++) {
+		ev.gpio = i;
+		ugpio_ring_push(ring, &ev);
+	}
+
+	return NULL;
+}
+
+/* events are taken in order, and each one is either taken or counted as dropped */
+static void test_spsc(void)
+{
+	struct ugpio_event events[16];
+	struct ugpio_ring_stats stats;
+	ugpio_ring_t *ring;
+	uint64_t taken = 0;
+	int64_t last = -1;
+	pthread_t thread;
+	size_t i, n;
+
+	REQUIRE((ring = ugpio_ring_new(64)) != NULL);
+	REQUIRE(pthread_create(&thread, NULL, producer, ring) == 0);
+
+	do {
+		ugpio_ring_get_stats(ring, &stats);
+		while ((n = ugpio_ring_pop(ring, events, 16)) > 0) {
+			for (i = 0; i < n; i++) {
+				CHECK((int64_t)events[i].gpio > last);
+				last = events[i].gpio;
+			}
+			taken += n;
+		}
+	} while (stats.pushed + stats.overflows < SPSC_EVENTS);
+
+	pthread_join(thread, NULL);
+	taken += ugpio_ring_pop(ring, events, 16);
+
+	ugpio_ring_get_stats(ring, &stats);
+	CHECK(stats.pushed + stats.overflows == SPSC_EVENTS);
+	CHECK(stats.popped == taken);
+	CHECK(taken == stats.pushed);
+
+	ugpio_ring_free(ring);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ugpio_event ev = { 0 }, events[16];
+	struct ugpio_ring_stats stats;
+	ugpio_capture_t *cap;
+	ugpio_ring_t *ring;
+	ugpio_t *ctxs[2];
+	uint64_t start;
+	size_t n;
+	int i;
+
+	/* the capacity is rounded up, a full ring drops and counts */
+	REQUIRE((ring = ugpio_ring_new(5)) != NULL);
+	for (i = 0; i < 8; i++) {
+		ev.gpio = i;
+		CHECK(ugpio_ring_push(ring, &ev) == 0);
+	}
+	ev.gpio = 8;
+	CHECK(ugpio_ring_push(ring, &ev) == -1);
+	CHECK(ugpio_ring_count(ring) == 8);
+
+	CHECK(ugpio_ring_pop(ring, events, 3) == 3);
+	CHECK(events[0].gpio == 0 && events[2].gpio == 2);
+
+	/* the ring wraps around */
+	for (i = 9; i < 12; i++) {
+		ev.gpio = i;
+		CHECK(ugpio_ring_push(ring, &ev) == 0);
+	}
+	for (n = 0; (i = ugpio_ring_pop(ring, events + n, 16 - n)) > 0; n += i)
+		;
+	CHECK(n == 8);
+	CHECK(events[0].gpio == 3 && events[4].gpio == 7 && events[5].gpio == 9 && events[7].gpio == 11);
+
+	ugpio_ring_get_stats(ring, &stats);
+	CHECK(stats.pushed == 11);
+	CHECK(stats.popped == 11);
+	CHECK(stats.overflows == 1);
+	ugpio_ring_free(ring);
+
+	test_spsc();
+
+	/* a capture thread records the edges of two lines into one ring */
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((ring = ugpio_ring_new(64)) != NULL);
+	REQUIRE((cap = ugpio_capture_new()) != NULL);
+
+	for (i = 0; i < 2; i++) {
+		ctxs[i] = ugpio_request_one(i, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL);
+		REQUIRE(ctxs[i] != NULL);
+		CHECK(ugpio_capture_add(cap, ctxs[i], ring) == 0);
+	}
+
+	start = now_ns();
+	CHECK(ugpio_capture_start(cap) == 0);
+	CHECK(ugpio_capture_add(cap, ctxs[0], ring) == -1 && errno == EBUSY);
+
+	CHECK(ugpio_sim_set_input(0, 1) == 0);
+	for (i = 0; i < 100 && ugpio_ring_count(ring) < 1; i++)
+		test_sleep_ms(1);
+	CHECK(ugpio_sim_set_input(1, 1) == 0);
+	for (i = 0; i < 100 && ugpio_ring_count(ring) < 2; i++)
+		test_sleep_ms(1);
+	CHECK(ugpio_sim_set_input(0, 0) == 0);
+	for (i = 0; i < 100 && ugpio_ring_count(ring) < 3; i++)
+		test_sleep_ms(1);
+
+	CHECK(ugpio_capture_stop(cap) == 0);
+
+	n = ugpio_ring_pop(ring, events, 16);
+	CHECK(n == 3);
+	if (n == 3) {
+		CHECK(events[0].gpio == 0 && events[0].value == 1);
+		CHECK(events[1].gpio == 1 && events[1].value == 1);
+		CHECK(events[2].gpio == 0 && events[2].value == 0);
+		CHECK(events[0].timestamp_ns >= start);
+		CHECK(events[1].timestamp_ns >= events[0].timestamp_ns);
+		CHECK(events[2].timestamp_ns >= events[1].timestamp_ns);
+		CHECK(events[2].timestamp_ns <= now_ns());
+	}
+
+	/* nothing is recorded while stopped */
+	CHECK(ugpio_sim_set_input(1, 0) == 0);
+	test_sleep_ms(10);
+	CHECK(ugpio_ring_count(ring) == 0);
+
+	ugpio_capture_free(cap);
+	ugpio_ring_free(ring);
+
+	for (i = 0; i < 2; i++) {
+		ugpio_close(ctxs[i]);
+		ugpio_free(ctxs[i]);
+	}
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <poll.h>
+
+#include <ugpio.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+/* whether an edge is pending on the value file of a context */
+static int edge_pending(ugpio_t *ctx)
+{
+	struct pollfd pfd = { .fd = ugpio_fd(ctx), .events = ugpio_fd_events(ctx) };
+
+	return poll(&pfd, 1, 0) == 1;
+}
+
+int main(int argc, char *argv[])
+{
+	ugpio_t *out, *in;
+	long edges;
+	int i;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(16) == 0);
+
+	CHECK(ugpio_sim_get_level(16) == -1 && errno == EINVAL);
+
+	REQUIRE((out = ugpio_request_one(0, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+	REQUIRE((in = ugpio_request(1, NULL)) != NULL);
+	REQUIRE(ugpio_open(out) >= 0);
+	REQUIRE(ugpio_full_open(in) == 0);
+	CHECK(ugpio_alterable_edge(in) == 1);
+	CHECK(ugpio_direction_input(in) == 0);
+	CHECK(ugpio_set_edge(in, GPIOF_TRIG_RISE | GPIOF_TRIG_FALL) == 0);
+
+	/* the chip cannot be replaced while its lines are open */
+	CHECK(ugpio_sim_init(8) == -1 && errno == EBUSY);
+
+	/* loopback: the input follows the output and signals its edges */
+	CHECK(ugpio_sim_connect(0, 1) == 0);
+	CHECK(ugpio_sim_set_input(1, 1) == -1 && errno == EBUSY);
+	CHECK(ugpio_set_value(out, 1) == 0);
+	CHECK(ugpio_sim_get_level(0) == 1);
+	CHECK(ugpio_sim_get_level(1) == 1);
+	CHECK(ugpio_sim_edge_count(1) == 1);
+	CHECK(edge_pending(in));
+	CHECK(ugpio_get_value(in) == 1);
+	CHECK(!edge_pending(in));
+	CHECK(ugpio_set_value(out, 0) == 0);
+	CHECK(ugpio_get_value(in) == 0);
+	CHECK(ugpio_sim_edge_count(1) == 2);
+	CHECK(ugpio_sim_disconnect(1) == 0);
+
+	/* active low inverts the value but not the physical level */
+	CHECK(ugpio_set_activelow(in, 1) == 0);
+	CHECK(ugpio_sim_set_input(1, 0) == 0);
+	CHECK(ugpio_get_value(in) == 1);
+	CHECK(ugpio_sim_set_input(1, 1) == 0);
+	CHECK(ugpio_get_value(in) == 0);
+	CHECK(ugpio_set_activelow(in, 0) == 0);
+
+	/* only the configured edges are signalled */
+	CHECK(ugpio_set_edge(in, GPIOF_TRIG_RISE) == 0);
+	edges = ugpio_sim_edge_count(1);
+	CHECK(ugpio_sim_toggle(1, 4) == 0);
+	CHECK(ugpio_sim_edge_count(1) == edges + 2);
+	CHECK(ugpio_set_edge(in, GPIOF_TRIG_RISE | GPIOF_TRIG_FALL) == 0);
+	CHECK(ugpio_sim_toggle(1, 4) == 0);
+	CHECK(ugpio_sim_edge_count(1) == edges + 6);
+
+	/* a finite generator stops by itself, but has to be stopped anyway */
+	edges = ugpio_sim_edge_count(1);
+	CHECK(ugpio_sim_generator_start(1, 1000000, 5) == 0);
+	CHECK(ugpio_sim_generator_start(1, 1000000, 5) == -1 && errno == EBUSY);
+	for (i = 0; i < 100 && ugpio_sim_edge_count(1) < edges + 5; i++)
+		test_sleep_ms(10);
+	test_sleep_ms(10);
+	CHECK(ugpio_sim_edge_count(1) == edges + 5);
+	CHECK(ugpio_sim_generator_stop(1) == 0);
+	CHECK(ugpio_sim_generator_stop(1) == -1 && errno == ESRCH);
+
+	/* an endless generator is stopped promptly */
+	CHECK(ugpio_sim_generator_start(1, 60000000000UL, 0) == 0);
+	CHECK(ugpio_sim_generator_stop(1) == 0);
+
+	ugpio_close(in);
+	ugpio_free(in);
+	ugpio_close(out);
+	ugpio_free(out);
+
+	/* the low level API keeps files open, drop them to replace the chip */
+	gpio_set_fd_cache_size(0);
+	CHECK(ugpio_sim_init(8) == 0);
+	ugpio_sim_cleanup();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _XOPEN_SOURCE 500
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#include <ugpio.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+/* more lines than a single snapshot thread reads */
+#define LINES	200
+
+static char root[] = "/tmp/test-snapshot-XXXXXX";
+
+static void make_dir(const char *name)
+{
+	char pathname[PATH_MAX];
+
+	snprintf(pathname, sizeof(pathname), "%s/%s", root, name);
+	REQUIRE(mkdir(pathname, 0755) == 0);
+}
+
+static void write_file(const char *name, const char *content)
+{
+	char pathname[PATH_MAX];
+	FILE *f;
+
+	snprintf(pathname, sizeof(pathname), "%s/%s", root, name);
+	REQUIRE((f = fopen(pathname, "w")) != NULL);
+	fputs(content, f);
+	fclose(f);
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *edges[] = { "none\n", "rising\n", "falling\n", "both\n" };
+	static const int triggers[] = {
+		0, GPIOF_TRIG_RISE, GPIOF_TRIG_FALL, GPIOF_TRIG_RISE | GPIOF_TRIG_FALL
+	};
+	struct ugpio_line_state *states;
+	ugpio_t *out, *in;
+	char name[64];
+	ssize_t n;
+	int i, gpio;
+
+	/* a fake sysfs tree, the lines exported in reverse order */
+	REQUIRE(mkdtemp(root) != NULL);
+	REQUIRE(ugpio_set_sysfs_root(root) == 0);
+	write_file("export", "");
+	write_file("unexport", "");
+	make_dir("gpiochip0");
+
+	CHECK(ugpio_snapshot(&states) == 0 && states == NULL);
+
+	for (i = LINES - 1; i >= 0; i--) {
+		gpio = 2 * i;
+		snprintf(name, sizeof(name), "gpio%d", gpio);
+		make_dir(name);
+		snprintf(name, sizeof(name), "gpio%d/direction", gpio);
+		write_file(name, (i & 1) ? "out\n" : "in\n");
+		snprintf(name, sizeof(name), "gpio%d/active_low", gpio);
+		write_file(name, (i % 3) ? "0\n" : "1\n");
+		snprintf(name, sizeof(name), "gpio%d/value", gpio);
+		write_file(name, (i % 5) ? "0\n" : "1\n");
+		/* lines without interrupt have no edge attribute */
+		if (i % 7) {
+			snprintf(name, sizeof(name), "gpio%d/edge", gpio);
+			write_file(name, edges[i & 3]);
+		}
+	}
+
+	/* neither a line which vanished nor an unrelated entry is reported */
+	make_dir("gpio1001");
+	make_dir("gpio12x");
+
+	n = ugpio_snapshot(&states);
+	CHECK(n == LINES);
+	REQUIRE(states != NULL);
+	for (i = 0; i < n && i < LINES; i++) {
+		CHECK(states[i].gpio == 2 * i);
+		CHECK(states[i].direction == ((i & 1) ? GPIOF_DIR_OUT : GPIOF_DIR_IN));
+		CHECK(states[i].active_low == !(i % 3));
+		CHECK(states[i].value == !(i % 5));
+		CHECK(states[i].edge == ((i % 7) ? triggers[i & 3] : -1));
+	}
+	free(states);
+
+	nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	CHECK(ugpio_snapshot(&states) == -1 && states == NULL);
+	CHECK(ugpio_set_sysfs_root(NULL) == 0);
+
+	/* the simulated chip reports its exported lines */
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	CHECK(ugpio_snapshot(&states) == 0 && states == NULL);
+
+	REQUIRE((out = ugpio_request_one(5, GPIOF_OUT_INIT_HIGH, NULL)) != NULL);
+	REQUIRE((in = ugpio_request_one(2, GPIOF_IN | GPIOF_TRIG_FALL, NULL)) != NULL);
+	CHECK(ugpio_sim_set_input(2, 1) == 0);
+
+	n = ugpio_snapshot(&states);
+	CHECK(n == 2);
+	REQUIRE(states != NULL);
+	CHECK(states[0].gpio == 2);
+	CHECK(states[0].direction == GPIOF_DIR_IN);
+	CHECK(states[0].value == 1);
+	CHECK(states[0].edge == GPIOF_TRIG_FALL);
+	CHECK(states[1].gpio == 5);
+	CHECK(states[1].direction == GPIOF_DIR_OUT);
+	CHECK(states[1].active_low == 0);
+	CHECK(states[1].value == 1);
+	free(states);
+
+	ugpio_free(in);
+	ugpio_free(out);
+	CHECK(ugpio_snapshot(&states) == 0);
+
+	/* backends which cannot enumerate their lines */
+	REQUIRE(ugpio_set_backend("client") == 0);
+	CHECK(ugpio_snapshot(&states) == -1 && errno == ENOSYS && states == NULL);
+
+	return TEST_RESULT();
+}
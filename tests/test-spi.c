@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-spi.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+/* the outputs and the inputs counting their edges */
+enum { SCLK, MOSI, CS, MISO, SCLK_PROBE, CS_PROBE, LINES };
+
+static ugpio_t *ctxs[LINES];
+
+/* a loopback transfer in the given mode, returns the number of clock edges */
+static long transfer(unsigned int flags)
+{
+	static const uint8_t tx[3] = { 0xa5, 0x3c, 0x01 };
+	uint8_t rx[3] = { 0 };
+	ugpio_spi_t *spi;
+	long sclk_edges;
+
+	REQUIRE((spi = ugpio_spi_new(ctxs[SCLK], ctxs[MOSI], ctxs[MISO], ctxs[CS], flags)) != NULL);
+
+	/* an empty transfer moves the lines to their idle levels */
+	CHECK(ugpio_spi_transfer(spi, NULL, NULL, 0) == 0);
+	CHECK(ugpio_sim_get_level(SCLK) == !!(flags & UGPIO_SPI_CPOL));
+	CHECK(ugpio_sim_get_level(CS) == !(flags & UGPIO_SPI_CS_HIGH));
+	sclk_edges = ugpio_sim_edge_count(SCLK_PROBE);
+
+	CHECK(ugpio_spi_transfer(spi, tx, rx, sizeof(tx)) == 0);
+	CHECK(memcmp(tx, rx, sizeof(tx)) == 0);
+	CHECK(ugpio_sim_get_level(SCLK) == !!(flags & UGPIO_SPI_CPOL));
+	CHECK(ugpio_sim_get_level(CS) == !(flags & UGPIO_SPI_CS_HIGH));
+
+	ugpio_spi_free(spi);
+
+	return ugpio_sim_edge_count(SCLK_PROBE) - sclk_edges;
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int modes[] = {
+		UGPIO_SPI_MODE_0, UGPIO_SPI_MODE_1, UGPIO_SPI_MODE_2, UGPIO_SPI_MODE_3,
+		UGPIO_SPI_MODE_0 | UGPIO_SPI_LSB_FIRST, UGPIO_SPI_MODE_3 | UGPIO_SPI_CS_HIGH,
+	};
+	struct ugpio_spi_stats stats;
+	uint8_t tx[64], rx[64];
+	ugpio_spi_t *spi;
+	long cs_edges;
+	size_t i;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(LINES) == 0);
+	for (i = SCLK; i <= CS; i++)
+		REQUIRE((ctxs[i] = ugpio_request_one(i, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+	for (i = MISO; i < LINES; i++)
+		REQUIRE((ctxs[i] = ugpio_request_one(i, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL)) != NULL);
+	REQUIRE(ugpio_sim_connect(MOSI, MISO) == 0);
+	REQUIRE(ugpio_sim_connect(SCLK, SCLK_PROBE) == 0);
+	REQUIRE(ugpio_sim_connect(CS, CS_PROBE) == 0);
+
+	/* every mode reads back what it shifted out, with a clock pulse per bit */
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+		CHECK(transfer(modes[i]) == 2 * 24);
+
+	/* the chip select is held active during a transfer */
+	REQUIRE((spi = ugpio_spi_new(ctxs[SCLK], ctxs[MOSI], ctxs[MISO], ctxs[CS], UGPIO_SPI_MODE_0)) != NULL);
+	CHECK(ugpio_spi_transfer(spi, NULL, NULL, 0) == 0);
+	ugpio_spi_reset_stats(spi);
+	cs_edges = ugpio_sim_edge_count(CS_PROBE);
+	CHECK(ugpio_spi_transfer(spi, NULL, rx, 4) == 0);
+	CHECK(rx[0] == 0 && rx[3] == 0);
+	CHECK(ugpio_sim_edge_count(CS_PROBE) - cs_edges == 2);
+
+	/* lines written by others in between are not assumed to be unchanged */
+	CHECK(ugpio_set_value(ctxs[CS], 0) == 0);
+	cs_edges = ugpio_sim_edge_count(CS_PROBE);
+	CHECK(ugpio_spi_transfer(spi, NULL, NULL, 0) == 0);
+	CHECK(ugpio_sim_edge_count(CS_PROBE) - cs_edges == 3);
+	CHECK(ugpio_sim_get_level(CS) == 1);
+	ugpio_spi_reset_stats(spi);
+	CHECK(ugpio_spi_transfer(spi, NULL, rx, 4) == 0);
+
+	/* the statistics count transfers and bits */
+	ugpio_spi_get_stats(spi, &stats);
+	CHECK(stats.transfers == 1);
+	CHECK(stats.bits == 32);
+	ugpio_spi_reset_stats(spi);
+	ugpio_spi_get_stats(spi, &stats);
+	CHECK(stats.transfers == 0 && stats.bits == 0 && stats.busy_ns == 0);
+
+	/* a lower clock rate stretches the transfer */
+	for (i = 0; i < sizeof(tx); i++)
+		tx[i] = i * 7;
+	ugpio_spi_set_speed(spi, 100000);
+	CHECK(ugpio_spi_transfer(spi, tx, rx, sizeof(tx)) == 0);
+	CHECK(memcmp(tx, rx, sizeof(tx)) == 0);
+	ugpio_spi_get_stats(spi, &stats);
+	CHECK(stats.bits == 8 * sizeof(tx));
+	CHECK(stats.busy_ns >= stats.bits * 10000 - 10000);
+	ugpio_spi_free(spi);
+
+	/* a write-only interface pulsing its latch, like a 74HC165 load */
+	REQUIRE((spi = ugpio_spi_new(ctxs[SCLK], ctxs[MOSI], NULL, ctxs[CS],
+				     UGPIO_SPI_MODE_0 | UGPIO_SPI_CS_PULSE)) != NULL);
+	cs_edges = ugpio_sim_edge_count(CS_PROBE);
+	CHECK(ugpio_spi_transfer(spi, tx, NULL, 2) == 0);
+	CHECK(ugpio_sim_edge_count(CS_PROBE) - cs_edges == 2);
+	ugpio_spi_free(spi);
+
+	/* a read-only interface */
+	CHECK(ugpio_sim_disconnect(MISO) == 0);
+	CHECK(ugpio_sim_set_input(MISO, 1) == 0);
+	REQUIRE((spi = ugpio_spi_new(ctxs[SCLK], NULL, ctxs[MISO], NULL, UGPIO_SPI_MODE_0)) != NULL);
+	CHECK(ugpio_spi_transfer(spi, NULL, rx, 2) == 0);
+	CHECK(rx[0] == 0xff && rx[1] == 0xff);
+	ugpio_spi_free(spi);
+
+	/* on error, the contexts opened so far are closed again */
+	for (i = SCLK; i <= MISO; i++)
+		ugpio_close(ctxs[i]);
+	REQUIRE(ugpio_open(ctxs[MOSI]) != -1);
+	ugpio_close(ctxs[CS_PROBE]);
+	REQUIRE(gpio_free(CS_PROBE) == 0);
+	CHECK(ugpio_spi_new(ctxs[SCLK], ctxs[MOSI], ctxs[CS_PROBE], ctxs[CS], UGPIO_SPI_MODE_0) == NULL);
+	CHECK(ugpio_fd(ctxs[SCLK]) == -1);
+	CHECK(ugpio_fd(ctxs[CS]) == -1);
+	CHECK(ugpio_fd(ctxs[MOSI]) != -1);
+
+	for (i = 0; i < LINES; i++) {
+		ugpio_close(ctxs[i]);
+		ugpio_free(ctxs[i]);
+	}
+
+	return TEST_RESULT();
+}
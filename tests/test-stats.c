@@ -0,0 +1,105 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+static uint64_t hist_sum(const uint64_t *hist)
+{
+	uint64_t sum = 0;
+	int i;
+
+	for (i = 0; i < UGPIO_STATS_BUCKETS; i++)
+		sum += hist[i];
+
+	return sum;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ugpio_stats stats, global;
+	ugpio_t *out, *in;
+	int i;
+
+	/* without --enable-stats nothing is recorded */
+	if (ugpio_stats_enable(1) == -1) {
+		CHECK(errno == ENOSYS);
+		CHECK(ugpio_stats_get(NULL, &stats) == -1 && errno == ENOSYS);
+		CHECK(ugpio_stats_reset(NULL) == -1 && errno == ENOSYS);
+		return test_failures ? EXIT_FAILURE : TEST_SKIP;
+	}
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((out = ugpio_request_one(0, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+	REQUIRE((in = ugpio_request_one(1, GPIOF_IN, NULL)) != NULL);
+	REQUIRE(ugpio_open(out) >= 0);
+	REQUIRE(ugpio_open(in) >= 0);
+	CHECK(ugpio_stats_reset(NULL) == 0);
+
+	/* the accesses of a context are accounted to it and to the aggregate */
+	for (i = 0; i < 10; i++)
+		CHECK(ugpio_set_value(out, i & 1) == 0);
+	for (i = 0; i < 5; i++)
+		CHECK(ugpio_get_value(out) == 1);
+
+	CHECK(ugpio_stats_get(out, &stats) == 0);
+	CHECK(stats.writes == 10);
+	CHECK(stats.reads == 5);
+	/* the simulated chip does no system calls */
+	CHECK(stats.syscalls == 0);
+	CHECK(stats.errors == 0);
+	CHECK(hist_sum(stats.write_hist) == 10);
+	CHECK(hist_sum(stats.read_hist) == 5);
+
+	CHECK(ugpio_stats_get(in, &stats) == 0);
+	CHECK(stats.reads == 0 && stats.writes == 0);
+
+	CHECK(ugpio_stats_get(NULL, &global) == 0);
+	CHECK(global.writes >= 10);
+	CHECK(global.reads >= 5);
+
+	/* failures are counted */
+	CHECK(ugpio_set_value(in, 1) == -1);
+	CHECK(ugpio_stats_get(in, &stats) == 0);
+	CHECK(stats.writes == 1 && stats.errors == 1);
+
+	/* the low level API only shows in the aggregate */
+	CHECK(gpio_get_value(0) == 1);
+	CHECK(ugpio_stats_get(out, &stats) == 0);
+	CHECK(stats.reads == 5);
+	CHECK(ugpio_stats_get(NULL, &stats) == 0);
+	CHECK(stats.reads > global.reads);
+
+	/* nothing is recorded while disabled */
+	CHECK(ugpio_stats_enable(0) == 0);
+	CHECK(ugpio_get_value(out) == 1);
+	CHECK(ugpio_stats_get(out, &stats) == 0);
+	CHECK(stats.reads == 5);
+	CHECK(ugpio_stats_enable(1) == 0);
+
+	CHECK(ugpio_stats_reset(out) == 0);
+	CHECK(ugpio_stats_get(out, &stats) == 0);
+	CHECK(stats.reads == 0 && stats.writes == 0 && hist_sum(stats.read_hist) == 0);
+
+	/* a file descriptor reused after a close is not accounted to the context */
+	ugpio_close(out);
+	CHECK(gpio_set_fd_cache_size(0) == 0);
+	for (i = 0; i < 5; i++)
+		CHECK(gpio_get_value(1) == 0);
+	CHECK(ugpio_stats_get(out, &stats) == 0);
+	CHECK(stats.reads == 0);
+
+	ugpio_free(out);
+	ugpio_close(in);
+	ugpio_free(in);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <ugpio.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define RECORDS		16
+
+static uint32_t thread_tid;
+
+static void *worker(void *arg)
+{
+	ugpio_t *ctx = arg;
+	int i;
+
+	thread_tid = syscall(SYS_gettid);
+	for (i = 0; i < 3; i++)
+		CHECK(ugpio_set_value(ctx, i & 1) == 0);
+
+	return NULL;
+}
+
+/* the index of the first record of the given type from index start on, -1 if none */
+static int find(const struct ugpio_trace_record *records, size_t n, size_t start, uint16_t type)
+{
+	size_t i;
+
+	for (i = start; i < n; i++)
+		if (records[i].type == type)
+			return i;
+
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ugpio_trace_record records[4 * RECORDS];
+	ugpio_t *out, *in, *other;
+	pthread_t thread;
+	char line[256];
+	uint32_t tid;
+	size_t i, n;
+	int lines, r;
+	FILE *f;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+
+	/* nothing is recorded unless enabled */
+	REQUIRE((in = ugpio_request_one(1, GPIOF_IN, NULL)) != NULL);
+	REQUIRE(ugpio_open(in) >= 0);
+	CHECK(ugpio_trace_snapshot(records, RECORDS) == 0);
+
+	CHECK(ugpio_trace_enable(RECORDS - 3) == 0);
+	tid = syscall(SYS_gettid);
+
+	/* the operations of a thread are recorded in order */
+	REQUIRE((out = ugpio_request_one(2, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+	REQUIRE(ugpio_open(out) >= 0);
+	CHECK(ugpio_set_value(out, 1) == 0);
+	CHECK(ugpio_get_value(out) == 1);
+	CHECK(ugpio_set_value(in, 1) == -1);
+
+	n = ugpio_trace_snapshot(records, RECORDS);
+	CHECK(n >= 5);
+	for (i = 1; i < n; i++)
+		CHECK(records[i].timestamp_ns >= records[i - 1].timestamp_ns);
+	for (i = 0; i < n; i++)
+		CHECK(records[i].tid == tid);
+
+	CHECK((r = find(records, n, 0, UGPIO_TRACE_REQUEST)) >= 0 && records[r].gpio == 2);
+	CHECK((r = find(records, n, r, UGPIO_TRACE_OPEN)) >= 0 && records[r].value == ugpio_fd(out));
+	CHECK((r = find(records, n, r, UGPIO_TRACE_SET)) >= 0 && records[r].value == 1);
+	CHECK((r = find(records, n, r, UGPIO_TRACE_GET)) >= 0 && records[r].value == 1);
+	CHECK((r = find(records, n, r, UGPIO_TRACE_ERROR)) >= 0 && records[r].gpio == 1);
+	if (r >= 0) {
+		CHECK(records[r].value == UGPIO_TRACE_SET);
+		CHECK(records[r].error == EPERM);
+	}
+
+	/* the ring of a thread keeps the most recent records */
+	for (i = 0; i < 2 * RECORDS; i++)
+		CHECK(ugpio_get_value(out) == 1);
+	CHECK(ugpio_trace_snapshot(records, 4 * RECORDS) == RECORDS);
+	CHECK(ugpio_trace_snapshot(records, 4) == 4);
+	CHECK(records[3].type == UGPIO_TRACE_GET);
+
+	/* each thread records into a ring of its own */
+	REQUIRE((other = ugpio_request_one(3, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+	REQUIRE(ugpio_open(other) >= 0);
+	REQUIRE(pthread_create(&thread, NULL, worker, other) == 0);
+	pthread_join(thread, NULL);
+	n = ugpio_trace_snapshot(records, 4 * RECORDS);
+	CHECK(n > RECORDS);
+	for (i = 0, r = 0; i < n; i++)
+		if (records[i].tid == thread_tid && records[i].gpio == 3)
+			r++;
+	CHECK(r == 3);
+
+	/* the dump has a line per record */
+	REQUIRE((f = tmpfile()) != NULL);
+	CHECK(ugpio_trace_dump(fileno(f)) == 0);
+	rewind(f);
+	for (lines = 0; fgets(line, sizeof(line), f); lines++)
+		;
+	fclose(f);
+	CHECK(lines == n);
+
+	/* and recording stops again */
+	CHECK(ugpio_trace_enable(0) == 0);
+	CHECK(ugpio_set_value(out, 0) == 0);
+	CHECK(ugpio_trace_snapshot(records, 4 * RECORDS) == n);
+
+	ugpio_close(other);
+	ugpio_free(other);
+	ugpio_close(out);
+	ugpio_free(out);
+	ugpio_close(in);
+	ugpio_free(in);
+
+	return TEST_RESULT();
+}
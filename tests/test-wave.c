@@ -0,0 +1,87 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdint.h>
+
+#include <ugpio.h>
+#include <ugpio-wave.h>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#define MS	UINT64_C(1000000)
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int outputs[] = { 0, 1 };
+	static const struct ugpio_wave_step steps[] = {
+		{ 0, 0x3, 0x1 },
+		{ 2 * MS, 0x3, 0x2 },
+		{ 4 * MS, 0x3, 0x0 },
+	};
+	static const struct ugpio_wave_step unordered[] = {
+		{ 2 * MS, 0x1, 0x1 },
+		{ 1 * MS, 0x1, 0x0 },
+	};
+	struct ugpio_wave_stats stats;
+	ugpio_port_t *port;
+	ugpio_wave_t *wave;
+	ugpio_t *probe;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+	REQUIRE((port = ugpio_port_request(outputs, 2, GPIOF_OUT_INIT_LOW, NULL)) != NULL);
+
+	/* line 0 is looped back to line 4, which counts its edges */
+	REQUIRE((probe = ugpio_request_one(4, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL, NULL)) != NULL);
+	REQUIRE(ugpio_sim_connect(0, 4) == 0);
+
+	CHECK(ugpio_wave_new(port, unordered, 2, 0, 1) == NULL && errno == EINVAL);
+	CHECK(ugpio_wave_new(port, steps, 3, 4 * MS, 2) == NULL && errno == EINVAL);
+	CHECK(ugpio_wave_new(port, steps, 0, 6 * MS, 1) == NULL && errno == EINVAL);
+
+	/* a waveform played a number of times */
+	REQUIRE((wave = ugpio_wave_new(port, steps, 3, 6 * MS, 3)) != NULL);
+	CHECK(ugpio_wave_start(wave) == 0);
+	CHECK(ugpio_wave_start(wave) == -1 && errno == EBUSY);
+	CHECK(ugpio_wave_wait(wave) == 0);
+
+	ugpio_wave_get_stats(wave, &stats);
+	CHECK(stats.steps == 9);
+	CHECK(stats.errors == 0);
+	CHECK(stats.requested_ns == 16 * MS);
+	CHECK(stats.achieved_ns >= stats.requested_ns);
+	CHECK(stats.lateness_min_ns <= stats.lateness_max_ns);
+	CHECK(stats.lateness_sum_ns >= 9 * stats.lateness_min_ns);
+	CHECK(ugpio_sim_edge_count(4) == 6);
+	CHECK(ugpio_sim_get_level(0) == 0 && ugpio_sim_get_level(1) == 0);
+
+	/* and again, the statistics start over */
+	CHECK(ugpio_wave_start(wave) == 0);
+	CHECK(ugpio_wave_wait(wave) == 0);
+	ugpio_wave_get_stats(wave, &stats);
+	CHECK(stats.steps == 9);
+	CHECK(ugpio_sim_edge_count(4) == 12);
+	ugpio_wave_free(wave);
+
+	/* an endless waveform runs until stopped, the lines keep their values */
+	REQUIRE((wave = ugpio_wave_new(port, steps, 2, 4 * MS, 0)) != NULL);
+	CHECK(ugpio_wave_start(wave) == 0);
+	test_sleep_ms(30);
+	ugpio_wave_get_stats(wave, &stats);
+	CHECK(stats.steps > 2);
+	CHECK(ugpio_wave_stop(wave) == 0);
+	ugpio_wave_get_stats(wave, &stats);
+	CHECK(ugpio_sim_get_level(0) == ((stats.steps % 2) ? 1 : 0));
+	CHECK(ugpio_sim_get_level(1) == ((stats.steps % 2) ? 0 : 1));
+	ugpio_wave_free(wave);
+
+	ugpio_close(probe);
+	ugpio_free(probe);
+	ugpio_port_free(port);
+
+	return TEST_RESULT();
+}
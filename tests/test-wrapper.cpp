@@ -0,0 +1,150 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <exception>
+#include <system_error>
+#include <utility>
+
+#include <ugpio.hpp>
+#include <ugpio-sim.h>
+
+#include "test.h"
+
+#if UGPIO_HAVE_COROUTINES
+/* a coroutine type running eagerly and detached */
+struct task {
+	struct promise_type {
+		task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+static task wait_edges(ugpio::edge_watch &watch, int *values, int num)
+{
+	for (int i = 0; i < num; i++)
+		values[i] = co_await watch;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int gpios[] = { 4, 5, 6 };
+	std::uint64_t bits;
+
+	REQUIRE(ugpio_set_backend("sim") == 0);
+	REQUIRE(ugpio_sim_init(8) == 0);
+
+	/* a line is requested and opened, and released with its owner */
+	{
+		ugpio::line out(0, GPIOF_OUT_INIT_HIGH, "test");
+
+		CHECK(static_cast<bool>(out));
+		CHECK(out.fd() >= 0);
+		CHECK(ugpio_sim_get_level(0) == 1);
+		CHECK(out.set(0) == 0);
+		CHECK(ugpio_sim_get_level(0) == 0);
+		CHECK(out.get() == 0);
+
+		ugpio::line moved(std::move(out));
+		CHECK(!out);
+		CHECK(moved.set(1) == 0 && moved.get() == 1);
+		CHECK(gpio_is_requested(0) == 1);
+
+		ugpio_t *ctx = moved.release();
+		CHECK(!moved);
+		moved.reset(ctx);
+	}
+	CHECK(gpio_is_requested(0) == 0);
+
+	try {
+		ugpio::line missing(100, GPIOF_IN);
+		CHECK(!"a missing GPIO was requested");
+	} catch (const std::system_error &e) {
+		CHECK(e.code().value() != 0);
+	}
+
+	/* a line set is accessed bit by bit and as a whole */
+	{
+		ugpio::line_set set(gpios, GPIOF_OUT_INIT_LOW);
+
+		CHECK(set.size() == 3);
+		CHECK(set[1] != nullptr);
+		CHECK(set.set(1, 1) == 0);
+		CHECK(ugpio_sim_get_level(5) == 1);
+		CHECK(set.get(1) == 1);
+		CHECK(set.set_all(0x5, 0x4) == 0);
+		CHECK(ugpio_sim_get_level(4) == 0 && ugpio_sim_get_level(6) == 1);
+		CHECK(set.get_all(bits) == 0);
+		CHECK(bits == 0x6);
+
+		ugpio::line_set other;
+		CHECK(!other);
+		other = std::move(set);
+		CHECK(!set && other.size() == 3);
+	}
+	for (unsigned int gpio : gpios)
+		CHECK(gpio_is_requested(gpio) == 0);
+
+	/* edges are remembered until they are taken */
+	{
+		ugpio::loop loop;
+		ugpio::line in(1, GPIOF_IN | GPIOF_TRIG_RISE | GPIOF_TRIG_FALL);
+		ugpio::edge_watch watch(loop, in);
+
+		CHECK(loop.fd() >= 0);
+		CHECK(watch.poll() == -2);
+		CHECK(ugpio_sim_set_input(1, 1) == 0);
+		CHECK(loop.run_once(100) == 1);
+		CHECK(watch.poll() == 1);
+		CHECK(watch.poll() == -2);
+
+		/* only the latest edge is kept */
+		CHECK(ugpio_sim_set_input(1, 0) == 0);
+		CHECK(loop.run_once(100) == 1);
+		CHECK(ugpio_sim_set_input(1, 1) == 0);
+		CHECK(loop.run_once(100) == 1);
+		CHECK(watch.poll() == 1);
+
+		try {
+			ugpio::edge_watch twice(loop, in);
+			CHECK(!"a line was watched twice");
+		} catch (const std::system_error &e) {
+			CHECK(e.code().value() == EEXIST);
+		}
+
+		ugpio::edge_watch moved(std::move(watch));
+		CHECK(!watch);
+		CHECK(watch.poll() == -1 && errno == EBADF);
+		CHECK(ugpio_sim_set_input(1, 0) == 0);
+		CHECK(loop.run_once(100) == 1);
+		CHECK(moved.poll() == 0);
+
+#if UGPIO_HAVE_COROUTINES
+		/* a coroutine is resumed from within the loop for every edge */
+		int values[3] = { -3, -3, -3 };
+		int busy[1] = { -3 };
+
+		wait_edges(moved, values, 3);
+		CHECK(values[0] == -3);
+
+		/* only one coroutine can wait for a watch */
+		wait_edges(moved, busy, 1);
+		CHECK(busy[0] == -1 && errno == EBUSY);
+
+		for (int i = 0; i < 3; i++) {
+			CHECK(ugpio_sim_set_input(1, !(i & 1)) == 0);
+			CHECK(loop.run_once(100) == 1);
+		}
+		CHECK(values[0] == 1 && values[1] == 0 && values[2] == 1);
+		CHECK(moved.poll() == -2);
+#endif
+	}
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2012-2019 Michael Heimpold <mhei@heimpold.de>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+/* the exit status telling the test driver that a test was skipped */
+#define TEST_SKIP	77
+
+static int test_failures;
+
+/* report a failed check and go on with the next one */
+#define CHECK(cond)								\
+	do {									\
+		if (!(cond)) {							\
+			fprintf(stderr, "%s:%d: check failed: %s (errno: %s)\n",	\
+				__FILE__, __LINE__, #cond, strerror(errno));	\
+			test_failures++;					\
+		}								\
+	} while (0)
+
+/* abort the test when a precondition fails */
+#define REQUIRE(cond)								\
+	do {									\
+		if (!(cond)) {							\
+			fprintf(stderr, "%s:%d: requirement failed: %s (errno: %s)\n",	\
+				__FILE__, __LINE__, #cond, strerror(errno));	\
+			exit(EXIT_FAILURE);					\
+		}								\
+	} while (0)
+
+#define TEST_RESULT()	(test_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+static inline void test_sleep_ms(unsigned int ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+#endif /* TEST_H */